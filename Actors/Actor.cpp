@@ -1,60 +1,96 @@
 ﻿#include "Actor.h"
 
-#include <glm/ext/matrix_transform.hpp>
-#include <glm/gtx/euler_angles.hpp>
+#include <utility>
+
+namespace
+{
+
+const glm::vec3 local_front(0.f, 1.f, 0.f);
+const glm::vec3 local_up(0.f, 0.f, 1.f);
+const glm::vec3 local_right(1.f, 0.f, 0.f);
+
+}
 
 glm::vec3 Actor::get_front() const
 {
-    glm::vec3 f;
-    f.x = sin(glm::radians(yaw_)) * cos(glm::radians(pitch_));
-    f.y = cos(glm::radians(yaw_)) * cos(glm::radians(pitch_));
-    f.z = sin(glm::radians(pitch_));
-    return normalize(f);
+    return transforms_->get_orientation(handle_) * local_front;
 }
 
 glm::vec3 Actor::get_up() const
 {
-    return normalize(cross(get_right(), get_front()));
+    return transforms_->get_orientation(handle_) * local_up;
 }
 
 glm::vec3 Actor::get_right() const
 {
-    return normalize(cross(get_front(), world_up_));
+    return transforms_->get_orientation(handle_) * local_right;
+}
+
+Actor::Actor(TransformSystem& transforms, const glm::vec3 position, const glm::vec3 scale, const glm::vec3 world_up, const float yaw, const float pitch, const float roll)
+    : transforms_(&transforms), world_up_(world_up)
+{
+    const glm::quat orientation = glm::angleAxis(glm::radians(-yaw), world_up)
+        * glm::angleAxis(glm::radians(pitch), local_right)
+        * glm::angleAxis(glm::radians(roll), local_front);
+
+    handle_ = transforms.add(position, orientation, scale);
+}
+
+Actor::~Actor()
+{
+    if (transforms_ != nullptr)
+    {
+        transforms_->remove(handle_);
+    }
 }
 
-Actor::Actor(const glm::vec3 position, const glm::vec3 scale, const glm::vec3 world_up, const float yaw, const float pitch, const float roll)
-    : position_(position), scale_(scale), world_up_(world_up), yaw_(yaw), pitch_(pitch), roll_(roll)
+Actor::Actor(Actor&& other) noexcept
+    : transforms_(std::exchange(other.transforms_, nullptr)), handle_(other.handle_), world_up_(other.world_up_)
 {
-    
+}
+
+Actor& Actor::operator=(Actor&& other) noexcept
+{
+    if (this != &other)
+    {
+        if (transforms_ != nullptr)
+        {
+            transforms_->remove(handle_);
+        }
+
+        transforms_ = std::exchange(other.transforms_, nullptr);
+        handle_ = other.handle_;
+        world_up_ = other.world_up_;
+    }
+
+    return *this;
 }
 
 void Actor::yaw(const float amount)
 {
-    yaw_ += amount;
+    // around the world's up rather than the actor's, so it doesn't drift into a roll
+    const glm::quat turn = glm::angleAxis(glm::radians(-amount), world_up_);
+    transforms_->set_orientation(handle_, normalize(turn * transforms_->get_orientation(handle_)));
 }
 
 void Actor::pitch(const float amount)
 {
-    pitch_ += amount;
+    const glm::quat turn = glm::angleAxis(glm::radians(amount), local_right);
+    transforms_->set_orientation(handle_, normalize(transforms_->get_orientation(handle_) * turn));
 }
 
 void Actor::roll(const float amount)
 {
-    roll_ += amount;
+    const glm::quat turn = glm::angleAxis(glm::radians(amount), local_front);
+    transforms_->set_orientation(handle_, normalize(transforms_->get_orientation(handle_) * turn));
 }
 
 void Actor::move(const glm::vec3 offset)
 {
-    position_ += offset;
+    transforms_->set_position(handle_, transforms_->get_position(handle_) + offset);
 }
 
-glm::mat4 Actor::get_transform() const
+const glm::mat4& Actor::get_transform() const
 {
-    glm::mat4 transform(1.f);
-        
-    transform = translate(transform, position_);
-    transform *= glm::yawPitchRoll(glm::radians(yaw_), glm::radians(roll_), glm::radians(pitch_));
-    transform = scale(transform, scale_);
-
-    return transform;
+    return transforms_->get_world_matrix(handle_);
 }
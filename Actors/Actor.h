@@ -2,28 +2,38 @@
 
 #include <glm/glm.hpp>
 
+#include "TransformSystem.h"
+
+// A handle to a transform in a TransformSystem, which has to outlive it. The
+// actor's front is its model's +y, its up +z and its right +x.
 class Actor
 {
-    // state
-    glm::vec3 position_;
-    glm::vec3 scale_;
+    TransformSystem* transforms_;
+    TransformSystem::Handle handle_;
     glm::vec3 world_up_;
-    
-    // Euler angles (in degrees)
-    float yaw_;
-    float pitch_;
-    float roll_;
 
     glm::vec3 get_front() const;
     glm::vec3 get_up() const;
     glm::vec3 get_right() const;
 public:
-    Actor(glm::vec3 position, glm::vec3 scale, glm::vec3 world_up, float yaw, float pitch, float roll);
+    // The angles (in degrees) are applied as by yaw(), pitch() and roll() in that order.
+    Actor(TransformSystem& transforms, glm::vec3 position, glm::vec3 scale, glm::vec3 world_up, float yaw, float pitch, float roll);
+    ~Actor();
+    Actor(const Actor&) = delete;
+    Actor& operator=(const Actor&) = delete;
+    Actor(Actor&& other) noexcept;
+    Actor& operator=(Actor&& other) noexcept;
+
+    // Turns by `amount` degrees, positive yaw turns right around the world up,
+    // positive pitch raises the front, positive roll tips the up to the right.
     void yaw(float amount);
     void pitch(float amount);
     void roll(float amount);
 
     void move(glm::vec3 offset);
 
-    glm::mat4 get_transform() const;
+    // as of the transform system's last update()
+    const glm::mat4& get_transform() const;
+    // what the transform system's get_changed() lists this actor as
+    [[nodiscard]] TransformSystem::Handle get_handle() const { return handle_; }
 };
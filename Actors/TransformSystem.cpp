@@ -0,0 +1,470 @@
+﻿#include "TransformSystem.h"
+
+#include <algorithm>
+
+#include "../Jobs/JobSystem.h"
+#include "../Profiling/CpuProfiler.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define TRANSFORM_SYSTEM_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// msvc accepts avx intrinsics anywhere, gcc and clang only in functions compiled for avx
+#if defined(TRANSFORM_SYSTEM_X86) && (defined(__GNUC__) || defined(__clang__))
+#define AVX_FUNCTION __attribute__((target("avx")))
+#else
+#define AVX_FUNCTION
+#endif
+
+namespace
+{
+
+bool is_avx_supported()
+{
+#if defined(TRANSFORM_SYSTEM_X86) && defined(_MSC_VER)
+    int registers[4];
+    __cpuid(registers, 1);
+    const bool avx = (registers[2] & (1 << 28)) != 0;
+    const bool os_saves_registers = (registers[2] & (1 << 27)) != 0 && (_xgetbv(0) & 6) == 6;
+    return avx && os_saves_registers;
+#elif defined(TRANSFORM_SYSTEM_X86)
+    return __builtin_cpu_supports("avx");
+#else
+    return false;
+#endif
+}
+
+#ifdef TRANSFORM_SYSTEM_X86
+
+// Writes one column of 4 consecutive matrices, `x` to `w` hold that column's
+// rows across the 4 transforms.
+void store_column(glm::mat4* matrices, const int column, __m128 x, __m128 y, __m128 z, __m128 w)
+{
+    _MM_TRANSPOSE4_PS(x, y, z, w);
+    _mm_storeu_ps(&matrices[0][column].x, x);
+    _mm_storeu_ps(&matrices[1][column].x, y);
+    _mm_storeu_ps(&matrices[2][column].x, z);
+    _mm_storeu_ps(&matrices[3][column].x, w);
+}
+
+#endif
+
+}
+
+void TransformSystem::create(JobSystem* jobs)
+{
+    avx_supported_ = is_avx_supported();
+    jobs_ = jobs;
+}
+
+void TransformSystem::clean()
+{
+    jobs_ = nullptr;
+}
+
+TransformSystem::Handle TransformSystem::add(const glm::vec3 position, const glm::quat orientation, const glm::vec3 scale)
+{
+    Handle handle;
+    if (free_handles_.empty())
+    {
+        handle = static_cast<Handle>(slots_.size());
+        slots_.push_back(0);
+    }
+    else
+    {
+        handle = free_handles_.back();
+        free_handles_.pop_back();
+    }
+
+    const auto slot = static_cast<uint32_t>(handles_.size());
+    slots_[handle] = slot;
+    handles_.push_back(handle);
+
+    position_x_.push_back(position.x);
+    position_y_.push_back(position.y);
+    position_z_.push_back(position.z);
+    orientation_x_.push_back(orientation.x);
+    orientation_y_.push_back(orientation.y);
+    orientation_z_.push_back(orientation.z);
+    orientation_w_.push_back(orientation.w);
+    scale_x_.push_back(scale.x);
+    scale_y_.push_back(scale.y);
+    scale_z_.push_back(scale.z);
+    world_matrices_.emplace_back(1.f);
+    dirty_.push_back(0);
+
+    if (dirty_block_flags_.size() * block_size_ < handles_.size())
+    {
+        dirty_block_flags_.push_back(0);
+    }
+
+    compute_range_scalar(slot, slot + 1);
+    // reported by the next update(), so a new transform reaches whoever mirrors the matrices
+    mark_dirty(slot);
+
+    return handle;
+}
+
+void TransformSystem::remove(const Handle handle)
+{
+    // the last transform moves into the freed slot
+    const uint32_t slot = slots_[handle];
+    const size_t last = handles_.size() - 1;
+
+    if (slot != last)
+    {
+        position_x_[slot] = position_x_[last];
+        position_y_[slot] = position_y_[last];
+        position_z_[slot] = position_z_[last];
+        orientation_x_[slot] = orientation_x_[last];
+        orientation_y_[slot] = orientation_y_[last];
+        orientation_z_[slot] = orientation_z_[last];
+        orientation_w_[slot] = orientation_w_[last];
+        scale_x_[slot] = scale_x_[last];
+        scale_y_[slot] = scale_y_[last];
+        scale_z_[slot] = scale_z_[last];
+        world_matrices_[slot] = world_matrices_[last];
+        handles_[slot] = handles_[last];
+        slots_[handles_[slot]] = slot;
+
+        // a pending rebuild moves along with it
+        dirty_[slot] = 0;
+        if (dirty_[last] != 0)
+        {
+            mark_dirty(slot);
+        }
+    }
+
+    position_x_.pop_back();
+    position_y_.pop_back();
+    position_z_.pop_back();
+    orientation_x_.pop_back();
+    orientation_y_.pop_back();
+    orientation_z_.pop_back();
+    orientation_w_.pop_back();
+    scale_x_.pop_back();
+    scale_y_.pop_back();
+    scale_z_.pop_back();
+    world_matrices_.pop_back();
+    handles_.pop_back();
+    // the block flags stay, a block past the end is skipped by update()
+    dirty_.pop_back();
+
+    free_handles_.push_back(handle);
+}
+
+glm::vec3 TransformSystem::get_position(const Handle handle) const
+{
+    const uint32_t slot = slots_[handle];
+    return {position_x_[slot], position_y_[slot], position_z_[slot]};
+}
+
+void TransformSystem::set_position(const Handle handle, const glm::vec3 position)
+{
+    const uint32_t slot = slots_[handle];
+    position_x_[slot] = position.x;
+    position_y_[slot] = position.y;
+    position_z_[slot] = position.z;
+    mark_dirty(slot);
+}
+
+glm::quat TransformSystem::get_orientation(const Handle handle) const
+{
+    const uint32_t slot = slots_[handle];
+    return {orientation_w_[slot], orientation_x_[slot], orientation_y_[slot], orientation_z_[slot]};
+}
+
+void TransformSystem::set_orientation(const Handle handle, const glm::quat orientation)
+{
+    const uint32_t slot = slots_[handle];
+    orientation_x_[slot] = orientation.x;
+    orientation_y_[slot] = orientation.y;
+    orientation_z_[slot] = orientation.z;
+    orientation_w_[slot] = orientation.w;
+    mark_dirty(slot);
+}
+
+glm::vec3 TransformSystem::get_scale(const Handle handle) const
+{
+    const uint32_t slot = slots_[handle];
+    return {scale_x_[slot], scale_y_[slot], scale_z_[slot]};
+}
+
+void TransformSystem::set_scale(const Handle handle, const glm::vec3 scale)
+{
+    const uint32_t slot = slots_[handle];
+    scale_x_[slot] = scale.x;
+    scale_y_[slot] = scale.y;
+    scale_z_[slot] = scale.z;
+    mark_dirty(slot);
+}
+
+void TransformSystem::update()
+{
+    changed_.clear();
+
+    if (dirty_blocks_.empty())
+    {
+        return;
+    }
+
+    PROFILE_ZONE("transform update");
+
+    const size_t count = handles_.size();
+
+    // whole blocks are rebuilt, the clean transforms in them come out the same
+    const auto compute_blocks = [this, count](const size_t first, const size_t last)
+    {
+        for (size_t i = first; i < last; ++i)
+        {
+            const size_t begin = dirty_blocks_[i] * block_size_;
+            if (begin < count)
+            {
+                compute_range(begin, std::min(begin + block_size_, count));
+            }
+        }
+    };
+
+    if (dirty_blocks_.size() * block_size_ < parallel_threshold_ || jobs_ == nullptr || jobs_->get_thread_count() < 2)
+    {
+        compute_blocks(0, dirty_blocks_.size());
+    }
+    else
+    {
+        jobs_->parallel_for("transform batch", dirty_blocks_.size(), blocks_per_job_, compute_blocks);
+    }
+
+    for (const uint32_t block : dirty_blocks_)
+    {
+        dirty_block_flags_[block] = 0;
+
+        const size_t begin = block * block_size_;
+        const size_t end = std::min(begin + block_size_, count);
+        for (size_t slot = begin; slot < end; ++slot)
+        {
+            if (dirty_[slot] != 0)
+            {
+                dirty_[slot] = 0;
+                changed_.push_back(handles_[slot]);
+            }
+        }
+    }
+
+    dirty_blocks_.clear();
+}
+
+const char* TransformSystem::get_instruction_set() const
+{
+#ifdef TRANSFORM_SYSTEM_X86
+    return avx_supported_ ? "avx" : "sse";
+#else
+    return "scalar";
+#endif
+}
+
+void TransformSystem::mark_dirty(const uint32_t slot)
+{
+    dirty_[slot] = 1;
+
+    const uint32_t block = slot / block_size_;
+    if (dirty_block_flags_[block] == 0)
+    {
+        dirty_block_flags_[block] = 1;
+        dirty_blocks_.push_back(block);
+    }
+}
+
+void TransformSystem::compute_range(const size_t begin, const size_t end)
+{
+#ifdef TRANSFORM_SYSTEM_X86
+    if (avx_supported_)
+    {
+        compute_range_avx(begin, end);
+    }
+    else
+    {
+        compute_range_sse(begin, end);
+    }
+#else
+    compute_range_scalar(begin, end);
+#endif
+}
+
+// translation * rotation * scale, the rotation columns as in glm::mat3_cast
+void TransformSystem::compute_range_scalar(const size_t begin, const size_t end)
+{
+    for (size_t i = begin; i < end; ++i)
+    {
+        const float x = orientation_x_[i];
+        const float y = orientation_y_[i];
+        const float z = orientation_z_[i];
+        const float w = orientation_w_[i];
+
+        const float xx = x * x;
+        const float yy = y * y;
+        const float zz = z * z;
+        const float xy = x * y;
+        const float xz = x * z;
+        const float yz = y * z;
+        const float wx = w * x;
+        const float wy = w * y;
+        const float wz = w * z;
+
+        auto& matrix = world_matrices_[i];
+        matrix[0] = glm::vec4(1.f - 2.f * (yy + zz), 2.f * (xy + wz), 2.f * (xz - wy), 0.f) * scale_x_[i];
+        matrix[1] = glm::vec4(2.f * (xy - wz), 1.f - 2.f * (xx + zz), 2.f * (yz + wx), 0.f) * scale_y_[i];
+        matrix[2] = glm::vec4(2.f * (xz + wy), 2.f * (yz - wx), 1.f - 2.f * (xx + yy), 0.f) * scale_z_[i];
+        matrix[3] = glm::vec4(position_x_[i], position_y_[i], position_z_[i], 1.f);
+    }
+}
+
+#ifdef TRANSFORM_SYSTEM_X86
+
+void TransformSystem::compute_range_sse(const size_t begin, const size_t end)
+{
+    const __m128 one = _mm_set1_ps(1.f);
+    const __m128 two = _mm_set1_ps(2.f);
+    const __m128 zero = _mm_setzero_ps();
+
+    size_t i = begin;
+
+    for (; i + 4 <= end; i += 4)
+    {
+        const __m128 x = _mm_loadu_ps(&orientation_x_[i]);
+        const __m128 y = _mm_loadu_ps(&orientation_y_[i]);
+        const __m128 z = _mm_loadu_ps(&orientation_z_[i]);
+        const __m128 w = _mm_loadu_ps(&orientation_w_[i]);
+
+        const __m128 xx = _mm_mul_ps(x, x);
+        const __m128 yy = _mm_mul_ps(y, y);
+        const __m128 zz = _mm_mul_ps(z, z);
+        const __m128 xy = _mm_mul_ps(x, y);
+        const __m128 xz = _mm_mul_ps(x, z);
+        const __m128 yz = _mm_mul_ps(y, z);
+        const __m128 wx = _mm_mul_ps(w, x);
+        const __m128 wy = _mm_mul_ps(w, y);
+        const __m128 wz = _mm_mul_ps(w, z);
+
+        const __m128 scale_x = _mm_loadu_ps(&scale_x_[i]);
+        const __m128 scale_y = _mm_loadu_ps(&scale_y_[i]);
+        const __m128 scale_z = _mm_loadu_ps(&scale_z_[i]);
+
+        glm::mat4* matrices = &world_matrices_[i];
+
+        store_column(matrices, 0,
+                     _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), scale_x),
+                     _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), scale_x),
+                     _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), scale_x),
+                     zero);
+        store_column(matrices, 1,
+                     _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), scale_y),
+                     _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), scale_y),
+                     _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), scale_y),
+                     zero);
+        store_column(matrices, 2,
+                     _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), scale_z),
+                     _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), scale_z),
+                     _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), scale_z),
+                     zero);
+        store_column(matrices, 3,
+                     _mm_loadu_ps(&position_x_[i]),
+                     _mm_loadu_ps(&position_y_[i]),
+                     _mm_loadu_ps(&position_z_[i]),
+                     one);
+    }
+
+    compute_range_scalar(i, end);
+}
+
+AVX_FUNCTION void TransformSystem::compute_range_avx(const size_t begin, const size_t end)
+{
+    const __m256 one = _mm256_set1_ps(1.f);
+    const __m256 two = _mm256_set1_ps(2.f);
+    const __m256 zero = _mm256_setzero_ps();
+
+    size_t i = begin;
+
+    for (; i + 8 <= end; i += 8)
+    {
+        const __m256 x = _mm256_loadu_ps(&orientation_x_[i]);
+        const __m256 y = _mm256_loadu_ps(&orientation_y_[i]);
+        const __m256 z = _mm256_loadu_ps(&orientation_z_[i]);
+        const __m256 w = _mm256_loadu_ps(&orientation_w_[i]);
+
+        const __m256 xx = _mm256_mul_ps(x, x);
+        const __m256 yy = _mm256_mul_ps(y, y);
+        const __m256 zz = _mm256_mul_ps(z, z);
+        const __m256 xy = _mm256_mul_ps(x, y);
+        const __m256 xz = _mm256_mul_ps(x, z);
+        const __m256 yz = _mm256_mul_ps(y, z);
+        const __m256 wx = _mm256_mul_ps(w, x);
+        const __m256 wy = _mm256_mul_ps(w, y);
+        const __m256 wz = _mm256_mul_ps(w, z);
+
+        const __m256 scale_x = _mm256_loadu_ps(&scale_x_[i]);
+        const __m256 scale_y = _mm256_loadu_ps(&scale_y_[i]);
+        const __m256 scale_z = _mm256_loadu_ps(&scale_z_[i]);
+
+        // rows of the 4 columns across the 8 transforms
+        const __m256 columns[4][4] = {
+            {
+                _mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(yy, zz))), scale_x),
+                _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(xy, wz)), scale_x),
+                _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(xz, wy)), scale_x),
+                zero,
+            },
+            {
+                _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(xy, wz)), scale_y),
+                _mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(xx, zz))), scale_y),
+                _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(yz, wx)), scale_y),
+                zero,
+            },
+            {
+                _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(xz, wy)), scale_z),
+                _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(yz, wx)), scale_z),
+                _mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(xx, yy))), scale_z),
+                zero,
+            },
+            {
+                _mm256_loadu_ps(&position_x_[i]),
+                _mm256_loadu_ps(&position_y_[i]),
+                _mm256_loadu_ps(&position_z_[i]),
+                one,
+            },
+        };
+
+        // each 128 bit half is transposed into 4 of the matrices
+        glm::mat4* matrices = &world_matrices_[i];
+        for (int column = 0; column < 4; ++column)
+        {
+            const auto& rows = columns[column];
+            store_column(matrices, column,
+                         _mm256_castps256_ps128(rows[0]), _mm256_castps256_ps128(rows[1]),
+                         _mm256_castps256_ps128(rows[2]), _mm256_castps256_ps128(rows[3]));
+            store_column(matrices + 4, column,
+                         _mm256_extractf128_ps(rows[0], 1), _mm256_extractf128_ps(rows[1], 1),
+                         _mm256_extractf128_ps(rows[2], 1), _mm256_extractf128_ps(rows[3], 1));
+        }
+    }
+
+    // the remaining 0 to 7 transforms
+    compute_range_sse(i, end);
+}
+
+#else
+
+void TransformSystem::compute_range_sse(const size_t begin, const size_t end)
+{
+    compute_range_scalar(begin, end);
+}
+
+void TransformSystem::compute_range_avx(const size_t begin, const size_t end)
+{
+    compute_range_scalar(begin, end);
+}
+
+#endif
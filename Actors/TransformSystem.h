@@ -0,0 +1,89 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+class JobSystem;
+
+// Positions, orientations and scales of every actor. Each component is a
+// separate array so world matrices are built 4 (SSE) or 8 (AVX) at a time, large
+// sets split across the job system. Only transforms changed since the last
+// update() are rebuilt, a frame where nothing moved builds none. Handles stay
+// valid while others are removed, the arrays stay dense.
+class TransformSystem
+{
+public:
+    using Handle = uint32_t;
+
+    // without a job system every matrix is built on the calling thread
+    void create(JobSystem* jobs = nullptr);
+    void clean();
+
+    // The world matrix is built right away, so it is valid before the next update(),
+    // which reports the transform as changed.
+    Handle add(glm::vec3 position, glm::quat orientation, glm::vec3 scale);
+    void remove(Handle handle);
+
+    [[nodiscard]] glm::vec3 get_position(Handle handle) const;
+    void set_position(Handle handle, glm::vec3 position);
+    [[nodiscard]] glm::quat get_orientation(Handle handle) const;
+    void set_orientation(Handle handle, glm::quat orientation);
+    [[nodiscard]] glm::vec3 get_scale(Handle handle) const;
+    void set_scale(Handle handle, glm::vec3 scale);
+
+    // Rebuilds the world matrices of the transforms set since the last call.
+    void update();
+    // the transforms update() rebuilt, each once, valid until the next update()
+    [[nodiscard]] const std::vector<Handle>& get_changed() const { return changed_; }
+
+    // as of the last update(), or add() for transforms added since
+    [[nodiscard]] const glm::mat4& get_world_matrix(const Handle handle) const { return world_matrices_[slots_[handle]]; }
+
+    [[nodiscard]] size_t get_count() const { return handles_.size(); }
+    [[nodiscard]] const char* get_instruction_set() const;
+
+private:
+    // slots are rebuilt in blocks of this many, one avx group
+    static constexpr size_t block_size_ = 8;
+    // A matrix takes a quaternion expansion, a scale and a 64 byte store, several
+    // times the work of a frustum test, so fewer transforms are worth splitting
+    // than culled spheres. Below 8 jobs of 512 transforms, waking the workers
+    // costs about what they save.
+    static constexpr size_t blocks_per_job_ = 64;
+    static constexpr size_t parallel_threshold_ = 8 * blocks_per_job_ * block_size_;
+
+    JobSystem* jobs_ = nullptr;
+    bool avx_supported_ = false;
+
+    std::vector<float> position_x_;
+    std::vector<float> position_y_;
+    std::vector<float> position_z_;
+    std::vector<float> orientation_x_;
+    std::vector<float> orientation_y_;
+    std::vector<float> orientation_z_;
+    std::vector<float> orientation_w_;
+    std::vector<float> scale_x_;
+    std::vector<float> scale_y_;
+    std::vector<float> scale_z_;
+    std::vector<glm::mat4> world_matrices_;
+
+    // the handle of each slot, and the slot of each handle
+    std::vector<Handle> handles_;
+    std::vector<uint32_t> slots_;
+    std::vector<Handle> free_handles_;
+
+    // set since the last update(), per slot and per block of slots
+    std::vector<uint8_t> dirty_;
+    std::vector<uint8_t> dirty_block_flags_;
+    std::vector<uint32_t> dirty_blocks_;
+    std::vector<Handle> changed_;
+
+    void mark_dirty(uint32_t slot);
+    void compute_range(size_t begin, size_t end);
+    void compute_range_scalar(size_t begin, size_t end);
+    void compute_range_sse(size_t begin, size_t end);
+    void compute_range_avx(size_t begin, size_t end);
+};
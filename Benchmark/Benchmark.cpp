@@ -0,0 +1,249 @@
+﻿// End-to-end rendering benchmark. Renders a synthetic scene headless for a
+// fixed number of frames and reports load time, frame time percentiles and
+// memory as JSON, optionally checked against a stored baseline.
+//
+//     Frontend3DBenchmark --actors 5000 --meshes 16 --textures 16 --dynamic 0.25 --churn 0.001
+//                         --frames 1000 --output result.json --baseline baseline.json
+//                         [--no-frustum-culling] [--no-bvh-culling] [--no-occlusion-culling]
+//                         [--dynamic-resolution <target gpu ms>] [--quality low|medium|high|ultra]
+//
+// Run it from the directory containing Shaders/. A baseline is the --output of
+// an earlier run on the same machine with the same options, it is rejected when
+// those differ. Exits with 2 when a metric regressed by more than --tolerance
+// (default 0.1).
+
+#include <chrono>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "BenchmarkReport.h"
+#include "SyntheticScene.h"
+#include "../Camera/Camera.h"
+#include "../Graphics/GraphicsRunner.h"
+
+namespace
+{
+
+struct BenchmarkOptions
+{
+    SceneParameters scene;
+    uint32_t warmup_frames = 60;
+    uint32_t frames = 600;
+    uint32_t width = 1280;
+    uint32_t height = 720;
+    std::string asset_directory = "benchmark_assets";
+    std::string output_path;
+    std::string baseline_path;
+    double tolerance = 0.1;
+    bool frustum_culling = true;
+    bool bvh_culling = true;
+    bool occlusion_culling = true;
+    // 0 renders at full resolution
+    double dynamic_resolution_milliseconds = 0.0;
+    QualityTier quality = quality::get_default_tier();
+};
+
+BenchmarkOptions parse_options(const std::vector<std::string>& arguments)
+{
+    BenchmarkOptions options;
+
+    for (size_t i = 0; i < arguments.size(); ++i)
+    {
+        const auto& name = arguments[i];
+
+        if (name == "--no-frustum-culling")
+        {
+            options.frustum_culling = false;
+            continue;
+        }
+
+        if (name == "--no-bvh-culling")
+        {
+            options.bvh_culling = false;
+            continue;
+        }
+
+        if (name == "--no-occlusion-culling")
+        {
+            options.occlusion_culling = false;
+            continue;
+        }
+
+        if (i + 1 == arguments.size())
+        {
+            throw std::runtime_error("Error: missing value for " + name);
+        }
+
+        const auto& value = arguments[++i];
+
+        if (name == "--actors") options.scene.actor_count = static_cast<uint32_t>(std::stoul(value));
+        else if (name == "--meshes") options.scene.mesh_count = static_cast<uint32_t>(std::stoul(value));
+        else if (name == "--textures") options.scene.texture_count = static_cast<uint32_t>(std::stoul(value));
+        else if (name == "--dynamic") options.scene.dynamic_ratio = std::stof(value);
+        else if (name == "--churn") options.scene.churn_rate = std::stof(value);
+        else if (name == "--seed") options.scene.seed = static_cast<uint32_t>(std::stoul(value));
+        else if (name == "--warmup") options.warmup_frames = static_cast<uint32_t>(std::stoul(value));
+        else if (name == "--frames") options.frames = static_cast<uint32_t>(std::stoul(value));
+        else if (name == "--width") options.width = static_cast<uint32_t>(std::stoul(value));
+        else if (name == "--height") options.height = static_cast<uint32_t>(std::stoul(value));
+        else if (name == "--assets") options.asset_directory = value;
+        else if (name == "--output") options.output_path = value;
+        else if (name == "--baseline") options.baseline_path = value;
+        else if (name == "--tolerance") options.tolerance = std::stod(value);
+        else if (name == "--dynamic-resolution") options.dynamic_resolution_milliseconds = std::stod(value);
+        else if (name == "--quality")
+        {
+            const auto tier = quality::find_tier(value);
+            if (!tier)
+            {
+                throw std::runtime_error("Error: unknown quality tier " + value);
+            }
+
+            options.quality = *tier;
+        }
+        else throw std::runtime_error("Error: unknown option " + name);
+    }
+
+    if (options.scene.mesh_count == 0 || options.scene.texture_count == 0)
+    {
+        throw std::runtime_error("Error: a scene needs at least one mesh and one texture.");
+    }
+
+    return options;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    try
+    {
+        const auto options = parse_options(std::vector<std::string>(argv + 1, argv + argc));
+
+        Camera camera;
+
+        GraphicsRunner runner(&camera);
+        runner.set_headless(options.width, options.height);
+        runner.set_frustum_culling(options.frustum_culling);
+        runner.set_bvh_culling(options.bvh_culling);
+        runner.set_occlusion_culling(options.occlusion_culling);
+        runner.set_quality_tier(options.quality);
+        if (options.dynamic_resolution_milliseconds > 0.0)
+        {
+            runner.set_dynamic_resolution(true, options.dynamic_resolution_milliseconds);
+        }
+        runner.init();
+
+        BenchmarkReport report;
+        report.scene = options.scene;
+        report.frame_count = options.frames;
+        report.width = options.width;
+        report.height = options.height;
+        report.frustum_culling = options.frustum_culling;
+        report.bvh_culling = options.bvh_culling;
+        // what actually ran, a culler without its shaders disables itself
+        report.occlusion_culling = runner.is_occlusion_culling_active();
+        report.quality = options.quality.name;
+        report.pipeline_milliseconds = runner.get_pipeline_creation_milliseconds();
+        report.pipeline_cache_warm = runner.is_pipeline_cache_warm();
+
+        SyntheticScene scene;
+
+        const auto load_start = std::chrono::high_resolution_clock::now();
+        scene.create(runner, options.scene, options.asset_directory);
+        report.load_milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - load_start).count();
+
+        // fixed time step, so every run moves the scene the same way
+        constexpr float delta_time = 1.f / 60.f;
+
+        // lets background pipeline compiles and texture streaming settle
+        for (uint32_t frame = 0; frame < options.warmup_frames; ++frame)
+        {
+            scene.update(runner, delta_time);
+            runner.update();
+        }
+
+        std::vector<double> cpu_frame_times;
+        std::vector<double> gpu_frame_times;
+        cpu_frame_times.reserve(options.frames);
+        gpu_frame_times.reserve(options.frames);
+        uint64_t culled_objects = 0;
+        uint64_t occluded_objects = 0;
+        uint64_t uploaded_transforms = 0;
+        double resolution_scale = 0.0;
+
+        for (uint32_t frame = 0; frame < options.frames; ++frame)
+        {
+            const auto frame_start = std::chrono::high_resolution_clock::now();
+
+            scene.update(runner, delta_time);
+            runner.update();
+
+            cpu_frame_times.push_back(std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - frame_start).count());
+            culled_objects += runner.get_culling_statistics().culled;
+            occluded_objects += runner.get_occluded_count();
+            uploaded_transforms += runner.get_uploaded_transform_count();
+            resolution_scale += runner.get_resolution_scale();
+
+            // lags a few frames behind, which doesn't matter for the distribution
+            if (const auto gpu_time = runner.get_gpu_milliseconds("frame"))
+            {
+                gpu_frame_times.push_back(*gpu_time);
+            }
+        }
+
+        report.cpu_frame_milliseconds = Percentiles::from_samples(std::move(cpu_frame_times));
+        report.gpu_frame_milliseconds = Percentiles::from_samples(std::move(gpu_frame_times));
+        report.culled_objects = options.frames > 0 ? static_cast<double>(culled_objects) / options.frames : 0.0;
+        report.occluded_objects = options.frames > 0 ? static_cast<double>(occluded_objects) / options.frames : 0.0;
+        report.uploaded_transforms = options.frames > 0 ? static_cast<double>(uploaded_transforms) / options.frames : 0.0;
+        report.resolution_scale = options.frames > 0 ? resolution_scale / options.frames : 1.0;
+        report.gpu_memory_bytes = runner.get_gpu_memory_usage();
+        report.process_memory_bytes = get_process_memory_bytes();
+
+        scene.clean(runner);
+        runner.clean_up();
+
+        const auto json = report.to_json();
+        std::cout << json;
+
+        if (!options.output_path.empty())
+        {
+            std::ofstream(options.output_path, std::ios::trunc) << json;
+        }
+
+        if (!options.baseline_path.empty())
+        {
+            std::ifstream baseline_file(options.baseline_path);
+            if (!baseline_file)
+            {
+                throw std::runtime_error("Error: unable to read baseline " + options.baseline_path);
+            }
+
+            std::stringstream baseline;
+            baseline << baseline_file.rdbuf();
+
+            const auto regressions = report.find_regressions(baseline.str(), options.tolerance);
+            for (const auto& regression : regressions)
+            {
+                std::cerr << "Regression: " << regression << '\n';
+            }
+
+            if (!regressions.empty())
+            {
+                return 2;
+            }
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,250 @@
+﻿#include "BenchmarkReport.h"
+
+#include <algorithm>
+#include <cmath>
+#include <format>
+#include <fstream>
+#include <numeric>
+#include <optional>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#define PSAPI_VERSION 2
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace
+{
+
+std::string to_json(const Percentiles& percentiles)
+{
+    return std::format(R"({{"mean": {:.4f}, "p50": {:.4f}, "p90": {:.4f}, "p99": {:.4f}, "max": {:.4f}}})",
+                       percentiles.mean, percentiles.p50, percentiles.p90, percentiles.p99, percentiles.max);
+}
+
+// Finds `"key": <value>`, inside `"object": {...}` when an object is given, and
+// returns the value without quotes. Only meant for the flat reports this file writes.
+std::optional<std::string> find_value(const std::string& json, const std::string& object, const std::string& key)
+{
+    size_t begin = 0;
+    size_t end = json.size();
+
+    if (!object.empty())
+    {
+        begin = json.find('"' + object + '"');
+        if (begin == std::string::npos)
+        {
+            return std::nullopt;
+        }
+
+        end = json.find('}', begin);
+    }
+
+    const auto position = json.find('"' + key + '"', begin);
+    if (position == std::string::npos || position > end)
+    {
+        return std::nullopt;
+    }
+
+    const auto begin_value = json.find_first_not_of(" \t", json.find(':', position) + 1);
+    if (begin_value == std::string::npos)
+    {
+        return std::nullopt;
+    }
+
+    if (json[begin_value] == '"')
+    {
+        const auto end_value = json.find('"', begin_value + 1);
+        if (end_value == std::string::npos)
+        {
+            return std::nullopt;
+        }
+
+        return json.substr(begin_value + 1, end_value - begin_value - 1);
+    }
+
+    const auto end_value = json.find_first_of(",}\n \t", begin_value);
+    return json.substr(begin_value, end_value == std::string::npos ? std::string::npos : end_value - begin_value);
+}
+
+std::optional<double> find_number(const std::string& json, const std::string& object, const std::string& key)
+{
+    const auto value = find_value(json, object, key);
+    if (!value.has_value())
+    {
+        return std::nullopt;
+    }
+
+    try
+    {
+        return std::stod(*value);
+    }
+    catch (const std::exception&)
+    {
+        return std::nullopt;
+    }
+}
+
+}
+
+Percentiles Percentiles::from_samples(std::vector<double> samples)
+{
+    Percentiles percentiles;
+
+    if (samples.empty())
+    {
+        return percentiles;
+    }
+
+    std::ranges::sort(samples);
+
+    // nearest rank
+    const auto at = [&samples](const double percentile)
+    {
+        const auto rank = static_cast<size_t>(std::ceil(percentile * static_cast<double>(samples.size())));
+        return samples[std::clamp<size_t>(rank, 1, samples.size()) - 1];
+    };
+
+    percentiles.mean = std::accumulate(samples.begin(), samples.end(), 0.0) / static_cast<double>(samples.size());
+    percentiles.p50 = at(0.50);
+    percentiles.p90 = at(0.90);
+    percentiles.p99 = at(0.99);
+    percentiles.max = samples.back();
+
+    return percentiles;
+}
+
+std::string BenchmarkReport::to_json() const
+{
+    std::string json = "{\n";
+    json += std::format(R"(  "scene": {{"actors": {}, "meshes": {}, "textures": {}, "dynamic_ratio": {:.3f}, "churn_rate": {:.4f}, "seed": {}}},)",
+                        scene.actor_count, scene.mesh_count, scene.texture_count, scene.dynamic_ratio, scene.churn_rate, scene.seed) + "\n";
+    json += std::format(R"(  "frames": {}, "width": {}, "height": {},)", frame_count, width, height) + "\n";
+    json += std::format(R"(  "load_ms": {:.3f},)", load_milliseconds) + "\n";
+    json += std::format(R"(  "pipeline_ms": {:.3f}, "pipeline_cache": "{}",)", pipeline_milliseconds,
+                        pipeline_cache_warm ? "warm" : "cold") + "\n";
+    json += "  \"cpu_frame_ms\": " + ::to_json(cpu_frame_milliseconds) + ",\n";
+    json += "  \"gpu_frame_ms\": " + ::to_json(gpu_frame_milliseconds) + ",\n";
+    json += std::format(R"(  "frustum_culling": {}, "bvh_culling": {}, "culled_objects": {:.1f},)", frustum_culling ? "true" : "false",
+                        bvh_culling ? "true" : "false", culled_objects) + "\n";
+    json += std::format(R"(  "occlusion_culling": {}, "occluded_objects": {:.1f},)", occlusion_culling ? "true" : "false", occluded_objects) + "\n";
+    json += std::format(R"(  "uploaded_transforms": {:.1f},)", uploaded_transforms) + "\n";
+    json += std::format(R"(  "quality": "{}", "resolution_scale": {:.3f},)", quality, resolution_scale) + "\n";
+    json += std::format(R"(  "gpu_memory_bytes": {},)", gpu_memory_bytes) + "\n";
+    json += std::format(R"(  "process_memory_bytes": {})", process_memory_bytes) + "\n";
+    json += "}\n";
+
+    return json;
+}
+
+std::vector<std::string> BenchmarkReport::find_regressions(const std::string& baseline_json, const double tolerance) const
+{
+    struct Setting
+    {
+        const char* object;
+        const char* key;
+        std::string value;
+    };
+
+    // formatted as to_json() writes them, timings of a different scene or setup say nothing
+    const std::vector<Setting> settings =
+    {
+        {"scene", "actors", std::to_string(scene.actor_count)},
+        {"scene", "meshes", std::to_string(scene.mesh_count)},
+        {"scene", "textures", std::to_string(scene.texture_count)},
+        {"scene", "dynamic_ratio", std::format("{:.3f}", scene.dynamic_ratio)},
+        {"scene", "churn_rate", std::format("{:.4f}", scene.churn_rate)},
+        {"scene", "seed", std::to_string(scene.seed)},
+        {"", "width", std::to_string(width)},
+        {"", "height", std::to_string(height)},
+        {"", "frustum_culling", frustum_culling ? "true" : "false"},
+        {"", "bvh_culling", bvh_culling ? "true" : "false"},
+        {"", "occlusion_culling", occlusion_culling ? "true" : "false"},
+        {"", "quality", quality},
+    };
+
+    std::string mismatches;
+
+    for (const auto& setting : settings)
+    {
+        const auto baseline = find_value(baseline_json, setting.object, setting.key);
+        if (baseline != setting.value)
+        {
+            const auto name = std::string(setting.object).empty() ? std::string(setting.key) : std::format("{}.{}", setting.object, setting.key);
+            mismatches += std::format("{}{} {} vs baseline {}", mismatches.empty() ? "" : ", ", name, setting.value,
+                                      baseline.value_or("missing"));
+        }
+    }
+
+    if (!mismatches.empty())
+    {
+        throw std::runtime_error("Error: the baseline was recorded with a different configuration: " + mismatches);
+    }
+
+    struct Metric
+    {
+        const char* object;
+        const char* key;
+        double value;
+    };
+
+    // lower is better for all of them
+    const std::vector<Metric> metrics =
+    {
+        {"", "load_ms", load_milliseconds},
+        {"cpu_frame_ms", "p50", cpu_frame_milliseconds.p50},
+        {"cpu_frame_ms", "p99", cpu_frame_milliseconds.p99},
+        {"gpu_frame_ms", "p50", gpu_frame_milliseconds.p50},
+        {"gpu_frame_ms", "p99", gpu_frame_milliseconds.p99},
+        {"", "gpu_memory_bytes", static_cast<double>(gpu_memory_bytes)},
+        {"", "process_memory_bytes", static_cast<double>(process_memory_bytes)},
+    };
+
+    std::vector<std::string> regressions;
+
+    for (const auto& metric : metrics)
+    {
+        const auto baseline = find_number(baseline_json, metric.object, metric.key);
+        if (!baseline.has_value() || *baseline <= 0.0)
+        {
+            continue;
+        }
+
+        if (metric.value > *baseline * (1.0 + tolerance))
+        {
+            const auto name = std::string(metric.object).empty() ? std::string(metric.key) : std::format("{}.{}", metric.object, metric.key);
+            regressions.push_back(std::format("{}: {:.3f} vs baseline {:.3f} (+{:.1f}%)", name, metric.value, *baseline,
+                                              (metric.value / *baseline - 1.0) * 100.0));
+        }
+    }
+
+    return regressions;
+}
+
+uint64_t get_process_memory_bytes()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters{};
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    {
+        return counters.WorkingSetSize;
+    }
+
+    return 0;
+#else
+    // second field is the resident page count
+    std::ifstream statm("/proc/self/statm");
+    uint64_t size = 0, resident = 0;
+    if (statm >> size >> resident)
+    {
+        return resident * static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+    }
+
+    return 0;
+#endif
+}
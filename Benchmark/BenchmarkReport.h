@@ -0,0 +1,56 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "SyntheticScene.h"
+
+struct Percentiles
+{
+    double mean = 0.0;
+    double p50 = 0.0;
+    double p90 = 0.0;
+    double p99 = 0.0;
+    double max = 0.0;
+
+    static Percentiles from_samples(std::vector<double> samples);
+};
+
+struct BenchmarkReport
+{
+    SceneParameters scene;
+    uint32_t frame_count = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+
+    double load_milliseconds = 0.0;
+    // creating the default pipeline at init, with or without a saved pipeline cache
+    double pipeline_milliseconds = 0.0;
+    bool pipeline_cache_warm = false;
+    Percentiles cpu_frame_milliseconds;
+    Percentiles gpu_frame_milliseconds;
+    bool frustum_culling = true;
+    bool bvh_culling = true;
+    bool occlusion_culling = true;
+    std::string quality;
+    // per frame, averaged
+    double culled_objects = 0.0;
+    double occluded_objects = 0.0;
+    // model matrices written into the frame's transform buffer
+    double uploaded_transforms = 0.0;
+    // of width and height, below 1 when dynamic resolution had to scale down
+    double resolution_scale = 1.0;
+    uint64_t gpu_memory_bytes = 0;
+    uint64_t process_memory_bytes = 0;
+
+    [[nodiscard]] std::string to_json() const;
+
+    // Compares against a report written by to_json(). Returns one line per
+    // metric that got worse by more than `tolerance` (0.1 is 10%). Throws when
+    // the baseline was recorded with a different scene, resolution, culling or quality.
+    [[nodiscard]] std::vector<std::string> find_regressions(const std::string& baseline_json, double tolerance) const;
+};
+
+// resident set size of this process, 0 where it can't be queried
+uint64_t get_process_memory_bytes();
@@ -0,0 +1,205 @@
+﻿#include "MicroBenchmark.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <format>
+#include <new>
+#include <numeric>
+#include <optional>
+
+namespace
+{
+
+std::atomic<uint64_t> allocation_count{0};
+std::atomic<uint64_t> allocated_bytes{0};
+
+void* allocate(const std::size_t size)
+{
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+
+    // malloc(0) may return null, operator new may not
+    if (void* memory = std::malloc(size == 0 ? 1 : size))
+    {
+        return memory;
+    }
+
+    throw std::bad_alloc();
+}
+
+void* allocate_aligned(const std::size_t size, const std::align_val_t alignment)
+{
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+
+    const auto alignment_bytes = static_cast<std::size_t>(alignment);
+#ifdef _WIN32
+    void* memory = _aligned_malloc(size == 0 ? 1 : size, alignment_bytes);
+#else
+    // aligned_alloc wants the size to be a multiple of the alignment
+    void* memory = std::aligned_alloc(alignment_bytes, std::max((size + alignment_bytes - 1) / alignment_bytes, std::size_t{1}) * alignment_bytes);
+#endif
+    if (memory)
+    {
+        return memory;
+    }
+
+    throw std::bad_alloc();
+}
+
+void free_aligned(void* memory) noexcept
+{
+#ifdef _WIN32
+    _aligned_free(memory);
+#else
+    std::free(memory);
+#endif
+}
+
+// Finds `"key": <number>` in the object following `"name": "<name>"`.
+std::optional<double> find_number(const std::string& json, const std::string& name, const std::string& key)
+{
+    const auto object = json.find(std::format(R"("name": "{}")", name));
+    if (object == std::string::npos)
+    {
+        return std::nullopt;
+    }
+
+    const auto position = json.find('"' + key + '"', object);
+    if (position == std::string::npos || position > json.find('}', object))
+    {
+        return std::nullopt;
+    }
+
+    try
+    {
+        return std::stod(json.substr(json.find(':', position) + 1));
+    }
+    catch (const std::exception&)
+    {
+        return std::nullopt;
+    }
+}
+
+}
+
+// The array and nothrow forms forward to these by default.
+void* operator new(const std::size_t size)
+{
+    return allocate(size);
+}
+
+void* operator new(const std::size_t size, const std::align_val_t alignment)
+{
+    return allocate_aligned(size, alignment);
+}
+
+void operator delete(void* memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::align_val_t) noexcept
+{
+    free_aligned(memory);
+}
+
+void operator delete(void* memory, std::size_t, std::align_val_t) noexcept
+{
+    free_aligned(memory);
+}
+
+uint64_t micro_benchmark::detail::allocation_count()
+{
+    return ::allocation_count.load(std::memory_order_relaxed);
+}
+
+uint64_t micro_benchmark::detail::allocated_bytes()
+{
+    return ::allocated_bytes.load(std::memory_order_relaxed);
+}
+
+micro_benchmark::Result micro_benchmark::detail::summarize(const std::string& name, const uint64_t iterations,
+                                                           const std::vector<double>& sample_nanoseconds,
+                                                           const uint64_t allocations, const uint64_t bytes)
+{
+    Result result{name, iterations, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+
+    if (sample_nanoseconds.empty())
+    {
+        return result;
+    }
+
+    auto sorted = sample_nanoseconds;
+    std::ranges::sort(sorted);
+
+    const auto count = static_cast<double>(sorted.size());
+    result.mean_nanoseconds = std::accumulate(sorted.begin(), sorted.end(), 0.0) / count;
+    result.median_nanoseconds = sorted.size() % 2 == 1
+        ? sorted[sorted.size() / 2]
+        : (sorted[sorted.size() / 2 - 1] + sorted[sorted.size() / 2]) / 2.0;
+    result.min_nanoseconds = sorted.front();
+
+    double variance = 0.0;
+    for (const auto sample : sorted)
+    {
+        variance += (sample - result.mean_nanoseconds) * (sample - result.mean_nanoseconds);
+    }
+    result.stddev_nanoseconds = std::sqrt(variance / count);
+
+    const auto calls = count * static_cast<double>(iterations);
+    result.allocations = static_cast<double>(allocations) / calls;
+    result.allocated_bytes = static_cast<double>(bytes) / calls;
+
+    return result;
+}
+
+std::string micro_benchmark::to_json(const std::vector<Result>& results)
+{
+    std::string json = "{\n  \"benchmarks\": [\n";
+
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const auto& result = results[i];
+        json += std::format(R"(    {{"name": "{}", "iterations": {}, "mean_ns": {:.3f}, "median_ns": {:.3f}, "min_ns": {:.3f}, "stddev_ns": {:.3f}, "allocations": {:.3f}, "allocated_bytes": {:.1f}}})",
+                            result.name, result.iterations, result.mean_nanoseconds, result.median_nanoseconds,
+                            result.min_nanoseconds, result.stddev_nanoseconds, result.allocations, result.allocated_bytes);
+        json += i + 1 < results.size() ? ",\n" : "\n";
+    }
+
+    json += "  ]\n}\n";
+    return json;
+}
+
+std::vector<std::string> micro_benchmark::find_regressions(const std::vector<Result>& results, const std::string& baseline_json,
+                                                           const double tolerance)
+{
+    std::vector<std::string> regressions;
+
+    for (const auto& result : results)
+    {
+        if (const auto median = find_number(baseline_json, result.name, "median_ns"); median && *median > 0.0
+            && result.median_nanoseconds > *median * (1.0 + tolerance))
+        {
+            regressions.push_back(std::format("{}: {:.1f} ns vs baseline {:.1f} ns (+{:.1f}%)", result.name,
+                                              result.median_nanoseconds, *median, (result.median_nanoseconds / *median - 1.0) * 100.0));
+        }
+
+        // allocations are deterministic, so any increase counts
+        if (const auto allocations = find_number(baseline_json, result.name, "allocations");
+            allocations && result.allocations > *allocations + 0.01)
+        {
+            regressions.push_back(std::format("{}: {:.2f} allocations per call vs baseline {:.2f}", result.name,
+                                              result.allocations, *allocations));
+        }
+    }
+
+    return regressions;
+}
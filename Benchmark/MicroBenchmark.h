@@ -0,0 +1,122 @@
+﻿#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Minimal harness for timing small cpu functions. Every benchmark is warmed up,
+// calibrated so one sample runs for about `sample_time`, then sampled
+// `repetitions` times. Heap allocations made by the benchmarked code are
+// counted through the replaced global operator new, so linking this file
+// replaces it for the whole executable.
+namespace micro_benchmark
+{
+
+struct Options
+{
+    std::chrono::nanoseconds warmup = std::chrono::milliseconds(100);
+    std::chrono::nanoseconds sample_time = std::chrono::milliseconds(10);
+    uint32_t repetitions = 20;
+};
+
+struct Result
+{
+    std::string name;
+    // calls per sample
+    uint64_t iterations;
+    // time per call
+    double mean_nanoseconds;
+    double median_nanoseconds;
+    double min_nanoseconds;
+    double stddev_nanoseconds;
+    // per call, averaged over all samples
+    double allocations;
+    double allocated_bytes;
+};
+
+namespace detail
+{
+
+using Clock = std::chrono::steady_clock;
+
+uint64_t allocation_count();
+uint64_t allocated_bytes();
+
+Result summarize(const std::string& name, uint64_t iterations, const std::vector<double>& sample_nanoseconds,
+                 uint64_t allocations, uint64_t bytes);
+
+}
+
+// Keeps the compiler from optimizing away a result that is never used.
+template <typename T>
+void do_not_optimize(const T& value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static const void* volatile sink;
+    sink = &value;
+#endif
+}
+
+// `body` is one call of the code being measured.
+template <typename Body>
+Result run(const std::string& name, Body&& body, const Options& options = {})
+{
+    using detail::Clock;
+
+    const auto run_batch = [&body](const uint64_t iterations)
+    {
+        const auto start = Clock::now();
+        for (uint64_t i = 0; i < iterations; ++i)
+        {
+            body();
+        }
+        return Clock::now() - start;
+    };
+
+    // double the batch until it fills a sample, and keep running it for the rest of the warmup
+    uint64_t iterations = 1;
+    const auto warmup_end = Clock::now() + options.warmup;
+    while (true)
+    {
+        const auto elapsed = run_batch(iterations);
+
+        if (elapsed < options.sample_time)
+        {
+            iterations *= 2;
+            continue;
+        }
+
+        if (Clock::now() >= warmup_end)
+        {
+            break;
+        }
+    }
+
+    std::vector<double> samples;
+    samples.reserve(options.repetitions);
+
+    const auto allocations_before = detail::allocation_count();
+    const auto bytes_before = detail::allocated_bytes();
+
+    for (uint32_t i = 0; i < options.repetitions; ++i)
+    {
+        const auto elapsed = std::chrono::duration<double, std::nano>(run_batch(iterations));
+        samples.push_back(elapsed.count() / static_cast<double>(iterations));
+    }
+
+    return detail::summarize(name, iterations, samples,
+                             detail::allocation_count() - allocations_before,
+                             detail::allocated_bytes() - bytes_before);
+}
+
+std::string to_json(const std::vector<Result>& results);
+
+// Compares against output of to_json(). Returns one line for every benchmark
+// whose median got slower by more than `tolerance` (0.1 is 10%), or that
+// allocates more often than before.
+std::vector<std::string> find_regressions(const std::vector<Result>& results, const std::string& baseline_json, double tolerance);
+
+}
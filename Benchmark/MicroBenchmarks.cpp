@@ -0,0 +1,378 @@
+﻿// Micro-benchmarks of the cpu hot paths. Needs neither a gpu nor a display:
+// the keyboard is polled through glfw's null platform where available.
+//
+//     Frontend3DMicroBenchmarks --filter hash --repetitions 30 --output micro.json --baseline micro_baseline.json
+//
+// Exits with 2 when a benchmark regressed by more than --tolerance (default 0.1).
+
+#include <array>
+#include <exception>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <GLFW/glfw3.h>
+
+#include "MicroBenchmark.h"
+#include "SyntheticAssets.h"
+#include "../Actors/Actor.h"
+#include "../Actors/TransformSystem.h"
+#include "../Camera/Camera.h"
+#include "../Culling/DynamicBvh.h"
+#include "../Culling/FrustumCuller.h"
+#include "../Input/Controls.h"
+#include "../Input/Input.h"
+#include "../Input/Keyboard.h"
+#include "../Jobs/JobSystem.h"
+#include "../Models/ModelLoading.h"
+#include "../Rendering/Vertex.h"
+
+namespace
+{
+
+struct MicroBenchmarkOptions
+{
+    micro_benchmark::Options run;
+    std::string filter;
+    std::string asset_directory = "benchmark_assets";
+    std::string output_path;
+    std::string baseline_path;
+    double tolerance = 0.1;
+};
+
+MicroBenchmarkOptions parse_options(const std::vector<std::string>& arguments)
+{
+    MicroBenchmarkOptions options;
+
+    for (size_t i = 0; i + 1 < arguments.size(); i += 2)
+    {
+        const auto& name = arguments[i];
+        const auto& value = arguments[i + 1];
+
+        if (name == "--filter") options.filter = value;
+        else if (name == "--repetitions") options.run.repetitions = static_cast<uint32_t>(std::stoul(value));
+        else if (name == "--warmup-ms") options.run.warmup = std::chrono::milliseconds(std::stoul(value));
+        else if (name == "--sample-ms") options.run.sample_time = std::chrono::milliseconds(std::stoul(value));
+        else if (name == "--assets") options.asset_directory = value;
+        else if (name == "--output") options.output_path = value;
+        else if (name == "--baseline") options.baseline_path = value;
+        else if (name == "--tolerance") options.tolerance = std::stod(value);
+        else throw std::runtime_error("Error: unknown option " + name);
+    }
+
+    return options;
+}
+
+constexpr std::array<Control, 8> benchmark_controls = {
+    controls::MOVE_RIGHT, controls::MOVE_UP, controls::LOOK_RIGHT, controls::LOOK_UP,
+    controls::ABILITY_ONE, controls::ABILITY_TWO, controls::PAUSE, controls::SELECT,
+};
+
+constexpr std::array<int, 8> benchmark_keys = {
+    GLFW_KEY_D, GLFW_KEY_W, GLFW_KEY_RIGHT, GLFW_KEY_UP, GLFW_KEY_1, GLFW_KEY_2, GLFW_KEY_ESCAPE, GLFW_KEY_M,
+};
+
+// An invisible window that needs no display server, or null when glfw can't provide one.
+GLFWwindow* create_headless_window()
+{
+#ifdef GLFW_PLATFORM_NULL
+    glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+#endif
+    if (!glfwInit())
+    {
+        return nullptr;
+    }
+
+    glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    return glfwCreateWindow(64, 64, "micro benchmarks", nullptr, nullptr);
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    try
+    {
+        const auto options = parse_options(std::vector<std::string>(argv + 1, argv + argc));
+
+        std::vector<micro_benchmark::Result> results;
+
+        const auto benchmark = [&](const std::string& name, auto&& body)
+        {
+            if (!options.filter.empty() && name.find(options.filter) == std::string::npos)
+            {
+                return;
+            }
+
+            const auto& result = results.emplace_back(micro_benchmark::run(name, body, options.run));
+            std::cout << std::format("{:<40} {:>12.1f} ns  (min {:.1f}, stddev {:.1f})  {:.2f} allocations, {:.0f} bytes\n",
+                                     result.name, result.median_nanoseconds, result.min_nanoseconds,
+                                     result.stddev_nanoseconds, result.allocations, result.allocated_bytes);
+        };
+
+        std::filesystem::create_directories(options.asset_directory);
+        for (const uint32_t segments : {16u, 64u})
+        {
+            const auto path = std::format("{}/sphere_{}.obj", options.asset_directory, segments);
+            if (!std::filesystem::exists(path))
+            {
+                synthetic_assets::write_sphere(path, segments);
+            }
+
+            benchmark(std::format("load_model/sphere_{}", segments), [&path]
+            {
+                std::vector<Vertex> vertices;
+                std::vector<uint32_t> indices;
+                MeshBounds bounds;
+                model_loading::load_model(vertices, indices, bounds, path);
+                micro_benchmark::do_not_optimize(indices.data());
+            });
+        }
+
+        {
+            // a realistic spread of vertices, cycled so the hash isn't run on one constant
+            std::vector<Vertex> vertices;
+            std::vector<uint32_t> indices;
+            MeshBounds bounds;
+            model_loading::load_model(vertices, indices, bounds, std::format("{}/sphere_64.obj", options.asset_directory));
+
+            size_t next = 0;
+            benchmark("hash<Vertex>", [&]
+            {
+                micro_benchmark::do_not_optimize(std::hash<Vertex>()(vertices[next]));
+                next = next + 1 == vertices.size() ? 0 : next + 1;
+            });
+        }
+
+        {
+            const Camera camera;
+            benchmark("Camera::get_ubo", [&camera]
+            {
+                micro_benchmark::do_not_optimize(camera.get_ubo());
+            });
+        }
+
+        JobSystem jobs;
+        jobs.create();
+
+        for (const uint32_t actor_count : {1000u, 100000u})
+        {
+            std::mt19937 random(1);
+            std::uniform_real_distribution<float> coordinate(-5000.f, 5000.f);
+            std::uniform_real_distribution<float> angle(0.f, 360.f);
+
+            TransformSystem transforms;
+            transforms.create();
+            TransformSystem parallel_transforms;
+            parallel_transforms.create(&jobs);
+            std::vector<Actor> actors;
+
+            for (uint32_t i = 0; i < actor_count; ++i)
+            {
+                const glm::vec3 position(coordinate(random), coordinate(random), coordinate(random));
+                const float yaw = angle(random);
+                const float pitch = angle(random);
+                const float roll = angle(random);
+                actors.emplace_back(transforms, position, glm::vec3(2.f), glm::vec3(0.f, 0.f, 1.f), yaw, pitch, roll);
+                actors.emplace_back(parallel_transforms, position, glm::vec3(2.f), glm::vec3(0.f, 0.f, 1.f), yaw, pitch, roll);
+            }
+
+            // every actor moved, setting the positions included
+            const auto move_all = [actor_count](TransformSystem& system)
+            {
+                for (TransformSystem::Handle handle = 0; handle < actor_count; ++handle)
+                {
+                    system.set_position(handle, system.get_position(handle));
+                }
+            };
+
+            benchmark(std::format("TransformSystem::update/{}/all_moved", actor_count), [&]
+            {
+                move_all(transforms);
+                transforms.update();
+                micro_benchmark::do_not_optimize(transforms.get_world_matrix(0));
+            });
+
+            benchmark(std::format("TransformSystem::update/{}/all_moved/{}_threads", actor_count, jobs.get_thread_count()), [&]
+            {
+                move_all(parallel_transforms);
+                parallel_transforms.update();
+                micro_benchmark::do_not_optimize(parallel_transforms.get_world_matrix(0));
+            });
+
+            benchmark(std::format("TransformSystem::update/{}/none_moved", actor_count), [&transforms]
+            {
+                transforms.update();
+                micro_benchmark::do_not_optimize(transforms.get_changed().data());
+            });
+
+            size_t next = 0;
+            benchmark(std::format("Actor::yaw/{}", actor_count), [&]
+            {
+                actors[next].yaw(1.f);
+                next = next + 1 == actors.size() ? 0 : next + 1;
+            });
+        }
+
+        for (const uint32_t object_count : {1000u, 100000u})
+        {
+            // small objects scattered widely, so the camera only sees a fraction of them
+            std::mt19937 random(1);
+            std::uniform_real_distribution<float> coordinate(-5000.f, 5000.f);
+
+            const Camera camera;
+            const auto ubo = camera.get_ubo();
+            const auto frustum = Frustum::from_matrix(ubo.proj * ubo.view);
+
+            FrustumCuller culler;
+            culler.create();
+            FrustumCuller parallel_culler;
+            parallel_culler.create(&jobs);
+            DynamicBvh bvh;
+            std::vector<uint32_t> proxies;
+
+            for (uint32_t i = 0; i < object_count; ++i)
+            {
+                const glm::vec3 center(coordinate(random), coordinate(random), coordinate(random));
+                culler.add(i, {center, 1.f});
+                parallel_culler.add(i, {center, 1.f});
+                proxies.push_back(bvh.insert(i, {center - glm::vec3(1.f), center + glm::vec3(1.f)}));
+            }
+
+            benchmark(std::format("FrustumCuller::cull/{}", object_count), [&]
+            {
+                micro_benchmark::do_not_optimize(culler.cull(frustum).data());
+            });
+
+            benchmark(std::format("FrustumCuller::cull/{}/{}_threads", object_count, jobs.get_thread_count()), [&]
+            {
+                micro_benchmark::do_not_optimize(parallel_culler.cull(frustum).data());
+            });
+
+            std::vector<uint32_t> visible;
+            benchmark(std::format("DynamicBvh::query/{}", object_count), [&]
+            {
+                bvh.query(frustum, visible);
+                micro_benchmark::do_not_optimize(visible.data());
+            });
+
+            // a new random position leaves the fat box, so every update moves a leaf
+            size_t next = 0;
+            benchmark(std::format("DynamicBvh::update/{}", object_count), [&]
+            {
+                const glm::vec3 center(coordinate(random), coordinate(random), coordinate(random));
+                bvh.update(proxies[next], {center - glm::vec3(1.f), center + glm::vec3(1.f)});
+                next = next + 1 == proxies.size() ? 0 : next + 1;
+            });
+
+            culler.clean();
+            parallel_culler.clean();
+        }
+
+        {
+            // the cost of handing out and waiting for a job that does nothing
+            benchmark("JobSystem::run+wait", [&jobs]
+            {
+                JobSystem::Counter done;
+                jobs.run("empty", [] {}, &done);
+                jobs.wait(done);
+            });
+
+            std::vector<float> values(100000, 1.f);
+            benchmark("JobSystem::parallel_for/100000", [&]
+            {
+                jobs.parallel_for("scale", values.size(), 1024, [&values](const size_t begin, const size_t end)
+                {
+                    for (size_t i = begin; i < end; ++i)
+                    {
+                        values[i] *= 1.0001f;
+                    }
+                });
+                micro_benchmark::do_not_optimize(values.data());
+            });
+        }
+
+        jobs.clean();
+
+        {
+            // no controller is connected, so only the mappings are looked up
+            Input input;
+            for (size_t i = 0; i < benchmark_controls.size(); ++i)
+            {
+                input.add_key_mapping(benchmark_controls[i], benchmark_keys[i]);
+                input.add_axis_mapping(benchmark_controls[i], static_cast<int>(i % 6), 0.5f);
+            }
+
+            size_t next = 0;
+            benchmark("Input::get_control_state", [&]
+            {
+                micro_benchmark::do_not_optimize(input.get_control_state(benchmark_controls[next]));
+                next = (next + 1) % benchmark_controls.size();
+            });
+        }
+
+        if (GLFWwindow* window = create_headless_window())
+        {
+            Keyboard keyboard;
+            for (size_t i = 0; i < benchmark_controls.size(); ++i)
+            {
+                keyboard.add_mapping(benchmark_controls[i], benchmark_keys[i]);
+            }
+
+            benchmark("Keyboard::update", [&]
+            {
+                keyboard.update(window);
+            });
+
+            glfwDestroyWindow(window);
+            glfwTerminate();
+        }
+        else
+        {
+            std::cerr << "Skipping Keyboard::update, glfw couldn't create a window without a display\n";
+        }
+
+        const auto json = micro_benchmark::to_json(results);
+
+        if (!options.output_path.empty())
+        {
+            std::ofstream(options.output_path, std::ios::trunc) << json;
+        }
+
+        if (!options.baseline_path.empty())
+        {
+            std::ifstream baseline_file(options.baseline_path);
+            if (!baseline_file)
+            {
+                throw std::runtime_error("Error: unable to read baseline " + options.baseline_path);
+            }
+
+            std::stringstream baseline;
+            baseline << baseline_file.rdbuf();
+
+            const auto regressions = micro_benchmark::find_regressions(results, baseline.str(), options.tolerance);
+            for (const auto& regression : regressions)
+            {
+                std::cerr << "Regression: " << regression << '\n';
+            }
+
+            if (!regressions.empty())
+            {
+                return 2;
+            }
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,73 @@
+﻿#include "SyntheticAssets.h"
+
+#include <cmath>
+#include <format>
+#include <fstream>
+#include <numbers>
+#include <stdexcept>
+#include <vector>
+
+void synthetic_assets::write_sphere(const std::string& path, const uint32_t segments)
+{
+    std::ofstream file(path, std::ios::trunc);
+    if (!file)
+    {
+        throw std::runtime_error("Error: unable to write mesh " + path);
+    }
+
+    const uint32_t rings = segments / 2;
+
+    // (rings + 1) x (segments + 1) grid, the seam is duplicated for the texture coordinates
+    for (uint32_t ring = 0; ring <= rings; ++ring)
+    for (uint32_t segment = 0; segment <= segments; ++segment)
+    {
+        const float u = static_cast<float>(segment) / static_cast<float>(segments);
+        const float v = static_cast<float>(ring) / static_cast<float>(rings);
+        const float theta = u * 2.f * std::numbers::pi_v<float>;
+        const float phi = v * std::numbers::pi_v<float>;
+
+        file << std::format("v {} {} {}\n", std::sin(phi) * std::cos(theta), std::sin(phi) * std::sin(theta), std::cos(phi));
+        file << std::format("vt {} {}\n", u, 1.f - v);
+    }
+
+    for (uint32_t ring = 0; ring < rings; ++ring)
+    for (uint32_t segment = 0; segment < segments; ++segment)
+    {
+        // obj indices start at 1
+        const uint32_t a = ring * (segments + 1) + segment + 1;
+        const uint32_t b = a + segments + 1;
+
+        file << std::format("f {0}/{0} {1}/{1} {2}/{2}\n", a, b, a + 1);
+        file << std::format("f {0}/{0} {1}/{1} {2}/{2}\n", a + 1, b, b + 1);
+    }
+}
+
+void synthetic_assets::write_checkerboard(const std::string& path, const uint32_t size, const uint32_t index)
+{
+    // binary ppm, which stb_image reads without any extra dependency
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file)
+    {
+        throw std::runtime_error("Error: unable to write texture " + path);
+    }
+
+    file << "P6\n" << size << " " << size << "\n255\n";
+
+    const uint8_t red = static_cast<uint8_t>(64 + index * 37 % 192);
+    const uint8_t green = static_cast<uint8_t>(64 + index * 71 % 192);
+    const uint8_t blue = static_cast<uint8_t>(64 + index * 113 % 192);
+
+    std::vector<uint8_t> row(static_cast<size_t>(size) * 3);
+    for (uint32_t y = 0; y < size; ++y)
+    {
+        for (uint32_t x = 0; x < size; ++x)
+        {
+            const bool light = ((x / 8) + (y / 8)) % 2 == 0;
+            row[x * 3 + 0] = light ? red : red / 4;
+            row[x * 3 + 1] = light ? green : green / 4;
+            row[x * 3 + 2] = light ? blue : blue / 4;
+        }
+
+        file.write(reinterpret_cast<const char*>(row.data()), static_cast<std::streamsize>(row.size()));
+    }
+}
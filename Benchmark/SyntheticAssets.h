@@ -0,0 +1,16 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <string>
+
+// Procedural assets for the benchmarks, so they don't depend on any files in the repository.
+namespace synthetic_assets
+{
+
+// unit uv sphere as an obj with positions and texture coordinates, segments^2 triangles
+void write_sphere(const std::string& path, uint32_t segments);
+
+// size x size binary ppm checkerboard, tinted differently for every index
+void write_checkerboard(const std::string& path, uint32_t size, uint32_t index);
+
+}
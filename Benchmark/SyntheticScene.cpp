@@ -0,0 +1,123 @@
+﻿#include "SyntheticScene.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <format>
+
+#include "SyntheticAssets.h"
+
+void SyntheticScene::create(GraphicsRunner& runner, const SceneParameters& parameters, const std::string& asset_directory)
+{
+    parameters_ = parameters;
+    random_.seed(parameters.seed);
+    transforms_.create(&runner.get_job_system());
+
+    std::filesystem::create_directories(asset_directory);
+
+    for (uint32_t i = 0; i < parameters_.mesh_count; ++i)
+    {
+        const auto segments = 8 + 8 * i;
+        const auto path = std::format("{}/sphere_{}.obj", asset_directory, segments);
+        if (!std::filesystem::exists(path))
+        {
+            synthetic_assets::write_sphere(path, segments);
+        }
+        mesh_paths_.push_back(path);
+    }
+
+    for (uint32_t i = 0; i < parameters_.texture_count; ++i)
+    {
+        // 64 to 1024 texels, so some textures stream and some don't
+        const uint32_t size = 64u << (i % 5);
+        const auto path = std::format("{}/checker_{}_{}.ppm", asset_directory, size, i);
+        if (!std::filesystem::exists(path))
+        {
+            synthetic_assets::write_checkerboard(path, size, i);
+        }
+        texture_paths_.push_back(path);
+    }
+
+    // the camera starts at the origin looking down +y
+    std::uniform_real_distribution forward(10.f, 200.f);
+    std::uniform_real_distribution unit(-1.f, 1.f);
+    std::uniform_real_distribution angle(0.f, 360.f);
+    std::uniform_real_distribution chance(0.f, 1.f);
+
+    const glm::vec3 world_up(0.f, 0.f, 1.f);
+
+    std::vector<GraphicsRunner::ResourceInfo> infos;
+    for (uint32_t i = 0; i < parameters_.actor_count; ++i)
+    {
+        const float distance = forward(random_);
+        const glm::vec3 position(unit(random_) * distance, distance, unit(random_) * distance * 0.75f);
+
+        SceneActor actor{
+            Actor(transforms_, position, glm::vec3(1.f), world_up, angle(random_), angle(random_), angle(random_)),
+            0,
+            i % parameters_.mesh_count,
+            i % parameters_.texture_count,
+            chance(random_) < parameters_.dynamic_ratio,
+        };
+
+        infos.push_back(get_resource_info(actor));
+        actors_.push_back(std::move(actor));
+    }
+
+    const auto resource_ids = runner.register_resources(infos);
+    for (size_t i = 0; i < actors_.size(); ++i)
+    {
+        actors_[i].resource_id = resource_ids[i];
+
+        const auto handle = actors_[i].actor.get_handle();
+        resources_by_transform_.resize(std::max<size_t>(resources_by_transform_.size(), handle + 1));
+        resources_by_transform_[handle] = resource_ids[i];
+    }
+}
+
+void SyntheticScene::clean(GraphicsRunner& runner)
+{
+    for (const auto& actor : actors_)
+    {
+        runner.unregister_resource(actor.resource_id);
+    }
+
+    actors_.clear();
+    resources_by_transform_.clear();
+    transforms_.clean();
+}
+
+void SyntheticScene::update(GraphicsRunner& runner, const float delta_time)
+{
+    for (auto& actor : actors_)
+    {
+        if (actor.dynamic)
+        {
+            actor.actor.yaw(45.f * delta_time);
+            actor.actor.roll(30.f * delta_time);
+        }
+    }
+
+    // only the actors that moved are passed on, static ones cost nothing
+    transforms_.update();
+
+    for (const auto handle : transforms_.get_changed())
+    {
+        runner.update_resource(resources_by_transform_[handle], transforms_.get_world_matrix(handle));
+    }
+
+    pending_churn_ += parameters_.churn_rate * static_cast<float>(actors_.size());
+
+    std::uniform_int_distribution<size_t> pick(0, actors_.empty() ? 0 : actors_.size() - 1);
+    for (; pending_churn_ >= 1.f && !actors_.empty(); pending_churn_ -= 1.f)
+    {
+        auto& actor = actors_[pick(random_)];
+        runner.unregister_resource(actor.resource_id);
+        actor.resource_id = runner.register_resource(get_resource_info(actor));
+        resources_by_transform_[actor.actor.get_handle()] = actor.resource_id;
+    }
+}
+
+GraphicsRunner::ResourceInfo SyntheticScene::get_resource_info(const SceneActor& actor) const
+{
+    return {mesh_paths_[actor.mesh], texture_paths_[actor.texture], actor.actor.get_transform()};
+}
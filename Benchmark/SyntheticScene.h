@@ -0,0 +1,59 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../Actors/Actor.h"
+#include "../Actors/TransformSystem.h"
+#include "../Graphics/GraphicsRunner.h"
+
+struct SceneParameters
+{
+    uint32_t actor_count = 1000;
+    // unique meshes and textures the actors are spread over
+    uint32_t mesh_count = 8;
+    uint32_t texture_count = 8;
+    // fraction of actors that move every frame, the rest never change
+    float dynamic_ratio = 0.25f;
+    // fraction of actors unregistered and registered again per frame
+    float churn_rate = 0.0f;
+    uint32_t seed = 1;
+};
+
+// A generated scene of actors over a few procedural meshes (uv spheres of
+// different density) and textures (checkerboards of different sizes). The
+// assets are written to `asset_directory` once and reused by later runs.
+class SyntheticScene
+{
+public:
+    void create(GraphicsRunner& runner, const SceneParameters& parameters, const std::string& asset_directory);
+    void clean(GraphicsRunner& runner);
+
+    // Moves the dynamic actors and churns resources for one frame.
+    void update(GraphicsRunner& runner, float delta_time);
+
+private:
+    struct SceneActor
+    {
+        Actor actor;
+        uint32_t resource_id;
+        uint32_t mesh;
+        uint32_t texture;
+        bool dynamic;
+    };
+
+    SceneParameters parameters_;
+    TransformSystem transforms_;
+    std::vector<std::string> mesh_paths_;
+    std::vector<std::string> texture_paths_;
+    std::vector<SceneActor> actors_;
+    // the resource of each actor, by transform handle
+    std::vector<uint32_t> resources_by_transform_;
+    std::mt19937 random_;
+    // churn carried over to the next frame when less than one actor is due
+    float pending_churn_ = 0.0f;
+
+    GraphicsRunner::ResourceInfo get_resource_info(const SceneActor& actor) const;
+};
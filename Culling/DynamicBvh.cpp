@@ -0,0 +1,552 @@
+﻿#include "DynamicBvh.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+
+BoundingBox merge(const BoundingBox& a, const BoundingBox& b)
+{
+    return {glm::min(a.min, b.min), glm::max(a.max, b.max)};
+}
+
+// half of it really, only ever compared
+float surface_area(const BoundingBox& box)
+{
+    const glm::vec3 size = box.max - box.min;
+    return size.x * size.y + size.y * size.z + size.z * size.x;
+}
+
+bool contains(const BoundingBox& outer, const BoundingBox& inner)
+{
+    return glm::all(glm::lessThanEqual(outer.min, inner.min)) && glm::all(glm::greaterThanEqual(outer.max, inner.max));
+}
+
+BoundingBox fatten(const BoundingBox& box, const float ratio, const float minimum_margin)
+{
+    const glm::vec3 margin = glm::max((box.max - box.min) * ratio, glm::vec3(minimum_margin));
+    return {box.min - margin, box.max + margin};
+}
+
+enum class Containment
+{
+    outside,
+    intersecting,
+    inside,
+};
+
+// Only the planes whose bit is set in `planes` are tested, the ones the box is
+// completely inside of are cleared so its children can skip them.
+Containment classify(const Frustum& frustum, const BoundingBox& box, uint32_t& planes)
+{
+    const glm::vec3 center = (box.min + box.max) * 0.5f;
+    const glm::vec3 extent = (box.max - box.min) * 0.5f;
+
+    for (uint32_t i = 0; i < frustum.planes.size(); ++i)
+    {
+        if ((planes & (1u << i)) == 0)
+        {
+            continue;
+        }
+
+        const auto& plane = frustum.planes[i];
+        const glm::vec3 normal(plane);
+        const float distance = glm::dot(normal, center) + plane.w;
+        const float radius = glm::dot(extent, glm::abs(normal));
+
+        if (distance < -radius)
+        {
+            return Containment::outside;
+        }
+
+        if (distance >= radius)
+        {
+            planes &= ~(1u << i);
+        }
+    }
+
+    return planes == 0 ? Containment::inside : Containment::intersecting;
+}
+
+bool overlaps(const BoundingSphere& sphere, const BoundingBox& box)
+{
+    const glm::vec3 offset = glm::clamp(sphere.center, box.min, box.max) - sphere.center;
+    return glm::dot(offset, offset) <= sphere.radius * sphere.radius;
+}
+
+// Slab test, `inverse_direction` may hold infinities for axis aligned rays.
+bool intersects(const glm::vec3& origin, const glm::vec3& inverse_direction, const float max_distance,
+                const BoundingBox& box, float& distance)
+{
+    const glm::vec3 t0 = (box.min - origin) * inverse_direction;
+    const glm::vec3 t1 = (box.max - origin) * inverse_direction;
+    const glm::vec3 near = glm::min(t0, t1);
+    const glm::vec3 far = glm::max(t0, t1);
+
+    // std::max/min return their first argument when the second is NaN, which
+    // drops the slab of a zero direction component whose ray starts on its plane
+    const float enter = std::max(std::max(std::max(0.f, near.x), near.y), near.z);
+    const float exit = std::min(std::min(std::min(max_distance, far.x), far.y), far.z);
+
+    distance = enter;
+    return enter <= exit;
+}
+
+}
+
+uint32_t DynamicBvh::insert(const uint32_t id, const BoundingBox& box)
+{
+    const uint32_t leaf = allocate_node();
+    nodes_[leaf].box = fatten(box, fat_ratio_, fat_margin_);
+    nodes_[leaf].tight = box;
+    nodes_[leaf].id = id;
+    nodes_[leaf].height = 0;
+
+    insert_leaf(leaf);
+    ++leaf_count_;
+
+    return leaf;
+}
+
+bool DynamicBvh::update(const uint32_t proxy, const BoundingBox& box)
+{
+    auto& leaf = nodes_[proxy];
+    leaf.tight = box;
+
+    const BoundingBox fat = fatten(box, fat_ratio_, fat_margin_);
+
+    // a fat box that has become much larger than the object (it shrank) is replaced as well
+    if (contains(leaf.box, box) && surface_area(leaf.box) <= 4.f * surface_area(fat))
+    {
+        return false;
+    }
+
+    remove_leaf(proxy);
+    nodes_[proxy].box = fat;
+    insert_leaf(proxy);
+
+    return true;
+}
+
+void DynamicBvh::remove(const uint32_t proxy)
+{
+    remove_leaf(proxy);
+    free_node(proxy);
+    --leaf_count_;
+}
+
+void DynamicBvh::clear()
+{
+    nodes_.clear();
+    root_ = null_node_;
+    free_list_ = null_node_;
+    leaf_count_ = 0;
+}
+
+void DynamicBvh::query(const Frustum& frustum, std::vector<uint32_t>& ids)
+{
+    ids.clear();
+    statistics_ = {};
+
+    if (root_ == null_node_)
+    {
+        return;
+    }
+
+    // the plane mask of a node travels with it on the stack
+    constexpr uint32_t all_planes = (1u << 6) - 1;
+    stack_.clear();
+    stack_.push_back(root_);
+    stack_.push_back(all_planes);
+
+    while (!stack_.empty())
+    {
+        uint32_t planes = stack_.back();
+        stack_.pop_back();
+        const uint32_t index = stack_.back();
+        stack_.pop_back();
+
+        const auto& node = nodes_[index];
+        ++statistics_.tested;
+
+        const auto containment = classify(frustum, node.is_leaf() ? node.tight : node.box, planes);
+
+        if (containment == Containment::outside)
+        {
+            continue;
+        }
+
+        if (node.is_leaf())
+        {
+            ids.push_back(node.id);
+        }
+        else if (containment == Containment::inside)
+        {
+            collect_leaves(index, ids);
+        }
+        else
+        {
+            stack_.push_back(node.left);
+            stack_.push_back(planes);
+            stack_.push_back(node.right);
+            stack_.push_back(planes);
+        }
+    }
+
+    statistics_.found = static_cast<uint32_t>(ids.size());
+}
+
+void DynamicBvh::query(const BoundingSphere& sphere, std::vector<uint32_t>& ids)
+{
+    ids.clear();
+    statistics_ = {};
+
+    if (root_ == null_node_)
+    {
+        return;
+    }
+
+    stack_.clear();
+    stack_.push_back(root_);
+
+    while (!stack_.empty())
+    {
+        const auto& node = nodes_[stack_.back()];
+        stack_.pop_back();
+        ++statistics_.tested;
+
+        if (!overlaps(sphere, node.is_leaf() ? node.tight : node.box))
+        {
+            continue;
+        }
+
+        if (node.is_leaf())
+        {
+            ids.push_back(node.id);
+        }
+        else
+        {
+            stack_.push_back(node.left);
+            stack_.push_back(node.right);
+        }
+    }
+
+    statistics_.found = static_cast<uint32_t>(ids.size());
+}
+
+void DynamicBvh::raycast(const glm::vec3& origin, const glm::vec3& direction, const float max_distance, std::vector<RayHit>& hits)
+{
+    hits.clear();
+    statistics_ = {};
+
+    if (root_ == null_node_)
+    {
+        return;
+    }
+
+    const glm::vec3 inverse_direction = 1.f / direction;
+
+    stack_.clear();
+    stack_.push_back(root_);
+
+    while (!stack_.empty())
+    {
+        const auto& node = nodes_[stack_.back()];
+        stack_.pop_back();
+        ++statistics_.tested;
+
+        float distance;
+        if (!intersects(origin, inverse_direction, max_distance, node.is_leaf() ? node.tight : node.box, distance))
+        {
+            continue;
+        }
+
+        if (node.is_leaf())
+        {
+            hits.push_back({node.id, distance});
+        }
+        else
+        {
+            stack_.push_back(node.left);
+            stack_.push_back(node.right);
+        }
+    }
+
+    std::ranges::sort(hits, {}, &RayHit::distance);
+    statistics_.found = static_cast<uint32_t>(hits.size());
+}
+
+uint32_t DynamicBvh::get_height() const
+{
+    return root_ == null_node_ ? 0 : static_cast<uint32_t>(nodes_[root_].height);
+}
+
+uint32_t DynamicBvh::allocate_node()
+{
+    if (free_list_ == null_node_)
+    {
+        nodes_.emplace_back();
+        return static_cast<uint32_t>(nodes_.size() - 1);
+    }
+
+    const uint32_t node = free_list_;
+    free_list_ = nodes_[node].parent;
+    nodes_[node] = Node{};
+    return node;
+}
+
+void DynamicBvh::free_node(const uint32_t node)
+{
+    nodes_[node].parent = free_list_;
+    nodes_[node].left = null_node_;
+    nodes_[node].right = null_node_;
+    nodes_[node].height = -1;
+    free_list_ = node;
+}
+
+void DynamicBvh::insert_leaf(const uint32_t leaf)
+{
+    if (root_ == null_node_)
+    {
+        root_ = leaf;
+        nodes_[leaf].parent = null_node_;
+        return;
+    }
+
+    const uint32_t sibling = find_best_sibling(nodes_[leaf].box);
+    const uint32_t old_parent = nodes_[sibling].parent;
+
+    // may grow nodes_, so nothing above holds a reference into it
+    const uint32_t new_parent = allocate_node();
+    nodes_[new_parent].parent = old_parent;
+    nodes_[new_parent].box = merge(nodes_[sibling].box, nodes_[leaf].box);
+    nodes_[new_parent].left = sibling;
+    nodes_[new_parent].right = leaf;
+    nodes_[new_parent].height = nodes_[sibling].height + 1;
+
+    if (old_parent == null_node_)
+    {
+        root_ = new_parent;
+    }
+    else if (nodes_[old_parent].left == sibling)
+    {
+        nodes_[old_parent].left = new_parent;
+    }
+    else
+    {
+        nodes_[old_parent].right = new_parent;
+    }
+
+    nodes_[sibling].parent = new_parent;
+    nodes_[leaf].parent = new_parent;
+
+    refit_ancestors(new_parent);
+}
+
+void DynamicBvh::remove_leaf(const uint32_t leaf)
+{
+    if (leaf == root_)
+    {
+        root_ = null_node_;
+        return;
+    }
+
+    const uint32_t parent = nodes_[leaf].parent;
+    const uint32_t grandparent = nodes_[parent].parent;
+    const uint32_t sibling = nodes_[parent].left == leaf ? nodes_[parent].right : nodes_[parent].left;
+
+    // the sibling takes the parent's place
+    if (grandparent == null_node_)
+    {
+        root_ = sibling;
+    }
+    else if (nodes_[grandparent].left == parent)
+    {
+        nodes_[grandparent].left = sibling;
+    }
+    else
+    {
+        nodes_[grandparent].right = sibling;
+    }
+
+    nodes_[sibling].parent = grandparent;
+    free_node(parent);
+
+    if (grandparent != null_node_)
+    {
+        refit_ancestors(grandparent);
+    }
+}
+
+uint32_t DynamicBvh::find_best_sibling(const BoundingBox& box)
+{
+    // Branch and bound over the cost of pairing the box with a node: the area of
+    // their union, plus what every ancestor grows by. A subtree's lower bound is
+    // the box's own area plus what its root's ancestors (the root included) grow by.
+    const float box_area = surface_area(box);
+
+    uint32_t best = root_;
+    float best_cost = surface_area(merge(nodes_[root_].box, box));
+
+    sibling_candidates_.clear();
+    sibling_candidates_.push_back({root_, 0.f});
+
+    while (!sibling_candidates_.empty())
+    {
+        const auto [index, inherited_cost] = sibling_candidates_.back();
+        sibling_candidates_.pop_back();
+
+        const auto& node = nodes_[index];
+        const float direct_cost = surface_area(merge(node.box, box));
+        const float cost = direct_cost + inherited_cost;
+
+        if (cost < best_cost)
+        {
+            best = index;
+            best_cost = cost;
+        }
+
+        if (node.is_leaf())
+        {
+            continue;
+        }
+
+        const float child_inherited_cost = inherited_cost + direct_cost - surface_area(node.box);
+        if (box_area + child_inherited_cost < best_cost)
+        {
+            sibling_candidates_.push_back({node.left, child_inherited_cost});
+            sibling_candidates_.push_back({node.right, child_inherited_cost});
+        }
+    }
+
+    return best;
+}
+
+void DynamicBvh::refit_ancestors(uint32_t node)
+{
+    while (node != null_node_)
+    {
+        auto& current = nodes_[node];
+        current.box = merge(nodes_[current.left].box, nodes_[current.right].box);
+        current.height = 1 + std::max(nodes_[current.left].height, nodes_[current.right].height);
+
+        rotate(node);
+
+        node = nodes_[node].parent;
+    }
+}
+
+void DynamicBvh::rotate(const uint32_t node)
+{
+    const uint32_t b = nodes_[node].left;
+    const uint32_t c = nodes_[node].right;
+
+    const auto& node_b = nodes_[b];
+    const auto& node_c = nodes_[c];
+
+    if (node_b.is_leaf() && node_c.is_leaf())
+    {
+        return;
+    }
+
+    // Swapping b with one of c's children (f, g) only changes c's area, and the
+    // other way around, so the best rotation is the one that shrinks its node most.
+    float best_area = 0.f;
+    uint32_t best_child = null_node_;
+    uint32_t best_grandchild = null_node_;
+
+    const auto consider = [&](const uint32_t child, const uint32_t other)
+    {
+        const auto& other_node = nodes_[other];
+        if (other_node.is_leaf())
+        {
+            return;
+        }
+
+        const float area = surface_area(other_node.box);
+        const auto& box = nodes_[child].box;
+
+        // child moves down next to the grandchild that stays
+        const float left_area = surface_area(merge(box, nodes_[other_node.right].box));
+        const float right_area = surface_area(merge(box, nodes_[other_node.left].box));
+
+        if (area - left_area > best_area)
+        {
+            best_area = area - left_area;
+            best_child = child;
+            best_grandchild = other_node.left;
+        }
+
+        if (area - right_area > best_area)
+        {
+            best_area = area - right_area;
+            best_child = child;
+            best_grandchild = other_node.right;
+        }
+    };
+
+    consider(b, c);
+    consider(c, b);
+
+    if (best_child != null_node_)
+    {
+        swap(node, best_child, best_grandchild);
+    }
+}
+
+void DynamicBvh::swap(const uint32_t parent, const uint32_t child, const uint32_t grandchild)
+{
+    const uint32_t other = nodes_[grandchild].parent;
+
+    if (nodes_[parent].left == child)
+    {
+        nodes_[parent].left = grandchild;
+    }
+    else
+    {
+        nodes_[parent].right = grandchild;
+    }
+
+    if (nodes_[other].left == grandchild)
+    {
+        nodes_[other].left = child;
+    }
+    else
+    {
+        nodes_[other].right = child;
+    }
+
+    nodes_[grandchild].parent = parent;
+    nodes_[child].parent = other;
+
+    auto& other_node = nodes_[other];
+    other_node.box = merge(nodes_[other_node.left].box, nodes_[other_node.right].box);
+    other_node.height = 1 + std::max(nodes_[other_node.left].height, nodes_[other_node.right].height);
+
+    auto& parent_node = nodes_[parent];
+    parent_node.height = 1 + std::max(nodes_[parent_node.left].height, nodes_[parent_node.right].height);
+}
+
+void DynamicBvh::collect_leaves(const uint32_t node, std::vector<uint32_t>& ids)
+{
+    // shares the stack with query(), whose entries below `base` are left alone
+    const size_t base = stack_.size();
+    stack_.push_back(node);
+
+    while (stack_.size() > base)
+    {
+        const auto& current = nodes_[stack_.back()];
+        stack_.pop_back();
+
+        if (current.is_leaf())
+        {
+            ids.push_back(current.id);
+        }
+        else
+        {
+            stack_.push_back(current.left);
+            stack_.push_back(current.right);
+        }
+    }
+}
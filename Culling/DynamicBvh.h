@@ -0,0 +1,105 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "Frustum.h"
+#include "../Models/Bounds.h"
+
+// A bounding volume hierarchy over world space boxes that is kept up to date as
+// they move, so a query only visits the parts of the scene it touches. Leaves
+// are inserted next to the sibling that grows the tree's surface area the
+// least, and every node on the way back up is rotated when swapping grandchildren
+// shrinks it. Each leaf keeps a fattened copy of its box in the tree: as long as
+// the object stays inside it, update() only stores the new box.
+class DynamicBvh
+{
+public:
+    struct Statistics
+    {
+        // boxes tested by the most recent query
+        uint32_t tested = 0;
+        uint32_t found = 0;
+    };
+
+    struct RayHit
+    {
+        uint32_t id;
+        // where the ray enters the box, in units of the ray direction
+        float distance;
+    };
+
+    // Returns the proxy of the new box. `id` is what the queries report for it.
+    uint32_t insert(uint32_t id, const BoundingBox& box);
+    // Returns true if the proxy had to move in the tree.
+    bool update(uint32_t proxy, const BoundingBox& box);
+    void remove(uint32_t proxy);
+    void clear();
+
+    // Ids of every box that touches the frustum, sphere or ray, in no particular
+    // order for the first two and nearest first for the ray. Queries share a
+    // traversal stack, so only one may run at a time.
+    void query(const Frustum& frustum, std::vector<uint32_t>& ids);
+    void query(const BoundingSphere& sphere, std::vector<uint32_t>& ids);
+    void raycast(const glm::vec3& origin, const glm::vec3& direction, float max_distance, std::vector<RayHit>& hits);
+
+    [[nodiscard]] Statistics get_statistics() const { return statistics_; }
+    [[nodiscard]] uint32_t get_height() const;
+    [[nodiscard]] uint32_t get_leaf_count() const { return leaf_count_; }
+
+private:
+    static constexpr uint32_t null_node_ = std::numeric_limits<uint32_t>::max();
+    // fat boxes grow by this fraction of their size on each side, but at least by
+    // the margin, or a flat or point sized box would be reinserted on every move
+    static constexpr float fat_ratio_ = 0.1f;
+    static constexpr float fat_margin_ = 0.05f;
+
+    struct Node
+    {
+        // fattened for leaves, the union of the children for the rest
+        BoundingBox box;
+        // the box last given to insert() or update(), leaves only
+        BoundingBox tight;
+        // the next free node while the node is unused
+        uint32_t parent = null_node_;
+        uint32_t left = null_node_;
+        uint32_t right = null_node_;
+        uint32_t id = 0;
+        // leaves are 0, unused nodes -1
+        int32_t height = -1;
+
+        [[nodiscard]] bool is_leaf() const { return left == null_node_; }
+    };
+
+    std::vector<Node> nodes_;
+    uint32_t root_ = null_node_;
+    uint32_t free_list_ = null_node_;
+    uint32_t leaf_count_ = 0;
+
+    struct SiblingCandidate
+    {
+        uint32_t node;
+        // what the candidate's ancestors grow by when the box is added below them
+        float inherited_cost;
+    };
+
+    std::vector<uint32_t> stack_;
+    std::vector<SiblingCandidate> sibling_candidates_;
+    Statistics statistics_;
+
+    uint32_t allocate_node();
+    void free_node(uint32_t node);
+
+    void insert_leaf(uint32_t leaf);
+    void remove_leaf(uint32_t leaf);
+    uint32_t find_best_sibling(const BoundingBox& box);
+    // refits and rotates every node from `node` to the root
+    void refit_ancestors(uint32_t node);
+    void rotate(uint32_t node);
+    // swaps `child` of `parent` with `grandchild`, a child of parent's other child
+    void swap(uint32_t parent, uint32_t child, uint32_t grandchild);
+
+    void collect_leaves(uint32_t node, std::vector<uint32_t>& ids);
+};
@@ -0,0 +1,51 @@
+﻿#include "Frustum.h"
+
+Frustum Frustum::from_matrix(const glm::mat4& view_projection)
+{
+    // glm is column major, clip = row · world for every row
+    const auto row = [&view_projection](const int index)
+    {
+        return glm::vec4(view_projection[0][index], view_projection[1][index],
+                         view_projection[2][index], view_projection[3][index]);
+    };
+
+    Frustum frustum;
+    frustum.planes[0] = row(3) + row(0);
+    frustum.planes[1] = row(3) - row(0);
+    frustum.planes[2] = row(3) + row(1);
+    frustum.planes[3] = row(3) - row(1);
+    frustum.planes[4] = row(2);
+    frustum.planes[5] = row(3) - row(2);
+
+    // normalized so the plane distance can be compared against a radius
+    for (auto& plane : frustum.planes)
+    {
+        const float length = glm::length(glm::vec3(plane));
+        if (length > 1e-6f)
+        {
+            plane /= length;
+        }
+    }
+
+    return frustum;
+}
+
+Frustum Frustum::everything()
+{
+    Frustum frustum;
+    frustum.planes.fill(glm::vec4(0.f, 0.f, 0.f, 1.f));
+    return frustum;
+}
+
+bool Frustum::intersects(const BoundingSphere& sphere) const
+{
+    for (const auto& plane : planes)
+    {
+        if (glm::dot(glm::vec3(plane), sphere.center) + plane.w < -sphere.radius)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,21 @@
+﻿#pragma once
+
+#include <array>
+#include <glm/glm.hpp>
+
+#include "../Models/Bounds.h"
+
+// Six planes (left, right, bottom, top, near, far) with normals pointing inwards,
+// so a point p is inside when dot(plane.xyz, p) + plane.w >= 0 for all of them.
+struct Frustum
+{
+    std::array<glm::vec4, 6> planes;
+
+    // Extracts the planes of a Vulkan (zero to one depth) projection * view
+    // matrix. An infinite far plane comes out with a zero normal, and always passes.
+    static Frustum from_matrix(const glm::mat4& view_projection);
+    // passes every sphere
+    static Frustum everything();
+
+    [[nodiscard]] bool intersects(const BoundingSphere& sphere) const;
+};
@@ -0,0 +1,261 @@
+﻿#include "FrustumCuller.h"
+
+#include <algorithm>
+
+#include "../Profiling/CpuProfiler.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define FRUSTUM_CULLER_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// msvc accepts avx intrinsics anywhere, gcc and clang only in functions compiled for avx
+#if defined(FRUSTUM_CULLER_X86) && (defined(__GNUC__) || defined(__clang__))
+#define AVX_FUNCTION __attribute__((target("avx")))
+#else
+#define AVX_FUNCTION
+#endif
+
+namespace
+{
+
+bool is_avx_supported()
+{
+#if defined(FRUSTUM_CULLER_X86) && defined(_MSC_VER)
+    int registers[4];
+    __cpuid(registers, 1);
+    const bool avx = (registers[2] & (1 << 28)) != 0;
+    const bool os_saves_registers = (registers[2] & (1 << 27)) != 0 && (_xgetbv(0) & 6) == 6;
+    return avx && os_saves_registers;
+#elif defined(FRUSTUM_CULLER_X86)
+    // also checks that the os saves the ymm registers
+    return __builtin_cpu_supports("avx");
+#else
+    return false;
+#endif
+}
+
+// appends ids[base + i] for every set bit i of the lane mask
+void append_visible(uint32_t mask, const uint32_t* ids, const size_t base, std::vector<uint32_t>& visible)
+{
+    while (mask != 0)
+    {
+#ifdef _MSC_VER
+        unsigned long lane;
+        _BitScanForward(&lane, mask);
+#else
+        const auto lane = static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+        visible.push_back(ids[base + lane]);
+        mask &= mask - 1;
+    }
+}
+
+}
+
+void FrustumCuller::create(JobSystem* jobs)
+{
+    avx_supported_ = is_avx_supported();
+    jobs_ = jobs;
+}
+
+void FrustumCuller::clean()
+{
+    jobs_ = nullptr;
+}
+
+uint32_t FrustumCuller::add(const uint32_t id, const BoundingSphere& sphere)
+{
+    center_x_.push_back(sphere.center.x);
+    center_y_.push_back(sphere.center.y);
+    center_z_.push_back(sphere.center.z);
+    radius_.push_back(sphere.radius);
+    ids_.push_back(id);
+
+    return static_cast<uint32_t>(ids_.size() - 1);
+}
+
+void FrustumCuller::update(const uint32_t slot, const BoundingSphere& sphere)
+{
+    center_x_[slot] = sphere.center.x;
+    center_y_[slot] = sphere.center.y;
+    center_z_[slot] = sphere.center.z;
+    radius_[slot] = sphere.radius;
+}
+
+std::optional<uint32_t> FrustumCuller::remove(const uint32_t slot)
+{
+    const size_t last = ids_.size() - 1;
+    std::optional<uint32_t> moved;
+
+    if (slot != last)
+    {
+        center_x_[slot] = center_x_[last];
+        center_y_[slot] = center_y_[last];
+        center_z_[slot] = center_z_[last];
+        radius_[slot] = radius_[last];
+        ids_[slot] = ids_[last];
+        moved = ids_[slot];
+    }
+
+    center_x_.pop_back();
+    center_y_.pop_back();
+    center_z_.pop_back();
+    radius_.pop_back();
+    ids_.pop_back();
+
+    return moved;
+}
+
+const std::vector<uint32_t>& FrustumCuller::cull(const Frustum& frustum)
+{
+    PROFILE_ZONE("frustum culling");
+
+    visible_.clear();
+    const size_t count = ids_.size();
+
+    frustum_ = frustum;
+
+    if (count < parallel_threshold_ || jobs_ == nullptr || jobs_->get_thread_count() < 2)
+    {
+        cull_range(0, count, visible_);
+    }
+    else
+    {
+        // chunks are a multiple of 8 so only the last one has a partial simd group
+        const size_t threads = jobs_->get_thread_count();
+        const size_t chunk_size = ((count + threads - 1) / threads + 7) / 8 * 8;
+        const size_t chunk_count = (count + chunk_size - 1) / chunk_size;
+        chunk_visible_.resize(chunk_count);
+
+        jobs_->parallel_for("frustum culling chunk", chunk_count, 1, [this, count, chunk_size](const size_t first, const size_t last)
+        {
+            for (size_t chunk = first; chunk < last; ++chunk)
+            {
+                const size_t begin = chunk * chunk_size;
+                chunk_visible_[chunk].clear();
+                cull_range(begin, std::min(begin + chunk_size, count), chunk_visible_[chunk]);
+            }
+        });
+
+        for (size_t chunk = 0; chunk < chunk_count; ++chunk)
+        {
+            visible_.insert(visible_.end(), chunk_visible_[chunk].begin(), chunk_visible_[chunk].end());
+        }
+    }
+
+    statistics_.tested = static_cast<uint32_t>(count);
+    statistics_.culled = static_cast<uint32_t>(count - visible_.size());
+
+    return visible_;
+}
+
+const char* FrustumCuller::get_instruction_set() const
+{
+#ifdef FRUSTUM_CULLER_X86
+    return avx_supported_ ? "avx" : "sse";
+#else
+    return "scalar";
+#endif
+}
+
+void FrustumCuller::cull_range(const size_t begin, const size_t end, std::vector<uint32_t>& visible) const
+{
+#ifdef FRUSTUM_CULLER_X86
+    if (avx_supported_)
+    {
+        cull_range_avx(begin, end, visible);
+    }
+    else
+    {
+        cull_range_sse(begin, end, visible);
+    }
+#else
+    cull_range_scalar(begin, end, visible);
+#endif
+}
+
+void FrustumCuller::cull_range_scalar(const size_t begin, const size_t end, std::vector<uint32_t>& visible) const
+{
+    for (size_t i = begin; i < end; ++i)
+    {
+        if (frustum_.intersects({{center_x_[i], center_y_[i], center_z_[i]}, radius_[i]}))
+        {
+            visible.push_back(ids_[i]);
+        }
+    }
+}
+
+#ifdef FRUSTUM_CULLER_X86
+
+void FrustumCuller::cull_range_sse(const size_t begin, const size_t end, std::vector<uint32_t>& visible) const
+{
+    size_t i = begin;
+
+    for (; i + 4 <= end; i += 4)
+    {
+        const __m128 x = _mm_loadu_ps(&center_x_[i]);
+        const __m128 y = _mm_loadu_ps(&center_y_[i]);
+        const __m128 z = _mm_loadu_ps(&center_z_[i]);
+        const __m128 negative_radius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&radius_[i]));
+
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+
+        for (const auto& plane : frustum_.planes)
+        {
+            __m128 distance = _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(plane.x)), _mm_set1_ps(plane.w));
+            distance = _mm_add_ps(distance, _mm_mul_ps(y, _mm_set1_ps(plane.y)));
+            distance = _mm_add_ps(distance, _mm_mul_ps(z, _mm_set1_ps(plane.z)));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negative_radius));
+        }
+
+        append_visible(static_cast<uint32_t>(_mm_movemask_ps(inside)), ids_.data(), i, visible);
+    }
+
+    cull_range_scalar(i, end, visible);
+}
+
+AVX_FUNCTION void FrustumCuller::cull_range_avx(const size_t begin, const size_t end, std::vector<uint32_t>& visible) const
+{
+    size_t i = begin;
+
+    for (; i + 8 <= end; i += 8)
+    {
+        const __m256 x = _mm256_loadu_ps(&center_x_[i]);
+        const __m256 y = _mm256_loadu_ps(&center_y_[i]);
+        const __m256 z = _mm256_loadu_ps(&center_z_[i]);
+        const __m256 negative_radius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(&radius_[i]));
+
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+
+        for (const auto& plane : frustum_.planes)
+        {
+            __m256 distance = _mm256_add_ps(_mm256_mul_ps(x, _mm256_set1_ps(plane.x)), _mm256_set1_ps(plane.w));
+            distance = _mm256_add_ps(distance, _mm256_mul_ps(y, _mm256_set1_ps(plane.y)));
+            distance = _mm256_add_ps(distance, _mm256_mul_ps(z, _mm256_set1_ps(plane.z)));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negative_radius, _CMP_GE_OQ));
+        }
+
+        append_visible(static_cast<uint32_t>(_mm256_movemask_ps(inside)), ids_.data(), i, visible);
+    }
+
+    // the remaining 0 to 7 spheres
+    cull_range_sse(i, end, visible);
+}
+
+#else
+
+void FrustumCuller::cull_range_sse(const size_t begin, const size_t end, std::vector<uint32_t>& visible) const
+{
+    cull_range_scalar(begin, end, visible);
+}
+
+void FrustumCuller::cull_range_avx(const size_t begin, const size_t end, std::vector<uint32_t>& visible) const
+{
+    cull_range_scalar(begin, end, visible);
+}
+
+#endif
@@ -0,0 +1,66 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "Frustum.h"
+#include "../Jobs/JobSystem.h"
+#include "../Models/Bounds.h"
+
+// Tests world space bounding spheres against a frustum. The spheres are kept
+// as separate x, y, z and radius arrays so 4 (SSE) or 8 (AVX) of them are
+// tested per instruction. Large sets are split across the job system's workers.
+class FrustumCuller
+{
+public:
+    struct Statistics
+    {
+        uint32_t tested = 0;
+        uint32_t culled = 0;
+    };
+
+    // without a job system everything is culled on the calling thread
+    void create(JobSystem* jobs = nullptr);
+    void clean();
+
+    // Returns the slot of the new sphere. `id` is what cull() reports for it.
+    uint32_t add(uint32_t id, const BoundingSphere& sphere);
+    void update(uint32_t slot, const BoundingSphere& sphere);
+
+    // The last sphere moves into the freed slot, its id is returned so the
+    // owner can update its slot.
+    std::optional<uint32_t> remove(uint32_t slot);
+
+    // Ids of every sphere that touches the frustum, valid until the next call.
+    const std::vector<uint32_t>& cull(const Frustum& frustum);
+    [[nodiscard]] const std::vector<uint32_t>& get_visible() const { return visible_; }
+
+    [[nodiscard]] Statistics get_statistics() const { return statistics_; }
+    [[nodiscard]] const char* get_instruction_set() const;
+
+private:
+    // below this many spheres the jobs cost more to hand out than they save
+    static constexpr size_t parallel_threshold_ = 16384;
+
+    std::vector<float> center_x_;
+    std::vector<float> center_y_;
+    std::vector<float> center_z_;
+    std::vector<float> radius_;
+    std::vector<uint32_t> ids_;
+
+    std::vector<uint32_t> visible_;
+    Statistics statistics_;
+    bool avx_supported_ = false;
+
+    JobSystem* jobs_ = nullptr;
+
+    // the current cull(), shared with the jobs
+    Frustum frustum_{};
+    std::vector<std::vector<uint32_t>> chunk_visible_;
+
+    void cull_range(size_t begin, size_t end, std::vector<uint32_t>& visible) const;
+    void cull_range_scalar(size_t begin, size_t end, std::vector<uint32_t>& visible) const;
+    void cull_range_sse(size_t begin, size_t end, std::vector<uint32_t>& visible) const;
+    void cull_range_avx(size_t begin, size_t end, std::vector<uint32_t>& visible) const;
+};
@@ -0,0 +1,687 @@
+﻿#include "OcclusionCuller.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <filesystem>
+#include <format>
+#include <stdexcept>
+
+#include "../Image/MappedFile.h"
+#include "../Logging/Logging.h"
+
+namespace
+{
+
+const char* const depth_reduce_shader = "Shaders/Compute/depth_reduce.spv";
+const char* const depth_reduce_multisampled_shader = "Shaders/Compute/depth_reduce_ms.spv";
+const char* const occlusion_cull_shader = "Shaders/Compute/occlusion_cull.spv";
+
+struct ReducePushConstants
+{
+    int32_t source_width;
+    int32_t source_height;
+    int32_t destination_width;
+    int32_t destination_height;
+};
+
+struct CullPushConstants
+{
+    glm::mat4 view_projection;
+    glm::vec2 viewport_size;
+    uint32_t pyramid_levels;
+    uint32_t candidate_count;
+};
+
+VkDescriptorSetLayoutBinding compute_binding(const uint32_t binding, const VkDescriptorType type)
+{
+    VkDescriptorSetLayoutBinding layout_binding{};
+    layout_binding.binding = binding;
+    layout_binding.descriptorType = type;
+    layout_binding.descriptorCount = 1;
+    layout_binding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    return layout_binding;
+}
+
+}
+
+void OcclusionCuller::create(const CreateOcclusionCullerInfo& info)
+{
+    device_ = info.device;
+    allocator_ = info.allocator;
+    retire_ = info.retire;
+    multisampled_ = info.samples != VK_SAMPLE_COUNT_1_BIT;
+
+    if (!info.depth_sampling_supported)
+    {
+        logging::warning("The depth buffer can't be sampled, occlusion culling is unavailable");
+        return;
+    }
+
+    for (const auto path : {depth_reduce_shader, depth_reduce_multisampled_shader, occlusion_cull_shader})
+    {
+        if (!std::filesystem::exists(path))
+        {
+            logging::warning(std::format("{} is missing, occlusion culling is unavailable", path));
+            return;
+        }
+    }
+
+    // reductions read the level below and write the next one
+    const std::array reduce_bindings =
+    {
+        compute_binding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER),
+        compute_binding(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE),
+    };
+
+    // pyramid, candidates, indirect draws, visibility
+    const std::array cull_bindings =
+    {
+        compute_binding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER),
+        compute_binding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER),
+        compute_binding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER),
+        compute_binding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER),
+    };
+
+    VkDescriptorSetLayoutCreateInfo set_layout_info{};
+    set_layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    set_layout_info.bindingCount = static_cast<uint32_t>(reduce_bindings.size());
+    set_layout_info.pBindings = reduce_bindings.data();
+
+    if (vkCreateDescriptorSetLayout(device_, &set_layout_info, nullptr, &reduce_set_layout_) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Error: unable to create depth reduction descriptor set layout.");
+    }
+
+    set_layout_info.bindingCount = static_cast<uint32_t>(cull_bindings.size());
+    set_layout_info.pBindings = cull_bindings.data();
+
+    if (vkCreateDescriptorSetLayout(device_, &set_layout_info, nullptr, &cull_set_layout_) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Error: unable to create occlusion culling descriptor set layout.");
+    }
+
+    VkPushConstantRange push_constant_range{};
+    push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    push_constant_range.size = sizeof(ReducePushConstants);
+
+    VkPipelineLayoutCreateInfo pipeline_layout_info{};
+    pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipeline_layout_info.setLayoutCount = 1;
+    pipeline_layout_info.pSetLayouts = &reduce_set_layout_;
+    pipeline_layout_info.pushConstantRangeCount = 1;
+    pipeline_layout_info.pPushConstantRanges = &push_constant_range;
+
+    if (vkCreatePipelineLayout(device_, &pipeline_layout_info, nullptr, &reduce_pipeline_layout_) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Error: unable to create depth reduction pipeline layout.");
+    }
+
+    push_constant_range.size = sizeof(CullPushConstants);
+    pipeline_layout_info.pSetLayouts = &cull_set_layout_;
+
+    if (vkCreatePipelineLayout(device_, &pipeline_layout_info, nullptr, &cull_pipeline_layout_) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Error: unable to create occlusion culling pipeline layout.");
+    }
+
+    reduce_pipeline_ = create_pipeline(depth_reduce_shader, reduce_pipeline_layout_, info.pipeline_cache);
+    first_reduce_pipeline_ = multisampled_
+        ? create_pipeline(depth_reduce_multisampled_shader, reduce_pipeline_layout_, info.pipeline_cache)
+        : reduce_pipeline_;
+    cull_pipeline_ = create_pipeline(occlusion_cull_shader, cull_pipeline_layout_, info.pipeline_cache);
+
+    // levels are read with texelFetch, the sampler only has to exist
+    VkSamplerCreateInfo sampler_info{};
+    sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    sampler_info.magFilter = VK_FILTER_NEAREST;
+    sampler_info.minFilter = VK_FILTER_NEAREST;
+    sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.maxLod = VK_LOD_CLAMP_NONE;
+
+    if (vkCreateSampler(device_, &sampler_info, nullptr, &sampler_) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Error: unable to create depth pyramid sampler.");
+    }
+
+    // the slots' sets, every pyramid brings a pool for its reductions
+    std::array<VkDescriptorPoolSize, 2> pool_sizes{};
+    pool_sizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    pool_sizes[0].descriptorCount = info.frame_count;
+    pool_sizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    pool_sizes[1].descriptorCount = 3 * info.frame_count;
+
+    VkDescriptorPoolCreateInfo pool_info{};
+    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.poolSizeCount = static_cast<uint32_t>(pool_sizes.size());
+    pool_info.pPoolSizes = pool_sizes.data();
+    pool_info.maxSets = info.frame_count;
+
+    if (vkCreateDescriptorPool(device_, &pool_info, nullptr, &descriptor_pool_) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Error: unable to create occlusion culling descriptor pool.");
+    }
+
+    slots_.resize(info.frame_count);
+    for (auto& slot : slots_)
+    {
+        VkDescriptorSetAllocateInfo allocate_info{};
+        allocate_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocate_info.descriptorPool = descriptor_pool_;
+        allocate_info.descriptorSetCount = 1;
+        allocate_info.pSetLayouts = &cull_set_layout_;
+
+        if (vkAllocateDescriptorSets(device_, &allocate_info, &slot.descriptor_set) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Error: unable to allocate occlusion culling descriptor set.");
+        }
+
+        create_slot_buffers(slot, 64);
+    }
+
+    available_ = true;
+}
+
+void OcclusionCuller::clean()
+{
+    if (!available_)
+    {
+        return;
+    }
+
+    clean_pyramid();
+
+    for (auto& slot : slots_)
+    {
+        clean_slot_buffers(slot);
+    }
+    slots_.clear();
+    results_.clear();
+
+    vkDestroyDescriptorPool(device_, descriptor_pool_, nullptr);
+    vkDestroySampler(device_, sampler_, nullptr);
+
+    if (first_reduce_pipeline_ != reduce_pipeline_)
+    {
+        vkDestroyPipeline(device_, first_reduce_pipeline_, nullptr);
+    }
+    vkDestroyPipeline(device_, reduce_pipeline_, nullptr);
+    vkDestroyPipeline(device_, cull_pipeline_, nullptr);
+
+    vkDestroyPipelineLayout(device_, reduce_pipeline_layout_, nullptr);
+    vkDestroyPipelineLayout(device_, cull_pipeline_layout_, nullptr);
+    vkDestroyDescriptorSetLayout(device_, reduce_set_layout_, nullptr);
+    vkDestroyDescriptorSetLayout(device_, cull_set_layout_, nullptr);
+
+    available_ = false;
+}
+
+void OcclusionCuller::create_pyramid(VkImageView depth_view, const VkExtent2D extent)
+{
+    if (pyramid_.image != VK_NULL_HANDLE)
+    {
+        // frames in flight still reduce into it and test against it
+        retire_([device = device_, allocator = allocator_, pyramid = std::move(pyramid_)]
+        {
+            destroy_pyramid(device, allocator, pyramid);
+        });
+
+        pyramid_ = {};
+    }
+
+    depth_extent_ = extent;
+    auto& levels = pyramid_.levels;
+
+    // level 0 is half the depth buffer, rounded down, the odd row and column are
+    // folded into the last texel so every level covers the whole screen
+    VkExtent2D level_extent = { std::max(extent.width / 2, 1u), std::max(extent.height / 2, 1u) };
+    while (true)
+    {
+        levels.push_back({ level_extent, VK_NULL_HANDLE, VK_NULL_HANDLE });
+
+        if (level_extent.width == 1 && level_extent.height == 1)
+        {
+            break;
+        }
+
+        level_extent = { std::max(level_extent.width / 2, 1u), std::max(level_extent.height / 2, 1u) };
+    }
+
+    VkImageCreateInfo image_info{};
+    image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    image_info.imageType = VK_IMAGE_TYPE_2D;
+    image_info.format = VK_FORMAT_R32_SFLOAT;
+    image_info.extent = { levels.front().extent.width, levels.front().extent.height, 1 };
+    image_info.mipLevels = static_cast<uint32_t>(levels.size());
+    image_info.arrayLayers = 1;
+    image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+    image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    image_info.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    VmaAllocationCreateInfo allocation_info{};
+    allocation_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+
+    if (vmaCreateImage(allocator_, &image_info, &allocation_info, &pyramid_.image, &pyramid_.allocation, nullptr) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Error: unable to create depth pyramid.");
+    }
+
+    VkImageViewCreateInfo view_info{};
+    view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    view_info.image = pyramid_.image;
+    view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    view_info.format = VK_FORMAT_R32_SFLOAT;
+    view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    view_info.subresourceRange.levelCount = image_info.mipLevels;
+    view_info.subresourceRange.layerCount = 1;
+
+    if (vkCreateImageView(device_, &view_info, nullptr, &pyramid_.view) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Error: unable to create depth pyramid view.");
+    }
+
+    std::array<VkDescriptorPoolSize, 2> pool_sizes{};
+    pool_sizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    pool_sizes[0].descriptorCount = image_info.mipLevels;
+    pool_sizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    pool_sizes[1].descriptorCount = image_info.mipLevels;
+
+    VkDescriptorPoolCreateInfo pool_info{};
+    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.poolSizeCount = static_cast<uint32_t>(pool_sizes.size());
+    pool_info.pPoolSizes = pool_sizes.data();
+    pool_info.maxSets = image_info.mipLevels;
+
+    if (vkCreateDescriptorPool(device_, &pool_info, nullptr, &pyramid_.descriptor_pool) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Error: unable to create depth reduction descriptor pool.");
+    }
+
+    std::vector layouts(levels.size(), reduce_set_layout_);
+    std::vector<VkDescriptorSet> descriptor_sets(levels.size());
+
+    VkDescriptorSetAllocateInfo allocate_info{};
+    allocate_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocate_info.descriptorPool = pyramid_.descriptor_pool;
+    allocate_info.descriptorSetCount = static_cast<uint32_t>(layouts.size());
+    allocate_info.pSetLayouts = layouts.data();
+
+    if (vkAllocateDescriptorSets(device_, &allocate_info, descriptor_sets.data()) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Error: unable to allocate depth reduction descriptor sets.");
+    }
+
+    for (uint32_t i = 0; i < levels.size(); ++i)
+    {
+        auto& level = levels[i];
+        level.descriptor_set = descriptor_sets[i];
+
+        view_info.subresourceRange.baseMipLevel = i;
+        view_info.subresourceRange.levelCount = 1;
+
+        if (vkCreateImageView(device_, &view_info, nullptr, &level.view) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Error: unable to create depth pyramid level view.");
+        }
+
+        // the pyramid stays in GENERAL, the depth attachment is left read only by the first phase
+        VkDescriptorImageInfo source_info{};
+        source_info.sampler = sampler_;
+        source_info.imageView = i == 0 ? depth_view : levels[i - 1].view;
+        source_info.imageLayout = i == 0 ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL;
+
+        VkDescriptorImageInfo destination_info{};
+        destination_info.imageView = level.view;
+        destination_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+        std::array<VkWriteDescriptorSet, 2> writes{};
+        writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[0].dstSet = level.descriptor_set;
+        writes[0].dstBinding = 0;
+        writes[0].descriptorCount = 1;
+        writes[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        writes[0].pImageInfo = &source_info;
+        writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[1].dstSet = level.descriptor_set;
+        writes[1].dstBinding = 1;
+        writes[1].descriptorCount = 1;
+        writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        writes[1].pImageInfo = &destination_info;
+
+        vkUpdateDescriptorSets(device_, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+    }
+
+    // a slot's set may be in use by a frame in flight, it is only written once the slot is recorded again
+    for (auto& slot : slots_)
+    {
+        slot.pyramid_outdated = true;
+    }
+}
+
+void OcclusionCuller::clean_pyramid()
+{
+    if (pyramid_.image == VK_NULL_HANDLE)
+    {
+        return;
+    }
+
+    destroy_pyramid(device_, allocator_, pyramid_);
+    pyramid_ = {};
+
+    for (auto& slot : slots_)
+    {
+        slot.pyramid_outdated = true;
+    }
+}
+
+const std::vector<OcclusionCuller::Result>& OcclusionCuller::read_results(const uint32_t frame_slot)
+{
+    auto& slot = slots_[frame_slot];
+    results_.clear();
+    occluded_count_ = 0;
+
+    if (!slot.recorded)
+    {
+        return results_;
+    }
+
+    vmaInvalidateAllocation(allocator_, slot.visibility_allocation, 0, VK_WHOLE_SIZE);
+
+    for (size_t i = 0; i < slot.ids.size(); ++i)
+    {
+        const bool visible = slot.visibility[i] != 0;
+        results_.push_back({ slot.ids[i], visible });
+        occluded_count_ += visible ? 0 : 1;
+    }
+
+    slot.recorded = false;
+    return results_;
+}
+
+void OcclusionCuller::set_candidates(const uint32_t frame_slot, const std::vector<Candidate>& candidates)
+{
+    auto& slot = slots_[frame_slot];
+
+    if (candidates.size() > slot.capacity)
+    {
+        // the slot's previous frame completed, nothing uses the old buffers any more
+        clean_slot_buffers(slot);
+        create_slot_buffers(slot, std::bit_ceil(static_cast<uint32_t>(candidates.size())));
+    }
+
+    slot.ids.clear();
+    for (size_t i = 0; i < candidates.size(); ++i)
+    {
+        const auto& candidate = candidates[i];
+        slot.ids.push_back(candidate.id);
+        slot.candidates[i] = { glm::vec4(candidate.sphere.center, candidate.sphere.radius), candidate.index_count,
+                               candidate.drawn_early ? 1u : 0u, {} };
+    }
+
+    vmaFlushAllocation(allocator_, slot.candidate_allocation, 0, VK_WHOLE_SIZE);
+}
+
+void OcclusionCuller::record(VkCommandBuffer command_buffer, const uint32_t frame_slot, const glm::mat4& view_projection,
+                             const VkExtent2D viewport)
+{
+    auto& slot = slots_[frame_slot];
+
+    if (slot.ids.empty())
+    {
+        return;
+    }
+
+    if (slot.pyramid_outdated)
+    {
+        // the slot's previous frame completed, nothing uses its set any more
+        VkDescriptorImageInfo pyramid_info{};
+        pyramid_info.sampler = sampler_;
+        pyramid_info.imageView = pyramid_.view;
+        pyramid_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+        VkWriteDescriptorSet write{};
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet = slot.descriptor_set;
+        write.dstBinding = 0;
+        write.descriptorCount = 1;
+        write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        write.pImageInfo = &pyramid_info;
+
+        vkUpdateDescriptorSets(device_, 1, &write, 0, nullptr);
+        slot.pyramid_outdated = false;
+    }
+
+    const auto mip_levels = static_cast<uint32_t>(pyramid_.levels.size());
+
+    // the previous frame's tests may still read the pyramid, its contents are rebuilt anyway
+    VkImageMemoryBarrier2 barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+    barrier.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+    barrier.srcAccessMask = VK_ACCESS_2_NONE;
+    barrier.dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+    barrier.dstAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = pyramid_.image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.levelCount = mip_levels;
+    barrier.subresourceRange.layerCount = 1;
+
+    VkDependencyInfo dependency_info{};
+    dependency_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    dependency_info.imageMemoryBarrierCount = 1;
+    dependency_info.pImageMemoryBarriers = &barrier;
+
+    vkCmdPipelineBarrier2(command_buffer, &dependency_info);
+
+    // every level reads the one below it, so each waits for the previous dispatch
+    barrier.srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+    barrier.subresourceRange.levelCount = 1;
+
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, first_reduce_pipeline_);
+
+    VkExtent2D source_extent = depth_extent_;
+    for (uint32_t i = 0; i < mip_levels; ++i)
+    {
+        const auto& level = pyramid_.levels[i];
+
+        if (i == 1 && first_reduce_pipeline_ != reduce_pipeline_)
+        {
+            vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, reduce_pipeline_);
+        }
+
+        vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, reduce_pipeline_layout_,
+                                0, 1, &level.descriptor_set, 0, nullptr);
+
+        const ReducePushConstants push_constants =
+        {
+            static_cast<int32_t>(source_extent.width), static_cast<int32_t>(source_extent.height),
+            static_cast<int32_t>(level.extent.width), static_cast<int32_t>(level.extent.height),
+        };
+        vkCmdPushConstants(command_buffer, reduce_pipeline_layout_, VK_SHADER_STAGE_COMPUTE_BIT,
+                           0, sizeof(push_constants), &push_constants);
+
+        vkCmdDispatch(command_buffer, (level.extent.width + 7) / 8, (level.extent.height + 7) / 8, 1);
+
+        barrier.subresourceRange.baseMipLevel = i;
+        vkCmdPipelineBarrier2(command_buffer, &dependency_info);
+
+        source_extent = level.extent;
+    }
+
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, cull_pipeline_);
+    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, cull_pipeline_layout_,
+                            0, 1, &slot.descriptor_set, 0, nullptr);
+
+    const CullPushConstants push_constants =
+    {
+        view_projection,
+        glm::vec2(static_cast<float>(viewport.width), static_cast<float>(viewport.height)),
+        mip_levels,
+        static_cast<uint32_t>(slot.ids.size()),
+    };
+    vkCmdPushConstants(command_buffer, cull_pipeline_layout_, VK_SHADER_STAGE_COMPUTE_BIT,
+                       0, sizeof(push_constants), &push_constants);
+
+    vkCmdDispatch(command_buffer, (push_constants.candidate_count + 63) / 64, 1, 1);
+
+    // the cpu reads the results once the frame completed, the draws are the caller's to synchronize
+    VkMemoryBarrier2 results_barrier{};
+    results_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+    results_barrier.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+    results_barrier.srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+    results_barrier.dstStageMask = VK_PIPELINE_STAGE_2_HOST_BIT;
+    results_barrier.dstAccessMask = VK_ACCESS_2_HOST_READ_BIT;
+
+    VkDependencyInfo results_dependency{};
+    results_dependency.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    results_dependency.memoryBarrierCount = 1;
+    results_dependency.pMemoryBarriers = &results_barrier;
+
+    vkCmdPipelineBarrier2(command_buffer, &results_dependency);
+
+    slot.recorded = true;
+}
+
+VkPipeline OcclusionCuller::create_pipeline(const char* path, VkPipelineLayout layout, VkPipelineCache pipeline_cache)
+{
+    const MappedFile code(path);
+
+    VkShaderModuleCreateInfo module_info{};
+    module_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    module_info.codeSize = code.size();
+    module_info.pCode = reinterpret_cast<const uint32_t*>(code.data());
+
+    VkShaderModule shader_module;
+    if (vkCreateShaderModule(device_, &module_info, nullptr, &shader_module) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Error: unable to create shader module.");
+    }
+
+    VkComputePipelineCreateInfo pipeline_info{};
+    pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipeline_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipeline_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipeline_info.stage.module = shader_module;
+    pipeline_info.stage.pName = "main";
+    pipeline_info.layout = layout;
+
+    VkPipeline pipeline;
+    const auto result = vkCreateComputePipelines(device_, pipeline_cache, 1, &pipeline_info, nullptr, &pipeline);
+
+    vkDestroyShaderModule(device_, shader_module, nullptr);
+
+    if (result != VK_SUCCESS)
+    {
+        throw std::runtime_error(std::string("Error: unable to create compute pipeline for ") + path);
+    }
+
+    return pipeline;
+}
+
+void OcclusionCuller::create_slot_buffers(FrameSlot& slot, const uint32_t capacity)
+{
+    slot.capacity = capacity;
+
+    VkBufferCreateInfo buffer_info{};
+    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    VmaAllocationCreateInfo allocation_create_info{};
+    VmaAllocationInfo allocation_info;
+
+    // written by the cpu every frame
+    buffer_info.size = sizeof(GpuCandidate) * capacity;
+    buffer_info.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    allocation_create_info.usage = VMA_MEMORY_USAGE_CPU_TO_GPU;
+    allocation_create_info.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+    if (vmaCreateBuffer(allocator_, &buffer_info, &allocation_create_info, &slot.candidate_buffer,
+                        &slot.candidate_allocation, &allocation_info) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Error: unable to create occlusion candidate buffer.");
+    }
+    slot.candidates = static_cast<GpuCandidate*>(allocation_info.pMappedData);
+
+    buffer_info.size = sizeof(VkDrawIndexedIndirectCommand) * capacity;
+    buffer_info.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+    allocation_create_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+    allocation_create_info.flags = 0;
+
+    if (vmaCreateBuffer(allocator_, &buffer_info, &allocation_create_info, &slot.indirect_buffer,
+                        &slot.indirect_allocation, nullptr) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Error: unable to create occlusion indirect draw buffer.");
+    }
+
+    // read back by the cpu
+    buffer_info.size = sizeof(uint32_t) * capacity;
+    buffer_info.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    allocation_create_info.usage = VMA_MEMORY_USAGE_GPU_TO_CPU;
+    allocation_create_info.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+    if (vmaCreateBuffer(allocator_, &buffer_info, &allocation_create_info, &slot.visibility_buffer,
+                        &slot.visibility_allocation, &allocation_info) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Error: unable to create occlusion visibility buffer.");
+    }
+    slot.visibility = static_cast<const uint32_t*>(allocation_info.pMappedData);
+
+    write_cull_descriptor_set(slot);
+}
+
+void OcclusionCuller::clean_slot_buffers(FrameSlot& slot)
+{
+    vmaDestroyBuffer(allocator_, slot.candidate_buffer, slot.candidate_allocation);
+    vmaDestroyBuffer(allocator_, slot.indirect_buffer, slot.indirect_allocation);
+    vmaDestroyBuffer(allocator_, slot.visibility_buffer, slot.visibility_allocation);
+
+    slot.capacity = 0;
+    // results in the old buffers are gone with them
+    slot.recorded = false;
+}
+
+void OcclusionCuller::write_cull_descriptor_set(const FrameSlot& slot)
+{
+    // the pyramid in binding 0 is written when the slot is recorded
+    const std::array buffer_infos =
+    {
+        VkDescriptorBufferInfo{ slot.candidate_buffer, 0, VK_WHOLE_SIZE },
+        VkDescriptorBufferInfo{ slot.indirect_buffer, 0, VK_WHOLE_SIZE },
+        VkDescriptorBufferInfo{ slot.visibility_buffer, 0, VK_WHOLE_SIZE },
+    };
+
+    std::array<VkWriteDescriptorSet, 3> writes{};
+    for (uint32_t i = 0; i < writes.size(); ++i)
+    {
+        writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].dstSet = slot.descriptor_set;
+        writes[i].dstBinding = i + 1;
+        writes[i].descriptorCount = 1;
+        writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writes[i].pBufferInfo = &buffer_infos[i];
+    }
+
+    vkUpdateDescriptorSets(device_, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+}
+
+void OcclusionCuller::destroy_pyramid(VkDevice device, VmaAllocator allocator, const Pyramid& pyramid)
+{
+    for (const auto& level : pyramid.levels)
+    {
+        vkDestroyImageView(device, level.view, nullptr);
+    }
+
+    vkDestroyDescriptorPool(device, pyramid.descriptor_pool, nullptr);
+    vkDestroyImageView(device, pyramid.view, nullptr);
+    vmaDestroyImage(allocator, pyramid.image, pyramid.allocation);
+}
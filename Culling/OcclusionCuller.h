@@ -0,0 +1,160 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include <glm/glm.hpp>
+#include <vk_mem_alloc.h>
+#include <vulkan/vulkan_core.h>
+
+#include "../Models/Bounds.h"
+
+struct CreateOcclusionCullerInfo
+{
+    VkDevice device;
+    VmaAllocator allocator;
+    VkPipelineCache pipeline_cache;
+    // sample count of the depth attachment the pyramid is built from
+    VkSampleCountFlagBits samples;
+    // the depth format supports sampling, at that sample count
+    bool depth_sampling_supported;
+    // one set of buffers per frame that can be in flight
+    uint32_t frame_count;
+    // destroys objects once every frame that may still use them has finished
+    std::function<void(std::function<void()>)> retire;
+};
+
+// Two phase occlusion culling against a hierarchical depth buffer. The objects
+// visible last frame are drawn first, then the depth they left behind is
+// reduced into a pyramid of farthest depths and every candidate is tested
+// against it on the gpu. The test writes an indirect draw per candidate with
+// an instance count of 0 or 1, so hidden objects cost no vertex or fragment
+// work in the second phase, and its results are read back once the frame slot
+// comes around again to decide what goes into the next first phase.
+class OcclusionCuller
+{
+public:
+    struct Candidate
+    {
+        uint32_t id;
+        BoundingSphere sphere;
+        uint32_t index_count;
+        // drawn in the first phase, its indirect draw never gets an instance
+        bool drawn_early;
+    };
+
+    struct Result
+    {
+        uint32_t id;
+        bool visible;
+    };
+
+    void create(const CreateOcclusionCullerInfo& info);
+    void clean();
+
+    // false when the compute shaders are missing or the depth buffer can't be
+    // sampled, nothing else may be called then
+    [[nodiscard]] bool is_available() const { return available_; }
+
+    // Builds the pyramid for the top left `extent` of a depth attachment. The
+    // previous pyramid is retired, frames recorded with it keep using it and its
+    // depth view, so that view has to stay valid until they are done.
+    void create_pyramid(VkImageView depth_view, VkExtent2D extent);
+    // Destroys the pyramid right away, the gpu has to be done with it.
+    void clean_pyramid();
+
+    // What the slot's candidates turned out to be the last time it was
+    // recorded. Must be called after the slot's previous frame was waited for,
+    // and before set_candidates.
+    const std::vector<Result>& read_results(uint32_t frame_slot);
+    // candidates found hidden by the most recently read results
+    [[nodiscard]] uint32_t get_occluded_count() const { return occluded_count_; }
+
+    void set_candidates(uint32_t frame_slot, const std::vector<Candidate>& candidates);
+
+    // Builds the pyramid and tests the slot's candidates. Must be recorded
+    // outside a render pass, with the depth attachment in
+    // DEPTH_STENCIL_READ_ONLY_OPTIMAL and its writes visible to compute shaders.
+    // Draws from the indirect buffer have to wait for the compute writes.
+    // `viewport` is the part of the depth attachment, from its top left corner,
+    // that view_projection was drawn to.
+    void record(VkCommandBuffer command_buffer, uint32_t frame_slot, const glm::mat4& view_projection, VkExtent2D viewport);
+
+    // the candidates' indirect draws, in the order they were set
+    [[nodiscard]] VkBuffer get_indirect_buffer(const uint32_t frame_slot) const { return slots_[frame_slot].indirect_buffer; }
+
+private:
+    struct GpuCandidate
+    {
+        glm::vec4 sphere;
+        uint32_t index_count;
+        uint32_t drawn_early;
+        uint32_t padding[2];
+    };
+
+    struct FrameSlot
+    {
+        std::vector<uint32_t> ids;
+        uint32_t capacity = 0;
+        VkBuffer candidate_buffer = VK_NULL_HANDLE;
+        VmaAllocation candidate_allocation = VK_NULL_HANDLE;
+        GpuCandidate* candidates = nullptr;
+        VkBuffer indirect_buffer = VK_NULL_HANDLE;
+        VmaAllocation indirect_allocation = VK_NULL_HANDLE;
+        VkBuffer visibility_buffer = VK_NULL_HANDLE;
+        VmaAllocation visibility_allocation = VK_NULL_HANDLE;
+        const uint32_t* visibility = nullptr;
+        VkDescriptorSet descriptor_set = VK_NULL_HANDLE;
+        // the slot's buffers hold results that haven't been read yet
+        bool recorded = false;
+        // the set still points at a previous pyramid, it is rewritten when the slot is recorded next
+        bool pyramid_outdated = true;
+    };
+
+    struct PyramidLevel
+    {
+        VkExtent2D extent;
+        VkImageView view;
+        VkDescriptorSet descriptor_set;
+    };
+
+    struct Pyramid
+    {
+        VkImage image = VK_NULL_HANDLE;
+        VmaAllocation allocation = VK_NULL_HANDLE;
+        VkImageView view = VK_NULL_HANDLE;
+        // the reductions' sets, which go away with the pyramid
+        VkDescriptorPool descriptor_pool = VK_NULL_HANDLE;
+        std::vector<PyramidLevel> levels;
+    };
+
+    VkDevice device_ = VK_NULL_HANDLE;
+    VmaAllocator allocator_ = VK_NULL_HANDLE;
+    std::function<void(std::function<void()>)> retire_;
+    bool available_ = false;
+    bool multisampled_ = false;
+
+    VkDescriptorSetLayout reduce_set_layout_ = VK_NULL_HANDLE;
+    VkDescriptorSetLayout cull_set_layout_ = VK_NULL_HANDLE;
+    VkPipelineLayout reduce_pipeline_layout_ = VK_NULL_HANDLE;
+    VkPipelineLayout cull_pipeline_layout_ = VK_NULL_HANDLE;
+    // the first reduction reads the depth attachment, which may be multisampled
+    VkPipeline first_reduce_pipeline_ = VK_NULL_HANDLE;
+    VkPipeline reduce_pipeline_ = VK_NULL_HANDLE;
+    VkPipeline cull_pipeline_ = VK_NULL_HANDLE;
+    VkSampler sampler_ = VK_NULL_HANDLE;
+    VkDescriptorPool descriptor_pool_ = VK_NULL_HANDLE;
+
+    VkExtent2D depth_extent_ = {};
+    Pyramid pyramid_;
+
+    std::vector<FrameSlot> slots_;
+    std::vector<Result> results_;
+    uint32_t occluded_count_ = 0;
+
+    VkPipeline create_pipeline(const char* path, VkPipelineLayout layout, VkPipelineCache pipeline_cache);
+    void create_slot_buffers(FrameSlot& slot, uint32_t capacity);
+    void clean_slot_buffers(FrameSlot& slot);
+    void write_cull_descriptor_set(const FrameSlot& slot);
+    static void destroy_pyramid(VkDevice device, VmaAllocator allocator, const Pyramid& pyramid);
+};
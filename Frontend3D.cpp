@@ -1,12 +1,120 @@
 #include <exception>
 #include <iostream>
 #include <chrono>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
 #include <glm/ext/matrix_transform.hpp>
 
 #include "Actors/Actor.h"
+#include "Actors/TransformSystem.h"
 #include "Graphics/GraphicsRunner.h"
 #include "Models/ModelLoading.h"
 #include "Input/Input.h"
+#include "Profiling/CpuProfiler.h"
+#include "Tools/TextureCompressor.h"
+
+// --present-mode fifo|fifo_relaxed|mailbox|immediate, --frame-rate <fps> (0 is uncapped),
+// --frames-in-flight <1-4>, --swap-chain-images <count>, --per-image-semaphores,
+// --trace-frames <first>-<last> (writes trace.json), --headless <width>x<height>, --no-frustum-culling,
+// --no-bvh-culling, --no-occlusion-culling, --dynamic-resolution <target gpu ms>, --quality low|medium|high|ultra
+void apply_presentation_options(GraphicsRunner& app, const std::vector<std::string>& arguments)
+{
+    const std::unordered_map<std::string, VkPresentModeKHR> present_modes =
+    {
+        {"fifo", VK_PRESENT_MODE_FIFO_KHR},
+        {"fifo_relaxed", VK_PRESENT_MODE_FIFO_RELAXED_KHR},
+        {"mailbox", VK_PRESENT_MODE_MAILBOX_KHR},
+        {"immediate", VK_PRESENT_MODE_IMMEDIATE_KHR},
+    };
+
+    for (size_t i = 0; i < arguments.size(); ++i)
+    {
+        if (arguments[i] == "--per-image-semaphores")
+        {
+            app.set_per_image_acquire_semaphores(true);
+        }
+
+        if (arguments[i] == "--no-frustum-culling")
+        {
+            app.set_frustum_culling(false);
+        }
+
+        if (arguments[i] == "--no-bvh-culling")
+        {
+            app.set_bvh_culling(false);
+        }
+
+        if (arguments[i] == "--no-occlusion-culling")
+        {
+            app.set_occlusion_culling(false);
+        }
+
+        if (i + 1 == arguments.size())
+        {
+            break;
+        }
+
+        if (arguments[i] == "--present-mode")
+        {
+            const auto present_mode = present_modes.find(arguments[i + 1]);
+            if (present_mode == present_modes.end())
+            {
+                throw std::runtime_error("Error: unknown present mode " + arguments[i + 1]);
+            }
+
+            app.set_present_mode(present_mode->second);
+        }
+        else if (arguments[i] == "--frame-rate")
+        {
+            app.set_frame_rate_limit(std::stod(arguments[i + 1]));
+        }
+        else if (arguments[i] == "--frames-in-flight")
+        {
+            app.set_frames_in_flight(static_cast<uint32_t>(std::stoul(arguments[i + 1])));
+        }
+        else if (arguments[i] == "--swap-chain-images")
+        {
+            app.set_swap_chain_image_count(static_cast<uint32_t>(std::stoul(arguments[i + 1])));
+        }
+        else if (arguments[i] == "--quality")
+        {
+            const auto tier = quality::find_tier(arguments[i + 1]);
+            if (!tier)
+            {
+                throw std::runtime_error("Error: unknown quality tier " + arguments[i + 1]);
+            }
+
+            app.set_quality_tier(*tier);
+        }
+        else if (arguments[i] == "--dynamic-resolution")
+        {
+            app.set_dynamic_resolution(true, std::stod(arguments[i + 1]));
+        }
+        else if (arguments[i] == "--headless")
+        {
+            const auto& size = arguments[i + 1];
+            const auto separator = size.find('x');
+            if (separator == std::string::npos)
+            {
+                throw std::runtime_error("Error: headless size must look like 1280x720, got " + size);
+            }
+
+            app.set_headless(static_cast<uint32_t>(std::stoul(size.substr(0, separator))),
+                             static_cast<uint32_t>(std::stoul(size.substr(separator + 1))));
+        }
+        else if (arguments[i] == "--trace-frames")
+        {
+            const auto& range = arguments[i + 1];
+            const auto separator = range.find('-');
+            const uint64_t first_frame = std::stoull(range.substr(0, separator));
+            const uint64_t last_frame = separator == std::string::npos ? first_frame : std::stoull(range.substr(separator + 1));
+
+            profiling::capture(first_frame, last_frame - first_frame + 1, "trace.json");
+        }
+    }
+}
 
 void initialize_inputs(Input& input)
 {
@@ -104,16 +212,24 @@ void debug_controller_inputs(Input& input)
         std::cout << "SELECT active: " << input.get_control_state(controls::SELECT) << '\n';
 }
 
-int main() {
+int main(int argc, char* argv[]) {
     try
     {
         // TestInput::run();
         // return 0; 
+
+        // offline texture compression: Frontend3D --compress-textures Textures/grid.jpg ...
+        if (argc > 1 && std::string(argv[1]) == "--compress-textures")
+        {
+            TextureCompressor::run(std::vector<std::string>(argv + 2, argv + argc));
+            return EXIT_SUCCESS;
+        }
         
         Camera camera;
         camera.move({0,0,0});
         
         GraphicsRunner app(&camera);
+        apply_presentation_options(app, std::vector<std::string>(argv + 1, argv + argc));
         app.init();
 
         const std::string sphere_model_path = "Models/sphere.obj";
@@ -124,12 +240,26 @@ int main() {
 
         glm::vec3 world_up(0.f, 0.f, 1.f);
         
-        uint32_t earth_id = app.register_resource({sphere_model_path, sphere_texture_path, glm::mat4(1.0f)});
-        uint32_t cube_id = app.register_resource({cube_model_path, cube_texture_path, glm::mat4(1.0f)});
-        uint32_t moon_id = app.register_resource({sphere_model_path, sphere_texture_path, glm::mat4(1.f)});
-        Actor cube(glm::vec3(0.f, 0.f, 0.f), glm::vec3(0.001f, 0.001f, 0.001f), world_up, 0.f, 0.f, 0.f);
-        Actor earth({0.f, 384399.f / 2.f, 0.f}, {6378.f, 6378.f, 6378.f}, world_up, 0.f, 0.f, 0.f);
-        Actor moon({0.f, -384399.f / 2.f, 0.f}, {1738.f, 1738.f, 1738.f}, world_up, 0.f, 0.f, 0.f);
+        TransformSystem transforms;
+        transforms.create(&app.get_job_system());
+        Actor cube(transforms, glm::vec3(0.f, 0.f, 0.f), glm::vec3(0.001f, 0.001f, 0.001f), world_up, 0.f, 0.f, 0.f);
+        Actor earth(transforms, {0.f, 384399.f / 2.f, 0.f}, {6378.f, 6378.f, 6378.f}, world_up, 0.f, 0.f, 0.f);
+        Actor moon(transforms, {0.f, -384399.f / 2.f, 0.f}, {1738.f, 1738.f, 1738.f}, world_up, 0.f, 0.f, 0.f);
+
+        const auto resource_ids = app.register_resources({
+            {sphere_model_path, sphere_texture_path, earth.get_transform()},
+            {cube_model_path, cube_texture_path, cube.get_transform()},
+            {sphere_model_path, sphere_texture_path, moon.get_transform()},
+        });
+        uint32_t earth_id = resource_ids[0];
+        uint32_t cube_id = resource_ids[1];
+        uint32_t moon_id = resource_ids[2];
+        const std::unordered_map<TransformSystem::Handle, uint32_t> resources_by_transform =
+        {
+            {earth.get_handle(), earth_id},
+            {cube.get_handle(), cube_id},
+            {moon.get_handle(), moon_id},
+        };
         
         uint32_t frame_counter = 0;
         auto start_time = std::chrono::high_resolution_clock::now();
@@ -139,16 +269,37 @@ int main() {
         // std::function get_target = []{ return glm::vec3(0,0,0); };
         // camera.set_target(get_target);
         
+        // headless runs have no window to take input from, and a fixed frame count and time step so
+        // their timings can be compared (--frames <count>, 600 by default)
+        uint32_t headless_frames = 600;
+        for (int i = 1; i + 1 < argc; ++i)
+        {
+            if (std::string(argv[i]) == "--frames")
+            {
+                headless_frames = static_cast<uint32_t>(std::stoul(argv[i + 1]));
+            }
+        }
+
         Input input;
-        initialize_inputs(input);
+        if (!app.is_headless())
+        {
+            initialize_inputs(input);
+        }
 
-        while (!app.done())
+        profiling::set_thread_name("main");
+
+        while (!app.done() && (!app.is_headless() || frame_counter < headless_frames))
         {
             auto current_time = std::chrono::high_resolution_clock::now();
-            auto delta_time = std::chrono::duration<float>(current_time - prev_time).count();
+            auto delta_time = app.is_headless() ? 1.f / 60.f : std::chrono::duration<float>(current_time - prev_time).count();
             
             app.update();
-            input.update(app.window_); // TODO: architect this better
+
+            PROFILE_ZONE("game update");
+            if (!app.is_headless())
+            {
+                input.update(app.window_); // TODO: architect this better
+            }
     
             ++frame_counter;
 
@@ -186,16 +337,26 @@ int main() {
             earth.pitch(1.f * delta_time);
             earth.pitch(1.f * delta_time);
             // earth.move({0.f, -1.f, 0.f});
-            
-            app.update_resource(earth_id, earth.get_transform());
 
-            app.update_resource(cube_id, cube.get_transform());
-            app.update_resource(moon_id, moon.get_transform());
+            // only what moved this frame reaches the gpu
+            transforms.update();
+            for (const auto handle : transforms.get_changed())
+            {
+                app.update_resource(resources_by_transform.at(handle), transforms.get_world_matrix(handle));
+            }
 
             prev_time = current_time;
         }
         
+        if (app.is_headless())
+        {
+            const auto duration = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start_time);
+            std::cout << "Rendered " << frame_counter << " headless frames in " << duration.count() << " ms ("
+                      << duration.count() / static_cast<float>(frame_counter) << " ms per frame)\n";
+        }
+
         input.destroy();
+        transforms.clean();
         app.clean_up();
     } catch (const std::exception& e) {
         std::cerr << e.what() << '\n';
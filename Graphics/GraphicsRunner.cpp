@@ -9,58 +9,200 @@
 #include <stdexcept>
 #include <vector>
 #include <format>
+#include <filesystem>
 #include <fstream>
 #include <set>
 #include <chrono>
+#include <cmath>
 #include <ranges>
+#include <bit>
 #include <stb_image.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <unordered_map>
 #include <vk_mem_alloc.h>
 
+#include "../Image/Ktx2.h"
+#include "../Image/MappedFile.h"
 #include "../Logging/Logging.h"
+#include "../Profiling/CpuProfiler.h"
 #include "../Rendering/UniformBufferObject.h"
 #include "../Rendering/Vertex.h"
 #include "../Models/ModelLoading.h"
 
+namespace
+{
+
+const char* get_present_mode_name(const VkPresentModeKHR present_mode)
+{
+    switch (present_mode)
+    {
+    case VK_PRESENT_MODE_IMMEDIATE_KHR:    return "IMMEDIATE";
+    case VK_PRESENT_MODE_MAILBOX_KHR:      return "MAILBOX";
+    case VK_PRESENT_MODE_FIFO_KHR:         return "FIFO";
+    case VK_PRESENT_MODE_FIFO_RELAXED_KHR: return "FIFO_RELAXED";
+    default:                               return "UNKNOWN";
+    }
+}
+
+}
+
 GraphicsRunner::GraphicsRunner(Camera* camera) :
     window_(nullptr), instance_(), debug_messenger_(), device_(),
     graphics_queue_(), present_queue_(), surface_(), swap_chain_(),
     swap_chain_image_format_(), swap_chain_extent_(), render_pass_(),
-    pipeline_layout_(), graphics_pipeline_(), command_pool_(),
+    pipeline_layout_(), command_pool_(),
     camera_(camera) {}
 
 GraphicsRunner::~GraphicsRunner() = default;
 
 void GraphicsRunner::init()
 {
-    init_window();
+    const auto start_time = std::chrono::high_resolution_clock::now();
+
+    if (!headless_)
+    {
+        init_window();
+    }
+
     init_vulkan();
+
+    const auto duration = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start_time);
+    logging::info(std::format("Initialized in {:.1f} ms", duration.count()));
 }
 
 void GraphicsRunner::update()
 {
+    profiling::begin_frame(frame_number_);
+
+    {
+        PROFILE_ZONE("frame limiter");
+        frame_limiter_.wait();
+    }
+
     draw_frame();
 }
 
+void GraphicsRunner::set_headless(const uint32_t width, const uint32_t height)
+{
+    if (device_ != VK_NULL_HANDLE)
+    {
+        throw std::runtime_error("Error: headless mode has to be chosen before init.");
+    }
+
+    headless_ = true;
+    headless_extent_ = { width, height };
+}
+
 uint32_t GraphicsRunner::register_resource(const ResourceInfo &info)
 {
-    RenderableResource resource;
-    resource.id = nextResourceId_++;
-    resource.model = info.model;
+    return register_resources({info}).front();
+}
+
+std::vector<uint32_t> GraphicsRunner::register_resources(const std::vector<ResourceInfo> &infos)
+{
+    // queue every distinct texture first so the workers decode while the models load
+    std::unordered_map<std::string, PendingTexture> textures;
+    for (const auto& info : infos)
+    {
+        if (textures.contains(info.texture_path))
+        {
+            continue;
+        }
+
+        auto& texture = textures[info.texture_path];
+        texture.staging = std::make_shared<StagingTexture>();
+
+        const auto decode_path = find_compressed_texture(info.texture_path).value_or(info.texture_path);
+        texture.decoding = texture_decoder_.decode(decode_path, [this, staging = texture.staging](const VkDeviceSize size)
+        {
+            return create_staging_buffer(size, staging->buffer, staging->allocation);
+        });
+    }
+
+    // streams keep their staging buffer, the rest go once the initial uploads are done
+    const auto release_staging_textures = [this, &textures]
+    {
+        for (auto& texture : textures | std::views::values)
+        {
+            // a worker may still be writing to it
+            if (texture.decoding.valid())
+            {
+                texture.decoding.wait();
+            }
+
+            if (texture.staging->buffer != VK_NULL_HANDLE)
+            {
+                release_staging_texture(std::move(texture.staging));
+            }
+        }
+    };
+
+    std::vector<uint32_t> resource_ids;
+
+    try
+    {
+        for (const auto& info : infos)
+        {
+            RenderableResource resource;
+            resource.id = nextResourceId_++;
+            resource.transform_index = allocate_transform(info.model);
+            resource.pipeline_state = info.pipeline_state;
+
+            // start compiling the variant now, it is usually ready before the first draw
+            pipeline_manager_.get(get_pipeline_state(resource.pipeline_state));
+
+            create_model_buffers(info.model_path, resource);
 
+            auto& texture = textures.at(info.texture_path);
+            if (texture.decoding.valid())
+            {
+                texture.staging->texture = texture.decoding.get();
+            }
+
+            upload_texture(texture.staging->buffer, texture.staging->texture, resource);
+            create_texture_image_view(resource);
+            create_texture_sampler(resource);
+            create_texture_descriptor_set(resource);
+
+            if (resource.resident_mip_level > 0)
+            {
+                texture_streams_.push_back({resource.id, texture.staging, 0});
+            }
+
+            resource.cull_slot = frustum_culler_.add(resource.id, bounds::transform(resource.bounds.sphere, info.model));
+            resource.bvh_proxy = scene_bvh_.insert(resource.id, bounds::transform(resource.bounds.box, info.model));
+
+            resources_[resource.id] = resource;
+            resource_ids.push_back(resource.id);
+        }
+    }
+    catch (...)
+    {
+        release_staging_textures();
+        throw;
+    }
+
+    release_staging_textures();
+
+    return resource_ids;
+}
+
+void GraphicsRunner::create_model_buffers(const std::string &model_path, RenderableResource &resource)
+{
     // Load model (with caching)
-    if (vertex_cache_.contains(info.model_path) && index_cache_.contains(info.model_path))
+    if (vertex_cache_.contains(model_path) && index_cache_.contains(model_path))
     {
-        resource.vertices = vertex_cache_[info.model_path];
-        resource.indices = index_cache_[info.model_path];
+        resource.vertices = vertex_cache_[model_path];
+        resource.indices = index_cache_[model_path];
+        resource.bounds = bounds_cache_[model_path];
     }
     else
     {
-        model_loading::load_model(resource.vertices, resource.indices, info.model_path);
-        vertex_cache_[info.model_path] = resource.vertices;
-        index_cache_[info.model_path] = resource.indices;
+        model_loading::load_model(resource.vertices, resource.indices, resource.bounds, model_path);
+        vertex_cache_[model_path] = resource.vertices;
+        index_cache_[model_path] = resource.indices;
+        bounds_cache_[model_path] = resource.bounds;
     }
 
     logging::info(std::format("Vertices' size: {}, Indices' size: {}",
@@ -95,8 +237,11 @@ uint32_t GraphicsRunner::register_resource(const ResourceInfo &info)
 
     copy_buffer(staging_vertex_buffer, resource.vertexBuffer, vertex_buffer_size);
 
-    // Destroy the staging vertex buffer using VMA
-    vmaDestroyBuffer(allocator_, staging_vertex_buffer, staging_vertex_allocation);
+    // Destroy the staging vertex buffer using VMA once the copy is done
+    retire([this, staging_vertex_buffer, staging_vertex_allocation]
+    {
+        vmaDestroyBuffer(allocator_, staging_vertex_buffer, staging_vertex_allocation);
+    });
 
     // --- Create index buffer using a staging buffer with VMA ---
     const VkDeviceSize index_buffer_size = sizeof(uint32_t) * resource.indices.size();
@@ -120,25 +265,73 @@ uint32_t GraphicsRunner::register_resource(const ResourceInfo &info)
                   resource.indexBufferAllocation);
 
     copy_buffer(staging_index_buffer, resource.indexBuffer, index_buffer_size);
-    vmaDestroyBuffer(allocator_, staging_index_buffer, staging_index_allocation);
-
-    // --- Create texture image, image view, and sampler ---
-    // (Assuming create_texture_image has been updated to use VMA internally)
-    create_texture_image(info.texture_path, resource);
-    create_texture_image_view(resource);
-    create_texture_sampler(resource);
+    retire([this, staging_index_buffer, staging_index_allocation]
+    {
+        vmaDestroyBuffer(allocator_, staging_index_buffer, staging_index_allocation);
+    });
+}
 
+void GraphicsRunner::create_texture_descriptor_set(RenderableResource &resource)
+{
     // Allocate a descriptor set for this resource’s texture.
     VkDescriptorSetAllocateInfo alloc_info{};
     alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    alloc_info.descriptorPool = descriptor_pool_;
     alloc_info.descriptorSetCount = 1;
     alloc_info.pSetLayouts = &texture_descriptor_set_layout_;
-    if (vkAllocateDescriptorSets(device_, &alloc_info, &resource.texture_descriptor_set) != VK_SUCCESS)
+
+    // the newest pool is the likeliest to have room, older ones only have what was freed
+    VkResult result = VK_ERROR_OUT_OF_POOL_MEMORY;
+    for (auto pool = texture_descriptor_pools_.rbegin(); pool != texture_descriptor_pools_.rend(); ++pool)
+    {
+        alloc_info.descriptorPool = *pool;
+        result = vkAllocateDescriptorSets(device_, &alloc_info, &resource.texture_descriptor_set);
+        if (result != VK_ERROR_OUT_OF_POOL_MEMORY && result != VK_ERROR_FRAGMENTED_POOL)
+        {
+            break;
+        }
+    }
+
+    if (result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL)
+    {
+        alloc_info.descriptorPool = create_texture_descriptor_pool();
+        result = vkAllocateDescriptorSets(device_, &alloc_info, &resource.texture_descriptor_set);
+    }
+
+    if (result != VK_SUCCESS)
     {
         throw std::runtime_error("Error: unable to allocate texture descriptor set for resource");
     }
-    
+    resource.texture_descriptor_pool = alloc_info.descriptorPool;
+
+    write_texture_descriptor_set(resource);
+}
+
+VkDescriptorPool GraphicsRunner::create_texture_descriptor_pool()
+{
+    VkDescriptorPoolSize pool_size{};
+    pool_size.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    pool_size.descriptorCount = texture_sets_per_pool_;
+
+    VkDescriptorPoolCreateInfo pool_create_info{};
+    pool_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    // resources come and go, and streamed textures replace their set whenever a level lands
+    pool_create_info.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
+    pool_create_info.poolSizeCount = 1;
+    pool_create_info.pPoolSizes = &pool_size;
+    pool_create_info.maxSets = texture_sets_per_pool_;
+
+    VkDescriptorPool pool;
+    if (vkCreateDescriptorPool(device_, &pool_create_info, nullptr, &pool) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Error: unable to create texture descriptor pool.");
+    }
+    texture_descriptor_pools_.push_back(pool);
+
+    return pool;
+}
+
+void GraphicsRunner::write_texture_descriptor_set(const RenderableResource &resource)
+{
     // Update the texture descriptor set with the resource’s texture info.
     VkDescriptorImageInfo image_info{};
     image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
@@ -155,16 +348,112 @@ uint32_t GraphicsRunner::register_resource(const ResourceInfo &info)
     descriptor_write.pImageInfo = &image_info;
     
     vkUpdateDescriptorSets(device_, 1, &descriptor_write, 0, nullptr);
+}
+
+void GraphicsRunner::set_present_mode(const VkPresentModeKHR present_mode)
+{
+    if (present_mode == requested_present_mode_)
+    {
+        return;
+    }
+
+    requested_present_mode_ = present_mode;
+
+    // an existing swap chain is rebuilt after the next present
+    swap_chain_outdated_ = swap_chain_ != VK_NULL_HANDLE;
+}
+
+void GraphicsRunner::set_swap_chain_image_count(const uint32_t image_count)
+{
+    requested_swap_chain_image_count_ = image_count;
+    swap_chain_outdated_ = swap_chain_ != VK_NULL_HANDLE;
+}
+
+void GraphicsRunner::set_frames_in_flight(const uint32_t frames_in_flight)
+{
+    // applied at the start of the next frame, when nothing is being recorded
+    requested_frames_in_flight_ = std::clamp(frames_in_flight, 1u, max_frames_in_flight_limit_);
+}
+
+void GraphicsRunner::set_per_image_acquire_semaphores(const bool enabled)
+{
+    requested_per_image_semaphores_ = enabled;
+    swap_chain_outdated_ = swap_chain_ != VK_NULL_HANDLE;
+}
+
+void GraphicsRunner::set_frame_rate_limit(const double frames_per_second)
+{
+    frame_limiter_.set_target_frame_rate(frames_per_second);
+}
+
+void GraphicsRunner::set_frustum_culling(const bool enabled)
+{
+    frustum_culling_ = enabled;
+}
+
+void GraphicsRunner::set_bvh_culling(const bool enabled)
+{
+    bvh_culling_ = enabled;
+}
+
+void GraphicsRunner::set_occlusion_culling(const bool enabled)
+{
+    occlusion_culling_ = enabled;
+}
+
+void GraphicsRunner::set_quality_tier(const QualityTier& tier)
+{
+    requested_quality_tier_ = tier;
+    // before init the tier is simply picked up by it
+    quality_outdated_ = device_ != VK_NULL_HANDLE;
+}
+
+void GraphicsRunner::set_dynamic_resolution(const bool enabled, const double target_milliseconds, const float min_scale)
+{
+    requested_dynamic_resolution_ = enabled;
+    quality_outdated_ = device_ != VK_NULL_HANDLE && enabled != dynamic_resolution_;
 
-    resources_[resource.id] = resource;
-    return resource.id;
+    dynamic_resolution_min_scale_ = min_scale;
+
+    auto settings = resolution_.get_settings();
+    settings.target_milliseconds = target_milliseconds;
+    resolution_.set_settings(settings);
+    update_resolution_settings();
+}
+
+void GraphicsRunner::set_gpu_pipeline_statistics(const bool enabled)
+{
+    gpu_profiler_.set_pipeline_statistics(enabled);
+}
+
+VkDeviceSize GraphicsRunner::get_gpu_memory_usage() const
+{
+    VmaTotalStatistics statistics;
+    vmaCalculateStatistics(allocator_, &statistics);
+    return statistics.total.statistics.allocationBytes;
+}
+
+void GraphicsRunner::set_texture_streaming(const bool enabled, const VkDeviceSize upload_budget)
+{
+    texture_streaming_ = enabled;
+    texture_upload_budget_ = upload_budget;
 }
 
 void GraphicsRunner::update_resource(const uint32_t resource_id, const glm::mat4 &new_ubo)
 {
     if (resources_.contains(resource_id))
     {
-        resources_[resource_id].model = new_ubo;
+        auto& resource = resources_[resource_id];
+
+        // callers that update everything every frame only pay for the ones that moved
+        if (transforms_[resource.transform_index] == new_ubo)
+        {
+            return;
+        }
+
+        set_transform(resource.transform_index, new_ubo);
+        frustum_culler_.update(resource.cull_slot, bounds::transform(resource.bounds.sphere, new_ubo));
+        scene_bvh_.update(resource.bvh_proxy, bounds::transform(resource.bounds.box, new_ubo));
     }
     else
     {
@@ -176,12 +465,43 @@ void GraphicsRunner::unregister_resource(uint32_t resource_id)
 {
     if (resources_.contains(resource_id))
     {
-        vkDestroySampler(device_, resources_[resource_id].texture_sampler, nullptr);
-        vkDestroyImageView(device_, resources_[resource_id].texture_image_view, nullptr);
-        vmaDestroyImage(allocator_, resources_[resource_id].texture_image, resources_[resource_id].textureImageAllocation);
+        for (auto stream = texture_streams_.begin(); stream != texture_streams_.end(); ++stream)
+        {
+            if (stream->resource_id == resource_id)
+            {
+                release_staging_texture(std::move(stream->staging));
+                texture_streams_.erase(stream);
+                break;
+            }
+        }
+
+        // frames in flight may still draw it
+        const auto& resource = resources_[resource_id];
+        retire([this, descriptor_pool = resource.texture_descriptor_pool, descriptor_set = resource.texture_descriptor_set,
+                sampler = resource.texture_sampler, image_view = resource.texture_image_view,
+                image = resource.texture_image, image_allocation = resource.textureImageAllocation,
+                vertex_buffer = resource.vertexBuffer, vertex_allocation = resource.vertexBufferAllocation,
+                index_buffer = resource.indexBuffer, index_allocation = resource.indexBufferAllocation]
+        {
+            vkFreeDescriptorSets(device_, descriptor_pool, 1, &descriptor_set);
+            vkDestroySampler(device_, sampler, nullptr);
+            vkDestroyImageView(device_, image_view, nullptr);
+            vmaDestroyImage(allocator_, image, image_allocation);
+
+            vmaDestroyBuffer(allocator_, vertex_buffer, vertex_allocation);
+            vmaDestroyBuffer(allocator_, index_buffer, index_allocation);
+        });
+
+        if (const auto moved = frustum_culler_.remove(resources_[resource_id].cull_slot))
+        {
+            resources_[*moved].cull_slot = resources_[resource_id].cull_slot;
+        }
+
+        scene_bvh_.remove(resources_[resource_id].bvh_proxy);
+
+        // frames in flight read their own copy, which the next owner only overwrites once they are done
+        free_transform_indices_.push_back(resources_[resource_id].transform_index);
 
-        vmaDestroyBuffer(allocator_, resources_[resource_id].vertexBuffer, resources_[resource_id].vertexBufferAllocation);
-        vmaDestroyBuffer(allocator_, resources_[resource_id].indexBuffer, resources_[resource_id].indexBufferAllocation);
         resources_.erase(resource_id);
     }
     else
@@ -193,16 +513,9 @@ void GraphicsRunner::unregister_resource(uint32_t resource_id)
 void GraphicsRunner::frame_buffer_resize_callback(GLFWwindow *window, int width, int height)
 {
     const auto app = static_cast<GraphicsRunner*>(glfwGetWindowUserPointer(window));
+
+    // the swap chain is recreated after the next present, outside of the callback
     app->frame_buffer_resized = true;
-    
-    // this is a workaround to render while resizing
-    if (width > 0 && height > 0)
-    {
-        // recreates the frame buffers
-        app->draw_frame();
-        // actually draws the frame
-        app->draw_frame();
-    }
 }
 
 void GraphicsRunner::init_window()
@@ -226,22 +539,35 @@ void GraphicsRunner::init_vulkan()
     create_surface();
     select_physical_device();
     create_logical_device();
+    depth_format_ = find_depth_format();
+    quality_tier_ = get_supported_quality_tier(requested_quality_tier_);
+    dynamic_resolution_ = requested_dynamic_resolution_;
+    update_resolution_settings();
     create_vma_allocator();
+    create_pipeline_cache();
+    texture_decoder_.create();
+    job_system_.create();
+    frustum_culler_.create(&job_system_);
     create_swap_chain();
     create_image_views();
+    create_upscaler();
     create_render_pass();
     create_global_descriptor_set_layout();
     create_texture_descriptor_set_layout();
     create_graphics_pipeline();
     create_command_pools();
-    create_color_resources();
-    create_depth_resources();
-    create_frame_buffers();
+    create_occlusion_culler();
+    create_render_graph();
+    create_attachments();
+    max_frames_in_flight_ = requested_frames_in_flight_;
     create_uniform_buffers();
+    create_transform_buffers();
     create_descriptor_pool();
     create_descriptor_sets();
     create_command_buffers();
     create_sync_objects();
+    create_image_semaphores();
+    create_gpu_profiler();
 }
 
 void GraphicsRunner::create_instance()
@@ -257,7 +583,8 @@ void GraphicsRunner::create_instance()
     app_info.pApplicationName = "Hello Triangle";
     app_info.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
     app_info.pEngineName = "No Engine";
-    app_info.apiVersion = VK_API_VERSION_1_0;
+    // 1.3 for timeline semaphores and synchronization2 in core
+    app_info.apiVersion = VK_API_VERSION_1_3;
 
     VkInstanceCreateInfo create_info{};
     create_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -368,11 +695,17 @@ void GraphicsRunner::set_up_debug_messenger()
 
 std::vector<const char *> GraphicsRunner::get_required_extensions()
 {
-    uint32_t glfw_extension_count = 0;
+    std::vector<const char*> extensions;
+
+    // glfw isn't initialized without a window, and nothing needs surface extensions
+    if (!headless_)
+    {
+        uint32_t glfw_extension_count = 0;
 
-    const char **glfw_extensions = glfwGetRequiredInstanceExtensions(&glfw_extension_count);
+        const char **glfw_extensions = glfwGetRequiredInstanceExtensions(&glfw_extension_count);
 
-    std::vector extensions(glfw_extensions, glfw_extensions + glfw_extension_count);
+        extensions.assign(glfw_extensions, glfw_extensions + glfw_extension_count);
+    }
 
     if (enable_validation_layers_)
     {
@@ -446,7 +779,8 @@ bool GraphicsRunner::are_device_extensions_supported(const VkPhysicalDevice devi
     std::vector<VkExtensionProperties> available_extensions(extension_count);
     vkEnumerateDeviceExtensionProperties(device, nullptr, &extension_count, available_extensions.data());
 
-    std::set<std::string> required_extensions(device_extensions_.begin(), device_extensions_.end());
+    const auto device_extensions = get_device_extensions();
+    std::set<std::string> required_extensions(device_extensions.begin(), device_extensions.end());
 
     for (const auto& extension : available_extensions)
     {
@@ -456,6 +790,19 @@ bool GraphicsRunner::are_device_extensions_supported(const VkPhysicalDevice devi
     return required_extensions.empty();
 }
 
+std::vector<const char*> GraphicsRunner::get_device_extensions()
+{
+    auto extensions = device_extensions_;
+
+    // offscreen frames are never presented
+    if (headless_)
+    {
+        std::erase_if(extensions, [](const char* extension) { return strcmp(extension, VK_KHR_SWAPCHAIN_EXTENSION_NAME) == 0; });
+    }
+
+    return extensions;
+}
+
 SwapChainSupportDetails GraphicsRunner::get_swap_chain_support_details(VkPhysicalDevice device)
 {
     SwapChainSupportDetails details;
@@ -496,13 +843,17 @@ int GraphicsRunner::rate_device(const VkPhysicalDevice device)
         return 0;
     }
 
+    if (!is_timeline_synchronization_supported(device))
+    {
+        return 0;
+    }
+
     if (!are_device_extensions_supported(device))
     {
         return 0;
     }
     
-    auto swap_chain_details = get_swap_chain_support_details(device);
-    if (!swap_chain_details.is_complete())
+    if (!headless_ && !get_swap_chain_support_details(device).is_complete())
     {
         return 0;
     }
@@ -529,7 +880,7 @@ int GraphicsRunner::rate_device(const VkPhysicalDevice device)
     return score;
 }
 
-VkSampleCountFlagBits GraphicsRunner::get_max_usable_sample_count()
+VkSampleCountFlagBits GraphicsRunner::get_usable_sample_count(const VkSampleCountFlagBits requested)
 {
     VkPhysicalDeviceProperties physical_device_properties;
     vkGetPhysicalDeviceProperties(physical_device_, &physical_device_properties);
@@ -548,7 +899,7 @@ VkSampleCountFlagBits GraphicsRunner::get_max_usable_sample_count()
 
     for (const auto possible_count : possible_counts)
     {
-        if (counts & possible_count)
+        if (possible_count <= requested && (counts & possible_count))
         {
             return possible_count;
         }
@@ -557,6 +908,89 @@ VkSampleCountFlagBits GraphicsRunner::get_max_usable_sample_count()
     return VK_SAMPLE_COUNT_1_BIT;
 }
 
+QualityTier GraphicsRunner::get_supported_quality_tier(QualityTier tier)
+{
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physical_device_, &properties);
+
+    tier.samples = get_usable_sample_count(tier.samples);
+    tier.sample_shading = tier.sample_shading && sample_rate_shading_supported_ && tier.samples != VK_SAMPLE_COUNT_1_BIT;
+    tier.max_anisotropy = std::clamp(tier.max_anisotropy, 1.0f, properties.limits.maxSamplerAnisotropy);
+    tier.resolution_scale = std::clamp(tier.resolution_scale, 0.1f, 1.0f);
+
+    return tier;
+}
+
+void GraphicsRunner::apply_quality_settings()
+{
+    PROFILE_ZONE("apply quality settings");
+
+    // nothing that is about to be rebuilt may still be in use
+    vkDeviceWaitIdle(device_);
+
+    const auto previous_tier = quality_tier_;
+    const bool was_upscaling = is_upscaling_active();
+
+    // the attachments are cleaned up as they were made, before the settings change
+    const auto tier = get_supported_quality_tier(requested_quality_tier_);
+    const bool upscaling = upscaler_.is_available() && (requested_dynamic_resolution_ || tier.resolution_scale < 1.0f);
+    const bool samples_changed = tier.samples != previous_tier.samples;
+    const bool rebuild_attachments = samples_changed || upscaling != was_upscaling;
+
+    if (rebuild_attachments)
+    {
+        clean_up_attachments();
+    }
+
+    quality_tier_ = tier;
+    dynamic_resolution_ = requested_dynamic_resolution_;
+    update_resolution_settings();
+
+    if (rebuild_attachments)
+    {
+        if (samples_changed)
+        {
+            // the pyramid's first reduction reads the depth attachment at its sample count
+            occlusion_culler_.clean();
+            create_occlusion_culler();
+
+            // so do the pipelines, through the render pass they are created against
+            const auto previous_render_pass = render_pass_;
+            create_render_pass();
+            pipeline_manager_.set_render_pass(render_pass_);
+            vkDestroyRenderPass(device_, previous_render_pass, nullptr);
+
+            // the fallback for the sample count's variants
+            pipeline_manager_.get_blocking(get_pipeline_state({}));
+        }
+
+        create_attachments();
+    }
+
+    if (quality_tier_.max_anisotropy != previous_tier.max_anisotropy)
+    {
+        for (auto& resource : resources_ | std::views::values)
+        {
+            vkDestroySampler(device_, resource.texture_sampler, nullptr);
+            create_texture_sampler(resource);
+            write_texture_descriptor_set(resource);
+        }
+    }
+
+    logging::info(std::format("Using the {} quality tier ({}x msaa{}, {}x anisotropy, {:.2f} resolution scale{})",
+                              quality_tier_.name, static_cast<uint32_t>(quality_tier_.samples),
+                              quality_tier_.sample_shading ? " with sample shading" : "", quality_tier_.max_anisotropy,
+                              quality_tier_.resolution_scale, dynamic_resolution_ ? " at most" : ""));
+}
+
+void GraphicsRunner::update_resolution_settings()
+{
+    auto settings = resolution_.get_settings();
+    settings.max_scale = quality_tier_.resolution_scale;
+    settings.min_scale = std::min(dynamic_resolution_min_scale_, settings.max_scale);
+    resolution_.set_settings(settings);
+}
+
 void GraphicsRunner::select_physical_device()
 {
     uint32_t device_count = 0;
@@ -582,8 +1016,6 @@ void GraphicsRunner::select_physical_device()
         }
     }
 
-    msaa_samples_ = get_max_usable_sample_count();
-
     if (highest_rating == 0 || physical_device_ == VK_NULL_HANDLE)
     {
         throw std::runtime_error("Error: no suitable GPUs found.");
@@ -610,7 +1042,15 @@ QueueFamilyIndices GraphicsRunner::find_queue_families(VkPhysicalDevice device)
         }
 
         VkBool32 present_support = false;
-        vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface_, &present_support);
+        if (headless_)
+        {
+            // nothing is presented, the graphics queue stands in for the present queue
+            present_support = graphics_support;
+        }
+        else
+        {
+            vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface_, &present_support);
+        }
         
         // if it supports graphics and present, set it to that
         if (graphics_support && present_support)
@@ -630,6 +1070,12 @@ QueueFamilyIndices GraphicsRunner::find_queue_families(VkPhysicalDevice device)
         {
             indices.present_family = i;
         }
+
+        // only a family without graphics runs alongside the graphics queue
+        if ((queue_family.queueFlags & VK_QUEUE_COMPUTE_BIT) && !graphics_support && !indices.compute_family.has_value())
+        {
+            indices.compute_family = i;
+        }
         
         i++;
     }
@@ -652,6 +1098,14 @@ void GraphicsRunner::create_logical_device()
         indices.present_family.value(),
     };
 
+    if (indices.compute_family.has_value())
+    {
+        queue_families.insert(indices.compute_family.value());
+    }
+
+    // outlives the loop, vkCreateDevice reads it
+    const float queue_priority = 1.0f;
+
     std::vector<VkDeviceQueueCreateInfo> queue_create_infos;
     for (auto queue_family : queue_families)
     {
@@ -659,23 +1113,59 @@ void GraphicsRunner::create_logical_device()
         queue_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
         queue_create_info.queueFamilyIndex = queue_family;
         queue_create_info.queueCount = 1;
-
-        float queue_priority = 1.0f;
         queue_create_info.pQueuePriorities = &queue_priority;
         queue_create_infos.push_back(queue_create_info);
     }
 
+    VkPhysicalDeviceFeatures supported_features;
+    vkGetPhysicalDeviceFeatures(physical_device_, &supported_features);
+
     VkPhysicalDeviceFeatures device_features{};
     device_features.samplerAnisotropy = VK_TRUE;
-    device_features.sampleRateShading = VK_TRUE;
+    // only quality tiers that ask for sample shading use it
+    device_features.sampleRateShading = supported_features.sampleRateShading;
+    sample_rate_shading_supported_ = supported_features.sampleRateShading == VK_TRUE;
+    // block compressed textures are optional, we fall back to rgba8 when none are supported
+    device_features.textureCompressionBC = supported_features.textureCompressionBC;
+    device_features.textureCompressionETC2 = supported_features.textureCompressionETC2;
+    device_features.textureCompressionASTC_LDR = supported_features.textureCompressionASTC_LDR;
+    // vertex and fragment invocation counts for the gpu profiler
+    device_features.pipelineStatisticsQuery = supported_features.pipelineStatisticsQuery;
+    pipeline_statistics_supported_ = supported_features.pipelineStatisticsQuery == VK_TRUE;
+
+    auto extensions = get_device_extensions();
+
+    // pipeline variants are linked from shared parts when the driver supports it
+    VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT pipeline_library_features{};
+    pipeline_library_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT;
+    graphics_pipeline_library_supported_ = is_graphics_pipeline_library_supported();
+
+    if (graphics_pipeline_library_supported_)
+    {
+        pipeline_library_features.graphicsPipelineLibrary = VK_TRUE;
+        extensions.push_back(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME);
+        extensions.push_back(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME);
+    }
+
+    // rate_device only picks devices with both
+    VkPhysicalDeviceVulkan13Features vulkan_13_features{};
+    vulkan_13_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+    vulkan_13_features.synchronization2 = VK_TRUE;
+    vulkan_13_features.pNext = graphics_pipeline_library_supported_ ? &pipeline_library_features : nullptr;
+
+    VkPhysicalDeviceVulkan12Features vulkan_12_features{};
+    vulkan_12_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    vulkan_12_features.timelineSemaphore = VK_TRUE;
+    vulkan_12_features.pNext = &vulkan_13_features;
 
     VkDeviceCreateInfo create_info{};
     create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    create_info.pNext = &vulkan_12_features;
     create_info.queueCreateInfoCount = static_cast<uint32_t>(queue_create_infos.size());
     create_info.pQueueCreateInfos = queue_create_infos.data();
     create_info.pEnabledFeatures = &device_features;
-    create_info.enabledExtensionCount = static_cast<uint32_t>(device_extensions_.size());
-    create_info.ppEnabledExtensionNames = device_extensions_.data();
+    create_info.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+    create_info.ppEnabledExtensionNames = extensions.data();
 
     if (enable_validation_layers_)
     {
@@ -694,39 +1184,215 @@ void GraphicsRunner::create_logical_device()
 
     vkGetDeviceQueue(device_, indices.graphics_family.value(), 0, &graphics_queue_);
     vkGetDeviceQueue(device_, indices.present_family.value(), 0, &present_queue_);
+
+    CreateQueueTimelineInfo timeline_info{};
+    timeline_info.device = device_;
+    timeline_info.queue = graphics_queue_;
+    graphics_timeline_.create(timeline_info);
+
+    CreateComputeQueueInfo compute_info{};
+    compute_info.device = device_;
+    compute_info.shares_graphics_queue = !indices.compute_family.has_value();
+    compute_info.queue_family = indices.compute_family.value_or(indices.graphics_family.value());
+    vkGetDeviceQueue(device_, compute_info.queue_family, 0, &compute_info.queue);
+    compute_queue_.create(compute_info);
+
+    logging::info(compute_info.shares_graphics_queue
+        ? std::string("No separate compute queue family, compute work runs on the graphics queue")
+        : std::format("Using queue family {} for async compute", compute_info.queue_family));
 }
 
-void GraphicsRunner::create_vma_allocator()
+bool GraphicsRunner::is_timeline_synchronization_supported(const VkPhysicalDevice device)
 {
-    VmaAllocatorCreateInfo allocatorInfo = {};
-    allocatorInfo.physicalDevice = physical_device_;
-    allocatorInfo.device = device_;
-    allocatorInfo.instance = instance_;
-    allocatorInfo.vulkanApiVersion = VK_API_VERSION_1_0;
-    if (vmaCreateAllocator(&allocatorInfo, &allocator_) != VK_SUCCESS)
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(device, &properties);
+
+    if (properties.apiVersion < VK_API_VERSION_1_3)
     {
-        throw std::runtime_error("Error: failed to create VMA allocator.");
+        return false;
     }
+
+    VkPhysicalDeviceVulkan13Features vulkan_13_features{};
+    vulkan_13_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+
+    VkPhysicalDeviceVulkan12Features vulkan_12_features{};
+    vulkan_12_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    vulkan_12_features.pNext = &vulkan_13_features;
+
+    VkPhysicalDeviceFeatures2 features{};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &vulkan_12_features;
+    vkGetPhysicalDeviceFeatures2(device, &features);
+
+    return vulkan_12_features.timelineSemaphore == VK_TRUE && vulkan_13_features.synchronization2 == VK_TRUE;
 }
 
-void GraphicsRunner::create_surface()
+bool GraphicsRunner::is_graphics_pipeline_library_supported()
 {
-    if (glfwCreateWindowSurface(instance_, window_, nullptr, &surface_) != VK_SUCCESS)
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physical_device_, &properties);
+
+    if (properties.apiVersion < VK_API_VERSION_1_1)
     {
-        throw std::runtime_error("Error: unable to create surface.");
+        return false;
     }
-}
 
-VkSurfaceFormatKHR GraphicsRunner::select_swap_surface_format(const std::vector<VkSurfaceFormatKHR> &available_formats)
-{
-    if (available_formats.empty())
+    uint32_t extension_count = 0;
+    vkEnumerateDeviceExtensionProperties(physical_device_, nullptr, &extension_count, nullptr);
+
+    std::vector<VkExtensionProperties> available_extensions(extension_count);
+    vkEnumerateDeviceExtensionProperties(physical_device_, nullptr, &extension_count, available_extensions.data());
+
+    std::set<std::string> required_extensions =
     {
-        throw std::runtime_error("Error: no available surface formats.");
-    }
-    
-    for (const auto& available_format : available_formats)
+        VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME,
+        VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME,
+    };
+
+    for (const auto& extension : available_extensions)
     {
-        if (available_format.format == VK_FORMAT_B8G8R8A8_SRGB && available_format.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR)
+        required_extensions.erase(extension.extensionName);
+    }
+
+    if (!required_extensions.empty())
+    {
+        return false;
+    }
+
+    VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT pipeline_library_features{};
+    pipeline_library_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT;
+
+    VkPhysicalDeviceFeatures2 features{};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &pipeline_library_features;
+    vkGetPhysicalDeviceFeatures2(physical_device_, &features);
+
+    return pipeline_library_features.graphicsPipelineLibrary == VK_TRUE;
+}
+
+void GraphicsRunner::create_vma_allocator()
+{
+    VmaAllocatorCreateInfo allocatorInfo = {};
+    allocatorInfo.physicalDevice = physical_device_;
+    allocatorInfo.device = device_;
+    allocatorInfo.instance = instance_;
+    // the instance and the required device features are 1.3, let vma use the core paths
+    allocatorInfo.vulkanApiVersion = VK_API_VERSION_1_3;
+    if (vmaCreateAllocator(&allocatorInfo, &allocator_) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Error: failed to create VMA allocator.");
+    }
+}
+
+void GraphicsRunner::create_pipeline_cache()
+{
+    std::vector<char> cache_data;
+
+    if (std::filesystem::exists(pipeline_cache_path_))
+    {
+        cache_data = read_file(pipeline_cache_path_);
+
+        if (!is_pipeline_cache_compatible(cache_data))
+        {
+            logging::info(std::format("Discarding {}, it was written by another driver or device", pipeline_cache_path_));
+            cache_data.clear();
+        }
+    }
+
+    VkPipelineCacheCreateInfo cache_create_info{};
+    cache_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    cache_create_info.initialDataSize = cache_data.size();
+    cache_create_info.pInitialData = cache_data.empty() ? nullptr : cache_data.data();
+
+    if (vkCreatePipelineCache(device_, &cache_create_info, nullptr, &pipeline_cache_) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Error: unable to create pipeline cache.");
+    }
+
+    pipeline_cache_warm_ = !cache_data.empty();
+    logging::info(std::format("Pipeline cache created {} with {} bytes of initial data",
+                              pipeline_cache_warm_ ? "warm" : "cold", cache_data.size()));
+}
+
+bool GraphicsRunner::is_pipeline_cache_compatible(const std::vector<char> &cache_data)
+{
+    // the driver also checks this, but some drivers crash on data from another device instead
+    VkPipelineCacheHeaderVersionOne header;
+    if (cache_data.size() < sizeof(header))
+    {
+        return false;
+    }
+
+    memcpy(&header, cache_data.data(), sizeof(header));
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physical_device_, &properties);
+
+    return header.headerSize >= sizeof(header)
+        && header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+        && header.vendorID == properties.vendorID
+        && header.deviceID == properties.deviceID
+        && memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+void GraphicsRunner::save_pipeline_cache()
+{
+    size_t cache_size = 0;
+    vkGetPipelineCacheData(device_, pipeline_cache_, &cache_size, nullptr);
+
+    std::vector<char> cache_data(cache_size);
+    if (vkGetPipelineCacheData(device_, pipeline_cache_, &cache_size, cache_data.data()) != VK_SUCCESS)
+    {
+        logging::warning("Unable to read back the pipeline cache");
+        return;
+    }
+
+    // write to a temporary file first so a crash mid-write can't leave a truncated cache behind
+    const auto temporary_path = pipeline_cache_path_ + ".tmp";
+    {
+        std::ofstream file(temporary_path, std::ios::binary | std::ios::trunc);
+
+        if (!file.is_open())
+        {
+            logging::warning(std::format("Unable to write pipeline cache {}", pipeline_cache_path_));
+            return;
+        }
+
+        file.write(cache_data.data(), static_cast<long long>(cache_size));
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temporary_path, pipeline_cache_path_, error);
+
+    if (error)
+    {
+        logging::warning(std::format("Unable to write pipeline cache {} - {}", pipeline_cache_path_, error.message()));
+    }
+}
+
+void GraphicsRunner::create_surface()
+{
+    if (headless_)
+    {
+        return;
+    }
+
+    if (glfwCreateWindowSurface(instance_, window_, nullptr, &surface_) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Error: unable to create surface.");
+    }
+}
+
+VkSurfaceFormatKHR GraphicsRunner::select_swap_surface_format(const std::vector<VkSurfaceFormatKHR> &available_formats)
+{
+    if (available_formats.empty())
+    {
+        throw std::runtime_error("Error: no available surface formats.");
+    }
+    
+    for (const auto& available_format : available_formats)
+    {
+        if (available_format.format == VK_FORMAT_B8G8R8A8_SRGB && available_format.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR)
         {
             return available_format;
         }
@@ -737,12 +1403,28 @@ VkSurfaceFormatKHR GraphicsRunner::select_swap_surface_format(const std::vector<
 
 VkPresentModeKHR GraphicsRunner::select_swap_present_mode(const std::vector<VkPresentModeKHR>& available_present_modes)
 {
-    for (const auto& available_present_mode : available_present_modes)
+    // closest alternatives first, FIFO is the only mode every device has to support
+    std::vector<VkPresentModeKHR> preferred_modes;
+    switch (requested_present_mode_)
+    {
+    case VK_PRESENT_MODE_MAILBOX_KHR:
+        preferred_modes = { VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR };
+        break;
+    case VK_PRESENT_MODE_IMMEDIATE_KHR:
+        preferred_modes = { VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR };
+        break;
+    case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+        preferred_modes = { VK_PRESENT_MODE_FIFO_RELAXED_KHR };
+        break;
+    default:
+        break;
+    }
+
+    for (const auto preferred_mode : preferred_modes)
     {
-        // TODO: switch to VK_PRESENT_MODE_MAILBOX_KHR if it gets more intensive to run. For now FIFO is good for not overworking the machine
-        if (available_present_mode == VK_PRESENT_MODE_FIFO_KHR)
+        if (std::ranges::find(available_present_modes, preferred_mode) != available_present_modes.end())
         {
-            return available_present_mode;
+            return preferred_mode;
         }
     }
 
@@ -774,9 +1456,15 @@ VkExtent2D GraphicsRunner::select_swap_extent(const VkSurfaceCapabilitiesKHR &ca
 
 void GraphicsRunner::recreate_swap_chain()
 {
+    PROFILE_ZONE("recreate swap chain");
+
     int width = 0, height = 0;
-    glfwGetFramebufferSize(window_, &width, &height);
-    while (width == 0 && height == 0)
+    if (!headless_)
+    {
+        glfwGetFramebufferSize(window_, &width, &height);
+    }
+
+    while (!headless_ && width == 0 && height == 0)
     {
         if (glfwWindowShouldClose(window_))
         {
@@ -786,27 +1474,43 @@ void GraphicsRunner::recreate_swap_chain()
         glfwGetFramebufferSize(window_, &width, &height);
         glfwWaitEvents();
     }
-    
-    vkDeviceWaitIdle(device_);
 
-    clean_up_swap_chain();
-    
+    // frames in flight keep rendering to and presenting the old images, the
+    // new swap chain takes over from the old one before it is destroyed
+    retire_swap_chain();
+    render_graph_.retire_framebuffers();
+
     create_swap_chain();
     create_image_views();
-    create_color_resources();
-    create_depth_resources();
-    create_frame_buffers();
+    create_image_semaphores();
+
+    // the graph keeps its images while the new size fits in them, the next frame creates anything else
 }
 
 void GraphicsRunner::create_swap_chain()
 {
+    if (headless_)
+    {
+        create_offscreen_targets();
+        return;
+    }
+
     const auto swap_chain_details = get_swap_chain_support_details(physical_device_);
 
     const auto surface_format = select_swap_surface_format(swap_chain_details.formats);
     const auto present_mode = select_swap_present_mode(swap_chain_details.present_modes);
+
+    if (present_mode != requested_present_mode_)
+    {
+        logging::warning(std::format("Present mode {} is unavailable, using {}",
+                                     get_present_mode_name(requested_present_mode_), get_present_mode_name(present_mode)));
+    }
     const auto extent = select_swap_extent(swap_chain_details.capabilities);
 
-    uint32_t image_count = swap_chain_details.capabilities.minImageCount + 1;
+    // one more than the minimum keeps the driver from blocking acquire by default
+    uint32_t image_count = requested_swap_chain_image_count_ == 0
+        ? swap_chain_details.capabilities.minImageCount + 1
+        : std::max(requested_swap_chain_image_count_, swap_chain_details.capabilities.minImageCount);
 
     if (swap_chain_details.capabilities.maxImageCount > 0 && image_count > swap_chain_details.capabilities.maxImageCount)
     {
@@ -851,9 +1555,11 @@ void GraphicsRunner::create_swap_chain()
     create_info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
 
     create_info.presentMode = present_mode;
+    present_mode_ = present_mode;
     create_info.clipped = VK_TRUE;
 
-    create_info.oldSwapchain = VK_NULL_HANDLE;
+    // a retired swap chain, its presented images are released to the new one
+    create_info.oldSwapchain = swap_chain_;
 
     if (vkCreateSwapchainKHR(device_, &create_info, nullptr, &swap_chain_) != VK_SUCCESS)
     {
@@ -870,13 +1576,33 @@ void GraphicsRunner::create_swap_chain()
     camera_->set_aspect_ratio(static_cast<float>(swap_chain_extent_.width) / static_cast<float>(swap_chain_extent_.height));
 }
 
+void GraphicsRunner::create_offscreen_targets()
+{
+    // one target per frame slot, a slot's target is free again once the slot's previous frame completed
+    swap_chain_images_.resize(max_frames_in_flight_limit_);
+    offscreen_image_allocations_.resize(max_frames_in_flight_limit_);
+
+    swap_chain_image_format_ = VK_FORMAT_R8G8B8A8_SRGB;
+    swap_chain_extent_ = headless_extent_;
+
+    for (size_t i = 0; i < swap_chain_images_.size(); ++i)
+    {
+        create_image(swap_chain_extent_.width, swap_chain_extent_.height, 1, VK_SAMPLE_COUNT_1_BIT,
+                     swap_chain_image_format_, VK_IMAGE_TILING_OPTIMAL,
+                     VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+                     VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, swap_chain_images_[i], offscreen_image_allocations_[i]);
+    }
+
+    camera_->set_aspect_ratio(static_cast<float>(swap_chain_extent_.width) / static_cast<float>(swap_chain_extent_.height));
+}
+
 void GraphicsRunner::create_image_views()
 {
     swap_chain_image_views_.resize(swap_chain_images_.size());
 
     for (size_t i = 0; i < swap_chain_images_.size(); ++i)
     {
-        swap_chain_image_views_[i] = create_image_view(swap_chain_images_[i], swap_chain_image_format_, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+        swap_chain_image_views_[i] = create_image_view(swap_chain_images_[i], swap_chain_image_format_, VK_IMAGE_ASPECT_COLOR_BIT, 0, 1);
     }
 }
 
@@ -916,36 +1642,30 @@ VkShaderModule GraphicsRunner::create_shader_module(const std::vector<char> &cod
 
 void GraphicsRunner::create_render_pass()
 {
+    // The render graph creates the render passes frames actually use. Pipelines
+    // only need a compatible one, and with a single subpass that means the same
+    // color and depth formats and sample counts, so load and store ops, layouts
+    // and dependencies are left at their simplest. Attachments are in the
+    // graph's order, colors, depth, then resolves.
+    const bool multisampled = quality_tier_.samples != VK_SAMPLE_COUNT_1_BIT;
+
     VkAttachmentDescription color_attachment{};
     color_attachment.format = swap_chain_image_format_;
-    color_attachment.samples = msaa_samples_;
-    // clears framebuffer to black before drawing new frame
-    color_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR; 
-    color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    color_attachment.samples = quality_tier_.samples;
+    color_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     color_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     color_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     color_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
     color_attachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
-    VkAttachmentDescription depth_attachment{};
-    depth_attachment.format = find_depth_format();
-    depth_attachment.samples = msaa_samples_;
-    depth_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    depth_attachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    depth_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    depth_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    depth_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VkAttachmentDescription depth_attachment = color_attachment;
+    depth_attachment.format = depth_format_;
     depth_attachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
-    VkAttachmentDescription color_attachment_resolve{};
-    color_attachment_resolve.format = swap_chain_image_format_;
+    // without msaa the scene is drawn straight into its target, there is nothing to resolve
+    VkAttachmentDescription color_attachment_resolve = color_attachment;
     color_attachment_resolve.samples = VK_SAMPLE_COUNT_1_BIT;
-    color_attachment_resolve.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    color_attachment_resolve.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-    color_attachment_resolve.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    color_attachment_resolve.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    color_attachment_resolve.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    color_attachment_resolve.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
     VkAttachmentReference color_attachment_reference{};
     color_attachment_reference.attachment = 0;
@@ -964,26 +1684,16 @@ void GraphicsRunner::create_render_pass()
     subpass.colorAttachmentCount = 1;
     subpass.pColorAttachments = &color_attachment_reference;
     subpass.pDepthStencilAttachment = &depth_attachment_reference;
-    subpass.pResolveAttachments = &color_attachment_resolve_reference;
-
-    VkSubpassDependency dependency{};
-    dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-    dependency.dstSubpass = 0;
-    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-    dependency.srcAccessMask = 0;
-    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    subpass.pResolveAttachments = multisampled ? &color_attachment_resolve_reference : nullptr;
 
     std::array attachments = {color_attachment, depth_attachment, color_attachment_resolve};
 
     VkRenderPassCreateInfo render_pass_create_info{};
     render_pass_create_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-    render_pass_create_info.attachmentCount = static_cast<uint32_t>(attachments.size());
+    render_pass_create_info.attachmentCount = multisampled ? 3 : 2;
     render_pass_create_info.pAttachments = attachments.data();
     render_pass_create_info.subpassCount = 1;
     render_pass_create_info.pSubpasses = &subpass;
-    render_pass_create_info.dependencyCount = 1;
-    render_pass_create_info.pDependencies = &dependency;
 
     if (vkCreateRenderPass(device_, &render_pass_create_info, nullptr, &render_pass_) != VK_SUCCESS)
     {
@@ -1004,10 +1714,19 @@ void GraphicsRunner::create_global_descriptor_set_layout()
     ubo_layout_binding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
     ubo_layout_binding.pImmutableSamplers = nullptr;
 
+    // the model matrices, indexed by a push constant per draw
+    VkDescriptorSetLayoutBinding transform_layout_binding{};
+    transform_layout_binding.binding = 1;
+    transform_layout_binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    transform_layout_binding.descriptorCount = 1;
+    transform_layout_binding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+    const std::array bindings = { ubo_layout_binding, transform_layout_binding };
+
     VkDescriptorSetLayoutCreateInfo layout_create_info{};
     layout_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-    layout_create_info.bindingCount = 1;
-    layout_create_info.pBindings = &ubo_layout_binding;
+    layout_create_info.bindingCount = static_cast<uint32_t>(bindings.size());
+    layout_create_info.pBindings = bindings.data();
     
     if (vkCreateDescriptorSetLayout(device_, &layout_create_info, nullptr, &global_descriptor_set_layout_) != VK_SUCCESS)
     {
@@ -1037,114 +1756,15 @@ void GraphicsRunner::create_texture_descriptor_set_layout()
 
 void GraphicsRunner::create_graphics_pipeline()
 {
-    auto vert_shader_code = read_file("Shaders/Vertex/vert.spv");
-    auto frag_shader_code = read_file("Shaders/Fragment/frag.spv");
-
-    auto vert_shader_module = create_shader_module(vert_shader_code);
-    auto frag_shader_module = create_shader_module(frag_shader_code);
-
-    VkPipelineShaderStageCreateInfo vert_shader_stage_create_info{};
-    vert_shader_stage_create_info.sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    vert_shader_stage_create_info.stage  = VK_SHADER_STAGE_VERTEX_BIT;
-    vert_shader_stage_create_info.module = vert_shader_module;
-    vert_shader_stage_create_info.pName  = "main";
-    
-    VkPipelineShaderStageCreateInfo frag_shader_stage_create_info{};
-    frag_shader_stage_create_info.sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    frag_shader_stage_create_info.stage  = VK_SHADER_STAGE_FRAGMENT_BIT;
-    frag_shader_stage_create_info.module = frag_shader_module;
-    frag_shader_stage_create_info.pName  = "main";
-
-    VkPipelineShaderStageCreateInfo shader_stages[] = {
-        vert_shader_stage_create_info,
-        frag_shader_stage_create_info
-    };
-
-    VkPipelineVertexInputStateCreateInfo vertex_input_info{};
-    auto binding_description = Vertex::get_binding_description();
-    auto attribute_descriptions = Vertex::get_attribute_descriptions();
-    vertex_input_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-    vertex_input_info.vertexBindingDescriptionCount   = 1;
-    vertex_input_info.pVertexBindingDescriptions      = &binding_description;
-    vertex_input_info.vertexAttributeDescriptionCount = static_cast<uint32_t>(attribute_descriptions.size());
-    vertex_input_info.pVertexAttributeDescriptions    = attribute_descriptions.data();
-
-    VkPipelineInputAssemblyStateCreateInfo input_assembly{};
-    input_assembly.sType                  = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-    input_assembly.topology               = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-    input_assembly.primitiveRestartEnable = VK_FALSE;
-
-    VkViewport viewport{};
-    viewport.x        = 0.0f;
-    viewport.y        = 0.0f;
-    viewport.width    = static_cast<float>(swap_chain_extent_.width);
-    viewport.height   = static_cast<float>(swap_chain_extent_.height);
-    viewport.minDepth = 0.0f;
-    viewport.maxDepth = 1.0f;
-
-    VkRect2D scissor{};
-    scissor.offset = { 0, 0 };
-    scissor.extent = swap_chain_extent_;
-
-    std::vector<VkDynamicState> dynamic_states = {
-        VK_DYNAMIC_STATE_VIEWPORT,
-        VK_DYNAMIC_STATE_SCISSOR
-    };
-
-    VkPipelineDynamicStateCreateInfo dynamic_state{};
-    dynamic_state.sType             = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-    dynamic_state.dynamicStateCount = static_cast<uint32_t>(dynamic_states.size());
-    dynamic_state.pDynamicStates    = dynamic_states.data();
-
-    VkPipelineViewportStateCreateInfo viewport_state{};
-    viewport_state.sType         = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-    viewport_state.viewportCount = 1;
-    viewport_state.pViewports    = &viewport;
-    viewport_state.scissorCount  = 1;
-    viewport_state.pScissors     = &scissor;
-
-    VkPipelineRasterizationStateCreateInfo rasterizer{};
-    rasterizer.sType                   = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-    rasterizer.depthClampEnable        = VK_FALSE;
-    rasterizer.rasterizerDiscardEnable = VK_FALSE;
-    rasterizer.polygonMode             = VK_POLYGON_MODE_FILL;
-    rasterizer.lineWidth               = 1.0f;
-    rasterizer.cullMode                = VK_CULL_MODE_BACK_BIT;
-    rasterizer.frontFace               = VK_FRONT_FACE_COUNTER_CLOCKWISE;
-    rasterizer.depthBiasEnable         = VK_FALSE;
-
-    VkPipelineMultisampleStateCreateInfo multisampling{};
-    multisampling.sType                = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-    multisampling.sampleShadingEnable  = VK_TRUE;
-    multisampling.rasterizationSamples = msaa_samples_;
-    multisampling.minSampleShading     = 0.2f;
-
-    VkPipelineColorBlendAttachmentState color_blend_attachment{};
-    color_blend_attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
-                                              VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-    color_blend_attachment.blendEnable    = VK_TRUE;
-    color_blend_attachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
-    color_blend_attachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
-    color_blend_attachment.colorBlendOp        = VK_BLEND_OP_ADD;
-    color_blend_attachment.srcAlphaBlendFactor   = VK_BLEND_FACTOR_ONE;
-    color_blend_attachment.dstAlphaBlendFactor   = VK_BLEND_FACTOR_ZERO;
-    color_blend_attachment.alphaBlendOp          = VK_BLEND_OP_ADD;
-
-    VkPipelineColorBlendStateCreateInfo color_blending{};
-    color_blending.sType             = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-    color_blending.logicOpEnable     = VK_FALSE;
-    color_blending.attachmentCount   = 1;
-    color_blending.pAttachments      = &color_blend_attachment;
-    color_blending.blendConstants[0] = 0.0f;
-    color_blending.blendConstants[1] = 0.0f;
-    color_blending.blendConstants[2] = 0.0f;
-    color_blending.blendConstants[3] = 0.0f;
-
-    // Add a push constant range for the per-object model matrix.
-    VkPushConstantRange pushConstantRange{};
-    pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-    pushConstantRange.offset     = 0;
-    pushConstantRange.size       = sizeof(glm::mat4);
+    // Add a push constant range for the per-object transform index, and one for
+    // the texture lod bias that follows it.
+    std::array<VkPushConstantRange, 2> push_constant_ranges{};
+    push_constant_ranges[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    push_constant_ranges[0].offset     = 0;
+    push_constant_ranges[0].size       = sizeof(uint32_t);
+    push_constant_ranges[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    push_constant_ranges[1].offset     = sizeof(uint32_t);
+    push_constant_ranges[1].size       = sizeof(float);
 
     // Use two descriptor set layouts:
     // Set 0: global UBO, Set 1: texture sampler.
@@ -1154,75 +1774,61 @@ void GraphicsRunner::create_graphics_pipeline()
     pipeline_layout_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
     pipeline_layout_create_info.setLayoutCount = static_cast<uint32_t>(set_layouts.size());
     pipeline_layout_create_info.pSetLayouts = set_layouts.data();
-    pipeline_layout_create_info.pushConstantRangeCount = 1;
-    pipeline_layout_create_info.pPushConstantRanges = &pushConstantRange;
+    pipeline_layout_create_info.pushConstantRangeCount = static_cast<uint32_t>(push_constant_ranges.size());
+    pipeline_layout_create_info.pPushConstantRanges = push_constant_ranges.data();
 
     if (vkCreatePipelineLayout(device_, &pipeline_layout_create_info, nullptr, &pipeline_layout_) != VK_SUCCESS)
     {
         throw std::runtime_error("Error: unable to create pipeline layout.");
     }
 
-    VkPipelineDepthStencilStateCreateInfo depth_stencil_state_create_info{};
-    depth_stencil_state_create_info.sType                 = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-    depth_stencil_state_create_info.depthTestEnable       = VK_TRUE;
-    depth_stencil_state_create_info.depthWriteEnable      = VK_TRUE;
-    depth_stencil_state_create_info.depthCompareOp        = VK_COMPARE_OP_LESS;
-    depth_stencil_state_create_info.depthBoundsTestEnable = VK_FALSE;
-    depth_stencil_state_create_info.stencilTestEnable     = VK_FALSE;
-
-    VkGraphicsPipelineCreateInfo pipeline_create_info{};
-    pipeline_create_info.sType               = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-    pipeline_create_info.stageCount          = 2;
-    pipeline_create_info.pStages             = shader_stages;
-    pipeline_create_info.pVertexInputState   = &vertex_input_info;
-    pipeline_create_info.pInputAssemblyState = &input_assembly;
-    pipeline_create_info.pViewportState      = &viewport_state;
-    pipeline_create_info.pRasterizationState = &rasterizer;
-    pipeline_create_info.pMultisampleState   = &multisampling;
-    pipeline_create_info.pDepthStencilState  = &depth_stencil_state_create_info;
-    pipeline_create_info.pColorBlendState    = &color_blending;
-    pipeline_create_info.pDynamicState       = &dynamic_state;
-    pipeline_create_info.layout              = pipeline_layout_;
-    pipeline_create_info.renderPass          = render_pass_;
-    pipeline_create_info.subpass             = 0;
-    pipeline_create_info.basePipelineHandle  = VK_NULL_HANDLE;
-
-    if (vkCreateGraphicsPipelines(device_, VK_NULL_HANDLE, 1, &pipeline_create_info, nullptr, &graphics_pipeline_) != VK_SUCCESS)
-    {
-        throw std::runtime_error("Error: unable to create graphics pipeline");
-    }
-    
-    vkDestroyShaderModule(device_, vert_shader_module, nullptr);
-    vkDestroyShaderModule(device_, frag_shader_module, nullptr);
+    // every variant shares the layout and render pass, the rest of the state is per variant
+    CreatePipelineManagerInfo manager_info{};
+    manager_info.device = device_;
+    manager_info.pipeline_cache = pipeline_cache_;
+    manager_info.pipeline_layout = pipeline_layout_;
+    manager_info.render_pass = render_pass_;
+    manager_info.use_pipeline_libraries = graphics_pipeline_library_supported_;
+    pipeline_manager_.create(manager_info);
+
+    const auto start_time = std::chrono::high_resolution_clock::now();
+
+    // the default variant is the fallback for everything compiled later, so it has to exist now
+    pipeline_manager_.get_blocking(get_pipeline_state({}));
+
+    // a cold start next to a warm one shows what the cache saves
+    pipeline_creation_milliseconds_ = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start_time).count();
+    logging::info(std::format("Created graphics pipeline in {:.2f} ms ({} start)", pipeline_creation_milliseconds_,
+                              pipeline_cache_warm_ ? "warm" : "cold"));
 }
 
-void GraphicsRunner::create_frame_buffers()
+PipelineState GraphicsRunner::get_pipeline_state(PipelineState state)
 {
-    swap_chain_framebuffers_.resize(swap_chain_image_views_.size());
-
-    for (size_t i = 0; i < swap_chain_image_views_.size(); ++i)
-    {
-        std::array attachments =
-        {
-            color_image_view_,
-            depth_image_view_,
-            swap_chain_image_views_[i],
-        };
+    // the render pass decides the sample count, and the quality tier what it costs
+    state.samples = quality_tier_.samples;
+    state.sample_shading = quality_tier_.sample_shading;
+    state.min_sample_shading = quality_tier_.sample_shading ? quality_tier_.min_sample_shading : 0.0f;
+    return state;
+}
 
-        VkFramebufferCreateInfo framebuffer_create_info{};
-        framebuffer_create_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-        framebuffer_create_info.renderPass = render_pass_;
-        framebuffer_create_info.attachmentCount = static_cast<uint32_t>(attachments.size());
-        framebuffer_create_info.pAttachments = attachments.data();
-        framebuffer_create_info.width = swap_chain_extent_.width;
-        framebuffer_create_info.height = swap_chain_extent_.height;
-        framebuffer_create_info.layers = 1;
+void GraphicsRunner::create_attachments()
+{
+    // the graph creates its images when it compiles a frame, so the pyramid and the upscaler get them right away
+    declare_frame(0);
+    render_graph_.compile();
+    bind_render_graph_images();
+}
 
-        if (vkCreateFramebuffer(device_, &framebuffer_create_info, nullptr, &swap_chain_framebuffers_[i]) != VK_SUCCESS)
-        {
-            throw std::runtime_error("Error: unable to create framebuffer.");
-        }
+void GraphicsRunner::clean_up_attachments()
+{
+    if (occlusion_culler_.is_available())
+    {
+        occlusion_culler_.clean_pyramid();
     }
+
+    render_graph_.clean_images();
+    bound_graph_generation_ = 0;
+    bound_extent_ = {};
 }
 
 void GraphicsRunner::create_command_pools()
@@ -1245,22 +1851,22 @@ void GraphicsRunner::create_command_pools()
     }
 }
 
-void GraphicsRunner::create_color_resources()
+bool GraphicsRunner::is_format_supported(VkFormat format, VkImageTiling tiling, VkFormatFeatureFlags features)
 {
-    VkFormat color_format = swap_chain_image_format_;
+    VkFormatProperties properties;
+    vkGetPhysicalDeviceFormatProperties(physical_device_, format, &properties);
 
-    create_image(swap_chain_extent_.width,
-        swap_chain_extent_.height,
-        1,
-        msaa_samples_,
-        color_format,
-        VK_IMAGE_TILING_OPTIMAL,
-        VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-        color_image_,
-        color_image_allocation_);
+    if (tiling == VK_IMAGE_TILING_LINEAR && (properties.linearTilingFeatures & features) == features)
+    {
+        return true;
+    }
+
+    if (tiling == VK_IMAGE_TILING_OPTIMAL && (properties.optimalTilingFeatures & features) == features)
+    {
+        return true;
+    }
 
-    color_image_view_ = create_image_view(color_image_, color_format, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+    return false;
 }
 
 VkFormat GraphicsRunner::find_supported_format(const std::vector<VkFormat> &candidates,
@@ -1268,15 +1874,7 @@ VkFormat GraphicsRunner::find_supported_format(const std::vector<VkFormat> &cand
 {
     for (auto format : candidates)
     {
-        VkFormatProperties properties;
-        vkGetPhysicalDeviceFormatProperties(physical_device_, format, &properties);
-
-        if (tiling == VK_IMAGE_TILING_LINEAR && (properties.linearTilingFeatures & features) == features)
-        {
-            return format;
-        }
-        
-        if (tiling == VK_IMAGE_TILING_OPTIMAL && (properties.optimalTilingFeatures & features) == features)
+        if (is_format_supported(format, tiling, features))
         {
             return format;
         }
@@ -1299,25 +1897,6 @@ bool GraphicsRunner::has_stencil_component(VkFormat format)
     return format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT;
 }
 
-void GraphicsRunner::create_depth_resources()
-{
-    auto depth_format = find_depth_format();
-
-    create_image(swap_chain_extent_.width,
-        swap_chain_extent_.height,
-        1,
-        msaa_samples_,
-        depth_format,
-        VK_IMAGE_TILING_OPTIMAL,
-        VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-        depth_image_,
-        depth_image_allocation_
-    );
-
-    depth_image_view_ = create_image_view(depth_image_, depth_format, VK_IMAGE_ASPECT_DEPTH_BIT, 1);
-}
-
 void GraphicsRunner::create_image(uint32_t width, uint32_t height, uint32_t mip_levels,
     VkSampleCountFlagBits num_samples, VkFormat format, VkImageTiling tiling,
     VkImageUsageFlags usage, VkMemoryPropertyFlags properties,
@@ -1355,173 +1934,226 @@ void GraphicsRunner::create_image(uint32_t width, uint32_t height, uint32_t mip_
     }
 }
 
-void GraphicsRunner::generate_mip_maps(VkImage image, VkFormat image_format, int32_t texture_width, int32_t texture_height, uint32_t mip_levels)
-{
-    VkFormatProperties format_properties;
-    vkGetPhysicalDeviceFormatProperties(physical_device_, image_format, &format_properties);
+// suffixes of the compressed variants of a texture, best quality first
+constexpr std::array compressed_texture_variants = {"bc7", "astc", "etc2", "bc1"};
 
-    // TODO: Add Image Resizing
-    if (!(format_properties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT))
+std::optional<std::string> GraphicsRunner::find_compressed_texture(const std::string &texture_path)
+{
+    for (const auto suffix : compressed_texture_variants)
     {
-        throw std::runtime_error("Error: texture image format does not support linear blitting.");
-    }
-    
-    auto command_buffer = begin_single_time_commands();
+        const auto variant_path = ktx2::variant_path(texture_path, suffix);
 
-    VkImageMemoryBarrier barrier{};
-    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-    barrier.image = image;
-    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    barrier.subresourceRange.baseArrayLayer = 0;
-    barrier.subresourceRange.layerCount = 1;
-    barrier.subresourceRange.levelCount = 1;
+        if (!std::filesystem::exists(variant_path))
+        {
+            continue;
+        }
 
-    int32_t mip_width = texture_width;
-    int32_t mip_height = texture_height;
-
-    for (uint32_t i = 1; i < mip_levels; ++i)
-    {
-        barrier.subresourceRange.baseMipLevel = i - 1;
-        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-        barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-
-        vkCmdPipelineBarrier(
-            command_buffer,
-            VK_PIPELINE_STAGE_TRANSFER_BIT,
-            VK_PIPELINE_STAGE_TRANSFER_BIT,
-            0,
-            0, nullptr,
-            0, nullptr,
-            1, &barrier
-        );
-
-        VkImageBlit blit{};
-        blit.srcOffsets[0] = {0, 0, 0};
-        blit.srcOffsets[1] = {mip_width, mip_height, 1};
-        blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        blit.srcSubresource.mipLevel = i - 1;
-        blit.srcSubresource.baseArrayLayer = 0;
-        blit.srcSubresource.layerCount = 1;
-        blit.dstOffsets[0] = {0, 0, 0};
-        blit.dstOffsets[1] = {mip_width > 1 ? mip_width / 2 : 1, mip_height > 1 ? mip_height / 2 : 1, 1};
-        blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        blit.dstSubresource.mipLevel = i;
-        blit.dstSubresource.baseArrayLayer = 0;
-        blit.dstSubresource.layerCount = 1;
-
-        vkCmdBlitImage(
-            command_buffer,
-            image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-            image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            1, &blit,
-            VK_FILTER_LINEAR
-        );
-
-        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-        barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-        vkCmdPipelineBarrier(
-            command_buffer,
-            VK_PIPELINE_STAGE_TRANSFER_BIT,
-            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-            0,
-            0, nullptr,
-            0, nullptr,
-            1, &barrier
-        );
-
-        if (mip_width > 1)
+        // the suffix only names the family, the image is created in whatever format the header says
+        VkFormat format;
+        try
         {
-            mip_width /= 2;
+            const MappedFile file(variant_path);
+            format = ktx2::parse(file.data(), file.size(), variant_path).format;
+        }
+        catch (const std::exception& e)
+        {
+            logging::warning(std::format("Skipping {}: {}", variant_path, e.what()));
+            continue;
         }
 
-        if (mip_height > 1)
+        if (is_format_supported(format, VK_IMAGE_TILING_OPTIMAL,
+            VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT))
         {
-            mip_height /= 2;
+            return variant_path;
         }
     }
 
-    barrier.subresourceRange.baseMipLevel = mip_levels - 1;
-    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-    vkCmdPipelineBarrier(
-        command_buffer,
-        VK_PIPELINE_STAGE_TRANSFER_BIT,
-        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-        0,
-        0, nullptr,
-        0, nullptr,
-        1, &barrier
-    );
-
-    end_single_time_commands(command_buffer);
+    return std::nullopt;
 }
 
-void GraphicsRunner::create_texture_image(const std::string &texture_path, RenderableResource& resource)
+void GraphicsRunner::upload_texture(VkBuffer staging_buffer, const TextureDecoder::DecodedTexture &texture,
+                                    RenderableResource &resource)
 {
-    int texture_width, texture_height, texture_channels;
-    stbi_uc* pixels = stbi_load(texture_path.c_str(), &texture_width, &texture_height, &texture_channels, STBI_rgb_alpha);
+    const VkFormat format = texture.format;
+    const uint32_t width = texture.width;
+    const uint32_t height = texture.height;
 
-    resource.mip_levels = static_cast<uint32_t>(std::floor(std::log2(std::max(texture_width, texture_height)))) + 1;
-
-    const VkDeviceSize image_size = static_cast<uint64_t>(texture_width) * static_cast<uint64_t>(texture_height) * 4l;
-
-    if (!pixels)
+    // streaming copies bands of whole block rows
+    if (!ktx2::get_texel_block(format).has_value())
     {
-        throw std::runtime_error("Error: unable to load texture image");
+        throw std::runtime_error("Error: textures can't be uploaded in format " + std::to_string(format));
     }
 
-    VkBuffer staging_buffer;
-    VmaAllocation staging_buffer_allocation;
-    create_buffer(image_size,
-        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-        staging_buffer,
-        staging_buffer_allocation);void* data;
-    
-    vmaMapMemory(allocator_, staging_buffer_allocation, &data);
-    memcpy(data, pixels, image_size);
-    vmaUnmapMemory(allocator_, staging_buffer_allocation);
+    resource.mip_levels = static_cast<uint32_t>(texture.level_offsets.size());
+    resource.texture_format = format;
+    resource.resident_mip_level = 0;
 
-    stbi_image_free(pixels);
+    // when streaming, only the small tail is uploaded now and the rest comes in over the next frames
+    if (texture_streaming_)
+    {
+        while (resource.resident_mip_level + 1 < resource.mip_levels
+            && std::max(width >> resource.resident_mip_level, height >> resource.resident_mip_level) > texture_stream_tail_size_)
+        {
+            ++resource.resident_mip_level;
+        }
+    }
 
-    create_image(texture_width, texture_height, resource.mip_levels,
-        VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R8G8B8A8_SRGB,
+    // every level is already in the staging buffer, so no blitting (and no TRANSFER_SRC) is needed
+    create_image(width, height, resource.mip_levels,
+        VK_SAMPLE_COUNT_1_BIT, format,
         VK_IMAGE_TILING_OPTIMAL,
-        VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, 
+        VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
         resource.texture_image, resource.textureImageAllocation);
 
+    // levels that are still streaming stay in TRANSFER_DST until they land
     transition_image_layout(
         resource.texture_image,
-        VK_FORMAT_R8G8B8A8_SRGB,
+        format,
         VK_IMAGE_LAYOUT_UNDEFINED,
         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        0,
         resource.mip_levels
     );
 
-    copy_buffer_to_image(
-        staging_buffer,
+    std::vector<VkBufferImageCopy> regions;
+    for (uint32_t i = resource.resident_mip_level; i < resource.mip_levels; ++i)
+    {
+        VkBufferImageCopy region{};
+        region.bufferOffset = texture.level_offsets[i];
+        region.bufferRowLength = 0;
+        region.bufferImageHeight = 0;
+
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.mipLevel = i;
+        region.imageSubresource.baseArrayLayer = 0;
+        region.imageSubresource.layerCount = 1;
+
+        region.imageOffset = {0, 0, 0};
+        region.imageExtent = {std::max(width >> i, 1u), std::max(height >> i, 1u), 1};
+        regions.push_back(region);
+    }
+
+    copy_buffer_to_image(staging_buffer, resource.texture_image, regions);
+
+    transition_image_layout(
         resource.texture_image,
-        static_cast<uint32_t>(texture_width),
-        static_cast<uint32_t>(texture_height)
+        format,
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        resource.resident_mip_level,
+        resource.mip_levels - resource.resident_mip_level
     );
+}
 
-    vmaDestroyBuffer(allocator_, staging_buffer, staging_buffer_allocation);
+void GraphicsRunner::stream_textures(VkCommandBuffer command_buffer)
+{
+    VkDeviceSize budget = texture_upload_budget_;
+
+    for (auto stream = texture_streams_.begin(); stream != texture_streams_.end() && budget > 0;)
+    {
+        auto& resource = resources_.at(stream->resource_id);
+        const auto& texture = stream->staging->texture;
+
+        const uint32_t level = resource.resident_mip_level - 1;
+        const uint32_t level_width = std::max(texture.width >> level, 1u);
+        const uint32_t level_height = std::max(texture.height >> level, 1u);
+
+        // copy as many rows (of blocks) as the budget allows, but always make progress,
+        // upload_texture() only accepts formats with a texel block
+        const auto texel_block = *ktx2::get_texel_block(texture.format);
+        const uint32_t block_height = texel_block.height;
+        const uint32_t block_rows = (level_height + block_height - 1) / block_height;
+        const VkDeviceSize block_row_size = static_cast<VkDeviceSize>((level_width + texel_block.width - 1) / texel_block.width)
+            * texel_block.bytes;
+        const uint32_t remaining_rows = block_rows - stream->uploaded_rows;
+        const uint32_t rows = std::max(static_cast<uint32_t>(std::min<VkDeviceSize>(budget / block_row_size, remaining_rows)), 1u);
+
+        VkBufferImageCopy region{};
+        region.bufferOffset = texture.level_offsets[level] + stream->uploaded_rows * block_row_size;
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.mipLevel = level;
+        region.imageSubresource.baseArrayLayer = 0;
+        region.imageSubresource.layerCount = 1;
+        region.imageOffset = {0, static_cast<int32_t>(stream->uploaded_rows * block_height), 0};
+        region.imageExtent = {level_width, std::min(rows * block_height, level_height - stream->uploaded_rows * block_height), 1};
+
+        vkCmdCopyBufferToImage(command_buffer, stream->staging->buffer, resource.texture_image,
+                               VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+        budget -= std::min(budget, rows * block_row_size);
+        stream->uploaded_rows += rows;
 
-    generate_mip_maps(resource.texture_image, VK_FORMAT_R8G8B8A8_SRGB, texture_width, texture_height, resource.mip_levels);
+        // out of budget for this frame
+        if (stream->uploaded_rows < block_rows)
+        {
+            break;
+        }
+
+        // the level is complete, make it visible to this frame's draws and widen the view to it
+        record_image_layout_transition(command_buffer, resource.texture_image, resource.texture_format,
+                                       VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, level, 1);
+
+        // frames in flight still use the old view and set
+        retire([this, image_view = resource.texture_image_view, descriptor_set = resource.texture_descriptor_set,
+                descriptor_pool = resource.texture_descriptor_pool]
+        {
+            vkFreeDescriptorSets(device_, descriptor_pool, 1, &descriptor_set);
+            vkDestroyImageView(device_, image_view, nullptr);
+        });
+
+        resource.resident_mip_level = level;
+        create_texture_image_view(resource);
+        create_texture_descriptor_set(resource);
+
+        stream->uploaded_rows = 0;
+
+        if (resource.resident_mip_level == 0)
+        {
+            release_staging_texture(std::move(stream->staging));
+            stream = texture_streams_.erase(stream);
+        }
+    }
+}
+
+void GraphicsRunner::release_staging_texture(std::shared_ptr<StagingTexture> staging)
+{
+    // other resources may still be streaming from the same buffer
+    if (staging.use_count() > 1)
+    {
+        return;
+    }
+
+    retire([this, staging]
+    {
+        vmaDestroyBuffer(allocator_, staging->buffer, staging->allocation);
+    });
+}
+
+void GraphicsRunner::retire(std::function<void()> destroy)
+{
+    // the gpu may use it up to the next submit, usually the frame being recorded
+    retired_objects_.push_back({graphics_timeline_.get_submitted_value() + 1, std::move(destroy)});
+}
+
+void GraphicsRunner::destroy_retired_objects(const bool all)
+{
+    if (retired_objects_.empty())
+    {
+        return;
+    }
+
+    const uint64_t completed_value = all ? UINT64_MAX : graphics_timeline_.poll();
+
+    while (!retired_objects_.empty() && retired_objects_.front().value <= completed_value)
+    {
+        retired_objects_.front().destroy();
+        retired_objects_.pop_front();
+    }
 }
 
-VkImageView GraphicsRunner::create_image_view(VkImage image, VkFormat format, VkImageAspectFlags aspect_flags, uint32_t mip_levels)
+VkImageView GraphicsRunner::create_image_view(VkImage image, VkFormat format, VkImageAspectFlags aspect_flags,
+                                              uint32_t base_mip_level, uint32_t mip_levels)
 {
     VkImageViewCreateInfo view_info{};
     view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -1529,7 +2161,7 @@ VkImageView GraphicsRunner::create_image_view(VkImage image, VkFormat format, Vk
     view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
     view_info.format = format;
     view_info.subresourceRange.aspectMask = aspect_flags;
-    view_info.subresourceRange.baseMipLevel = 0;
+    view_info.subresourceRange.baseMipLevel = base_mip_level;
     view_info.subresourceRange.levelCount = mip_levels;
     view_info.subresourceRange.baseArrayLayer = 0;
     view_info.subresourceRange.layerCount = 1;
@@ -1544,7 +2176,9 @@ VkImageView GraphicsRunner::create_image_view(VkImage image, VkFormat format, Vk
 
 void GraphicsRunner::create_texture_image_view(RenderableResource& resource)
 {
-    resource.texture_image_view = create_image_view(resource.texture_image, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT, resource.mip_levels);
+    // the view only covers the levels that are resident, streamed levels get a new view
+    resource.texture_image_view = create_image_view(resource.texture_image, resource.texture_format, VK_IMAGE_ASPECT_COLOR_BIT,
+                                                    resource.resident_mip_level, resource.mip_levels - resource.resident_mip_level);
 }
 
 void GraphicsRunner::create_texture_sampler(RenderableResource& resource)
@@ -1562,12 +2196,9 @@ void GraphicsRunner::create_texture_sampler(RenderableResource& resource)
     sampler_create_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
     sampler_create_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
     sampler_create_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-    sampler_create_info.anisotropyEnable = VK_TRUE;
-
-    VkPhysicalDeviceProperties properties{};
-    vkGetPhysicalDeviceProperties(physical_device_, &properties);
-    
-    sampler_create_info.maxAnisotropy = properties.limits.maxSamplerAnisotropy;
+    // already clamped to the device's limit
+    sampler_create_info.anisotropyEnable = quality_tier_.max_anisotropy > 1.0f ? VK_TRUE : VK_FALSE;
+    sampler_create_info.maxAnisotropy = quality_tier_.max_anisotropy;
     sampler_create_info.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
     sampler_create_info.unnormalizedCoordinates = VK_FALSE;
     sampler_create_info.compareEnable = VK_FALSE;
@@ -1625,12 +2256,46 @@ void GraphicsRunner::create_buffer(VkDeviceSize size, VkBufferUsageFlags usage,
     }
 }
 
-void GraphicsRunner::transition_image_layout(VkImage image, VkFormat format, VkImageLayout old_layout, VkImageLayout new_layout, uint32_t mip_levels)
+uint8_t* GraphicsRunner::create_staging_buffer(VkDeviceSize size, VkBuffer &buffer, VmaAllocation &buffer_allocation)
+{
+    VkBufferCreateInfo buffer_create_info{};
+    buffer_create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_create_info.size = size;
+    buffer_create_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    buffer_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    // persistently mapped so the decoder can write into it from its own thread.
+    // cached memory is preferred since the mip cache file is written back out of it
+    VmaAllocationCreateInfo allocInfo = {};
+    allocInfo.usage = VMA_MEMORY_USAGE_CPU_ONLY;
+    allocInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+    allocInfo.preferredFlags = VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+
+    VmaAllocationInfo allocation_info;
+    if (vmaCreateBuffer(allocator_, &buffer_create_info, &allocInfo, &buffer, &buffer_allocation, &allocation_info) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Error: unable to create staging buffer with VMA.");
+    }
+
+    return static_cast<uint8_t*>(allocation_info.pMappedData);
+}
+
+void GraphicsRunner::transition_image_layout(VkImage image, VkFormat format, VkImageLayout old_layout, VkImageLayout new_layout,
+                                             uint32_t base_mip_level, uint32_t mip_levels)
 {
     VkCommandBuffer command_buffer = begin_single_time_commands();
 
-    VkImageMemoryBarrier barrier{};
-    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    record_image_layout_transition(command_buffer, image, format, old_layout, new_layout, base_mip_level, mip_levels);
+
+    end_single_time_commands(command_buffer);
+}
+
+void GraphicsRunner::record_image_layout_transition(VkCommandBuffer command_buffer, VkImage image, VkFormat format,
+                                                    VkImageLayout old_layout, VkImageLayout new_layout,
+                                                    uint32_t base_mip_level, uint32_t mip_levels)
+{
+    VkImageMemoryBarrier2 barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
     barrier.oldLayout = old_layout;
     barrier.newLayout = new_layout;
     barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
@@ -1651,79 +2316,56 @@ void GraphicsRunner::transition_image_layout(VkImage image, VkFormat format, VkI
         barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
     }
     
-    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.baseMipLevel = base_mip_level;
     barrier.subresourceRange.levelCount = mip_levels;
     barrier.subresourceRange.baseArrayLayer = 0;
     barrier.subresourceRange.layerCount = 1;
 
-    VkPipelineStageFlags source_stage;
-    VkPipelineStageFlags destination_stage;
-
     if (old_layout == VK_IMAGE_LAYOUT_UNDEFINED && new_layout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL)
     {
-        barrier.srcAccessMask = 0;
-        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-
-        source_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-        destination_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+        barrier.srcStageMask = VK_PIPELINE_STAGE_2_NONE;
+        barrier.srcAccessMask = VK_ACCESS_2_NONE;
+        barrier.dstStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+        barrier.dstAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
     }
     else if (old_layout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && new_layout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
     {
-        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-        source_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-        destination_stage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+        barrier.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+        barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+        barrier.dstStageMask = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT;
+        barrier.dstAccessMask = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT;
     }
     else if (old_layout == VK_IMAGE_LAYOUT_UNDEFINED && new_layout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL)
     {
-        barrier.srcAccessMask = 0;
-        barrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-
-        source_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-        destination_stage = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+        barrier.srcStageMask = VK_PIPELINE_STAGE_2_NONE;
+        barrier.srcAccessMask = VK_ACCESS_2_NONE;
+        barrier.dstStageMask = VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT;
+        barrier.dstAccessMask = VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
     }
     else
     {
         throw std::invalid_argument("Error: layout transition not supported");
     }
 
-    vkCmdPipelineBarrier(
-        command_buffer,
-        source_stage, destination_stage,
-        0,
-        0, nullptr,
-        0, nullptr,
-        1, &barrier
-    );
+    VkDependencyInfo dependency_info{};
+    dependency_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    dependency_info.imageMemoryBarrierCount = 1;
+    dependency_info.pImageMemoryBarriers = &barrier;
 
-    end_single_time_commands(command_buffer);
+    vkCmdPipelineBarrier2(command_buffer, &dependency_info);
 }
 
-void GraphicsRunner::copy_buffer_to_image(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height)
+void GraphicsRunner::copy_buffer_to_image(VkBuffer buffer, VkImage image, const std::vector<VkBufferImageCopy> &regions)
 {
     auto command_buffer = begin_single_time_commands();
 
-    VkBufferImageCopy region{};
-    region.bufferOffset = 0;
-    region.bufferRowLength = 0;
-    region.bufferImageHeight = 0;
-
-    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    region.imageSubresource.mipLevel = 0;
-    region.imageSubresource.baseArrayLayer = 0;
-    region.imageSubresource.layerCount = 1;
-
-    region.imageOffset = {0, 0, 0};
-    region.imageExtent = {width, height, 1};
-
     vkCmdCopyBufferToImage(
         command_buffer,
         buffer,
         image,
         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-        1,
-        &region
+        static_cast<uint32_t>(regions.size()),
+        regions.data()
     );
 
     end_single_time_commands(command_buffer);
@@ -1749,19 +2391,19 @@ VkCommandBuffer GraphicsRunner::begin_single_time_commands()
     return command_buffer;
 }
 
-void GraphicsRunner::end_single_time_commands(VkCommandBuffer command_buffer)
+uint64_t GraphicsRunner::end_single_time_commands(VkCommandBuffer command_buffer)
 {
     vkEndCommandBuffer(command_buffer);
 
-    VkSubmitInfo submit_info{};
-    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submit_info.commandBufferCount = 1;
-    submit_info.pCommandBuffers = &command_buffer;
+    // retired first, so it is keyed to the submit below
+    retire([this, command_buffer]
+    {
+        vkFreeCommandBuffers(device_, command_pool_, 1, &command_buffer);
+    });
 
-    vkQueueSubmit(graphics_queue_, 1, &submit_info, VK_NULL_HANDLE);
-    vkQueueWaitIdle(graphics_queue_);
+    upload_value_ = graphics_timeline_.submit({command_buffer});
 
-    vkFreeCommandBuffers(device_, command_pool_, 1, &command_buffer);
+    return upload_value_;
 }
 
 void GraphicsRunner::copy_buffer(VkBuffer src_buffer, VkBuffer dst_buffer, VkDeviceSize size)
@@ -1799,18 +2441,23 @@ void GraphicsRunner::create_uniform_buffers()
 
 void GraphicsRunner::create_descriptor_pool()
 {
-    std::array<VkDescriptorPoolSize, 2> pool_sizes{};
+    std::array<VkDescriptorPoolSize, 3> pool_sizes{};
     pool_sizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    pool_sizes[0].descriptorCount = static_cast<uint32_t>(max_frames_in_flight_);
+    // sized for the most frames in flight so the count can change without a new pool
+    pool_sizes[0].descriptorCount = max_frames_in_flight_limit_;
     pool_sizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    // Global sets + support for up to 100 texture sets.
-    pool_sizes[1].descriptorCount = static_cast<uint32_t>(max_frames_in_flight_ + 100);
+    // the global sets only, texture sets come from texture_descriptor_pools_
+    pool_sizes[1].descriptorCount = max_frames_in_flight_limit_;
+    pool_sizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    pool_sizes[2].descriptorCount = max_frames_in_flight_limit_;
 
     VkDescriptorPoolCreateInfo pool_create_info{};
     pool_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    // the global sets are freed when the frame count changes
+    pool_create_info.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
     pool_create_info.poolSizeCount = static_cast<uint32_t>(pool_sizes.size());
     pool_create_info.pPoolSizes = pool_sizes.data();
-    pool_create_info.maxSets = static_cast<uint32_t>(max_frames_in_flight_ + 100);
+    pool_create_info.maxSets = max_frames_in_flight_limit_;
 
     if (vkCreateDescriptorPool(device_, &pool_create_info, nullptr, &descriptor_pool_) != VK_SUCCESS)
     {
@@ -1850,7 +2497,111 @@ void GraphicsRunner::create_descriptor_sets()
         descriptor_write.pBufferInfo = &buffer_info;
         
         vkUpdateDescriptorSets(device_, 1, &descriptor_write, 0, nullptr);
+
+        write_transform_descriptor(i);
+    }
+
+    transform_sets_outdated_.assign(max_frames_in_flight_, false);
+}
+
+uint32_t GraphicsRunner::allocate_transform(const glm::mat4& model)
+{
+    uint32_t index;
+    if (free_transform_indices_.empty())
+    {
+        index = static_cast<uint32_t>(transforms_.size());
+        transforms_.emplace_back(1.f);
+        transform_copies_behind_.push_back(0);
+    }
+    else
+    {
+        index = free_transform_indices_.back();
+        free_transform_indices_.pop_back();
+    }
+
+    if (transforms_.size() > transform_capacity_)
+    {
+        // frames in flight keep reading the copies they were recorded with
+        for (size_t i = 0; i < transform_buffers_.size(); ++i)
+        {
+            retire([this, buffer = transform_buffers_[i], allocation = transform_buffer_allocations_[i]]
+            {
+                vmaUnmapMemory(allocator_, allocation);
+                vmaDestroyBuffer(allocator_, buffer, allocation);
+            });
+        }
+
+        transforms_[index] = model;
+        create_transform_buffers();
+        transform_sets_outdated_.assign(max_frames_in_flight_, true);
+    }
+    else
+    {
+        set_transform(index, model);
+    }
+
+    return index;
+}
+
+void GraphicsRunner::set_transform(const uint32_t index, const glm::mat4& model)
+{
+    transforms_[index] = model;
+
+    // a copy that already caught up on an earlier change has to be written again
+    if (transform_copies_behind_[index] == 0)
+    {
+        pending_transforms_.push_back(index);
+    }
+    transform_copies_behind_[index] = max_frames_in_flight_;
+}
+
+void GraphicsRunner::create_transform_buffers()
+{
+    // doubling, so registering many resources one by one replaces the copies rarely
+    transform_capacity_ = std::bit_ceil(std::max<uint32_t>(static_cast<uint32_t>(transforms_.size()), 1024));
+    const VkDeviceSize buffer_size = sizeof(glm::mat4) * transform_capacity_;
+
+    transform_buffers_.resize(max_frames_in_flight_);
+    transform_buffer_allocations_.resize(max_frames_in_flight_);
+    transform_buffers_mapped_.resize(max_frames_in_flight_);
+
+    for (size_t i = 0; i < max_frames_in_flight_; ++i)
+    {
+        create_buffer(buffer_size,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            transform_buffers_[i],
+            transform_buffer_allocations_[i]);
+
+        vmaMapMemory(allocator_, transform_buffer_allocations_[i], &transform_buffers_mapped_[i]);
+        memcpy(transform_buffers_mapped_[i], transforms_.data(), sizeof(glm::mat4) * transforms_.size());
+    }
+
+    // every copy starts out up to date
+    for (const uint32_t index : pending_transforms_)
+    {
+        transform_copies_behind_[index] = 0;
     }
+    pending_transforms_.clear();
+}
+
+void GraphicsRunner::write_transform_descriptor(const size_t frame)
+{
+    VkDescriptorBufferInfo buffer_info{};
+    buffer_info.buffer = transform_buffers_[frame];
+    buffer_info.offset = 0;
+    buffer_info.range = VK_WHOLE_SIZE;
+
+    VkWriteDescriptorSet descriptor_write{};
+    descriptor_write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptor_write.dstSet = descriptor_sets_[frame];
+    descriptor_write.dstBinding = 1;
+    descriptor_write.dstArrayElement = 0;
+    descriptor_write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    descriptor_write.descriptorCount = 1;
+    descriptor_write.pBufferInfo = &buffer_info;
+
+    vkUpdateDescriptorSets(device_, 1, &descriptor_write, 0, nullptr);
 }
 
 void GraphicsRunner::create_command_buffers()
@@ -1873,16 +2624,12 @@ void GraphicsRunner::create_sync_objects()
 {
     image_available_semaphores_.resize(max_frames_in_flight_);
     render_finished_semaphores_.resize(max_frames_in_flight_);
-    in_flight_fences_.resize(max_frames_in_flight_);
+    // the device is idle whenever this runs, so 0 (always complete) is right for every frame
+    frame_timeline_values_.assign(max_frames_in_flight_limit_, 0);
 
-    
     VkSemaphoreCreateInfo semaphore_create_info{};
     semaphore_create_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-    VkFenceCreateInfo fence_create_info{};
-    fence_create_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    fence_create_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-
     for (size_t i = 0; i < max_frames_in_flight_; ++i)
     {
         if (vkCreateSemaphore(device_, &semaphore_create_info, nullptr, &image_available_semaphores_[i]) != VK_SUCCESS)
@@ -1894,81 +2641,511 @@ void GraphicsRunner::create_sync_objects()
         {
             throw std::runtime_error("Error: unable to create render finished semaphore.");
         }
+    }
+}
+
+void GraphicsRunner::create_gpu_profiler()
+{
+    const auto indices = find_queue_families(physical_device_);
+
+    uint32_t queue_family_count = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physical_device_, &queue_family_count, nullptr);
 
-        if (vkCreateFence(device_, &fence_create_info, nullptr, &in_flight_fences_[i]) != VK_SUCCESS)
+    std::vector<VkQueueFamilyProperties> queue_families(queue_family_count);
+    vkGetPhysicalDeviceQueueFamilyProperties(physical_device_, &queue_family_count, queue_families.data());
+
+    CreateGpuProfilerInfo profiler_info{};
+    profiler_info.physical_device = physical_device_;
+    profiler_info.device = device_;
+    profiler_info.timestamp_valid_bits = queue_families[indices.graphics_family.value()].timestampValidBits;
+    // frame slots follow current_frame_, which can go up to the limit
+    profiler_info.frame_count = max_frames_in_flight_limit_;
+    profiler_info.pipeline_statistics_supported = pipeline_statistics_supported_;
+    gpu_profiler_.create(profiler_info);
+
+    if (profiler_info.timestamp_valid_bits == 0)
+    {
+        logging::warning("The graphics queue doesn't support timestamps, gpu timings are unavailable");
+    }
+}
+
+void GraphicsRunner::create_occlusion_culler()
+{
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physical_device_, &properties);
+
+    CreateOcclusionCullerInfo culler_info{};
+    culler_info.device = device_;
+    culler_info.allocator = allocator_;
+    culler_info.pipeline_cache = pipeline_cache_;
+    culler_info.samples = quality_tier_.samples;
+    culler_info.depth_sampling_supported =
+        is_format_supported(depth_format_, VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) &&
+        (properties.limits.sampledImageDepthSampleCounts & quality_tier_.samples) != 0;
+    // frame slots follow current_frame_, which can go up to the limit
+    culler_info.frame_count = max_frames_in_flight_limit_;
+    culler_info.retire = [this](std::function<void()> destroy) { retire(std::move(destroy)); };
+    occlusion_culler_.create(culler_info);
+}
+
+void GraphicsRunner::create_upscaler()
+{
+    CreateUpscalerInfo upscaler_info{};
+    upscaler_info.device = device_;
+    upscaler_info.pipeline_cache = pipeline_cache_;
+    upscaler_info.format = swap_chain_image_format_;
+    upscaler_info.frame_count = max_frames_in_flight_limit_;
+    upscaler_.create(upscaler_info);
+}
+
+void GraphicsRunner::create_render_graph()
+{
+    CreateRenderGraphInfo graph_info{};
+    graph_info.device = device_;
+    graph_info.allocator = allocator_;
+    graph_info.retire = [this](std::function<void()> destroy) { retire(std::move(destroy)); };
+    render_graph_.create(graph_info);
+}
+
+void GraphicsRunner::create_image_semaphores()
+{
+    per_image_semaphores_ = requested_per_image_semaphores_;
+
+    if (!per_image_semaphores_)
+    {
+        return;
+    }
+
+    VkSemaphoreCreateInfo semaphore_create_info{};
+    semaphore_create_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+    // acquire semaphores are handed out from the free list and attached to an image once its index is known
+    image_acquire_semaphores_.assign(swap_chain_images_.size(), VK_NULL_HANDLE);
+    image_render_finished_semaphores_.resize(swap_chain_images_.size());
+
+    for (auto& semaphore : image_render_finished_semaphores_)
+    {
+        if (vkCreateSemaphore(device_, &semaphore_create_info, nullptr, &semaphore) != VK_SUCCESS)
         {
-            throw std::runtime_error("Error: unable to create in flight fence.");
+            throw std::runtime_error("Error: unable to create render finished semaphore.");
         }
     }
 }
 
-void GraphicsRunner::record_command_buffer(VkCommandBuffer command_buffer, uint32_t image_index)
+VkSemaphore GraphicsRunner::get_free_acquire_semaphore()
 {
-    VkCommandBufferBeginInfo begin_info{};
-    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    begin_info.flags = 0;
-    begin_info.pInheritanceInfo = nullptr;
+    if (!free_acquire_semaphores_.empty())
+    {
+        const auto semaphore = free_acquire_semaphores_.back();
+        free_acquire_semaphores_.pop_back();
+        return semaphore;
+    }
 
-    if (vkBeginCommandBuffer(command_buffer, &begin_info) != VK_SUCCESS)
+    VkSemaphoreCreateInfo semaphore_create_info{};
+    semaphore_create_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+    VkSemaphore semaphore;
+    if (vkCreateSemaphore(device_, &semaphore_create_info, nullptr, &semaphore) != VK_SUCCESS)
     {
-        throw std::runtime_error("Error: unable to begin command buffer.");
+        throw std::runtime_error("Error: unable to create image available semaphore.");
     }
 
-    std::array<VkClearValue, 2> clear_values{};
-    clear_values[0].color = {{0.0f, 0.0f, 0.0f, 1.0f}};
-    clear_values[1].depthStencil = {1.0f, 0};
+    return semaphore;
+}
+
+std::vector<VkSemaphore> GraphicsRunner::take_image_semaphores()
+{
+    std::vector<VkSemaphore> semaphores;
 
-    VkRenderPassBeginInfo render_pass_begin_info{};
-    render_pass_begin_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    render_pass_begin_info.renderPass = render_pass_;
-    render_pass_begin_info.framebuffer = swap_chain_framebuffers_[image_index];
-    render_pass_begin_info.renderArea.offset = {0, 0};
-    render_pass_begin_info.renderArea.extent = swap_chain_extent_;
-    render_pass_begin_info.clearValueCount = static_cast<uint32_t>(clear_values.size());
-    render_pass_begin_info.pClearValues = clear_values.data();
-    
-    vkCmdBeginRenderPass(command_buffer, &render_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
+    for (const auto semaphore : image_acquire_semaphores_)
+    {
+        if (semaphore != VK_NULL_HANDLE)
+        {
+            semaphores.push_back(semaphore);
+        }
+    }
+
+    semaphores.insert(semaphores.end(), free_acquire_semaphores_.begin(), free_acquire_semaphores_.end());
+    semaphores.insert(semaphores.end(), image_render_finished_semaphores_.begin(), image_render_finished_semaphores_.end());
+
+    image_acquire_semaphores_.clear();
+    free_acquire_semaphores_.clear();
+    image_render_finished_semaphores_.clear();
+
+    return semaphores;
+}
+
+void GraphicsRunner::clean_up_frame_resources()
+{
+    for (size_t i = 0; i < max_frames_in_flight_; ++i)
+    {
+        vmaUnmapMemory(allocator_, uniform_buffers_allocations_[i]);
+        vmaDestroyBuffer(allocator_, uniform_buffers_[i], uniform_buffers_allocations_[i]);
+        vmaUnmapMemory(allocator_, transform_buffer_allocations_[i]);
+        vmaDestroyBuffer(allocator_, transform_buffers_[i], transform_buffer_allocations_[i]);
+    }
 
-    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphics_pipeline_);
+    vkFreeDescriptorSets(device_, descriptor_pool_, static_cast<uint32_t>(descriptor_sets_.size()), descriptor_sets_.data());
+    vkFreeCommandBuffers(device_, command_pool_, static_cast<uint32_t>(command_buffers_.size()), command_buffers_.data());
 
+    for (size_t i = 0; i < max_frames_in_flight_; ++i)
+    {
+        vkDestroySemaphore(device_, image_available_semaphores_[i], nullptr);
+        vkDestroySemaphore(device_, render_finished_semaphores_[i], nullptr);
+    }
+}
+
+void GraphicsRunner::resize_frame_resources()
+{
+    vkDeviceWaitIdle(device_);
+
+    clean_up_frame_resources();
+
+    max_frames_in_flight_ = requested_frames_in_flight_;
+    current_frame_ = 0;
+
+    create_uniform_buffers();
+    create_transform_buffers();
+    create_descriptor_sets();
+    create_command_buffers();
+    create_sync_objects();
+
+    logging::info(std::format("Using {} frames in flight", max_frames_in_flight_));
+}
+
+void GraphicsRunner::update_render_extent()
+{
+    render_scale_ = 1.0f;
+
+    if (is_upscaling_active())
+    {
+        render_scale_ = quality_tier_.resolution_scale;
+
+        if (dynamic_resolution_)
+        {
+            // the slot's previous frame completed, so the profiler holds a frame that just finished
+            if (const auto gpu_milliseconds = gpu_profiler_.get_milliseconds("frame"))
+            {
+                resolution_.update(*gpu_milliseconds);
+            }
+
+            render_scale_ = resolution_.get_scale();
+        }
+    }
+
+    render_extent_ = {
+        std::max(static_cast<uint32_t>(static_cast<float>(swap_chain_extent_.width) * render_scale_), 1u),
+        std::max(static_cast<uint32_t>(static_cast<float>(swap_chain_extent_.height) * render_scale_), 1u),
+    };
+}
+
+void GraphicsRunner::cull_resources()
+{
+    const auto ubo = camera_->get_ubo();
+
+    const auto frustum = frustum_culling_ ? Frustum::from_matrix(ubo.proj * ubo.view) : Frustum::everything();
+
+    if (bvh_culling_)
+    {
+        scene_bvh_.query(frustum, visible_resources_);
+        culling_statistics_ = {
+            scene_bvh_.get_statistics().tested,
+            static_cast<uint32_t>(resources_.size() - visible_resources_.size()),
+        };
+    }
+    else
+    {
+        visible_resources_ = frustum_culler_.cull(frustum);
+        culling_statistics_ = frustum_culler_.get_statistics();
+    }
+
+    occlusion_candidates_.clear();
+
+    if (!is_occlusion_culling_active())
+    {
+        return;
+    }
+
+    // the slot's previous frame completed, so what it found last time can decide this frame's first phase
+    for (const auto& [resource_id, visible] : occlusion_culler_.read_results(current_frame_))
+    {
+        // the resource may have been unregistered since
+        if (const auto resource = resources_.find(resource_id); resource != resources_.end())
+        {
+            resource->second.occluded = !visible;
+        }
+    }
+
+    for (const uint32_t resource_id : visible_resources_)
+    {
+        const auto& resource = resources_.at(resource_id);
+        occlusion_candidates_.push_back({
+            resource_id,
+            bounds::transform(resource.bounds.sphere, transforms_[resource.transform_index]),
+            static_cast<uint32_t>(resource.indices.size()),
+            !resource.occluded,
+        });
+    }
+
+    occlusion_culler_.set_candidates(current_frame_, occlusion_candidates_);
+}
+
+bool GraphicsRunner::is_occlusion_culling_active() const
+{
+    return occlusion_culling_ && occlusion_culler_.is_available();
+}
+
+bool GraphicsRunner::is_upscaling_active() const
+{
+    return upscaler_.is_available() && (dynamic_resolution_ || quality_tier_.resolution_scale < 1.0f);
+}
+
+void GraphicsRunner::declare_frame(const uint32_t image_index)
+{
+    render_graph_.reset();
+
+    const bool multisampled = quality_tier_.samples != VK_SAMPLE_COUNT_1_BIT;
+    const bool upscaling = is_upscaling_active();
+
+    // offscreen targets are copied out instead of presented
+    const auto output = render_graph_.import_image("output", swap_chain_images_[image_index], swap_chain_image_views_[image_index],
+                                                   {swap_chain_image_format_, swap_chain_extent_},
+                                                   headless_ ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+
+    // full size, so a different scale only changes the viewport
+    scene_color_ = upscaling ? render_graph_.create_image("scene color", {swap_chain_image_format_, swap_chain_extent_}) : output;
+
+    // resolved into the scene color, without msaa the scene is drawn into that directly
+    const auto color = multisampled
+        ? render_graph_.create_image("multisampled color", {swap_chain_image_format_, swap_chain_extent_, quality_tier_.samples})
+        : scene_color_;
+
+    // occlusion culling samples the depth the first phase leaves behind. The usage
+    // stays while it is switched off, so switching doesn't create new images
+    depth_attachment_ = render_graph_.create_image("depth", {
+        depth_format_, swap_chain_extent_, quality_tier_.samples,
+        occlusion_culler_.is_available() ? static_cast<VkImageUsageFlags>(VK_IMAGE_USAGE_SAMPLED_BIT) : 0,
+    });
+
+    VkClearValue clear_color{};
+    clear_color.color = {{0.0f, 0.0f, 0.0f, 1.0f}};
+    VkClearValue clear_depth{};
+    clear_depth.depthStencil = {1.0f, 0};
+
+    // the whole attachments are cleared, so depth outside the rendered part stays far for occlusion culling
+    std::vector<RenderGraph::Use> scene_uses =
+    {
+        {color, RenderGraph::Usage::color_attachment, clear_color},
+        {depth_attachment_, RenderGraph::Usage::depth_attachment, clear_depth},
+    };
+
+    if (multisampled)
+    {
+        scene_uses.push_back({scene_color_, RenderGraph::Usage::resolve_attachment});
+    }
+
+    if (!is_occlusion_culling_active())
+    {
+        render_graph_.add_pass("scene", scene_uses, [this](VkCommandBuffer command_buffer)
+        {
+            record_scene_draws(command_buffer, false);
+        });
+    }
+    else
+    {
+        // only the ones that were visible last time are drawn here
+        render_graph_.add_pass("first phase", scene_uses, [this](VkCommandBuffer command_buffer)
+        {
+            record_scene_draws(command_buffer, true);
+        });
+
+        const auto indirect_draws = render_graph_.import_buffer("indirect draws", occlusion_culler_.get_indirect_buffer(current_frame_));
+
+        render_graph_.add_pass("occlusion culling",
+        {
+            {depth_attachment_, RenderGraph::Usage::compute_sampled},
+            {indirect_draws, RenderGraph::Usage::compute_written},
+        },
+        [this](VkCommandBuffer command_buffer)
+        {
+            const auto ubo = camera_->get_ubo();
+            occlusion_culler_.record(command_buffer, current_frame_, ubo.proj * ubo.view, render_extent_);
+        });
+
+        // everything else is drawn from the test's indirect commands
+        scene_uses.push_back({indirect_draws, RenderGraph::Usage::indirect_read});
+
+        render_graph_.add_pass("second phase", std::move(scene_uses), [this](VkCommandBuffer command_buffer)
+        {
+            bind_scene_state(command_buffer);
+            VkPipeline bound_pipeline = VK_NULL_HANDLE;
+
+            const VkBuffer indirect_buffer = occlusion_culler_.get_indirect_buffer(current_frame_);
+            for (size_t i = 0; i < occlusion_candidates_.size(); ++i)
+            {
+                if (occlusion_candidates_[i].drawn_early)
+                {
+                    continue;
+                }
+
+                record_draw(command_buffer, resources_.at(occlusion_candidates_[i].id), bound_pipeline,
+                            indirect_buffer, i * sizeof(VkDrawIndexedIndirectCommand));
+            }
+        });
+    }
+
+    if (upscaling)
+    {
+        render_graph_.add_pass("upscale",
+        {
+            {scene_color_, RenderGraph::Usage::fragment_sampled},
+            {output, RenderGraph::Usage::color_attachment},
+        },
+        [this](VkCommandBuffer command_buffer)
+        {
+            upscaler_.record(command_buffer, current_frame_, swap_chain_extent_, render_extent_);
+        });
+    }
+}
+
+void GraphicsRunner::bind_render_graph_images()
+{
+    const bool extent_changed = swap_chain_extent_.width != bound_extent_.width || swap_chain_extent_.height != bound_extent_.height;
+
+    if (render_graph_.get_generation() == bound_graph_generation_ && !extent_changed)
+    {
+        return;
+    }
+
+    // frames in flight keep the previous pyramid and scene color, the graph and the culler retire them
+    if (occlusion_culler_.is_available())
+    {
+        occlusion_culler_.create_pyramid(render_graph_.get_image_view(depth_attachment_), swap_chain_extent_);
+    }
+
+    if (is_upscaling_active())
+    {
+        upscaler_.set_scene_color(render_graph_.get_image_view(scene_color_));
+    }
+
+    bound_graph_generation_ = render_graph_.get_generation();
+    bound_extent_ = swap_chain_extent_;
+}
+
+void GraphicsRunner::bind_scene_state(VkCommandBuffer command_buffer)
+{
     VkViewport viewport{};
     viewport.x = 0.0f;
     viewport.y = 0.0f;
-    viewport.width = static_cast<float>(swap_chain_extent_.width);
-    viewport.height = static_cast<float>(swap_chain_extent_.height);
+    viewport.width = static_cast<float>(render_extent_.width);
+    viewport.height = static_cast<float>(render_extent_.height);
     viewport.minDepth = 0.0f;
     viewport.maxDepth = 1.0f;
     vkCmdSetViewport(command_buffer, 0, 1, &viewport);
 
     VkRect2D scissor{};
     scissor.offset = {0, 0};
-    scissor.extent = swap_chain_extent_;
+    scissor.extent = render_extent_;
     vkCmdSetScissor(command_buffer, 0, 1, &scissor);
 
     // Bind global descriptor set (set 0: camera UBO)
     vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
                               pipeline_layout_, 0, 1, &descriptor_sets_[current_frame_], 0, nullptr);
 
-    // For each resource, bind vertex/index buffers, bind its texture descriptor set (set 1),
-    // push its model matrix, and draw.
-    for (const auto &resource : resources_ | std::views::values) {
-        const VkBuffer vertex_buffers[] = { resource.vertexBuffer };
-        constexpr VkDeviceSize offsets[] = { 0 };
-        vkCmdBindVertexBuffers(command_buffer, 0, 1, vertex_buffers, offsets);
-        vkCmdBindIndexBuffer(command_buffer, resource.indexBuffer, 0, VK_INDEX_TYPE_UINT32);
-        
-        // Bind resource’s texture descriptor set at set index 1.
-        vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout_,
-                                  1, 1, &resource.texture_descriptor_set, 0, nullptr);
-        
-        // Push the per-resource model matrix via push constants.
-        vkCmdPushConstants(command_buffer, pipeline_layout_,
-                           VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4), &resource.model);
-        
+    // a texel covers 1 / scale as many pixels, one mip level per halving. Samplers
+    // are baked into the texture descriptor sets, so the bias is applied in the shader
+    const float lod_bias = std::log2(render_scale_);
+    vkCmdPushConstants(command_buffer, pipeline_layout_,
+                       VK_SHADER_STAGE_FRAGMENT_BIT, sizeof(uint32_t), sizeof(float), &lod_bias);
+}
+
+void GraphicsRunner::record_scene_draws(VkCommandBuffer command_buffer, const bool skip_occluded)
+{
+    bind_scene_state(command_buffer);
+    VkPipeline bound_pipeline = VK_NULL_HANDLE;
+
+    // For each resource that survived culling, bind its pipeline and vertex/index buffers,
+    // bind its texture descriptor set (set 1), push its model matrix, and draw.
+    for (const uint32_t resource_id : visible_resources_) {
+        const auto &resource = resources_.at(resource_id);
+
+        if (skip_occluded && resource.occluded)
+        {
+            continue;
+        }
+
+        record_draw(command_buffer, resource, bound_pipeline);
+    }
+}
+
+void GraphicsRunner::record_draw(VkCommandBuffer command_buffer, const RenderableResource &resource, VkPipeline &bound_pipeline,
+                                 VkBuffer indirect_buffer, const VkDeviceSize indirect_offset)
+{
+    // variants that are still compiling draw with a stand-in, or not at all if there is none
+    const VkPipeline pipeline = pipeline_manager_.get(get_pipeline_state(resource.pipeline_state));
+    if (pipeline == VK_NULL_HANDLE)
+    {
+        return;
+    }
+
+    if (pipeline != bound_pipeline)
+    {
+        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+        bound_pipeline = pipeline;
+    }
+
+    const VkBuffer vertex_buffers[] = { resource.vertexBuffer };
+    constexpr VkDeviceSize offsets[] = { 0 };
+    vkCmdBindVertexBuffers(command_buffer, 0, 1, vertex_buffers, offsets);
+    vkCmdBindIndexBuffer(command_buffer, resource.indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+    
+    // Bind resource’s texture descriptor set at set index 1.
+    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout_,
+                              1, 1, &resource.texture_descriptor_set, 0, nullptr);
+    
+    // Push the index of the per-resource model matrix in the frame's transform buffer.
+    vkCmdPushConstants(command_buffer, pipeline_layout_,
+                       VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(uint32_t), &resource.transform_index);
+
+    if (indirect_buffer != VK_NULL_HANDLE)
+    {
+        // occluded resources come out with no instances
+        vkCmdDrawIndexedIndirect(command_buffer, indirect_buffer, indirect_offset, 1, sizeof(VkDrawIndexedIndirectCommand));
+    }
+    else
+    {
         vkCmdDrawIndexed(command_buffer, static_cast<uint32_t>(resource.indices.size()), 1, 0, 0, 0);
     }
+}
+
+void GraphicsRunner::record_command_buffer(VkCommandBuffer command_buffer, uint32_t image_index)
+{
+    VkCommandBufferBeginInfo begin_info{};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = 0;
+    begin_info.pInheritanceInfo = nullptr;
+
+    if (vkBeginCommandBuffer(command_buffer, &begin_info) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Error: unable to begin command buffer.");
+    }
+
+    // texture uploads have to happen outside of the render passes
+    // the queries of this frame slot were last used max_frames_in_flight_ frames ago, which has completed
+    gpu_profiler_.begin_frame(command_buffer, current_frame_);
+    gpu_profiler_.begin_scope(command_buffer, "frame");
+
+    gpu_profiler_.begin_scope(command_buffer, "texture streaming");
+    stream_textures(command_buffer);
+    gpu_profiler_.end_scope(command_buffer);
 
-    vkCmdEndRenderPass(command_buffer);
+    // barriers, render passes and the passes' gpu scopes all come from the graph
+    declare_frame(image_index);
+    render_graph_.compile();
+    bind_render_graph_images();
+    render_graph_.execute(command_buffer, gpu_profiler_);
+
+    gpu_profiler_.end_scope(command_buffer);
 
     if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS)
     {
@@ -1978,10 +3155,50 @@ void GraphicsRunner::record_command_buffer(VkCommandBuffer command_buffer, uint3
 
 void GraphicsRunner::draw_frame()
 {
-    vkWaitForFences(device_, 1, &in_flight_fences_[current_frame_], VK_TRUE, UINT64_MAX);
+    PROFILE_ZONE("draw frame");
+
+    if (requested_frames_in_flight_ != max_frames_in_flight_)
+    {
+        resize_frame_resources();
+    }
+
+    if (quality_outdated_)
+    {
+        quality_outdated_ = false;
+        apply_quality_settings();
+    }
+
+    // the frame that last used this slot
+    if (frame_number_ >= max_frames_in_flight_)
+    {
+        PROFILE_ZONE("wait for frame");
+        wait_for_frame(frame_number_ - max_frames_in_flight_);
+    }
+
+    destroy_retired_objects(false);
+
+    if (headless_)
+    {
+        draw_offscreen_frame();
+        return;
+    }
+
+    VkSemaphore acquire_semaphore = per_image_semaphores_
+        ? get_free_acquire_semaphore()
+        : image_available_semaphores_[current_frame_];
 
     uint32_t image_index;
-    auto result = vkAcquireNextImageKHR(device_, swap_chain_, UINT64_MAX, image_available_semaphores_[current_frame_], VK_NULL_HANDLE, &image_index);
+    VkResult result;
+    {
+        PROFILE_ZONE("acquire");
+        result = vkAcquireNextImageKHR(device_, swap_chain_, UINT64_MAX, acquire_semaphore, VK_NULL_HANDLE, &image_index);
+    }
+
+    if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR && per_image_semaphores_)
+    {
+        // nothing was signalled, the semaphore can be handed out again
+        free_acquire_semaphores_.push_back(acquire_semaphore);
+    }
 
     if (result == VK_ERROR_OUT_OF_DATE_KHR)
     {
@@ -1994,38 +3211,49 @@ void GraphicsRunner::draw_frame()
         throw std::runtime_error("Error: failed to acquire swap chain image.");
     }
 
-    vkResetFences(device_, 1, &in_flight_fences_[current_frame_]);
-    
-    vkResetCommandBuffer(command_buffers_[current_frame_], 0);
+    VkSemaphore render_finished_semaphore = render_finished_semaphores_[current_frame_];
 
-    record_command_buffer(command_buffers_[current_frame_], image_index);
+    if (per_image_semaphores_)
+    {
+        // the image's previous acquire has been waited on by the submit that rendered to it,
+        // which the image being handed back out again guarantees has started
+        if (image_acquire_semaphores_[image_index] != VK_NULL_HANDLE)
+        {
+            free_acquire_semaphores_.push_back(image_acquire_semaphores_[image_index]);
+        }
+        image_acquire_semaphores_[image_index] = acquire_semaphore;
 
-    update_uniform_buffer();
+        // present waits on this, so it can only be reused once the same image comes back
+        render_finished_semaphore = image_render_finished_semaphores_[image_index];
+    }
 
-    VkSubmitInfo submit_info{};
-    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    vkResetCommandBuffer(command_buffers_[current_frame_], 0);
 
-    VkSemaphore wait_semaphores[] = {image_available_semaphores_[current_frame_]};
-    VkPipelineStageFlags wait_stages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-    submit_info.waitSemaphoreCount = 1;
-    submit_info.pWaitSemaphores = wait_semaphores;
-    submit_info.pWaitDstStageMask = wait_stages;
-    submit_info.commandBufferCount = 1;
-    submit_info.pCommandBuffers = &command_buffers_[current_frame_];
+    update_render_extent();
+    cull_resources();
+
+    {
+        PROFILE_ZONE("update transform buffer");
+        update_transform_buffer();
+    }
 
-    VkSemaphore signal_semaphores[] = {render_finished_semaphores_[current_frame_]};
-    submit_info.signalSemaphoreCount = 1;
-    submit_info.pSignalSemaphores = signal_semaphores;
+    {
+        PROFILE_ZONE("record command buffer");
+        record_command_buffer(command_buffers_[current_frame_], image_index);
+    }
 
-    if (vkQueueSubmit(graphics_queue_, 1, &submit_info, in_flight_fences_[current_frame_]) != VK_SUCCESS)
     {
-        throw std::runtime_error("Error: unable to submit draw command buffer.");
+        PROFILE_ZONE("update uniform buffer");
+        update_uniform_buffer();
     }
 
+    // the presentation engine only knows binary semaphores
+    submit_frame({{acquire_semaphore, 0, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT}}, {render_finished_semaphore});
+
     VkPresentInfoKHR present_info{};
     present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
     present_info.waitSemaphoreCount = 1;
-    present_info.pWaitSemaphores = signal_semaphores;
+    present_info.pWaitSemaphores = &render_finished_semaphore;
 
     VkSwapchainKHR swap_chains[] = {swap_chain_};
     present_info.swapchainCount = 1;
@@ -2034,11 +3262,15 @@ void GraphicsRunner::draw_frame()
     // only needed for multiple swap chains
     present_info.pResults = nullptr;
 
-    result = vkQueuePresentKHR(present_queue_, &present_info);
+    {
+        PROFILE_ZONE("present");
+        result = vkQueuePresentKHR(present_queue_, &present_info);
+    }
 
-    if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || frame_buffer_resized)
+    if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || frame_buffer_resized || swap_chain_outdated_)
     {
         frame_buffer_resized = false;
+        swap_chain_outdated_ = false;
         recreate_swap_chain();
     }
     else if (result != VK_SUCCESS)
@@ -2047,6 +3279,182 @@ void GraphicsRunner::draw_frame()
     }
 
     current_frame_ = (current_frame_ + 1) % max_frames_in_flight_;
+    ++frame_number_;
+}
+
+void GraphicsRunner::draw_offscreen_frame()
+{
+    // the slot's target was last rendered max_frames_in_flight_ frames ago, which has completed
+    const uint32_t image_index = current_frame_;
+
+    vkResetCommandBuffer(command_buffers_[current_frame_], 0);
+
+    update_render_extent();
+    cull_resources();
+
+    {
+        PROFILE_ZONE("update transform buffer");
+        update_transform_buffer();
+    }
+
+    {
+        PROFILE_ZONE("record command buffer");
+        record_command_buffer(command_buffers_[current_frame_], image_index);
+    }
+
+    {
+        PROFILE_ZONE("update uniform buffer");
+        update_uniform_buffer();
+    }
+
+    submit_frame({}, {});
+
+    last_offscreen_image_ = image_index;
+
+    current_frame_ = (current_frame_ + 1) % max_frames_in_flight_;
+    ++frame_number_;
+}
+
+void GraphicsRunner::submit_frame(std::vector<QueueTimeline::Wait> waits, const std::vector<VkSemaphore>& signals)
+{
+    PROFILE_ZONE("submit");
+
+    // the vertex buffers and textures the frame uses may still be copying
+    if (!graphics_timeline_.is_complete(upload_value_))
+    {
+        waits.push_back({graphics_timeline_.get_semaphore(), upload_value_, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT});
+    }
+
+    if (compute_wait_stages_ != 0)
+    {
+        auto& compute_timeline = compute_queue_.get_timeline();
+        if (compute_timeline.is_complete(compute_wait_value_))
+        {
+            compute_wait_stages_ = 0;
+        }
+        else
+        {
+            waits.push_back({compute_timeline.get_semaphore(), compute_wait_value_, compute_wait_stages_});
+        }
+    }
+
+    frame_timeline_values_[frame_number_ % max_frames_in_flight_limit_] =
+        graphics_timeline_.submit({command_buffers_[current_frame_]}, waits, signals);
+}
+
+uint64_t GraphicsRunner::submit_compute(const std::function<void(VkCommandBuffer)>& record,
+                                        const VkPipelineStageFlags2 frame_stages, const bool after_frame)
+{
+    std::vector<QueueTimeline::Wait> waits;
+    if (after_frame && !graphics_timeline_.is_complete(graphics_timeline_.get_submitted_value()))
+    {
+        waits.push_back({graphics_timeline_.get_semaphore(), graphics_timeline_.get_submitted_value(),
+                         VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT});
+    }
+
+    const uint64_t value = compute_queue_.submit(record, waits);
+
+    // every frame waits until it is done, one frame's wait doesn't hold back the frames after it
+    if (frame_stages != 0)
+    {
+        compute_wait_value_ = value;
+        compute_wait_stages_ |= frame_stages;
+    }
+
+    return value;
+}
+
+bool GraphicsRunner::is_frame_complete(const uint64_t frame)
+{
+    if (frame >= frame_number_)
+    {
+        return false;
+    }
+
+    // the frame that overwrote its value waited for it before being submitted
+    if (frame + max_frames_in_flight_limit_ < frame_number_)
+    {
+        return true;
+    }
+
+    return graphics_timeline_.is_complete(frame_timeline_values_[frame % max_frames_in_flight_limit_]);
+}
+
+void GraphicsRunner::wait_for_frame(const uint64_t frame)
+{
+    if (frame >= frame_number_)
+    {
+        throw std::runtime_error("Error: can't wait for a frame that hasn't been submitted.");
+    }
+
+    if (frame + max_frames_in_flight_limit_ < frame_number_)
+    {
+        return;
+    }
+
+    graphics_timeline_.wait(frame_timeline_values_[frame % max_frames_in_flight_limit_]);
+}
+
+std::vector<uint8_t> GraphicsRunner::read_frame()
+{
+    if (!headless_)
+    {
+        throw std::runtime_error("Error: frames can only be read back in headless mode.");
+    }
+
+    if (frame_number_ == 0)
+    {
+        throw std::runtime_error("Error: no frame has been rendered yet.");
+    }
+
+    const VkDeviceSize size = static_cast<VkDeviceSize>(swap_chain_extent_.width) * swap_chain_extent_.height * 4;
+
+    VkBuffer staging_buffer;
+    VmaAllocation staging_buffer_allocation;
+    const uint8_t* pixels = create_staging_buffer(size, staging_buffer, staging_buffer_allocation);
+
+    const auto command_buffer = begin_single_time_commands();
+
+    // the render graph left the target in TRANSFER_SRC_OPTIMAL, only its writes need to become visible
+    VkImageMemoryBarrier2 barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+    barrier.srcStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+    barrier.srcAccessMask = VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT;
+    barrier.dstStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+    barrier.dstAccessMask = VK_ACCESS_2_TRANSFER_READ_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = swap_chain_images_[last_offscreen_image_];
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.layerCount = 1;
+
+    VkDependencyInfo dependency_info{};
+    dependency_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    dependency_info.imageMemoryBarrierCount = 1;
+    dependency_info.pImageMemoryBarriers = &barrier;
+
+    vkCmdPipelineBarrier2(command_buffer, &dependency_info);
+
+    VkBufferImageCopy region{};
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.layerCount = 1;
+    region.imageExtent = { swap_chain_extent_.width, swap_chain_extent_.height, 1 };
+
+    vkCmdCopyImageToBuffer(command_buffer, swap_chain_images_[last_offscreen_image_], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                           staging_buffer, 1, &region);
+
+    // the copy is submitted after the frame, so waiting for it includes the frame itself
+    graphics_timeline_.wait(end_single_time_commands(command_buffer));
+
+    vmaInvalidateAllocation(allocator_, staging_buffer_allocation, 0, VK_WHOLE_SIZE);
+    std::vector frame(pixels, pixels + size);
+
+    vmaDestroyBuffer(allocator_, staging_buffer, staging_buffer_allocation);
+
+    return frame;
 }
 
 void GraphicsRunner::update_uniform_buffer()
@@ -2056,20 +3464,63 @@ void GraphicsRunner::update_uniform_buffer()
     memcpy(uniform_buffers_mapped_[current_frame_], &ubo, sizeof(ubo));
 }
 
+void GraphicsRunner::update_transform_buffer()
+{
+    if (transform_sets_outdated_[current_frame_])
+    {
+        write_transform_descriptor(current_frame_);
+        transform_sets_outdated_[current_frame_] = false;
+    }
+
+    auto* matrices = static_cast<glm::mat4*>(transform_buffers_mapped_[current_frame_]);
+    uploaded_transforms_ = static_cast<uint32_t>(pending_transforms_.size());
+
+    // the slots come around in order, after max_frames_in_flight_ frames every copy has caught up
+    size_t kept = 0;
+    for (const uint32_t index : pending_transforms_)
+    {
+        matrices[index] = transforms_[index];
+
+        if (--transform_copies_behind_[index] > 0)
+        {
+            pending_transforms_[kept++] = index;
+        }
+    }
+    pending_transforms_.resize(kept);
+}
+
 void GraphicsRunner::clean_up()
 {
     // wait for last frame & stuff to process
     vkDeviceWaitIdle(device_);
-    
-    clean_up_swap_chain();
 
-    for (size_t i = 0; i < max_frames_in_flight_; ++i)
+    texture_decoder_.clean();
+    frustum_culler_.clean();
+    job_system_.clean();
+    scene_bvh_.clear();
+
+    for (auto& stream : texture_streams_)
     {
-        vmaUnmapMemory(allocator_, uniform_buffers_allocations_[i]);
-        vmaDestroyBuffer(allocator_, uniform_buffers_[i], uniform_buffers_allocations_[i]);
+        release_staging_texture(std::move(stream.staging));
     }
+    texture_streams_.clear();
+
+    retire_swap_chain();
+    clean_up_attachments();
+    destroy_retired_objects(true);
+
+    occlusion_culler_.clean();
+    upscaler_.clean();
+    render_graph_.clean();
+
+    clean_up_frame_resources();
 
     vkDestroyDescriptorPool(device_, descriptor_pool_, nullptr);
+    for (const auto pool : texture_descriptor_pools_)
+    {
+        vkDestroyDescriptorPool(device_, pool, nullptr);
+    }
+    texture_descriptor_pools_.clear();
 
     vkDestroyDescriptorSetLayout(device_, global_descriptor_set_layout_, nullptr);
 
@@ -2087,22 +3538,23 @@ void GraphicsRunner::clean_up()
 
     resources_.clear();
     
-    for (size_t i = 0; i < max_frames_in_flight_; ++i)
-    {
-        vkDestroySemaphore(device_, image_available_semaphores_[i], nullptr);
-        vkDestroySemaphore(device_, render_finished_semaphores_[i], nullptr);
-        vkDestroyFence(device_, in_flight_fences_[i], nullptr);
-    }
-    
     vkDestroyCommandPool(device_, command_pool_, nullptr);
     
-    vkDestroyPipeline(device_, graphics_pipeline_, nullptr);
+    pipeline_manager_.clean();
+
+    gpu_profiler_.clean();
+
+    save_pipeline_cache();
+    vkDestroyPipelineCache(device_, pipeline_cache_, nullptr);
     
     vkDestroyPipelineLayout(device_, pipeline_layout_, nullptr);
 
     vkDestroyRenderPass(device_, render_pass_, nullptr);
 
     vmaDestroyAllocator(allocator_);
+
+    compute_queue_.clean();
+    graphics_timeline_.clean();
     
     vkDestroyDevice(device_, nullptr);
     
@@ -2111,39 +3563,63 @@ void GraphicsRunner::clean_up()
         destroy_debug_utils_messenger(instance_, debug_messenger_, nullptr);
     }
     
-    vkDestroySurfaceKHR(instance_, surface_, nullptr);
+    if (!headless_)
+    {
+        vkDestroySurfaceKHR(instance_, surface_, nullptr);
+    }
     
     vkDestroyInstance(instance_, nullptr);
+
+    if (!headless_)
+    {
+        glfwDestroyWindow(window_);
     
-    glfwDestroyWindow(window_);
-    
-    glfwTerminate();
+        glfwTerminate();
+    }
 }
 
 bool GraphicsRunner::done()
 {
+    // headless runs are driven by the caller, there is no window to close
+    if (headless_)
+    {
+        return false;
+    }
+
+    PROFILE_ZONE("poll events");
     glfwPollEvents();
 
     return glfwWindowShouldClose(window_);
 }
 
-void GraphicsRunner::clean_up_swap_chain()
+void GraphicsRunner::retire_swap_chain()
 {
-    vkDestroyImageView(device_, color_image_view_, nullptr);
-    vmaDestroyImage(allocator_, color_image_, color_image_allocation_);
-
-    vkDestroyImageView(device_, depth_image_view_, nullptr);
-    vmaDestroyImage(allocator_, depth_image_, depth_image_allocation_);
-    
-    for (const auto framebuffer : swap_chain_framebuffers_)
-    {
-        vkDestroyFramebuffer(device_, framebuffer, nullptr);
-    }
-    
-    for (const auto image_view : swap_chain_image_views_)
+    retire([this, swap_chain = swap_chain_, images = swap_chain_images_, image_views = std::move(swap_chain_image_views_),
+            image_allocations = std::move(offscreen_image_allocations_), semaphores = take_image_semaphores()]
     {
-        vkDestroyImageView(device_, image_view, nullptr);
-    }
-    
-    vkDestroySwapchainKHR(device_, swap_chain_, nullptr);
+        for (const auto semaphore : semaphores)
+        {
+            vkDestroySemaphore(device_, semaphore, nullptr);
+        }
+
+        for (const auto image_view : image_views)
+        {
+            vkDestroyImageView(device_, image_view, nullptr);
+        }
+
+        if (headless_)
+        {
+            for (size_t i = 0; i < images.size(); ++i)
+            {
+                vmaDestroyImage(allocator_, images[i], image_allocations[i]);
+            }
+
+            return;
+        }
+
+        vkDestroySwapchainKHR(device_, swap_chain, nullptr);
+    });
+
+    swap_chain_image_views_.clear();
+    offscreen_image_allocations_.clear();
 }
@@ -5,15 +5,33 @@
 // following directive which tells glfw to do it
 #define GLFW_INCLUDE_VULKAN
 
+#include <deque>
+#include <functional>
+#include <memory>
+#include <optional>
 #include <string>
 #include <vector>
 #include <GLFW/glfw3.h>
 #include <vk_mem_alloc.h>
 
 #include "../Camera/Camera.h"
+#include "../Culling/DynamicBvh.h"
+#include "../Culling/FrustumCuller.h"
+#include "../Culling/OcclusionCuller.h"
+#include "../Image/TextureDecoder.h"
+#include "../Jobs/JobSystem.h"
+#include "../Pipeline/PipelineManager.h"
+#include "../Profiling/GpuProfiler.h"
+#include "../Queue/ComputeQueue.h"
 #include "../Queue/QueueFamilyIndices.h"
+#include "../Queue/QueueTimeline.h"
+#include "../Rendering/DynamicResolution.h"
+#include "../Rendering/QualityTier.h"
+#include "../Rendering/RenderGraph.h"
+#include "../Rendering/Upscaler.h"
 #include "../Rendering/Vertex.h"
 #include "../SwapChain/SwapChainSupportDetails.h"
+#include "../Timing/FrameLimiter.h"
 
 class GraphicsRunner
 {
@@ -29,17 +47,148 @@ public:
 
     bool done();
 
+    // Renders into offscreen targets of the given size instead of a window. No
+    // window, surface or swap chain is created, so it runs without a display.
+    // Every update() renders one frame. Must be called before init.
+    void set_headless(uint32_t width, uint32_t height);
+    [[nodiscard]] bool is_headless() const { return headless_; }
+
+    // Waits for the most recent headless frame and returns its pixels, tightly
+    // packed RGBA8 (sRGB) rows.
+    std::vector<uint8_t> read_frame();
+
+    // Frames are numbered from 0 in the order update() renders them. A frame is
+    // complete once the gpu finished its commands, which is also when whatever it
+    // retired is destroyed. Frames not rendered yet are never complete.
+    [[nodiscard]] uint64_t get_frame_number() const { return frame_number_; }
+    bool is_frame_complete(uint64_t frame);
+    void wait_for_frame(uint64_t frame);
+
+    // Records compute work with `record` and submits it to the async compute
+    // queue, or to the graphics queue on devices with a single family. With
+    // after_frame it starts once the most recently submitted frame is done, and
+    // frames submitted from now on wait for it at frame_stages, so it overlaps the
+    // frame being recorded. Buffers and images it shares with the frames need
+    // VK_SHARING_MODE_CONCURRENT over both families while is_async_compute().
+    // Returns the value is_compute_complete and wait_for_compute take.
+    uint64_t submit_compute(const std::function<void(VkCommandBuffer)>& record, VkPipelineStageFlags2 frame_stages,
+                            bool after_frame = false);
+    bool is_compute_complete(uint64_t value) { return compute_queue_.get_timeline().is_complete(value); }
+    void wait_for_compute(uint64_t value) { compute_queue_.get_timeline().wait(value); }
+    [[nodiscard]] bool is_async_compute() const { return compute_queue_.is_async(); }
+    [[nodiscard]] uint32_t get_compute_queue_family() const { return compute_queue_.get_queue_family(); }
+
+    // Worker threads for the frame's cpu work, culling runs on them as well.
+    // The thread that created the runner is worker 0 and only helps while it waits.
+    JobSystem& get_job_system() { return job_system_; }
+
     /* Registered Resources */
     struct ResourceInfo {
         std::string model_path;
         std::string texture_path;
         glm::mat4 model;
+        // the sample count and sample shading are always taken from the runner's quality tier
+        PipelineState pipeline_state = {};
     };
 
     // Register a new renderable resource. Returns a unique identifier for the resource.
     uint32_t register_resource(const ResourceInfo& info);
 
-    // Update the resource’s uniform (transformation) data.
+    // Register several resources at once. Their textures are decoded in parallel
+    // while the models load, so prefer this over repeated register_resource calls.
+    std::vector<uint32_t> register_resources(const std::vector<ResourceInfo>& infos);
+
+    // Switches between FIFO, FIFO_RELAXED, MAILBOX and IMMEDIATE presentation. The
+    // swap chain is recreated after the next frame. Unsupported modes fall back to
+    // the closest supported one, and finally to FIFO.
+    void set_present_mode(VkPresentModeKHR present_mode);
+    [[nodiscard]] VkPresentModeKHR get_present_mode() const { return present_mode_; }
+
+    // Sets the swap chain's image count, clamped to what the surface allows. 0 (the
+    // default) uses one more than the surface's minimum.
+    void set_swap_chain_image_count(uint32_t image_count);
+
+    // 1 to 4 frames may be recorded ahead of the gpu, 2 by default. Per-frame
+    // resources are rebuilt at the start of the next frame.
+    void set_frames_in_flight(uint32_t frames_in_flight);
+
+    // Tracks acquire and render finished semaphores per swap chain image instead of
+    // per frame in flight, so a semaphore is never reused while a present may still
+    // wait on it. Takes effect when the swap chain is rebuilt after the next frame.
+    void set_per_image_acquire_semaphores(bool enabled);
+
+    // Caps update() to the given rate, 0 (the default) leaves it uncapped.
+    void set_frame_rate_limit(double frames_per_second);
+
+    // GPU time of the scopes in the most recently completed frame: "frame", nested
+    // in it "texture streaming" and the render graph's passes. Those are "scene",
+    // or "first phase", "occlusion culling" and "second phase" with occlusion
+    // culling, then "upscale" when rendering below the output resolution.
+    [[nodiscard]] const std::vector<GpuProfiler::Scope>& get_gpu_timings() const { return gpu_profiler_.get_results(); }
+    [[nodiscard]] std::optional<double> get_gpu_milliseconds(const std::string& scope) const { return gpu_profiler_.get_milliseconds(scope); }
+
+    // Adds vertex and fragment shader invocation counts to the outermost gpu scope,
+    // when the device supports pipeline statistics queries.
+    void set_gpu_pipeline_statistics(bool enabled);
+
+    // When enabled (the default), resources whose bounding sphere is outside the
+    // camera's view are skipped while recording.
+    void set_frustum_culling(bool enabled);
+    // When enabled (the default), frustum culling walks a bounding volume hierarchy
+    // over the resources' world boxes instead of testing every bounding sphere.
+    void set_bvh_culling(bool enabled);
+    // objects (bvh nodes with bvh culling) tested and objects culled in the most recent frame
+    [[nodiscard]] FrustumCuller::Statistics get_culling_statistics() const { return culling_statistics_; }
+    // model matrices the most recent frame wrote into its transform buffer, 0 when nothing moved for a while
+    [[nodiscard]] uint32_t get_uploaded_transform_count() const { return uploaded_transforms_; }
+
+    // When enabled (the default), the objects visible last frame are drawn first
+    // and everything else is tested against their depth on the gpu, hidden objects
+    // are never drawn. Does nothing if the compute shaders are missing or the
+    // depth buffer can't be sampled.
+    void set_occlusion_culling(bool enabled);
+    // enabled and the culler could be created, valid after init()
+    [[nodiscard]] bool is_occlusion_culling_active() const;
+    // objects found hidden by the frame that last used the current frame slot
+    [[nodiscard]] uint32_t get_occluded_count() const { return occlusion_culler_.get_occluded_count(); }
+
+    // Selects msaa, sample shading, anisotropic filtering and resolution scale, the
+    // "high" tier by default. Applied at the start of the next frame, which waits
+    // for the gpu and rebuilds only what depends on the settings that changed: the
+    // attachments for a different sample count or when scaling starts or stops, the
+    // render pass for a different sample count, and the texture samplers for a
+    // different anisotropy.
+    // Pipeline variants are kept per sample count and compile in the background.
+    void set_quality_tier(const QualityTier& tier);
+    // the applied tier, with samples and anisotropy as the device supports them
+    [[nodiscard]] const QualityTier& get_quality_tier() const { return quality_tier_; }
+
+    // Renders the scene into the top left part of an internal target and scales it
+    // up to the output, picking the fraction each frame so the gpu frame time stays
+    // just under target_milliseconds. The quality tier's resolution scale is the
+    // most it goes up to. Textures are sampled with a matching mip lod bias.
+    // Switching it on or off is applied like a quality tier. Does nothing if the
+    // upscale shaders are missing.
+    void set_dynamic_resolution(bool enabled, double target_milliseconds = 16.0, float min_scale = 0.5f);
+    // fraction of the output width and height the most recent frame was rendered at
+    [[nodiscard]] float get_resolution_scale() const { return render_scale_; }
+
+    // Bytes currently allocated through vma, across all memory heaps.
+    [[nodiscard]] VkDeviceSize get_gpu_memory_usage() const;
+
+    // Time init() spent creating the default graphics pipeline, and whether a
+    // pipeline cache saved by a previous run was loaded for it.
+    [[nodiscard]] double get_pipeline_creation_milliseconds() const { return pipeline_creation_milliseconds_; }
+    [[nodiscard]] bool is_pipeline_cache_warm() const { return pipeline_cache_warm_; }
+
+    // When enabled (the default), textures registered from now on only upload their
+    // small mip tail right away and stream the larger levels in over the following
+    // frames, copying at most upload_budget bytes per frame.
+    void set_texture_streaming(bool enabled, VkDeviceSize upload_budget = 8 * 1024 * 1024);
+
+    // Update the resource’s uniform (transformation) data. Only call it for
+    // resources that moved, each changed matrix is copied into every frame in
+    // flight's transform buffer as that frame comes around.
     void update_resource(unsigned int resource_id, const glm::mat4& new_ubo);
 
     // Unregister (delete) a resource.
@@ -54,7 +203,13 @@ private:
     const int height_ = 600;
     const char* title_ = "Vulkan";
 
-    const size_t max_frames_in_flight_ = 2;
+    const uint32_t max_frames_in_flight_limit_ = 4;
+    uint32_t max_frames_in_flight_ = 2;
+    uint32_t requested_frames_in_flight_ = 2;
+
+    const std::string pipeline_cache_path_ = "pipeline_cache.bin";
+    bool pipeline_cache_warm_ = false;
+    double pipeline_creation_milliseconds_ = 0.0;
     
     const std::vector<const char*> validation_layers_ =
     {
@@ -71,6 +226,7 @@ private:
 #endif
     
     uint32_t current_frame_ = 0;
+    uint64_t frame_number_ = 0;
     
     VkInstance instance_;
     VkDebugUtilsMessengerEXT debug_messenger_;
@@ -81,26 +237,62 @@ private:
     VkDevice device_;
     
     VkQueue graphics_queue_; // implicitly destroyed
+    // every graphics submit signals the next value, frames and uploads alike
+    QueueTimeline graphics_timeline_;
+    // value of the most recent upload, the next frame waits for it on the gpu
+    uint64_t upload_value_ = 0;
+    // the graphics queue without a separate compute family
+    ComputeQueue compute_queue_;
+    // compute work frames wait for, and the stages they wait at until it is done
+    uint64_t compute_wait_value_ = 0;
+    VkPipelineStageFlags2 compute_wait_stages_ = 0;
     VkQueue present_queue_; // implicitly destroyed
     
     VkSurfaceKHR surface_;
     
-    VkSwapchainKHR swap_chain_;
+    VkSwapchainKHR swap_chain_ = VK_NULL_HANDLE;
+    bool headless_ = false;
+    VkExtent2D headless_extent_ = {};
+    // headless mode renders into these instead of swap chain images
+    std::vector<VmaAllocation> offscreen_image_allocations_;
+    uint32_t last_offscreen_image_ = 0;
+    VkPresentModeKHR requested_present_mode_ = VK_PRESENT_MODE_FIFO_KHR;
+    VkPresentModeKHR present_mode_ = VK_PRESENT_MODE_FIFO_KHR;
+    // 0 asks for one image more than the surface's minimum
+    uint32_t requested_swap_chain_image_count_ = 0;
+    // set when a swap chain setting changed, the swap chain is rebuilt after the next present
+    bool swap_chain_outdated_ = false;
     std::vector<VkImage> swap_chain_images_;
     VkFormat swap_chain_image_format_;
     VkExtent2D swap_chain_extent_;
     std::vector<VkImageView> swap_chain_image_views_;
     
+    // only for creating pipelines, the render graph begins compatible ones
     VkRenderPass render_pass_;
+
+    // declares every frame's passes, and owns the swap chain sized images they render into
+    RenderGraph render_graph_;
+    VkFormat depth_format_ = VK_FORMAT_UNDEFINED;
+    // images of the most recent declaration
+    RenderGraph::Resource depth_attachment_ = 0;
+    RenderGraph::Resource scene_color_ = 0;
+    // generation of the graph's images the depth pyramid and the upscaler use, 0 for none,
+    // and the swap chain extent the pyramid was built for
+    uint64_t bound_graph_generation_ = 0;
+    VkExtent2D bound_extent_ = {};
     
     VkDescriptorSetLayout global_descriptor_set_layout_;
     VkDescriptorSetLayout texture_descriptor_set_layout_;
     
     VkPipelineLayout pipeline_layout_;
-    VkPipeline graphics_pipeline_;
-    std::vector<VkFramebuffer> swap_chain_framebuffers_;
+    VkPipelineCache pipeline_cache_ = VK_NULL_HANDLE;
+    PipelineManager pipeline_manager_;
+    bool graphics_pipeline_library_supported_ = false;
     VkCommandPool command_pool_;
     VkDescriptorPool descriptor_pool_;
+    // one texture set per resource, another pool is added whenever they are all full
+    std::vector<VkDescriptorPool> texture_descriptor_pools_;
+    static constexpr uint32_t texture_sets_per_pool_ = 256;
     // implicitly destroyed when pool is destroyed
     std::vector<VkDescriptorSet> descriptor_sets_;
 
@@ -108,21 +300,55 @@ private:
     std::vector<VmaAllocation> uniform_buffers_allocations_;
     std::vector<void*> uniform_buffers_mapped_;
 
+    // model matrices by transform index, every frame in flight reads its own copy from a storage buffer
+    std::vector<glm::mat4> transforms_;
+    std::vector<uint32_t> free_transform_indices_;
+    // indices some copies are behind on, and how many copies that is per index
+    std::vector<uint32_t> pending_transforms_;
+    std::vector<uint32_t> transform_copies_behind_;
+    // matrices each copy has room for
+    uint32_t transform_capacity_ = 0;
+    std::vector<VkBuffer> transform_buffers_;
+    std::vector<VmaAllocation> transform_buffer_allocations_;
+    std::vector<void*> transform_buffers_mapped_;
+    // the slot's descriptor set still points at a replaced copy, it is rewritten when the slot is recorded next
+    std::vector<bool> transform_sets_outdated_;
+    uint32_t uploaded_transforms_ = 0;
+
     // per-flight
     std::vector<VkCommandBuffer> command_buffers_;
     std::vector<VkSemaphore> image_available_semaphores_;
     std::vector<VkSemaphore> render_finished_semaphores_;
-    std::vector<VkFence> in_flight_fences_;
-
-    VkImage depth_image_;
-    VmaAllocation depth_image_allocation_;
-    VkImageView depth_image_view_;
-
-    VkImage color_image_;
-    VmaAllocation color_image_allocation_;
-    VkImageView color_image_view_;
-
-    VkSampleCountFlagBits msaa_samples_ = VK_SAMPLE_COUNT_1_BIT;
+    // timeline value of the frames submitted last, indexed by frame number modulo the limit
+    std::vector<uint64_t> frame_timeline_values_;
+
+    // per swap chain image, when enabled
+    bool requested_per_image_semaphores_ = false;
+    bool per_image_semaphores_ = false;
+    std::vector<VkSemaphore> image_acquire_semaphores_;
+    std::vector<VkSemaphore> free_acquire_semaphores_;
+    std::vector<VkSemaphore> image_render_finished_semaphores_;
+
+    // when upscaling the scene resolves into an image of the render graph instead of the
+    // swap chain image, and only the top left render_extent_ of it (and of color and depth) is drawn
+    bool dynamic_resolution_ = false;
+    bool requested_dynamic_resolution_ = false;
+    float dynamic_resolution_min_scale_ = 0.5f;
+    DynamicResolution resolution_;
+    Upscaler upscaler_;
+    VkExtent2D render_extent_ = {};
+    float render_scale_ = 1.0f;
+
+    QualityTier quality_tier_ = quality::get_default_tier();
+    QualityTier requested_quality_tier_ = quality::get_default_tier();
+    // set when the tier or dynamic resolution changed, they are applied at the start of the next frame
+    bool quality_outdated_ = false;
+    bool sample_rate_shading_supported_ = false;
+
+    FrameLimiter frame_limiter_;
+
+    GpuProfiler gpu_profiler_;
+    bool pipeline_statistics_supported_ = false;
 
     /* Externally Modified */
     Camera* camera_;
@@ -138,21 +364,83 @@ private:
         VmaAllocation indexBufferAllocation;     // renamed & type changed
         // texture
         uint32_t mip_levels;
+        // most detailed level that is uploaded, the view starts here
+        uint32_t resident_mip_level;
+        VkFormat texture_format;
         VkImage texture_image;
         VmaAllocation textureImageAllocation;    // renamed & type changed
         VkImageView texture_image_view;
         VkSampler texture_sampler;
         VkDescriptorSet texture_descriptor_set;
-        // position
-        glm::mat4 model;
+        // the pool the set was allocated from, to free it back to
+        VkDescriptorPool texture_descriptor_pool;
+        // position, the model matrix is transforms_[transform_index]
+        uint32_t transform_index;
+        PipelineState pipeline_state;
+        // culling
+        MeshBounds bounds;
+        uint32_t cull_slot;
+        uint32_t bvh_proxy;
+        // hidden when last tested, drawn in the second phase if at all
+        bool occluded = false;
     };
 
     // Container mapping resource IDs to their renderable data.
     std::unordered_map<uint32_t, RenderableResource> resources_;
     std::unordered_map<std::string, std::vector<Vertex>> vertex_cache_;
     std::unordered_map<std::string, std::vector<uint32_t>> index_cache_;
+    std::unordered_map<std::string, MeshBounds> bounds_cache_;
     uint32_t nextResourceId_ = 1;
 
+    TextureDecoder texture_decoder_;
+    JobSystem job_system_;
+
+    FrustumCuller frustum_culler_;
+    bool frustum_culling_ = true;
+    DynamicBvh scene_bvh_;
+    bool bvh_culling_ = true;
+    // ids of the resources that survived this frame's frustum culling
+    std::vector<uint32_t> visible_resources_;
+    FrustumCuller::Statistics culling_statistics_;
+
+    OcclusionCuller occlusion_culler_;
+    bool occlusion_culling_ = true;
+    // this frame's frustum survivors, in the order of their indirect draws
+    std::vector<OcclusionCuller::Candidate> occlusion_candidates_;
+
+    // a decoded texture's staging buffer, shared by every resource streaming from it
+    struct StagingTexture {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VmaAllocation allocation = VK_NULL_HANDLE;
+        TextureDecoder::DecodedTexture texture;
+    };
+
+    struct PendingTexture {
+        std::shared_ptr<StagingTexture> staging;
+        std::future<TextureDecoder::DecodedTexture> decoding;
+    };
+
+    struct TextureStream {
+        uint32_t resource_id;
+        std::shared_ptr<StagingTexture> staging;
+        // rows (of blocks) of the next level that have been copied already
+        uint32_t uploaded_rows;
+    };
+
+    bool texture_streaming_ = true;
+    // levels this size and smaller are uploaded when the resource is registered
+    const uint32_t texture_stream_tail_size_ = 64;
+    VkDeviceSize texture_upload_budget_ = 8 * 1024 * 1024;
+    std::vector<TextureStream> texture_streams_;
+
+    // objects the gpu may still be using, destroyed once the timeline reaches the value
+    // of the submit after their retirement
+    struct RetiredObject {
+        uint64_t value;
+        std::function<void()> destroy;
+    };
+    std::deque<RetiredObject> retired_objects_;
+
     static void frame_buffer_resize_callback(GLFWwindow* window, int width, int height);
     void init_window();
     /* Vulkan Initialization */
@@ -165,16 +453,28 @@ private:
     bool are_validation_layers_supported();
 
     bool are_device_extensions_supported(const VkPhysicalDevice device);
+    std::vector<const char*> get_device_extensions();
     SwapChainSupportDetails get_swap_chain_support_details(VkPhysicalDevice device);
     int rate_device(VkPhysicalDevice device);
-    VkSampleCountFlagBits get_max_usable_sample_count();
+    // Vulkan 1.3 with timeline semaphores and synchronization2, every submit and barrier uses them
+    static bool is_timeline_synchronization_supported(VkPhysicalDevice device);
+    // the highest count up to `requested` that color and depth attachments support
+    VkSampleCountFlagBits get_usable_sample_count(VkSampleCountFlagBits requested);
+    QualityTier get_supported_quality_tier(QualityTier tier);
+    void apply_quality_settings();
+    void update_resolution_settings();
     void select_physical_device();
 
     QueueFamilyIndices find_queue_families(VkPhysicalDevice device);
     void create_logical_device();
+    bool is_graphics_pipeline_library_supported();
 
     void create_vma_allocator();
 
+    void create_pipeline_cache();
+    bool is_pipeline_cache_compatible(const std::vector<char> &cache_data);
+    void save_pipeline_cache();
+
     void create_surface();
 
     VkSurfaceFormatKHR select_swap_surface_format(const std::vector<VkSurfaceFormatKHR>& available_formats);
@@ -182,6 +482,7 @@ private:
     VkExtent2D select_swap_extent(const VkSurfaceCapabilitiesKHR& capabilities);
     void recreate_swap_chain();
     void create_swap_chain();
+    void create_offscreen_targets();
 
     void create_image_views();
 
@@ -195,47 +496,69 @@ private:
     void create_texture_descriptor_set_layout();
     
     void create_graphics_pipeline();
+    PipelineState get_pipeline_state(PipelineState state);
 
-    void create_frame_buffers();
+    // the render graph's swap chain sized images
+    void create_attachments();
+    void clean_up_attachments();
 
     void create_command_pools();
-    void create_color_resources();
     
+    bool is_format_supported(VkFormat format, VkImageTiling tiling, VkFormatFeatureFlags features);
     VkFormat find_supported_format(const std::vector<VkFormat> &candidates, VkImageTiling tiling,
                                    VkFormatFeatureFlags features);
     VkFormat find_depth_format();
     bool has_stencil_component(VkFormat format);
 
-    void create_depth_resources();
-
     void create_image(uint32_t width, uint32_t height, uint32_t mip_levels, VkSampleCountFlagBits num_samples, VkFormat format, VkImageTiling
                       tiling, VkImageUsageFlags
                       usage, VkMemoryPropertyFlags properties, VkImage &image, VmaAllocation &image_allocation);
-    void generate_mip_maps(VkImage image, VkFormat image_format, int32_t texture_width,
-                           int32_t texture_height, uint32_t mip_levels);
+    void create_model_buffers(const std::string &model_path, RenderableResource &resource);
+
+    std::optional<std::string> find_compressed_texture(const std::string &texture_path);
+    void upload_texture(VkBuffer staging_buffer, const TextureDecoder::DecodedTexture &texture, RenderableResource &resource);
+    void stream_textures(VkCommandBuffer command_buffer);
+    void release_staging_texture(std::shared_ptr<StagingTexture> staging);
 
-    void create_texture_image(const std::string &texture_path, RenderableResource &resource);
+    void retire(std::function<void()> destroy);
+    void destroy_retired_objects(bool all);
     
-    VkImageView create_image_view(VkImage image, VkFormat format, VkImageAspectFlags aspect_flags, uint32_t mip_levels);
+    VkImageView create_image_view(VkImage image, VkFormat format, VkImageAspectFlags aspect_flags, uint32_t base_mip_level,
+                                  uint32_t mip_levels);
 
     void create_texture_image_view(RenderableResource &resource);
 
     void create_texture_sampler(RenderableResource &resource);
 
+    void create_texture_descriptor_set(RenderableResource &resource);
+    VkDescriptorPool create_texture_descriptor_pool();
+    void write_texture_descriptor_set(const RenderableResource &resource);
+
     uint32_t find_memory_type(uint32_t type_filter, VkMemoryPropertyFlags properties);
 
     void create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer &buffer, VmaAllocation
                        &buffer_allocation);
+    uint8_t* create_staging_buffer(VkDeviceSize size, VkBuffer &buffer, VmaAllocation &buffer_allocation);
     void transition_image_layout(VkImage image, VkFormat format, VkImageLayout old_layout,
-                                 VkImageLayout new_layout, uint32_t mip_levels);
-    void copy_buffer_to_image(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height);
+                                 VkImageLayout new_layout, uint32_t base_mip_level, uint32_t mip_levels);
+    void record_image_layout_transition(VkCommandBuffer command_buffer, VkImage image, VkFormat format,
+                                        VkImageLayout old_layout, VkImageLayout new_layout,
+                                        uint32_t base_mip_level, uint32_t mip_levels);
+    void copy_buffer_to_image(VkBuffer buffer, VkImage image, const std::vector<VkBufferImageCopy> &regions);
     VkCommandBuffer begin_single_time_commands();
-    void end_single_time_commands(VkCommandBuffer command_buffer);
+    // submits without waiting, returns the timeline value the commands finish at
+    uint64_t end_single_time_commands(VkCommandBuffer command_buffer);
 
     void copy_buffer(VkBuffer src_buffer, VkBuffer dst_buffer, VkDeviceSize size);
 
     void create_uniform_buffers();
 
+    uint32_t allocate_transform(const glm::mat4& model);
+    void set_transform(uint32_t index, const glm::mat4& model);
+    // one copy per frame in flight with room for every transform, filled from transforms_
+    void create_transform_buffers();
+    void write_transform_descriptor(size_t frame);
+
     void create_descriptor_pool();
     
     void create_descriptor_sets();
@@ -243,12 +566,45 @@ private:
     void create_command_buffers();
 
     void create_sync_objects();
-
+    void create_gpu_profiler();
+    void create_occlusion_culler();
+    void create_upscaler();
+    void create_render_graph();
+    void create_image_semaphores();
+    VkSemaphore get_free_acquire_semaphore();
+    // hands over every per image semaphore and leaves the lists empty
+    std::vector<VkSemaphore> take_image_semaphores();
+
+    void clean_up_frame_resources();
+    void resize_frame_resources();
+
+    void update_render_extent();
+    void cull_resources();
+    [[nodiscard]] bool is_upscaling_active() const;
+    // declares the passes of a frame that renders to the swap chain image image_index
+    void declare_frame(uint32_t image_index);
+    // points the depth pyramid and the upscaler at the graph's images when it
+    // created new ones, or when the swap chain changed size
+    void bind_render_graph_images();
+    // viewport, scissor, camera and lod bias of a pass drawing the scene
+    void bind_scene_state(VkCommandBuffer command_buffer);
+    void record_scene_draws(VkCommandBuffer command_buffer, bool skip_occluded);
+    // draws directly, or from the indirect command at indirect_offset when an indirect buffer is given
+    void record_draw(VkCommandBuffer command_buffer, const RenderableResource &resource, VkPipeline &bound_pipeline,
+                     VkBuffer indirect_buffer = VK_NULL_HANDLE, VkDeviceSize indirect_offset = 0);
     void record_command_buffer(VkCommandBuffer command_buffer, uint32_t image_index);
     
     void draw_frame();
+    void draw_offscreen_frame();
+    // submits the current slot's command buffer after the pending uploads, and records the frame's timeline value
+    void submit_frame(std::vector<QueueTimeline::Wait> waits, const std::vector<VkSemaphore>& signals);
     
     void update_uniform_buffer();
+    // brings the current slot's transform buffer up to date, before the slot is recorded
+    void update_transform_buffer();
 
-    void clean_up_swap_chain();
+    // The swap chain, its views and semaphores are destroyed once the frames in
+    // flight are done with them. swap_chain_ stays set, so the next swap chain
+    // can take over from it.
+    void retire_swap_chain();
 };
@@ -0,0 +1,344 @@
+﻿#include "Ktx2.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+#include "MappedFile.h"
+
+namespace
+{
+
+constexpr std::array<uint8_t, 12> identifier =
+{
+    0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A,
+};
+
+struct Header
+{
+    uint8_t identifier[12];
+    uint32_t vk_format;
+    uint32_t type_size;
+    uint32_t pixel_width;
+    uint32_t pixel_height;
+    uint32_t pixel_depth;
+    uint32_t layer_count;
+    uint32_t face_count;
+    uint32_t level_count;
+    uint32_t supercompression_scheme;
+    uint32_t dfd_byte_offset;
+    uint32_t dfd_byte_length;
+    uint32_t kvd_byte_offset;
+    uint32_t kvd_byte_length;
+    uint64_t sgd_byte_offset;
+    uint64_t sgd_byte_length;
+};
+
+static_assert(sizeof(Header) == 80, "KTX2 header must be 80 bytes");
+
+struct LevelIndex
+{
+    uint64_t byte_offset;
+    uint64_t byte_length;
+    uint64_t uncompressed_byte_length;
+};
+
+// Khronos data format descriptor color models for the formats we write
+constexpr uint8_t df_model_bc1a = 128;
+constexpr uint8_t df_model_bc7 = 134;
+constexpr uint8_t df_primaries_bt709 = 1;
+constexpr uint8_t df_transfer_linear = 1;
+constexpr uint8_t df_transfer_srgb = 2;
+
+struct BlockFormat
+{
+    uint8_t color_model;
+    uint8_t block_bytes;
+    bool srgb;
+};
+
+BlockFormat get_block_format(const VkFormat format)
+{
+    switch (format)
+    {
+    case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+        return {df_model_bc1a, 8, true};
+    case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+        return {df_model_bc1a, 8, false};
+    case VK_FORMAT_BC7_SRGB_BLOCK:
+        return {df_model_bc7, 16, true};
+    case VK_FORMAT_BC7_UNORM_BLOCK:
+        return {df_model_bc7, 16, false};
+    default:
+        throw std::runtime_error("Error: unsupported KTX2 output format.");
+    }
+}
+
+std::vector<uint32_t> build_data_format_descriptor(const BlockFormat& block_format)
+{
+    constexpr uint32_t block_size = 24 + 16;
+
+    std::vector<uint32_t> dfd;
+    dfd.push_back(4 + block_size);
+    // vendor id 0 (Khronos), descriptor type 0 (basic)
+    dfd.push_back(0);
+    // version 2, block size
+    dfd.push_back(2u | (block_size << 16));
+    dfd.push_back(block_format.color_model
+        | (df_primaries_bt709 << 8)
+        | ((block_format.srgb ? df_transfer_srgb : df_transfer_linear) << 16));
+    // 4x4 texel blocks (stored as dimension - 1)
+    dfd.push_back(3u | (3u << 8));
+    dfd.push_back(block_format.block_bytes);
+    dfd.push_back(0);
+    // a single sample covering the whole block
+    dfd.push_back(0u | ((block_format.block_bytes * 8u - 1u) << 16));
+    dfd.push_back(0);
+    dfd.push_back(0);
+    dfd.push_back(0xFFFFFFFFu);
+
+    return dfd;
+}
+
+uint64_t align_up(const uint64_t value, const uint64_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+}
+
+std::optional<ktx2::TexelBlock> ktx2::get_texel_block(const VkFormat format)
+{
+    switch (format)
+    {
+    case VK_FORMAT_R8G8B8A8_SRGB:
+    case VK_FORMAT_R8G8B8A8_UNORM:
+        return TexelBlock{1, 1, 4};
+    case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+    case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+    case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+    case VK_FORMAT_BC4_UNORM_BLOCK:
+    case VK_FORMAT_ETC2_R8G8B8_SRGB_BLOCK:
+    case VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK:
+    case VK_FORMAT_ETC2_R8G8B8A1_SRGB_BLOCK:
+    case VK_FORMAT_ETC2_R8G8B8A1_UNORM_BLOCK:
+        return TexelBlock{4, 4, 8};
+    case VK_FORMAT_BC3_SRGB_BLOCK:
+    case VK_FORMAT_BC3_UNORM_BLOCK:
+    case VK_FORMAT_BC5_UNORM_BLOCK:
+    case VK_FORMAT_BC7_SRGB_BLOCK:
+    case VK_FORMAT_BC7_UNORM_BLOCK:
+    case VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK:
+    case VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK:
+    case VK_FORMAT_ASTC_4x4_SRGB_BLOCK:
+    case VK_FORMAT_ASTC_4x4_UNORM_BLOCK:
+        return TexelBlock{4, 4, 16};
+    case VK_FORMAT_ASTC_5x4_SRGB_BLOCK:
+    case VK_FORMAT_ASTC_5x4_UNORM_BLOCK:
+        return TexelBlock{5, 4, 16};
+    case VK_FORMAT_ASTC_5x5_SRGB_BLOCK:
+    case VK_FORMAT_ASTC_5x5_UNORM_BLOCK:
+        return TexelBlock{5, 5, 16};
+    case VK_FORMAT_ASTC_6x5_SRGB_BLOCK:
+    case VK_FORMAT_ASTC_6x5_UNORM_BLOCK:
+        return TexelBlock{6, 5, 16};
+    case VK_FORMAT_ASTC_6x6_SRGB_BLOCK:
+    case VK_FORMAT_ASTC_6x6_UNORM_BLOCK:
+        return TexelBlock{6, 6, 16};
+    case VK_FORMAT_ASTC_8x5_SRGB_BLOCK:
+    case VK_FORMAT_ASTC_8x5_UNORM_BLOCK:
+        return TexelBlock{8, 5, 16};
+    case VK_FORMAT_ASTC_8x6_SRGB_BLOCK:
+    case VK_FORMAT_ASTC_8x6_UNORM_BLOCK:
+        return TexelBlock{8, 6, 16};
+    case VK_FORMAT_ASTC_8x8_SRGB_BLOCK:
+    case VK_FORMAT_ASTC_8x8_UNORM_BLOCK:
+        return TexelBlock{8, 8, 16};
+    case VK_FORMAT_ASTC_10x5_SRGB_BLOCK:
+    case VK_FORMAT_ASTC_10x5_UNORM_BLOCK:
+        return TexelBlock{10, 5, 16};
+    case VK_FORMAT_ASTC_10x6_SRGB_BLOCK:
+    case VK_FORMAT_ASTC_10x6_UNORM_BLOCK:
+        return TexelBlock{10, 6, 16};
+    case VK_FORMAT_ASTC_10x8_SRGB_BLOCK:
+    case VK_FORMAT_ASTC_10x8_UNORM_BLOCK:
+        return TexelBlock{10, 8, 16};
+    case VK_FORMAT_ASTC_10x10_SRGB_BLOCK:
+    case VK_FORMAT_ASTC_10x10_UNORM_BLOCK:
+        return TexelBlock{10, 10, 16};
+    case VK_FORMAT_ASTC_12x10_SRGB_BLOCK:
+    case VK_FORMAT_ASTC_12x10_UNORM_BLOCK:
+        return TexelBlock{12, 10, 16};
+    case VK_FORMAT_ASTC_12x12_SRGB_BLOCK:
+    case VK_FORMAT_ASTC_12x12_UNORM_BLOCK:
+        return TexelBlock{12, 12, 16};
+    default:
+        return std::nullopt;
+    }
+}
+
+ktx2::Texture ktx2::parse(const uint8_t* bytes, const size_t size, const std::string& path)
+{
+    if (size < sizeof(Header))
+    {
+        throw std::runtime_error("Error: " + path + " is too small to be a KTX2 file.");
+    }
+
+    Header header;
+    memcpy(&header, bytes, sizeof(Header));
+
+    if (memcmp(header.identifier, identifier.data(), identifier.size()) != 0)
+    {
+        throw std::runtime_error("Error: " + path + " is not a KTX2 file.");
+    }
+
+    if (header.supercompression_scheme != 0)
+    {
+        throw std::runtime_error("Error: " + path + " is supercompressed, transcode it to a GPU format offline.");
+    }
+
+    if (header.pixel_depth > 1 || header.layer_count > 1 || header.face_count != 1)
+    {
+        throw std::runtime_error("Error: " + path + " is not a single 2D texture.");
+    }
+
+    if (header.pixel_width == 0 || header.pixel_height == 0)
+    {
+        throw std::runtime_error("Error: " + path + " has no texels.");
+    }
+
+    const auto texel_block = get_texel_block(static_cast<VkFormat>(header.vk_format));
+    if (!texel_block.has_value())
+    {
+        throw std::runtime_error("Error: " + path + " is in an unsupported format (" + std::to_string(header.vk_format) + ").");
+    }
+
+    // a full chain ends at 1x1
+    const uint32_t level_count = std::max(header.level_count, 1u);
+    if (level_count > static_cast<uint32_t>(std::bit_width(std::max(header.pixel_width, header.pixel_height))))
+    {
+        throw std::runtime_error("Error: " + path + " has more levels than its size allows.");
+    }
+
+    if (sizeof(Header) + level_count * sizeof(LevelIndex) > size)
+    {
+        throw std::runtime_error("Error: " + path + " has a truncated level index.");
+    }
+
+    Texture texture;
+    texture.format = static_cast<VkFormat>(header.vk_format);
+    texture.width = header.pixel_width;
+    texture.height = header.pixel_height;
+    texture.levels.resize(level_count);
+
+    for (uint32_t i = 0; i < level_count; ++i)
+    {
+        LevelIndex level_index;
+        memcpy(&level_index, bytes + sizeof(Header) + i * sizeof(LevelIndex), sizeof(LevelIndex));
+
+        // written so neither side can wrap
+        if (level_index.byte_offset > size || level_index.byte_length > size - level_index.byte_offset)
+        {
+            throw std::runtime_error("Error: " + path + " has a level outside of the file.");
+        }
+
+        const uint64_t blocks_wide = (std::max(header.pixel_width >> i, 1u) + texel_block->width - 1) / texel_block->width;
+        const uint64_t blocks_high = (std::max(header.pixel_height >> i, 1u) + texel_block->height - 1) / texel_block->height;
+        if (level_index.byte_length != blocks_wide * blocks_high * texel_block->bytes)
+        {
+            throw std::runtime_error("Error: " + path + " has a level of the wrong size for its extent and format.");
+        }
+
+        texture.levels[i] = {level_index.byte_offset, level_index.byte_length};
+    }
+
+    return texture;
+}
+
+ktx2::Texture ktx2::load(const std::string& path)
+{
+    const MappedFile file(path);
+
+    auto texture = parse(file.data(), file.size(), path);
+
+    uint64_t data_size = 0;
+    for (const auto& level : texture.levels)
+    {
+        data_size += level.size;
+    }
+
+    // repack so the base level comes first and the levels are contiguous
+    texture.data.resize(data_size);
+
+    uint64_t offset = 0;
+    for (auto& level : texture.levels)
+    {
+        memcpy(texture.data.data() + offset, file.data() + level.offset, level.size);
+        level.offset = offset;
+        offset += level.size;
+    }
+
+    return texture;
+}
+
+void ktx2::save(const std::string& path, const Texture& texture)
+{
+    const auto block_format = get_block_format(texture.format);
+    const auto dfd = build_data_format_descriptor(block_format);
+    const auto level_count = static_cast<uint32_t>(texture.levels.size());
+
+    Header header{};
+    memcpy(header.identifier, identifier.data(), identifier.size());
+    header.vk_format = texture.format;
+    header.type_size = 1;
+    header.pixel_width = texture.width;
+    header.pixel_height = texture.height;
+    header.pixel_depth = 0;
+    header.layer_count = 0;
+    header.face_count = 1;
+    header.level_count = level_count;
+    header.supercompression_scheme = 0;
+    header.dfd_byte_offset = static_cast<uint32_t>(sizeof(Header) + level_count * sizeof(LevelIndex));
+    header.dfd_byte_length = static_cast<uint32_t>(dfd.size() * sizeof(uint32_t));
+
+    // levels are stored smallest first, each aligned to the block size
+    std::vector<LevelIndex> level_indices(level_count);
+    uint64_t offset = header.dfd_byte_offset + header.dfd_byte_length;
+    for (uint32_t i = level_count; i-- > 0;)
+    {
+        offset = align_up(offset, block_format.block_bytes);
+        level_indices[i] = {offset, texture.levels[i].size, texture.levels[i].size};
+        offset += texture.levels[i].size;
+    }
+
+    std::vector<uint8_t> bytes(offset, 0);
+    memcpy(bytes.data(), &header, sizeof(Header));
+    memcpy(bytes.data() + sizeof(Header), level_indices.data(), level_count * sizeof(LevelIndex));
+    memcpy(bytes.data() + header.dfd_byte_offset, dfd.data(), header.dfd_byte_length);
+
+    for (uint32_t i = 0; i < level_count; ++i)
+    {
+        memcpy(bytes.data() + level_indices[i].byte_offset, texture.data.data() + texture.levels[i].offset, texture.levels[i].size);
+    }
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+
+    if (!file.is_open())
+    {
+        throw std::runtime_error("Error: unable to write file " + path);
+    }
+
+    file.write(reinterpret_cast<const char*>(bytes.data()), static_cast<long long>(bytes.size()));
+}
+
+std::string ktx2::variant_path(const std::string& texture_path, const std::string& suffix)
+{
+    std::filesystem::path path(texture_path);
+    path.replace_extension("." + suffix + ".ktx2");
+    return path.string();
+}
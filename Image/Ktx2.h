@@ -0,0 +1,59 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan_core.h>
+
+namespace ktx2
+{
+
+struct Level
+{
+    // byte range of the level inside Texture::data
+    uint64_t offset;
+    uint64_t size;
+};
+
+struct Texture
+{
+    VkFormat format;
+    uint32_t width;
+    uint32_t height;
+    // index 0 is the base level
+    std::vector<Level> levels;
+    std::vector<uint8_t> data;
+};
+
+// Texel extent and byte size of one block of a format, 1x1 for uncompressed ones
+struct TexelBlock
+{
+    uint32_t width;
+    uint32_t height;
+    uint32_t bytes;
+};
+
+// Empty for formats textures can't be loaded in.
+std::optional<TexelBlock> get_texel_block(VkFormat format);
+
+// Loads an uncompressed-container KTX2 file (supercompressionScheme 0). Basis
+// and zstd supercompressed files have to be transcoded offline first.
+Texture load(const std::string& path);
+
+// Reads the header and level index of a KTX2 file that is already in memory.
+// The levels are byte ranges inside `bytes` and Texture::data is left empty,
+// so the caller can copy them straight to their destination. `path` is only
+// used for error messages. Throws unless the format has a texel block, every
+// level lies inside the file and has exactly the size its extent requires.
+Texture parse(const uint8_t* bytes, size_t size, const std::string& path);
+
+// Writes the texture as a KTX2 file. Only block compressed formats produced by
+// the texture compressor are given a data format descriptor.
+void save(const std::string& path, const Texture& texture);
+
+// The path a compressed variant of a source texture is stored at, i.e.
+// "Textures/grid.jpg" with suffix "bc1" becomes "Textures/grid.bc1.ktx2".
+std::string variant_path(const std::string& texture_path, const std::string& suffix);
+
+}
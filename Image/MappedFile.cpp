@@ -0,0 +1,141 @@
+﻿#include "MappedFile.h"
+
+#include <stdexcept>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::string& path)
+{
+#ifdef _WIN32
+    file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+
+    if (file_ == INVALID_HANDLE_VALUE)
+    {
+        file_ = nullptr;
+        throw std::runtime_error("Error: unable to open file " + path);
+    }
+
+    LARGE_INTEGER file_size;
+    GetFileSizeEx(file_, &file_size);
+    size_ = static_cast<size_t>(file_size.QuadPart);
+
+    // empty files can't be mapped, they are simply empty
+    if (size_ == 0)
+    {
+        return;
+    }
+
+    mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping_ == nullptr)
+    {
+        unmap();
+        throw std::runtime_error("Error: unable to map file " + path);
+    }
+
+    data_ = static_cast<const uint8_t*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+#else
+    const int file = open(path.c_str(), O_RDONLY);
+
+    if (file < 0)
+    {
+        throw std::runtime_error("Error: unable to open file " + path);
+    }
+
+    struct stat file_stat{};
+    fstat(file, &file_stat);
+    size_ = static_cast<size_t>(file_stat.st_size);
+
+    if (size_ == 0)
+    {
+        close(file);
+        return;
+    }
+
+    void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, file, 0);
+    // the mapping keeps its own reference to the file
+    close(file);
+
+    if (data == MAP_FAILED)
+    {
+        size_ = 0;
+        throw std::runtime_error("Error: unable to map file " + path);
+    }
+
+    madvise(data, size_, MADV_SEQUENTIAL);
+    data_ = static_cast<const uint8_t*>(data);
+#endif
+
+    if (data_ == nullptr)
+    {
+        unmap();
+        throw std::runtime_error("Error: unable to map file " + path);
+    }
+}
+
+MappedFile::~MappedFile()
+{
+    unmap();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+{
+    *this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+    if (this != &other)
+    {
+        unmap();
+        data_ = std::exchange(other.data_, nullptr);
+        size_ = std::exchange(other.size_, 0);
+#ifdef _WIN32
+        file_ = std::exchange(other.file_, nullptr);
+        mapping_ = std::exchange(other.mapping_, nullptr);
+#endif
+    }
+
+    return *this;
+}
+
+void MappedFile::unmap()
+{
+#ifdef _WIN32
+    if (data_ != nullptr)
+    {
+        UnmapViewOfFile(data_);
+    }
+
+    if (mapping_ != nullptr)
+    {
+        CloseHandle(mapping_);
+    }
+
+    if (file_ != nullptr)
+    {
+        CloseHandle(file_);
+    }
+
+    mapping_ = nullptr;
+    file_ = nullptr;
+#else
+    if (data_ != nullptr)
+    {
+        munmap(const_cast<uint8_t*>(data_), size_);
+    }
+#endif
+
+    data_ = nullptr;
+    size_ = 0;
+}
@@ -0,0 +1,349 @@
+﻿#include "MipChain.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <stdexcept>
+#include <thread>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MIP_CHAIN_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "../Logging/Logging.h"
+
+namespace
+{
+
+constexpr char cache_magic[4] = {'M', 'I', 'P', 'S'};
+constexpr uint32_t cache_version = 1;
+
+struct CacheHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t source_size;
+    int64_t source_time;
+    uint32_t width;
+    uint32_t height;
+    uint32_t level_count;
+    uint32_t reserved;
+};
+
+float srgb_to_linear(const float value)
+{
+    return value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+}
+
+float linear_to_srgb(const float value)
+{
+    return value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.f / 2.4f) - 0.055f;
+}
+
+// 8 bit sRGB -> linear float, and 12 bit linear -> 8 bit sRGB (12 bits keeps the
+// dark end of the curve exact after rounding)
+struct ColorTables
+{
+    std::array<float, 256> to_linear;
+    std::array<uint8_t, 4096> to_srgb;
+
+    ColorTables()
+    {
+        for (uint32_t i = 0; i < to_linear.size(); ++i)
+        {
+            to_linear[i] = srgb_to_linear(static_cast<float>(i) / 255.f);
+        }
+
+        for (uint32_t i = 0; i < to_srgb.size(); ++i)
+        {
+            const float srgb = linear_to_srgb(static_cast<float>(i) / 4095.f);
+            to_srgb[i] = static_cast<uint8_t>(std::clamp(std::lround(srgb * 255.f), 0l, 255l));
+        }
+    }
+};
+
+const ColorTables& color_tables()
+{
+    static const ColorTables tables;
+    return tables;
+}
+
+// Runs function(first_row, last_row) over the rows, split across threads when
+// there is enough work for it to pay off.
+template<typename Function>
+void parallel_rows(const uint32_t rows, const uint64_t pixels, Function function)
+{
+    constexpr uint64_t min_pixels_per_thread = 64 * 1024;
+
+    const uint64_t hardware_threads = std::max(std::thread::hardware_concurrency(), 1u);
+    const auto thread_count = static_cast<uint32_t>(std::min({pixels / min_pixels_per_thread, hardware_threads, static_cast<uint64_t>(rows)}));
+
+    if (thread_count <= 1)
+    {
+        function(0u, rows);
+        return;
+    }
+
+    const uint32_t rows_per_thread = (rows + thread_count - 1) / thread_count;
+
+    std::vector<std::thread> threads;
+    for (uint32_t first_row = 0; first_row < rows; first_row += rows_per_thread)
+    {
+        threads.emplace_back(function, first_row, std::min(first_row + rows_per_thread, rows));
+    }
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+}
+
+void decode_rows(const uint8_t* pixels, float* linear, const uint32_t width, const uint32_t first_row, const uint32_t last_row)
+{
+    const auto& tables = color_tables();
+
+    for (size_t i = static_cast<size_t>(first_row) * width; i < static_cast<size_t>(last_row) * width; ++i)
+    {
+        linear[i * 4 + 0] = tables.to_linear[pixels[i * 4 + 0]];
+        linear[i * 4 + 1] = tables.to_linear[pixels[i * 4 + 1]];
+        linear[i * 4 + 2] = tables.to_linear[pixels[i * 4 + 2]];
+        linear[i * 4 + 3] = static_cast<float>(pixels[i * 4 + 3]) / 255.f;
+    }
+}
+
+void encode_rows(const float* linear, uint8_t* pixels, const uint32_t width, const uint32_t first_row, const uint32_t last_row)
+{
+    const auto& tables = color_tables();
+
+#ifdef MIP_CHAIN_SSE2
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.f);
+    const __m128 scale = _mm_set_ps(255.f, 4095.f, 4095.f, 4095.f);
+    alignas(16) int32_t indices[4];
+#endif
+
+    for (size_t i = static_cast<size_t>(first_row) * width; i < static_cast<size_t>(last_row) * width; ++i)
+    {
+#ifdef MIP_CHAIN_SSE2
+        const __m128 value = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(linear + i * 4), zero), one);
+        _mm_store_si128(reinterpret_cast<__m128i*>(indices), _mm_cvtps_epi32(_mm_mul_ps(value, scale)));
+
+        pixels[i * 4 + 0] = tables.to_srgb[indices[0]];
+        pixels[i * 4 + 1] = tables.to_srgb[indices[1]];
+        pixels[i * 4 + 2] = tables.to_srgb[indices[2]];
+        pixels[i * 4 + 3] = static_cast<uint8_t>(indices[3]);
+#else
+        for (size_t c = 0; c < 3; ++c)
+        {
+            const float value = std::clamp(linear[i * 4 + c], 0.f, 1.f);
+            pixels[i * 4 + c] = tables.to_srgb[std::lround(value * 4095.f)];
+        }
+        pixels[i * 4 + 3] = static_cast<uint8_t>(std::lround(std::clamp(linear[i * 4 + 3], 0.f, 1.f) * 255.f));
+#endif
+    }
+}
+
+// 2x2 box filter, the last row/column is repeated for odd sizes
+void downsample_rows(const float* source, const uint32_t source_width, const uint32_t source_height,
+                     float* destination, const uint32_t destination_width, const uint32_t first_row, const uint32_t last_row)
+{
+#ifdef MIP_CHAIN_SSE2
+    const __m128 quarter = _mm_set1_ps(0.25f);
+#endif
+
+    for (uint32_t y = first_row; y < last_row; ++y)
+    {
+        const float* row0 = source + static_cast<size_t>(std::min(y * 2, source_height - 1)) * source_width * 4;
+        const float* row1 = source + static_cast<size_t>(std::min(y * 2 + 1, source_height - 1)) * source_width * 4;
+        float* output = destination + static_cast<size_t>(y) * destination_width * 4;
+
+        for (uint32_t x = 0; x < destination_width; ++x)
+        {
+            const size_t x0 = static_cast<size_t>(std::min(x * 2, source_width - 1)) * 4;
+            const size_t x1 = static_cast<size_t>(std::min(x * 2 + 1, source_width - 1)) * 4;
+
+#ifdef MIP_CHAIN_SSE2
+            const __m128 top = _mm_add_ps(_mm_loadu_ps(row0 + x0), _mm_loadu_ps(row0 + x1));
+            const __m128 bottom = _mm_add_ps(_mm_loadu_ps(row1 + x0), _mm_loadu_ps(row1 + x1));
+            _mm_storeu_ps(output + x * 4, _mm_mul_ps(_mm_add_ps(top, bottom), quarter));
+#else
+            for (size_t c = 0; c < 4; ++c)
+            {
+                output[x * 4 + c] = (row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c]) * 0.25f;
+            }
+#endif
+        }
+    }
+}
+
+}
+
+std::vector<mip_chain::Level> mip_chain::layout(const uint32_t width, const uint32_t height)
+{
+    const uint32_t level_count = static_cast<uint32_t>(std::floor(std::log2(std::max(width, height)))) + 1;
+
+    std::vector<Level> levels(level_count);
+
+    uint64_t offset = 0;
+    for (uint32_t i = 0; i < level_count; ++i)
+    {
+        levels[i].width = std::max(width >> i, 1u);
+        levels[i].height = std::max(height >> i, 1u);
+        levels[i].offset = offset;
+        levels[i].size = static_cast<uint64_t>(levels[i].width) * levels[i].height * 4;
+        offset += levels[i].size;
+    }
+
+    return levels;
+}
+
+uint64_t mip_chain::size(const std::vector<Level>& levels)
+{
+    return levels.back().offset + levels.back().size;
+}
+
+void mip_chain::generate(const uint8_t* pixels, const uint32_t width, const uint32_t height, uint8_t* output)
+{
+    const auto levels = layout(width, height);
+
+    memcpy(output, pixels, levels[0].size);
+
+    std::vector<float> linear(static_cast<size_t>(width) * height * 4);
+    parallel_rows(height, static_cast<uint64_t>(width) * height, [&](const uint32_t first_row, const uint32_t last_row)
+    {
+        decode_rows(pixels, linear.data(), width, first_row, last_row);
+    });
+
+    std::vector<float> next_linear;
+    for (size_t i = 1; i < levels.size(); ++i)
+    {
+        const auto& source = levels[i - 1];
+        const auto& level = levels[i];
+
+        next_linear.resize(static_cast<size_t>(level.width) * level.height * 4);
+        uint8_t* level_output = output + level.offset;
+
+        parallel_rows(level.height, static_cast<uint64_t>(level.width) * level.height, [&](const uint32_t first_row, const uint32_t last_row)
+        {
+            downsample_rows(linear.data(), source.width, source.height, next_linear.data(), level.width, first_row, last_row);
+            encode_rows(next_linear.data(), level_output, level.width, first_row, last_row);
+        });
+
+        std::swap(linear, next_linear);
+    }
+}
+
+mip_chain::MipChain mip_chain::generate(const uint8_t* pixels, const uint32_t width, const uint32_t height)
+{
+    MipChain chain;
+    chain.width = width;
+    chain.height = height;
+    chain.levels = layout(width, height);
+    chain.data.resize(size(chain.levels));
+
+    generate(pixels, width, height, chain.data.data());
+
+    return chain;
+}
+
+std::optional<mip_chain::CachedChain> mip_chain::open_cache(const std::string& texture_path)
+{
+    std::error_code error;
+    if (!std::filesystem::exists(cache_path(texture_path), error))
+    {
+        return std::nullopt;
+    }
+
+    CachedChain cache;
+    try
+    {
+        cache.file = MappedFile(cache_path(texture_path));
+    }
+    catch (const std::runtime_error&)
+    {
+        return std::nullopt;
+    }
+
+    if (cache.file.size() < sizeof(CacheHeader))
+    {
+        return std::nullopt;
+    }
+
+    CacheHeader header;
+    memcpy(&header, cache.file.data(), sizeof(header));
+
+    if (memcmp(header.magic, cache_magic, sizeof(cache_magic)) != 0 || header.version != cache_version)
+    {
+        return std::nullopt;
+    }
+
+    // if the source is gone, the cache is all we have
+    if (std::filesystem::exists(texture_path, error))
+    {
+        const auto source_size = std::filesystem::file_size(texture_path, error);
+        const auto source_time = std::filesystem::last_write_time(texture_path, error).time_since_epoch().count();
+
+        if (error || header.source_size != source_size || header.source_time != source_time)
+        {
+            return std::nullopt;
+        }
+    }
+
+    cache.width = header.width;
+    cache.height = header.height;
+    cache.levels = layout(header.width, header.height);
+
+    if (cache.levels.size() != header.level_count || sizeof(CacheHeader) + size(cache.levels) > cache.file.size())
+    {
+        return std::nullopt;
+    }
+
+    cache.data = cache.file.data() + sizeof(CacheHeader);
+
+    return cache;
+}
+
+void mip_chain::save_cache(const std::string& texture_path, const uint32_t width, const uint32_t height, const uint8_t* data)
+{
+    std::error_code error;
+    const auto source_size = std::filesystem::file_size(texture_path, error);
+    const auto source_time = std::filesystem::last_write_time(texture_path, error).time_since_epoch().count();
+
+    if (error)
+    {
+        logging::warning(std::format("Unable to stat {} for its mip cache - {}", texture_path, error.message()));
+        return;
+    }
+
+    const auto levels = layout(width, height);
+
+    CacheHeader header{};
+    memcpy(header.magic, cache_magic, sizeof(cache_magic));
+    header.version = cache_version;
+    header.source_size = source_size;
+    header.source_time = static_cast<int64_t>(source_time);
+    header.width = width;
+    header.height = height;
+    header.level_count = static_cast<uint32_t>(levels.size());
+
+    std::ofstream file(cache_path(texture_path), std::ios::binary | std::ios::trunc);
+
+    if (!file.is_open())
+    {
+        logging::warning(std::format("Unable to write mip cache {}", cache_path(texture_path)));
+        return;
+    }
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(data), static_cast<long long>(size(levels)));
+}
+
+std::string mip_chain::cache_path(const std::string& texture_path)
+{
+    return texture_path + ".mips";
+}
@@ -0,0 +1,64 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "MappedFile.h"
+
+namespace mip_chain
+{
+
+struct Level
+{
+    // byte range of the level inside MipChain::data
+    uint64_t offset;
+    uint64_t size;
+    uint32_t width;
+    uint32_t height;
+};
+
+// A full rgba8 sRGB mip chain, base level first, all levels packed back to back
+// so the whole chain can be uploaded from one staging buffer.
+struct MipChain
+{
+    uint32_t width;
+    uint32_t height;
+    std::vector<Level> levels;
+    std::vector<uint8_t> data;
+};
+
+// Byte layout of the full chain of a width x height base image.
+std::vector<Level> layout(uint32_t width, uint32_t height);
+
+// Total byte size of a chain with the given layout.
+uint64_t size(const std::vector<Level>& levels);
+
+// Builds every level down to 1x1 from an rgba8 sRGB base image. Filtering happens
+// in linear space (alpha is treated as linear), larger levels are split over threads.
+// `output` must hold size(layout(width, height)) bytes, e.g. a mapped staging buffer.
+void generate(const uint8_t* pixels, uint32_t width, uint32_t height, uint8_t* output);
+
+MipChain generate(const uint8_t* pixels, uint32_t width, uint32_t height);
+
+// A cache file that was written for the current version of its source,
+// mapped in memory. `data` points at the packed chain inside the mapping.
+struct CachedChain
+{
+    MappedFile file;
+    uint32_t width;
+    uint32_t height;
+    std::vector<Level> levels;
+    const uint8_t* data;
+};
+
+std::optional<CachedChain> open_cache(const std::string& texture_path);
+
+// Writes the packed chain `data` of a width x height texture to its cache file.
+void save_cache(const std::string& texture_path, uint32_t width, uint32_t height, const uint8_t* data);
+
+// "Textures/grid.jpg" is cached as "Textures/grid.jpg.mips"
+std::string cache_path(const std::string& texture_path);
+
+}
@@ -0,0 +1,199 @@
+﻿#include "TextureDecoder.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <memory>
+#include <stdexcept>
+
+// STB_IMAGE_IMPLEMENTATION is defined for the whole project, the implementation
+// itself is compiled into GraphicsRunner.cpp
+#undef STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+#include "Ktx2.h"
+#include "MappedFile.h"
+#include "MipChain.h"
+#include "../Logging/Logging.h"
+#include "../Profiling/CpuProfiler.h"
+
+void TextureDecoder::create(uint32_t thread_count)
+{
+    if (thread_count == 0)
+    {
+        thread_count = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+    }
+
+    stopping_ = false;
+
+    for (uint32_t i = 0; i < thread_count; ++i)
+    {
+        workers_.emplace_back(&TextureDecoder::work, this);
+    }
+}
+
+void TextureDecoder::clean()
+{
+    {
+        std::lock_guard lock(mutex_);
+        stopping_ = true;
+    }
+    jobs_available_.notify_all();
+
+    for (auto& worker : workers_)
+    {
+        worker.join();
+    }
+
+    workers_.clear();
+}
+
+std::future<TextureDecoder::DecodedTexture> TextureDecoder::decode(const std::string& path, StagingAllocator allocate_staging)
+{
+    // std::function has to be copyable, so the task lives behind a shared_ptr
+    auto task = std::make_shared<std::packaged_task<DecodedTexture()>>(
+        [path, allocate_staging = std::move(allocate_staging)]
+        {
+            PROFILE_ZONE("decode texture");
+            const auto start_time = std::chrono::high_resolution_clock::now();
+
+            auto texture = std::filesystem::path(path).extension() == ".ktx2"
+                ? decode_compressed(path, allocate_staging)
+                : decode_image(path, allocate_staging);
+
+            const auto duration = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start_time);
+            logging::info(std::format("Decoded {} ({} levels, {} bytes) in {:.1f} ms", path,
+                                      texture.level_offsets.size(), texture.size, duration.count()));
+
+            return texture;
+        });
+
+    auto decoded = task->get_future();
+
+    {
+        std::lock_guard lock(mutex_);
+        jobs_.emplace_back([task] { (*task)(); });
+    }
+    jobs_available_.notify_one();
+
+    return decoded;
+}
+
+void TextureDecoder::work()
+{
+    profiling::set_thread_name("texture decoder");
+
+    while (true)
+    {
+        std::function<void()> job;
+
+        {
+            std::unique_lock lock(mutex_);
+            jobs_available_.wait(lock, [this] { return stopping_ || !jobs_.empty(); });
+
+            // queued textures are still finished so nobody waits on a dead future
+            if (jobs_.empty())
+            {
+                return;
+            }
+
+            job = std::move(jobs_.front());
+            jobs_.pop_front();
+        }
+
+        // exceptions end up in the texture's future
+        job();
+    }
+}
+
+TextureDecoder::DecodedTexture TextureDecoder::decode_compressed(const std::string& path, const StagingAllocator& allocate_staging)
+{
+    const MappedFile file(path);
+    const auto texture = ktx2::parse(file.data(), file.size(), path);
+
+    DecodedTexture decoded;
+    decoded.format = texture.format;
+    decoded.width = texture.width;
+    decoded.height = texture.height;
+    decoded.size = 0;
+
+    for (const auto& level : texture.levels)
+    {
+        decoded.level_offsets.push_back(decoded.size);
+        decoded.size += level.size;
+    }
+
+    uint8_t* staging = allocate_staging(decoded.size);
+
+    for (size_t i = 0; i < texture.levels.size(); ++i)
+    {
+        memcpy(staging + decoded.level_offsets[i], file.data() + texture.levels[i].offset, texture.levels[i].size);
+    }
+
+    return decoded;
+}
+
+TextureDecoder::DecodedTexture TextureDecoder::decode_image(const std::string& path, const StagingAllocator& allocate_staging)
+{
+    DecodedTexture decoded;
+    decoded.format = VK_FORMAT_R8G8B8A8_SRGB;
+
+    // the full chain is built on the cpu once and cached beside the texture
+    if (const auto cache = mip_chain::open_cache(path))
+    {
+        decoded.width = cache->width;
+        decoded.height = cache->height;
+        decoded.size = mip_chain::size(cache->levels);
+
+        for (const auto& level : cache->levels)
+        {
+            decoded.level_offsets.push_back(level.offset);
+        }
+
+        memcpy(allocate_staging(decoded.size), cache->data, decoded.size);
+        return decoded;
+    }
+
+    const MappedFile file(path);
+
+    int texture_width, texture_height, texture_channels;
+    stbi_uc* pixels = stbi_load_from_memory(file.data(), static_cast<int>(file.size()),
+                                            &texture_width, &texture_height, &texture_channels, STBI_rgb_alpha);
+
+    if (!pixels)
+    {
+        throw std::runtime_error("Error: unable to load texture image " + path);
+    }
+
+    decoded.width = static_cast<uint32_t>(texture_width);
+    decoded.height = static_cast<uint32_t>(texture_height);
+
+    const auto levels = mip_chain::layout(decoded.width, decoded.height);
+    decoded.size = mip_chain::size(levels);
+
+    for (const auto& level : levels)
+    {
+        decoded.level_offsets.push_back(level.offset);
+    }
+
+    uint8_t* staging;
+    try
+    {
+        staging = allocate_staging(decoded.size);
+    }
+    catch (...)
+    {
+        stbi_image_free(pixels);
+        throw;
+    }
+
+    // stb_image can't decode into caller memory, so the base level is the one copy left
+    mip_chain::generate(pixels, decoded.width, decoded.height, staging);
+    stbi_image_free(pixels);
+
+    mip_chain::save_cache(path, decoded.width, decoded.height, staging);
+
+    return decoded;
+}
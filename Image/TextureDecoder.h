@@ -0,0 +1,57 @@
+﻿#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <vulkan/vulkan_core.h>
+
+// Decodes textures on a pool of worker threads. Source files are memory mapped
+// and every level is written straight into memory handed out by the caller
+// (normally a mapped staging buffer), so the main thread only has to record the
+// copy once a texture is ready.
+class TextureDecoder
+{
+public:
+    struct DecodedTexture
+    {
+        VkFormat format;
+        uint32_t width;
+        uint32_t height;
+        // byte offset of every level inside the staging memory, base level first
+        std::vector<VkDeviceSize> level_offsets;
+        VkDeviceSize size;
+    };
+
+    // Called on a worker thread once the decoded size is known. Must return
+    // host-writable memory of at least `size` bytes that stays valid until the
+    // future of the texture is ready. Vma is internally synchronized, so
+    // creating a buffer from here is fine.
+    using StagingAllocator = std::function<uint8_t*(VkDeviceSize size)>;
+
+    // thread_count 0 uses one thread per core, minus the one loading models
+    void create(uint32_t thread_count = 0);
+    void clean();
+
+    // Queues `path` for decoding. ".ktx2" files are copied level by level,
+    // anything else goes through stb_image and gets a full mip chain (using the
+    // chain's cache file when it is up to date).
+    std::future<DecodedTexture> decode(const std::string& path, StagingAllocator allocate_staging);
+
+private:
+    std::vector<std::thread> workers_;
+    std::deque<std::function<void()>> jobs_;
+    std::mutex mutex_;
+    std::condition_variable jobs_available_;
+    bool stopping_ = false;
+
+    void work();
+
+    static DecodedTexture decode_compressed(const std::string& path, const StagingAllocator& allocate_staging);
+    static DecodedTexture decode_image(const std::string& path, const StagingAllocator& allocate_staging);
+};
@@ -0,0 +1,295 @@
+﻿#include "JobSystem.h"
+
+#include <algorithm>
+#include <format>
+
+#include "../Profiling/CpuProfiler.h"
+
+namespace
+{
+
+// the worker the calling thread is, if it is one of `system`'s
+struct CurrentWorker
+{
+    const JobSystem* system = nullptr;
+    uint32_t index = 0;
+};
+
+thread_local CurrentWorker current_worker;
+
+}
+
+void JobSystem::create(uint32_t thread_count)
+{
+    if (thread_count == 0)
+    {
+        thread_count = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+
+    stopping_ = false;
+
+    for (uint32_t i = 0; i < thread_count; ++i)
+    {
+        deques_.push_back(std::make_unique<WorkStealingDeque<Job>>(deque_capacity_));
+    }
+
+    current_worker = {this, 0};
+
+    for (uint32_t i = 1; i < thread_count; ++i)
+    {
+        workers_.emplace_back(&JobSystem::work, this, i);
+    }
+}
+
+void JobSystem::clean()
+{
+    {
+        std::lock_guard lock(sleep_mutex_);
+        stopping_ = true;
+    }
+    jobs_available_.notify_all();
+
+    for (auto& worker : workers_)
+    {
+        worker.join();
+    }
+
+    workers_.clear();
+    deques_.clear();
+    injected_.clear();
+    queued_jobs_ = 0;
+
+    if (current_worker.system == this)
+    {
+        current_worker = {};
+    }
+}
+
+void JobSystem::run(const char* name, std::function<void()> job, Counter* counter, const Counter* dependency)
+{
+    if (counter != nullptr)
+    {
+        counter->pending_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    auto* queued = new Job{name, std::move(job), counter};
+
+    if (dependency != nullptr)
+    {
+        std::lock_guard lock(dependency->mutex_);
+        if (!dependency->is_done())
+        {
+            // the job that brings it to 0 queues this one
+            const_cast<Counter*>(dependency)->waiting_.push_back(queued);
+            return;
+        }
+    }
+
+    push(queued);
+}
+
+void JobSystem::wait(const Counter& counter)
+{
+    while (!counter.is_done())
+    {
+        if (Job* job = find_job())
+        {
+            execute(job);
+        }
+        else
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    // the job that brought it to 0 may still hold the lock, the counter can go away after this
+    std::lock_guard lock(counter.mutex_);
+}
+
+void JobSystem::parallel_for(const char* name, const size_t count, const size_t min_batch,
+                             const std::function<void(size_t, size_t)>& body)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    // a few batches per worker, so the ones finishing early have something to steal
+    const size_t max_batches = static_cast<size_t>(get_thread_count()) * 4;
+    const size_t batch_count = std::clamp(count / std::max<size_t>(min_batch, 1), size_t{1}, max_batches);
+    const size_t batch_size = (count + batch_count - 1) / batch_count;
+
+    if (batch_count == 1)
+    {
+        PROFILE_ZONE(name);
+        body(0, count);
+        return;
+    }
+
+    Counter done;
+    for (size_t begin = batch_size; begin < count; begin += batch_size)
+    {
+        const size_t end = std::min(begin + batch_size, count);
+        run(name, [&body, begin, end] { body(begin, end); }, &done);
+    }
+
+    {
+        // the first batch is the calling thread's
+        PROFILE_ZONE(name);
+        body(0, std::min(batch_size, count));
+    }
+
+    wait(done);
+}
+
+void JobSystem::work(const uint32_t worker)
+{
+    current_worker = {this, worker};
+    profiling::set_thread_name(std::format("job worker {}", worker));
+
+    while (true)
+    {
+        Job* job = nullptr;
+        for (uint32_t i = 0; i < spin_count_ && job == nullptr; ++i)
+        {
+            job = find_job();
+            if (job == nullptr)
+            {
+                std::this_thread::yield();
+            }
+        }
+
+        if (job != nullptr)
+        {
+            execute(job);
+            continue;
+        }
+
+        std::unique_lock lock(sleep_mutex_);
+        sleeping_workers_.fetch_add(1);
+        jobs_available_.wait(lock, [this] { return stopping_ || queued_jobs_.load() > 0; });
+        sleeping_workers_.fetch_sub(1);
+
+        if (stopping_)
+        {
+            return;
+        }
+    }
+}
+
+void JobSystem::push(Job* job)
+{
+    const bool worker = current_worker.system == this;
+
+    // counted before it is published, a thief taking it right away must not take the count below zero
+    queued_jobs_.fetch_add(1);
+
+    if (worker && !deques_[current_worker.index]->push(job))
+    {
+        queued_jobs_.fetch_sub(1);
+
+        // the deque is full, running it here keeps the order of its own jobs intact
+        execute(job);
+        return;
+    }
+
+    if (!worker)
+    {
+        std::lock_guard lock(injected_mutex_);
+        injected_.push_back(job);
+    }
+
+    // a worker going to sleep either sees the job or is counted here
+    if (sleeping_workers_.load() > 0)
+    {
+        {
+            std::lock_guard lock(sleep_mutex_);
+        }
+        jobs_available_.notify_one();
+    }
+}
+
+JobSystem::Job* JobSystem::find_job()
+{
+    if (queued_jobs_.load(std::memory_order_relaxed) == 0)
+    {
+        return nullptr;
+    }
+
+    const bool worker = current_worker.system == this;
+    const auto count = static_cast<uint32_t>(deques_.size());
+    const uint32_t self = worker ? current_worker.index : 0;
+
+    Job* job = worker ? deques_[self]->pop() : nullptr;
+
+    if (job == nullptr)
+    {
+        std::lock_guard lock(injected_mutex_);
+        if (!injected_.empty())
+        {
+            job = injected_.front();
+            injected_.pop_front();
+        }
+    }
+
+    // the next worker first, so thieves spread over the deques
+    for (uint32_t i = 1; i <= count && job == nullptr; ++i)
+    {
+        const uint32_t victim = (self + i) % count;
+        if (!worker || victim != self)
+        {
+            job = deques_[victim]->steal();
+        }
+    }
+
+    if (job != nullptr)
+    {
+        queued_jobs_.fetch_sub(1);
+    }
+
+    return job;
+}
+
+void JobSystem::execute(Job* job)
+{
+    {
+        PROFILE_ZONE(job->name);
+
+        if (profiler_hook_)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            job->function();
+            const uint32_t worker = current_worker.system == this ? current_worker.index : UINT32_MAX;
+            profiler_hook_(job->name, worker, std::chrono::steady_clock::now() - start);
+        }
+        else
+        {
+            job->function();
+        }
+    }
+
+    if (job->counter != nullptr)
+    {
+        finish(*job->counter);
+    }
+
+    delete job;
+}
+
+void JobSystem::finish(Counter& counter)
+{
+    std::vector<Job*> released;
+
+    {
+        std::lock_guard lock(counter.mutex_);
+        if (counter.pending_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            released.swap(counter.waiting_);
+        }
+    }
+
+    for (Job* job : released)
+    {
+        push(job);
+    }
+}
@@ -0,0 +1,110 @@
+﻿#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "WorkStealingDeque.h"
+
+// Runs jobs on one worker per hardware thread. Every worker has its own deque,
+// it works through its newest jobs first and steals the oldest ones of the
+// others when it runs out. The thread calling create() is worker 0, it only
+// runs jobs while it waits for a counter, other threads can queue jobs and wait
+// as well. Every job is a cpu profiler zone under its name.
+//
+//     JobSystem::Counter done;
+//     jobs.run("update actors", [&] { update_actors(); }, &done);
+//     jobs.run("build draw list", [&] { build_draw_list(); }, nullptr, &done);
+//     jobs.wait(done);
+class JobSystem
+{
+    struct Job;
+
+public:
+    // Counts unfinished jobs. Jobs can be made to wait for one, and a thread
+    // waiting for one runs other jobs meanwhile. Must outlive the jobs counted
+    // on it and the waits for it.
+    class Counter
+    {
+    public:
+        Counter() = default;
+        Counter(const Counter&) = delete;
+        Counter& operator=(const Counter&) = delete;
+
+        [[nodiscard]] bool is_done() const { return pending_.load(std::memory_order_acquire) == 0; }
+
+    private:
+        friend class JobSystem;
+
+        std::atomic<uint32_t> pending_{0};
+        // guards waiting_ and orders the last decrement against it
+        mutable std::mutex mutex_;
+        std::vector<Job*> waiting_;
+    };
+
+    // called on the worker that ran the job, after it finished
+    using ProfilerHook = std::function<void(const char* name, uint32_t worker, std::chrono::nanoseconds duration)>;
+
+    // thread_count 0 uses one worker per hardware thread, the calling thread included
+    void create(uint32_t thread_count = 0);
+    // Every counter has to be waited for first.
+    void clean();
+
+    [[nodiscard]] uint32_t get_thread_count() const { return static_cast<uint32_t>(deques_.size()); }
+
+    // Queues `job`, `counter` is incremented now and decremented once the job
+    // finished. With a `dependency` the job only starts once that reaches 0.
+    // `name` must stay valid until the job ran, a string literal is fine.
+    void run(const char* name, std::function<void()> job, Counter* counter = nullptr, const Counter* dependency = nullptr);
+
+    // Runs queued jobs until `counter` reaches 0.
+    void wait(const Counter& counter);
+
+    // Splits [0, count) into batches of at least min_batch and calls body(begin,
+    // end) for each, spread across the workers. Returns once every batch ran.
+    void parallel_for(const char* name, size_t count, size_t min_batch, const std::function<void(size_t, size_t)>& body);
+
+    void set_profiler_hook(ProfilerHook hook) { profiler_hook_ = std::move(hook); }
+
+private:
+    struct Job
+    {
+        const char* name;
+        std::function<void()> function;
+        Counter* counter;
+    };
+
+    // jobs pushed beyond this run on the pushing thread right away
+    static constexpr size_t deque_capacity_ = 4096;
+    // attempts to find a job before a worker goes to sleep
+    static constexpr uint32_t spin_count_ = 64;
+
+    std::vector<std::unique_ptr<WorkStealingDeque<Job>>> deques_;
+    std::vector<std::thread> workers_;
+
+    // jobs queued by threads that aren't workers
+    std::mutex injected_mutex_;
+    std::deque<Job*> injected_;
+
+    // jobs in the deques and the injected queue, workers sleep while it is 0
+    std::atomic<uint32_t> queued_jobs_{0};
+    std::atomic<uint32_t> sleeping_workers_{0};
+    std::mutex sleep_mutex_;
+    std::condition_variable jobs_available_;
+    bool stopping_ = false;
+
+    ProfilerHook profiler_hook_;
+
+    void work(uint32_t worker);
+    void push(Job* job);
+    Job* find_job();
+    void execute(Job* job);
+    void finish(Counter& counter);
+};
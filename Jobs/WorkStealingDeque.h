@@ -0,0 +1,96 @@
+﻿#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Chase-Lev work stealing deque of pointers with a fixed capacity. Only the
+// owning thread pushes and pops, at the bottom, any thread may steal from the
+// top. Memory orders follow Le, Pop, Cohen and Zappa Nardelli, "Correct and
+// Efficient Work-Stealing for Weak Memory Models" (2013).
+template <typename T>
+class WorkStealingDeque
+{
+public:
+    // `capacity` must be a power of two
+    explicit WorkStealingDeque(const size_t capacity)
+        : buffer_(std::make_unique<std::atomic<T*>[]>(capacity)), mask_(static_cast<int64_t>(capacity) - 1)
+    {
+    }
+
+    // owner only, false when the deque is full
+    bool push(T* item)
+    {
+        const int64_t bottom = bottom_.load(std::memory_order_relaxed);
+        const int64_t top = top_.load(std::memory_order_acquire);
+
+        if (bottom - top > mask_)
+        {
+            return false;
+        }
+
+        buffer_[bottom & mask_].store(item, std::memory_order_relaxed);
+        // publishes the item to thieves, a release store rather than the paper's fence
+        bottom_.store(bottom + 1, std::memory_order_release);
+        return true;
+    }
+
+    // owner only, the most recently pushed item or null
+    T* pop()
+    {
+        const int64_t bottom = bottom_.load(std::memory_order_relaxed) - 1;
+        bottom_.store(bottom, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t top = top_.load(std::memory_order_relaxed);
+
+        if (top > bottom)
+        {
+            bottom_.store(bottom + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        T* item = buffer_[bottom & mask_].load(std::memory_order_relaxed);
+
+        if (top == bottom)
+        {
+            // the last item, thieves may be taking it as well
+            if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            {
+                item = nullptr;
+            }
+            bottom_.store(bottom + 1, std::memory_order_relaxed);
+        }
+
+        return item;
+    }
+
+    // any thread, the oldest item or null when empty or another thief won
+    T* steal()
+    {
+        int64_t top = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const int64_t bottom = bottom_.load(std::memory_order_acquire);
+
+        if (top >= bottom)
+        {
+            return nullptr;
+        }
+
+        T* item = buffer_[top & mask_].load(std::memory_order_relaxed);
+
+        if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        {
+            return nullptr;
+        }
+
+        return item;
+    }
+
+private:
+    std::unique_ptr<std::atomic<T*>[]> buffer_;
+    int64_t mask_;
+    // apart, so thieves and the owner don't share a cache line
+    alignas(64) std::atomic<int64_t> top_{0};
+    alignas(64) std::atomic<int64_t> bottom_{0};
+};
@@ -0,0 +1,63 @@
+﻿#include "Bounds.h"
+
+#include <algorithm>
+#include <cmath>
+
+MeshBounds bounds::compute(const std::vector<Vertex>& vertices)
+{
+    if (vertices.empty())
+    {
+        return {{glm::vec3(0.f), glm::vec3(0.f)}, {glm::vec3(0.f), 0.f}};
+    }
+
+    glm::vec3 min = vertices.front().pos;
+    glm::vec3 max = vertices.front().pos;
+
+    for (const auto& vertex : vertices)
+    {
+        min = glm::min(min, vertex.pos);
+        max = glm::max(max, vertex.pos);
+    }
+
+    const glm::vec3 center = (min + max) * 0.5f;
+
+    float radius_squared = 0.f;
+    for (const auto& vertex : vertices)
+    {
+        const glm::vec3 offset = vertex.pos - center;
+        radius_squared = std::max(radius_squared, glm::dot(offset, offset));
+    }
+
+    return {{min, max}, {center, std::sqrt(radius_squared)}};
+}
+
+BoundingSphere bounds::transform(const BoundingSphere& sphere, const glm::mat4& model)
+{
+    const glm::vec4 center = model * glm::vec4(sphere.center, 1.f);
+
+    const float scale = std::max({
+        glm::length(glm::vec3(model[0])),
+        glm::length(glm::vec3(model[1])),
+        glm::length(glm::vec3(model[2])),
+    });
+
+    return {glm::vec3(center), sphere.radius * scale};
+}
+
+BoundingBox bounds::transform(const BoundingBox& box, const glm::mat4& model)
+{
+    // each column's contribution is smallest at one end of the box and largest at the other
+    glm::vec3 min(model[3]);
+    glm::vec3 max(model[3]);
+
+    for (int column = 0; column < 3; ++column)
+    {
+        const glm::vec3 axis(model[column]);
+        const glm::vec3 a = axis * box.min[column];
+        const glm::vec3 b = axis * box.max[column];
+        min += glm::min(a, b);
+        max += glm::max(a, b);
+    }
+
+    return {min, max};
+}
@@ -0,0 +1,38 @@
+﻿#pragma once
+
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "../Rendering/Vertex.h"
+
+struct BoundingBox
+{
+    glm::vec3 min;
+    glm::vec3 max;
+};
+
+struct BoundingSphere
+{
+    glm::vec3 center;
+    float radius;
+};
+
+// Bounds of a mesh in its own (model) space.
+struct MeshBounds
+{
+    BoundingBox box;
+    // centered on the box, so it is tight for most meshes but not minimal
+    BoundingSphere sphere;
+};
+
+namespace bounds
+{
+
+MeshBounds compute(const std::vector<Vertex>& vertices);
+
+// Encloses `sphere` after `model` is applied, scaled by the largest axis scale.
+BoundingSphere transform(const BoundingSphere& sphere, const glm::mat4& model);
+// The world space box around `box` after `model` is applied.
+BoundingBox transform(const BoundingBox& box, const glm::mat4& model);
+
+}
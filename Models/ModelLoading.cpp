@@ -1,8 +1,9 @@
 ﻿#include "ModelLoading.h"
 
+#include <stdexcept>
 #include <tiny_obj_loader.h>
 
-void model_loading::load_model(std::vector<Vertex> &vertices, std::vector<uint32_t> &indices,
+void model_loading::load_model(std::vector<Vertex> &vertices, std::vector<uint32_t> &indices, MeshBounds &mesh_bounds,
     const std::string &model_path)
 {
     tinyobj::attrib_t attrib;
@@ -43,4 +44,6 @@ void model_loading::load_model(std::vector<Vertex> &vertices, std::vector<uint32
 
         indices.push_back(unique_vertices[vertex]);
     }
+
+    mesh_bounds = bounds::compute(vertices);
 }
@@ -4,11 +4,13 @@
 #include <string>
 #include <unordered_map>
 
+#include "Bounds.h"
 #include "../Rendering/Vertex.h"
 
 namespace model_loading
 {
 
-void load_model(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, const std::string& model_path);
+// Also computes the mesh's bounds, which culling uses.
+void load_model(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, MeshBounds& mesh_bounds, const std::string& model_path);
 
 }
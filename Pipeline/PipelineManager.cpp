@@ -0,0 +1,565 @@
+﻿#include "PipelineManager.h"
+
+#include <algorithm>
+#include <chrono>
+#include <format>
+#include <memory>
+#include <ranges>
+#include <stdexcept>
+
+#include "../Image/MappedFile.h"
+#include "../Logging/Logging.h"
+#include "../Profiling/CpuProfiler.h"
+#include "../Rendering/Vertex.h"
+
+namespace
+{
+
+// The create infos of one pipeline state. They point at each other, so the
+// description can't be copied or moved.
+struct PipelineDescription
+{
+    VkVertexInputBindingDescription binding_description;
+    std::array<VkVertexInputAttributeDescription, 3> attribute_descriptions;
+    std::array<VkDynamicState, 2> dynamic_states = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+
+    VkPipelineVertexInputStateCreateInfo vertex_input{};
+    VkPipelineInputAssemblyStateCreateInfo input_assembly{};
+    VkPipelineDynamicStateCreateInfo dynamic_state{};
+    VkPipelineViewportStateCreateInfo viewport_state{};
+    VkPipelineRasterizationStateCreateInfo rasterizer{};
+    VkPipelineMultisampleStateCreateInfo multisampling{};
+    VkPipelineDepthStencilStateCreateInfo depth_stencil{};
+    VkPipelineColorBlendAttachmentState color_blend_attachment{};
+    VkPipelineColorBlendStateCreateInfo color_blending{};
+
+    explicit PipelineDescription(const PipelineState& state)
+    {
+        binding_description = Vertex::get_binding_description();
+        attribute_descriptions = Vertex::get_attribute_descriptions();
+
+        vertex_input.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+        vertex_input.vertexBindingDescriptionCount = 1;
+        vertex_input.pVertexBindingDescriptions = &binding_description;
+        vertex_input.vertexAttributeDescriptionCount = static_cast<uint32_t>(attribute_descriptions.size());
+        vertex_input.pVertexAttributeDescriptions = attribute_descriptions.data();
+
+        input_assembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+        input_assembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+        input_assembly.primitiveRestartEnable = VK_FALSE;
+
+        // viewport and scissor are set while recording, so variants don't depend on the swap chain
+        dynamic_state.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+        dynamic_state.dynamicStateCount = static_cast<uint32_t>(dynamic_states.size());
+        dynamic_state.pDynamicStates = dynamic_states.data();
+
+        viewport_state.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+        viewport_state.viewportCount = 1;
+        viewport_state.scissorCount = 1;
+
+        rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+        rasterizer.depthClampEnable = VK_FALSE;
+        rasterizer.rasterizerDiscardEnable = VK_FALSE;
+        rasterizer.polygonMode = state.polygon_mode;
+        rasterizer.lineWidth = 1.0f;
+        rasterizer.cullMode = state.cull_mode;
+        rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+        rasterizer.depthBiasEnable = VK_FALSE;
+
+        multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+        multisampling.sampleShadingEnable = state.sample_shading ? VK_TRUE : VK_FALSE;
+        multisampling.rasterizationSamples = state.samples;
+        multisampling.minSampleShading = state.min_sample_shading;
+
+        depth_stencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+        depth_stencil.depthTestEnable = state.depth_test ? VK_TRUE : VK_FALSE;
+        depth_stencil.depthWriteEnable = state.depth_write ? VK_TRUE : VK_FALSE;
+        depth_stencil.depthCompareOp = VK_COMPARE_OP_LESS;
+        depth_stencil.depthBoundsTestEnable = VK_FALSE;
+        depth_stencil.stencilTestEnable = VK_FALSE;
+
+        color_blend_attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
+                                                VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+        color_blend_attachment.blendEnable = state.blend_mode == BlendMode::opaque ? VK_FALSE : VK_TRUE;
+        color_blend_attachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+        color_blend_attachment.dstColorBlendFactor = state.blend_mode == BlendMode::additive
+            ? VK_BLEND_FACTOR_ONE
+            : VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+        color_blend_attachment.colorBlendOp = VK_BLEND_OP_ADD;
+        color_blend_attachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+        color_blend_attachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+        color_blend_attachment.alphaBlendOp = VK_BLEND_OP_ADD;
+
+        color_blending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+        color_blending.logicOpEnable = VK_FALSE;
+        color_blending.attachmentCount = 1;
+        color_blending.pAttachments = &color_blend_attachment;
+    }
+
+    PipelineDescription(const PipelineDescription&) = delete;
+    PipelineDescription& operator=(const PipelineDescription&) = delete;
+};
+
+VkPipelineShaderStageCreateInfo shader_stage(const VkShaderStageFlagBits stage, const VkShaderModule module)
+{
+    VkPipelineShaderStageCreateInfo stage_create_info{};
+    stage_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    stage_create_info.stage = stage;
+    stage_create_info.module = module;
+    stage_create_info.pName = "main";
+
+    return stage_create_info;
+}
+
+// how alike two states are, used to pick a stand-in for a variant that is still compiling
+int similarity(const PipelineState& lhs, const PipelineState& rhs)
+{
+    return (lhs.vertex_shader == rhs.vertex_shader ? 4 : 0)
+        + (lhs.fragment_shader == rhs.fragment_shader ? 4 : 0)
+        + (lhs.blend_mode == rhs.blend_mode ? 2 : 0)
+        + (lhs.cull_mode == rhs.cull_mode ? 1 : 0)
+        + (lhs.polygon_mode == rhs.polygon_mode ? 1 : 0)
+        + (lhs.depth_test == rhs.depth_test ? 1 : 0)
+        + (lhs.depth_write == rhs.depth_write ? 1 : 0)
+        + (lhs.sample_shading == rhs.sample_shading ? 1 : 0);
+}
+
+}
+
+void PipelineManager::create(const CreatePipelineManagerInfo& info, uint32_t thread_count)
+{
+    device_ = info.device;
+    pipeline_cache_ = info.pipeline_cache;
+    pipeline_layout_ = info.pipeline_layout;
+    render_pass_ = info.render_pass;
+    use_pipeline_libraries_ = info.use_pipeline_libraries;
+
+    if (thread_count == 0)
+    {
+        thread_count = std::clamp(std::thread::hardware_concurrency() / 4, 1u, 4u);
+    }
+
+    stopping_ = false;
+
+    for (uint32_t i = 0; i < thread_count; ++i)
+    {
+        workers_.emplace_back(&PipelineManager::work, this);
+    }
+
+    logging::info(std::format("Pipeline manager started with {} compile threads{}", thread_count,
+                              use_pipeline_libraries_ ? ", using graphics pipeline libraries" : ""));
+}
+
+void PipelineManager::clean()
+{
+    {
+        std::lock_guard lock(mutex_);
+        stopping_ = true;
+    }
+    jobs_available_.notify_all();
+
+    for (auto& worker : workers_)
+    {
+        worker.join();
+    }
+
+    workers_.clear();
+
+    // the dropped jobs point at variants destroyed below, a later create() must not run them
+    jobs_.clear();
+
+    for (auto& variant : variants_ | std::views::values)
+    {
+        vkDestroyPipeline(device_, variant.pipeline, nullptr);
+    }
+
+    for (const auto pipeline : replaced_pipelines_)
+    {
+        vkDestroyPipeline(device_, pipeline, nullptr);
+    }
+
+    for (auto& library : libraries_ | std::views::values)
+    {
+        // parts whose compile failed have nothing to destroy
+        try
+        {
+            vkDestroyPipeline(device_, library.get(), nullptr);
+        }
+        catch (const std::exception&)
+        {
+        }
+    }
+
+    variants_.clear();
+    replaced_pipelines_.clear();
+    libraries_.clear();
+}
+
+void PipelineManager::set_render_pass(const VkRenderPass render_pass)
+{
+    std::unique_lock lock(mutex_);
+    jobs_done_.wait(lock, [this] { return jobs_.empty() && running_jobs_ == 0; });
+
+    render_pass_ = render_pass;
+}
+
+VkPipeline PipelineManager::get_blocking(const PipelineState& state)
+{
+    std::shared_future<void> compiled;
+    {
+        std::lock_guard lock(mutex_);
+        compiled = queue(state).compiled;
+    }
+
+    // rethrows if the compile failed
+    compiled.get();
+
+    std::lock_guard lock(mutex_);
+    return variants_.at(state).pipeline;
+}
+
+VkPipeline PipelineManager::get(const PipelineState& state)
+{
+    std::lock_guard lock(mutex_);
+
+    const auto& variant = queue(state);
+    if (variant.pipeline != VK_NULL_HANDLE)
+    {
+        return variant.pipeline;
+    }
+
+    // the render pass fixes the sample count, anything else can differ
+    VkPipeline fallback = VK_NULL_HANDLE;
+    int best_similarity = -1;
+
+    for (const auto& [other_state, other_variant] : variants_)
+    {
+        if (other_variant.pipeline == VK_NULL_HANDLE || other_state.samples != state.samples)
+        {
+            continue;
+        }
+
+        if (const int other_similarity = similarity(state, other_state); other_similarity > best_similarity)
+        {
+            best_similarity = other_similarity;
+            fallback = other_variant.pipeline;
+        }
+    }
+
+    return fallback;
+}
+
+PipelineManager::Variant& PipelineManager::queue(const PipelineState& state)
+{
+    if (const auto variant = variants_.find(state); variant != variants_.end())
+    {
+        return variant->second;
+    }
+
+    // unordered_map nodes don't move, so the job can hold on to the variant
+    auto& variant = variants_[state];
+
+    auto promise = std::make_shared<std::promise<void>>();
+    variant.compiled = promise->get_future().share();
+
+    jobs_.emplace_back([this, state, &variant, promise]
+    {
+        try
+        {
+            compile(state, variant);
+            promise->set_value();
+        }
+        catch (const std::exception& exception)
+        {
+            logging::error(std::format("Unable to compile pipeline variant {:x} - {}", std::hash<PipelineState>{}(state), exception.what()));
+            promise->set_exception(std::current_exception());
+        }
+    });
+    jobs_available_.notify_one();
+
+    return variant;
+}
+
+void PipelineManager::work()
+{
+    profiling::set_thread_name("pipeline compiler");
+
+    while (true)
+    {
+        std::function<void()> job;
+
+        {
+            std::unique_lock lock(mutex_);
+            jobs_available_.wait(lock, [this] { return stopping_ || !jobs_.empty(); });
+
+            // queued variants are dropped on shutdown, nobody is going to draw with them
+            if (stopping_)
+            {
+                return;
+            }
+
+            job = std::move(jobs_.front());
+            jobs_.pop_front();
+            ++running_jobs_;
+        }
+
+        job();
+
+        {
+            std::lock_guard lock(mutex_);
+            --running_jobs_;
+        }
+        jobs_done_.notify_all();
+    }
+}
+
+void PipelineManager::compile(const PipelineState& state, Variant& variant)
+{
+    PROFILE_ZONE("compile pipeline");
+    const auto start_time = std::chrono::high_resolution_clock::now();
+
+    if (use_pipeline_libraries_)
+    {
+        const std::array libraries =
+        {
+            get_library(VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT, state),
+            get_library(VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT, state),
+            get_library(VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT, state),
+            get_library(VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT, state),
+        };
+
+        // a fast link is cheap enough to be usable right away, the optimized link replaces it later
+        publish(variant, link(libraries, false));
+        publish(variant, link(libraries, true));
+    }
+    else
+    {
+        publish(variant, create_pipeline(state));
+    }
+
+    const auto duration = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start_time);
+    logging::info(std::format("Compiled pipeline variant {:x} in {:.2f} ms", std::hash<PipelineState>{}(state), duration.count()));
+}
+
+void PipelineManager::publish(Variant& variant, const VkPipeline pipeline)
+{
+    std::lock_guard lock(mutex_);
+
+    if (variant.pipeline != VK_NULL_HANDLE)
+    {
+        replaced_pipelines_.push_back(variant.pipeline);
+    }
+
+    variant.pipeline = pipeline;
+}
+
+VkPipeline PipelineManager::create_pipeline(const PipelineState& state)
+{
+    const PipelineDescription description(state);
+
+    const VkShaderModule vertex_shader_module = create_shader_module(state.vertex_shader);
+    const VkShaderModule fragment_shader_module = create_shader_module(state.fragment_shader);
+
+    const std::array shader_stages =
+    {
+        shader_stage(VK_SHADER_STAGE_VERTEX_BIT, vertex_shader_module),
+        shader_stage(VK_SHADER_STAGE_FRAGMENT_BIT, fragment_shader_module),
+    };
+
+    VkGraphicsPipelineCreateInfo pipeline_create_info{};
+    pipeline_create_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipeline_create_info.stageCount = static_cast<uint32_t>(shader_stages.size());
+    pipeline_create_info.pStages = shader_stages.data();
+    pipeline_create_info.pVertexInputState = &description.vertex_input;
+    pipeline_create_info.pInputAssemblyState = &description.input_assembly;
+    pipeline_create_info.pViewportState = &description.viewport_state;
+    pipeline_create_info.pRasterizationState = &description.rasterizer;
+    pipeline_create_info.pMultisampleState = &description.multisampling;
+    pipeline_create_info.pDepthStencilState = &description.depth_stencil;
+    pipeline_create_info.pColorBlendState = &description.color_blending;
+    pipeline_create_info.pDynamicState = &description.dynamic_state;
+    pipeline_create_info.layout = pipeline_layout_;
+    pipeline_create_info.renderPass = render_pass_;
+    pipeline_create_info.subpass = 0;
+    pipeline_create_info.basePipelineHandle = VK_NULL_HANDLE;
+
+    VkPipeline pipeline;
+    const auto result = vkCreateGraphicsPipelines(device_, pipeline_cache_, 1, &pipeline_create_info, nullptr, &pipeline);
+
+    vkDestroyShaderModule(device_, vertex_shader_module, nullptr);
+    vkDestroyShaderModule(device_, fragment_shader_module, nullptr);
+
+    if (result != VK_SUCCESS)
+    {
+        throw std::runtime_error("Error: unable to create graphics pipeline");
+    }
+
+    return pipeline;
+}
+
+VkPipeline PipelineManager::get_library(const VkGraphicsPipelineLibraryFlagsEXT part, const PipelineState& state)
+{
+    // only the state a part depends on goes into its key, so variants share parts
+    std::string key;
+    switch (part)
+    {
+    case VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT:
+        key = "vertex_input";
+        break;
+    case VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT:
+        // made for a render pass, which is only compatible with others of the same sample count
+        key = std::format("pre_rasterization|{}|{}|{}|{}", state.vertex_shader, static_cast<uint32_t>(state.samples),
+                          static_cast<uint32_t>(state.cull_mode), static_cast<uint32_t>(state.polygon_mode));
+        break;
+    case VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT:
+        key = std::format("fragment_shader|{}|{}|{}|{}|{}|{}", state.fragment_shader, static_cast<uint32_t>(state.samples),
+                          state.sample_shading, state.min_sample_shading, state.depth_test, state.depth_write);
+        break;
+    default:
+        key = std::format("fragment_output|{}|{}|{}|{}", static_cast<uint32_t>(state.blend_mode),
+                          static_cast<uint32_t>(state.samples), state.sample_shading, state.min_sample_shading);
+        break;
+    }
+
+    std::shared_ptr<std::promise<VkPipeline>> promise;
+    std::shared_future<VkPipeline> library;
+    {
+        std::lock_guard lock(mutex_);
+
+        if (const auto existing = libraries_.find(key); existing != libraries_.end())
+        {
+            library = existing->second;
+        }
+        else
+        {
+            promise = std::make_shared<std::promise<VkPipeline>>();
+            library = promise->get_future().share();
+            libraries_[key] = library;
+        }
+    }
+
+    // another compile is already building this part
+    if (!promise)
+    {
+        return library.get();
+    }
+
+    try
+    {
+        promise->set_value(create_library(part, state));
+    }
+    catch (...)
+    {
+        promise->set_exception(std::current_exception());
+    }
+
+    return library.get();
+}
+
+VkPipeline PipelineManager::create_library(const VkGraphicsPipelineLibraryFlagsEXT part, const PipelineState& state)
+{
+    const PipelineDescription description(state);
+
+    VkGraphicsPipelineLibraryCreateInfoEXT library_create_info{};
+    library_create_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT;
+    library_create_info.flags = part;
+
+    VkGraphicsPipelineCreateInfo pipeline_create_info{};
+    pipeline_create_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipeline_create_info.pNext = &library_create_info;
+    // keep what the optimized link needs
+    pipeline_create_info.flags = VK_PIPELINE_CREATE_LIBRARY_BIT_KHR | VK_PIPELINE_CREATE_RETAIN_LINK_TIME_OPTIMIZATION_INFO_BIT_EXT;
+
+    VkShaderModule shader_module = VK_NULL_HANDLE;
+    VkPipelineShaderStageCreateInfo stage_create_info{};
+
+    switch (part)
+    {
+    case VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT:
+        pipeline_create_info.pVertexInputState = &description.vertex_input;
+        pipeline_create_info.pInputAssemblyState = &description.input_assembly;
+        break;
+    case VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT:
+        shader_module = create_shader_module(state.vertex_shader);
+        stage_create_info = shader_stage(VK_SHADER_STAGE_VERTEX_BIT, shader_module);
+        pipeline_create_info.stageCount = 1;
+        pipeline_create_info.pStages = &stage_create_info;
+        pipeline_create_info.pViewportState = &description.viewport_state;
+        pipeline_create_info.pRasterizationState = &description.rasterizer;
+        pipeline_create_info.pDynamicState = &description.dynamic_state;
+        pipeline_create_info.layout = pipeline_layout_;
+        pipeline_create_info.renderPass = render_pass_;
+        break;
+    case VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT:
+        shader_module = create_shader_module(state.fragment_shader);
+        stage_create_info = shader_stage(VK_SHADER_STAGE_FRAGMENT_BIT, shader_module);
+        pipeline_create_info.stageCount = 1;
+        pipeline_create_info.pStages = &stage_create_info;
+        pipeline_create_info.pDepthStencilState = &description.depth_stencil;
+        pipeline_create_info.pMultisampleState = &description.multisampling;
+        pipeline_create_info.layout = pipeline_layout_;
+        pipeline_create_info.renderPass = render_pass_;
+        break;
+    default:
+        pipeline_create_info.pColorBlendState = &description.color_blending;
+        pipeline_create_info.pMultisampleState = &description.multisampling;
+        pipeline_create_info.renderPass = render_pass_;
+        break;
+    }
+
+    VkPipeline library;
+    const auto result = vkCreateGraphicsPipelines(device_, pipeline_cache_, 1, &pipeline_create_info, nullptr, &library);
+
+    if (shader_module != VK_NULL_HANDLE)
+    {
+        vkDestroyShaderModule(device_, shader_module, nullptr);
+    }
+
+    if (result != VK_SUCCESS)
+    {
+        throw std::runtime_error("Error: unable to create graphics pipeline library.");
+    }
+
+    return library;
+}
+
+VkPipeline PipelineManager::link(const std::array<VkPipeline, 4>& libraries, const bool optimize)
+{
+    VkPipelineLibraryCreateInfoKHR library_info{};
+    library_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR;
+    library_info.libraryCount = static_cast<uint32_t>(libraries.size());
+    library_info.pLibraries = libraries.data();
+
+    VkGraphicsPipelineCreateInfo pipeline_create_info{};
+    pipeline_create_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipeline_create_info.pNext = &library_info;
+    pipeline_create_info.flags = optimize ? VK_PIPELINE_CREATE_LINK_TIME_OPTIMIZATION_BIT_EXT : 0;
+    pipeline_create_info.layout = pipeline_layout_;
+
+    VkPipeline pipeline;
+    if (vkCreateGraphicsPipelines(device_, pipeline_cache_, 1, &pipeline_create_info, nullptr, &pipeline) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Error: unable to link graphics pipeline libraries.");
+    }
+
+    return pipeline;
+}
+
+VkShaderModule PipelineManager::create_shader_module(const std::string& path)
+{
+    // spir-v is read straight out of the mapping, which is page aligned
+    const MappedFile code(path);
+
+    VkShaderModuleCreateInfo create_info{};
+    create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    create_info.codeSize = code.size();
+    create_info.pCode = reinterpret_cast<const uint32_t*>(code.data());
+
+    VkShaderModule shader_module;
+    if (vkCreateShaderModule(device_, &create_info, nullptr, &shader_module) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Error: unable to create shader module.");
+    }
+
+    return shader_module;
+}
@@ -0,0 +1,100 @@
+﻿#pragma once
+
+#include <array>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <vulkan/vulkan_core.h>
+
+#include "PipelineState.h"
+
+struct CreatePipelineManagerInfo
+{
+    VkDevice device;
+    VkPipelineCache pipeline_cache;
+    VkPipelineLayout pipeline_layout;
+    VkRenderPass render_pass;
+    // VK_EXT_graphics_pipeline_library is enabled on the device
+    bool use_pipeline_libraries;
+};
+
+// Owns every graphics pipeline variant, keyed by the full PipelineState.
+// Variants are compiled on background threads and a draw asking for one that
+// isn't ready yet gets the closest ready variant with the same sample count.
+//
+// With graphics pipeline libraries the four pipeline parts are compiled once
+// and shared between variants. A new variant is fast-linked from them first,
+// then replaced by a link-time optimized version.
+class PipelineManager
+{
+public:
+    // thread_count 0 picks a few threads, compiles are heavy and shouldn't starve the frame
+    void create(const CreatePipelineManagerInfo& info, uint32_t thread_count = 0);
+
+    // The device must be idle.
+    void clean();
+
+    // Variants compiled from now on are made for `render_pass`. Waits for the
+    // compiles that are already queued, they still use the previous one, which
+    // can be destroyed afterwards. Existing variants keep working with any
+    // compatible render pass, so they survive switching back and forth.
+    void set_render_pass(VkRenderPass render_pass);
+
+    // Returns the pipeline for `state`, waiting for its compile if needed. Use it
+    // for pipelines that must exist before the first frame, since they are the
+    // fallbacks of get().
+    VkPipeline get_blocking(const PipelineState& state);
+
+    // Returns the pipeline for `state` if it is ready. Otherwise queues it and
+    // returns the closest ready variant, or VK_NULL_HANDLE if no compatible
+    // variant exists yet.
+    VkPipeline get(const PipelineState& state);
+
+private:
+    struct Variant
+    {
+        VkPipeline pipeline = VK_NULL_HANDLE;
+        std::shared_future<void> compiled;
+    };
+
+    VkDevice device_ = VK_NULL_HANDLE;
+    VkPipelineCache pipeline_cache_ = VK_NULL_HANDLE;
+    VkPipelineLayout pipeline_layout_ = VK_NULL_HANDLE;
+    VkRenderPass render_pass_ = VK_NULL_HANDLE;
+    bool use_pipeline_libraries_ = false;
+
+    std::mutex mutex_;
+    std::unordered_map<PipelineState, Variant> variants_;
+    // pipeline library parts by a key of the state they depend on
+    std::unordered_map<std::string, std::shared_future<VkPipeline>> libraries_;
+    // fast-linked pipelines that were replaced, frames in flight may still use them
+    std::vector<VkPipeline> replaced_pipelines_;
+
+    std::vector<std::thread> workers_;
+    std::deque<std::function<void()>> jobs_;
+    std::condition_variable jobs_available_;
+    // signalled when the last queued job is done
+    std::condition_variable jobs_done_;
+    uint32_t running_jobs_ = 0;
+    bool stopping_ = false;
+
+    void work();
+
+    // must be called with mutex_ locked
+    Variant& queue(const PipelineState& state);
+    void compile(const PipelineState& state, Variant& variant);
+    void publish(Variant& variant, VkPipeline pipeline);
+
+    VkPipeline create_pipeline(const PipelineState& state);
+    VkPipeline get_library(VkGraphicsPipelineLibraryFlagsEXT part, const PipelineState& state);
+    VkPipeline create_library(VkGraphicsPipelineLibraryFlagsEXT part, const PipelineState& state);
+    VkPipeline link(const std::array<VkPipeline, 4>& libraries, bool optimize);
+
+    VkShaderModule create_shader_module(const std::string& path);
+};
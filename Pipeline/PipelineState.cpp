@@ -0,0 +1,29 @@
+﻿#include "PipelineState.h"
+
+namespace
+{
+
+template<typename T>
+void hash_combine(size_t& seed, const T& value)
+{
+    seed ^= std::hash<T>{}(value) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+}
+
+}
+
+size_t std::hash<PipelineState>::operator()(PipelineState const& state) const noexcept
+{
+    size_t seed = 0;
+    hash_combine(seed, state.vertex_shader);
+    hash_combine(seed, state.fragment_shader);
+    hash_combine(seed, static_cast<uint32_t>(state.samples));
+    hash_combine(seed, state.sample_shading);
+    hash_combine(seed, state.min_sample_shading);
+    hash_combine(seed, static_cast<uint32_t>(state.blend_mode));
+    hash_combine(seed, static_cast<uint32_t>(state.cull_mode));
+    hash_combine(seed, static_cast<uint32_t>(state.polygon_mode));
+    hash_combine(seed, state.depth_test);
+    hash_combine(seed, state.depth_write);
+
+    return seed;
+}
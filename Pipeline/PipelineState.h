@@ -0,0 +1,35 @@
+﻿#pragma once
+
+#include <string>
+#include <vulkan/vulkan_core.h>
+
+enum class BlendMode
+{
+    opaque,
+    alpha,
+    additive,
+};
+
+// Everything that goes into a graphics pipeline besides the layout and render
+// pass, which are shared by every variant. The vertex input always comes from Vertex.
+struct PipelineState
+{
+    std::string vertex_shader = "Shaders/Vertex/vert.spv";
+    std::string fragment_shader = "Shaders/Fragment/frag.spv";
+    VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+    bool sample_shading = true;
+    float min_sample_shading = 0.2f;
+    BlendMode blend_mode = BlendMode::alpha;
+    VkCullModeFlags cull_mode = VK_CULL_MODE_BACK_BIT;
+    VkPolygonMode polygon_mode = VK_POLYGON_MODE_FILL;
+    bool depth_test = true;
+    bool depth_write = true;
+
+    bool operator==(const PipelineState& rhs) const = default;
+};
+
+template<>
+struct std::hash<PipelineState>
+{
+    size_t operator()(PipelineState const& state) const noexcept;
+};
@@ -0,0 +1,231 @@
+﻿#include "CpuProfiler.h"
+
+#include <chrono>
+#include <format>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "../Logging/Logging.h"
+
+namespace
+{
+
+struct Event
+{
+    const char* name;
+    int64_t start;
+    int64_t end;
+};
+
+// Written only by its thread. The exporter reads `count` events, which the
+// release store of `count` makes visible.
+struct ThreadBuffer
+{
+    static constexpr uint32_t capacity = 1 << 16;
+
+    std::vector<Event> events = std::vector<Event>(capacity);
+    std::atomic<uint32_t> count = 0;
+    // capture the events belong to, the owner clears the buffer when it changes
+    std::atomic<uint32_t> generation = 0;
+    uint32_t thread_index = 0;
+    std::string thread_name;
+};
+
+const auto epoch = std::chrono::steady_clock::now();
+
+// buffers outlive their threads so a capture keeps the events of finished threads
+std::mutex buffers_mutex;
+std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+
+std::atomic<uint32_t> current_generation = 0;
+
+thread_local ThreadBuffer* thread_buffer = nullptr;
+thread_local std::string pending_thread_name;
+
+struct Capture
+{
+    uint64_t first_frame = 0;
+    uint64_t end_frame = 0;
+    std::string path;
+    bool requested = false;
+    bool running = false;
+};
+
+Capture capture_state;
+
+ThreadBuffer* get_thread_buffer()
+{
+    if (thread_buffer == nullptr)
+    {
+        auto buffer = std::make_unique<ThreadBuffer>();
+        buffer->thread_name = pending_thread_name;
+
+        std::lock_guard lock(buffers_mutex);
+        buffer->thread_index = static_cast<uint32_t>(buffers.size());
+        thread_buffer = buffers.emplace_back(std::move(buffer)).get();
+    }
+
+    return thread_buffer;
+}
+
+std::string escape(const std::string& text)
+{
+    std::string escaped;
+    escaped.reserve(text.size());
+
+    for (const char character : text)
+    {
+        if (character == '"' || character == '\\')
+        {
+            escaped += '\\';
+        }
+        escaped += character;
+    }
+
+    return escaped;
+}
+
+void write_capture(const std::string& path)
+{
+    const uint32_t generation = current_generation.load(std::memory_order_relaxed);
+
+    std::ofstream file(path, std::ios::trunc);
+    if (!file)
+    {
+        logging::error("Error: unable to write trace " + path);
+        return;
+    }
+
+    size_t event_count = 0;
+    file << "{\"traceEvents\":[\n";
+
+    std::lock_guard lock(buffers_mutex);
+    bool first = true;
+
+    for (const auto& buffer : buffers)
+    {
+        if (buffer->generation.load(std::memory_order_acquire) != generation)
+        {
+            continue;
+        }
+
+        const uint32_t thread_id = buffer->thread_index;
+
+        if (!buffer->thread_name.empty())
+        {
+            file << (first ? "" : ",\n")
+                 << std::format(R"({{"name":"thread_name","ph":"M","pid":0,"tid":{},"args":{{"name":"{}"}}}})",
+                                thread_id, escape(buffer->thread_name));
+            first = false;
+        }
+
+        const uint32_t count = buffer->count.load(std::memory_order_acquire);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            const auto& event = buffer->events[i];
+
+            // trace_event times are in microseconds
+            file << (first ? "" : ",\n")
+                 << std::format(R"({{"name":"{}","cat":"cpu","ph":"X","pid":0,"tid":{},"ts":{:.3f},"dur":{:.3f}}})",
+                                escape(event.name), thread_id, static_cast<double>(event.start) / 1000.0,
+                                static_cast<double>(event.end - event.start) / 1000.0);
+            first = false;
+        }
+
+        event_count += count;
+
+        if (count == ThreadBuffer::capacity)
+        {
+            logging::warning(std::format("Trace buffer of thread {} filled up, later zones are missing", thread_id));
+        }
+    }
+
+    file << "\n]}\n";
+
+    logging::info(std::format("Wrote {} trace events to {}", event_count, path));
+}
+
+}
+
+namespace profiling
+{
+    void set_thread_name(const std::string& name)
+    {
+        // applied when the thread first records, the buffer doesn't exist before that
+        pending_thread_name = name;
+
+        if (thread_buffer != nullptr)
+        {
+            std::lock_guard lock(buffers_mutex);
+            thread_buffer->thread_name = name;
+        }
+    }
+
+    void begin_frame(const uint64_t frame)
+    {
+        auto& capture = capture_state;
+
+        if (capture.running && frame >= capture.end_frame)
+        {
+            detail::recording.store(false, std::memory_order_relaxed);
+            capture.running = false;
+            write_capture(capture.path);
+        }
+
+        if (capture.requested && frame >= capture.first_frame)
+        {
+            capture.requested = false;
+            capture.running = true;
+            capture.end_frame = frame + (capture.end_frame - capture.first_frame);
+
+            // every thread clears its buffer on its next zone
+            current_generation.fetch_add(1, std::memory_order_release);
+            detail::recording.store(true, std::memory_order_relaxed);
+        }
+    }
+
+    void capture(const uint64_t first_frame, const uint64_t frame_count, const std::string& path)
+    {
+#ifdef DISABLE_CPU_PROFILER
+        logging::warning("The cpu profiler is compiled out, nothing will be captured");
+#endif
+
+        capture_state.first_frame = first_frame;
+        capture_state.end_frame = first_frame + frame_count;
+        capture_state.path = path;
+        capture_state.requested = frame_count > 0;
+    }
+
+    namespace detail
+    {
+        std::atomic<bool> recording = false;
+
+        int64_t now()
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+        }
+
+        void record(const char* name, const int64_t start, const int64_t end)
+        {
+            ThreadBuffer* buffer = get_thread_buffer();
+
+            const uint32_t generation = current_generation.load(std::memory_order_acquire);
+            if (buffer->generation.load(std::memory_order_relaxed) != generation)
+            {
+                buffer->count.store(0, std::memory_order_relaxed);
+                buffer->generation.store(generation, std::memory_order_release);
+            }
+
+            const uint32_t index = buffer->count.load(std::memory_order_relaxed);
+            if (index == ThreadBuffer::capacity)
+            {
+                return;
+            }
+
+            buffer->events[index] = {name, start, end};
+            buffer->count.store(index + 1, std::memory_order_release);
+        }
+    }
+}
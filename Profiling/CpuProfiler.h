@@ -0,0 +1,71 @@
+﻿#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Scoped CPU zones, exported as Chrome trace_event JSON (chrome://tracing or
+// ui.perfetto.dev). Zones are only recorded while a capture is running, each
+// thread appends to its own buffer without locking. Defining
+// DISABLE_CPU_PROFILER compiles every zone out.
+//
+//     PROFILE_ZONE("record command buffer");
+
+#define PROFILE_CONCATENATE_INNER(a, b) a##b
+#define PROFILE_CONCATENATE(a, b) PROFILE_CONCATENATE_INNER(a, b)
+
+#ifdef DISABLE_CPU_PROFILER
+#define PROFILE_ZONE(name)
+#else
+#define PROFILE_ZONE(name) const profiling::Zone PROFILE_CONCATENATE(profile_zone_, __LINE__)(name)
+#endif
+
+namespace profiling
+{
+    // Names the calling thread in the trace.
+    void set_thread_name(const std::string& name);
+
+    // Marks the start of a frame. Captures start and stop on these marks.
+    void begin_frame(uint64_t frame);
+
+    // Records frames [first_frame, first_frame + frame_count) and writes them
+    // to `path` once the last one ends. Call from the thread calling begin_frame.
+    void capture(uint64_t first_frame, uint64_t frame_count, const std::string& path);
+
+    namespace detail
+    {
+        extern std::atomic<bool> recording;
+
+        int64_t now();
+        void record(const char* name, int64_t start, int64_t end);
+    }
+
+    // `name` must stay valid until the capture is written, a string literal is fine.
+    class Zone
+    {
+    public:
+        explicit Zone(const char* name)
+        {
+            if (detail::recording.load(std::memory_order_relaxed))
+            {
+                name_ = name;
+                start_ = detail::now();
+            }
+        }
+
+        ~Zone()
+        {
+            if (name_ != nullptr)
+            {
+                detail::record(name_, start_, detail::now());
+            }
+        }
+
+        Zone(const Zone&) = delete;
+        Zone& operator=(const Zone&) = delete;
+
+    private:
+        const char* name_ = nullptr;
+        int64_t start_ = 0;
+    };
+}
@@ -0,0 +1,237 @@
+﻿#include "GpuProfiler.h"
+
+#include <array>
+#include <stdexcept>
+
+void GpuProfiler::create(const CreateGpuProfilerInfo& info)
+{
+    device_ = info.device;
+    max_scopes_per_frame_ = info.max_scopes_per_frame;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(info.physical_device, &properties);
+    timestamp_period_ = properties.limits.timestampPeriod;
+
+    // queues without timestamp support leave the profiler disabled
+    if (info.timestamp_valid_bits == 0)
+    {
+        return;
+    }
+
+    timestamp_mask_ = info.timestamp_valid_bits >= 64 ? UINT64_MAX : (uint64_t{1} << info.timestamp_valid_bits) - 1;
+
+    VkQueryPoolCreateInfo timestamp_pool_info{};
+    timestamp_pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    timestamp_pool_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    timestamp_pool_info.queryCount = info.frame_count * max_scopes_per_frame_ * 2;
+
+    if (vkCreateQueryPool(device_, &timestamp_pool_info, nullptr, &timestamp_pool_) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Error: unable to create timestamp query pool.");
+    }
+
+    if (info.pipeline_statistics_supported)
+    {
+        VkQueryPoolCreateInfo statistics_pool_info{};
+        statistics_pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        statistics_pool_info.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+        statistics_pool_info.queryCount = info.frame_count * max_scopes_per_frame_;
+        statistics_pool_info.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+                                                  VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+
+        if (vkCreateQueryPool(device_, &statistics_pool_info, nullptr, &statistics_pool_) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Error: unable to create pipeline statistics query pool.");
+        }
+    }
+
+    slots_.resize(info.frame_count);
+    for (auto& slot : slots_)
+    {
+        slot.scopes.reserve(max_scopes_per_frame_);
+    }
+
+    timestamps_.resize(static_cast<size_t>(max_scopes_per_frame_) * 2);
+}
+
+void GpuProfiler::clean()
+{
+    if (timestamp_pool_ != VK_NULL_HANDLE)
+    {
+        vkDestroyQueryPool(device_, timestamp_pool_, nullptr);
+    }
+
+    if (statistics_pool_ != VK_NULL_HANDLE)
+    {
+        vkDestroyQueryPool(device_, statistics_pool_, nullptr);
+    }
+
+    timestamp_pool_ = VK_NULL_HANDLE;
+    statistics_pool_ = VK_NULL_HANDLE;
+    slots_.clear();
+    results_.clear();
+}
+
+void GpuProfiler::set_pipeline_statistics(const bool enabled)
+{
+    statistics_enabled_ = enabled;
+}
+
+void GpuProfiler::begin_frame(VkCommandBuffer command_buffer, const uint32_t frame_slot)
+{
+    if (timestamp_pool_ == VK_NULL_HANDLE)
+    {
+        return;
+    }
+
+    read_results(frame_slot);
+
+    current_slot_ = frame_slot;
+    slots_[current_slot_].scopes.clear();
+    open_scopes_.clear();
+    statistics_active_ = false;
+
+    vkCmdResetQueryPool(command_buffer, timestamp_pool_, current_slot_ * max_scopes_per_frame_ * 2, max_scopes_per_frame_ * 2);
+
+    if (statistics_pool_ != VK_NULL_HANDLE)
+    {
+        vkCmdResetQueryPool(command_buffer, statistics_pool_, current_slot_ * max_scopes_per_frame_, max_scopes_per_frame_);
+    }
+}
+
+void GpuProfiler::begin_scope(VkCommandBuffer command_buffer, const char* name)
+{
+    if (timestamp_pool_ == VK_NULL_HANDLE)
+    {
+        return;
+    }
+
+    auto& scopes = slots_[current_slot_].scopes;
+
+    // scopes past the limit aren't timed, but still have to be balanced by end_scope
+    if (scopes.size() == max_scopes_per_frame_)
+    {
+        open_scopes_.push_back(UINT32_MAX);
+        return;
+    }
+
+    const auto index = static_cast<uint32_t>(scopes.size());
+
+    RecordedScope scope{};
+    scope.name = name;
+    scope.depth = static_cast<uint32_t>(open_scopes_.size());
+    scope.timestamp_query = (current_slot_ * max_scopes_per_frame_ + index) * 2;
+    scope.statistics_query = UINT32_MAX;
+
+    if (statistics_enabled_ && statistics_pool_ != VK_NULL_HANDLE && !statistics_active_)
+    {
+        scope.statistics_query = current_slot_ * max_scopes_per_frame_ + index;
+        statistics_active_ = true;
+        vkCmdBeginQuery(command_buffer, statistics_pool_, scope.statistics_query, 0);
+    }
+
+    vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestamp_pool_, scope.timestamp_query);
+
+    scopes.push_back(scope);
+    open_scopes_.push_back(index);
+}
+
+void GpuProfiler::end_scope(VkCommandBuffer command_buffer)
+{
+    if (timestamp_pool_ == VK_NULL_HANDLE)
+    {
+        return;
+    }
+
+    if (open_scopes_.empty())
+    {
+        throw std::runtime_error("Error: end_scope without a matching begin_scope.");
+    }
+
+    const auto index = open_scopes_.back();
+    open_scopes_.pop_back();
+
+    if (index == UINT32_MAX)
+    {
+        return;
+    }
+
+    const auto& scope = slots_[current_slot_].scopes[index];
+
+    vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestamp_pool_, scope.timestamp_query + 1);
+
+    if (scope.statistics_query != UINT32_MAX)
+    {
+        vkCmdEndQuery(command_buffer, statistics_pool_, scope.statistics_query);
+        statistics_active_ = false;
+    }
+}
+
+std::optional<double> GpuProfiler::get_milliseconds(const std::string& name) const
+{
+    for (const auto& scope : results_)
+    {
+        if (scope.name == name)
+        {
+            return scope.milliseconds;
+        }
+    }
+
+    return std::nullopt;
+}
+
+void GpuProfiler::read_results(const uint32_t frame_slot)
+{
+    const auto& scopes = slots_[frame_slot].scopes;
+
+    if (scopes.empty())
+    {
+        return;
+    }
+
+    const auto scope_count = static_cast<uint32_t>(scopes.size());
+    const auto first_timestamp = frame_slot * max_scopes_per_frame_ * 2;
+
+    // the slot's previous frame completed, so the queries are available and nothing waits here
+    const auto timestamp_result = vkGetQueryPoolResults(device_, timestamp_pool_, first_timestamp, scope_count * 2,
+                                                        scope_count * 2 * sizeof(uint64_t), timestamps_.data(),
+                                                        sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+
+    // keep the previous results rather than report garbage
+    if (timestamp_result != VK_SUCCESS)
+    {
+        return;
+    }
+
+    results_.resize(scope_count);
+
+    for (uint32_t i = 0; i < scope_count; ++i)
+    {
+        const uint64_t begin = timestamps_[i * 2] & timestamp_mask_;
+        const uint64_t end = timestamps_[i * 2 + 1] & timestamp_mask_;
+        // counters narrower than 64 bits can wrap between the two writes
+        const uint64_t ticks = (end - begin) & timestamp_mask_;
+
+        auto& result = results_[i];
+        result.name = scopes[i].name;
+        result.depth = scopes[i].depth;
+        result.milliseconds = static_cast<double>(ticks) * timestamp_period_ / 1e6;
+        result.vertex_invocations.reset();
+        result.fragment_invocations.reset();
+
+        // only some scopes begin a statistics query, the others were never written and would fail a ranged read
+        if (scopes[i].statistics_query == UINT32_MAX)
+        {
+            continue;
+        }
+
+        // two counters in bit order: vertex invocations, then fragment invocations
+        std::array<uint64_t, 2> statistics{};
+        if (vkGetQueryPoolResults(device_, statistics_pool_, scopes[i].statistics_query, 1, sizeof(statistics),
+                                  statistics.data(), sizeof(statistics), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS)
+        {
+            result.vertex_invocations = statistics[0];
+            result.fragment_invocations = statistics[1];
+        }
+    }
+}
@@ -0,0 +1,94 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan_core.h>
+
+struct CreateGpuProfilerInfo
+{
+    VkPhysicalDevice physical_device;
+    VkDevice device;
+    // timestampValidBits of the queue family the command buffers are submitted to
+    uint32_t timestamp_valid_bits;
+    // one set of queries per frame that can be in flight
+    uint32_t frame_count;
+    uint32_t max_scopes_per_frame = 64;
+    // the device's pipelineStatisticsQuery feature is enabled
+    bool pipeline_statistics_supported;
+};
+
+// Times named scopes of a frame's command buffer with timestamp queries. Every
+// frame slot has its own queries, which are read once that slot comes around
+// again, when its previous frame has completed, so reading never stalls. The
+// results always describe the most recently completed frame.
+class GpuProfiler
+{
+public:
+    struct Scope
+    {
+        std::string name;
+        // nesting level, 0 for outermost scopes
+        uint32_t depth;
+        double milliseconds;
+        // only filled when pipeline statistics are enabled and the scope got a query
+        std::optional<uint64_t> vertex_invocations;
+        std::optional<uint64_t> fragment_invocations;
+    };
+
+    void create(const CreateGpuProfilerInfo& info);
+    void clean();
+
+    // Pipeline statistics are collected for outermost scopes only, queries of
+    // the same type can't be active at the same time.
+    void set_pipeline_statistics(bool enabled);
+
+    // Reads the results of the slot's previous frame and resets its queries.
+    // Must be called outside a render pass, after the slot's previous frame was waited for.
+    void begin_frame(VkCommandBuffer command_buffer, uint32_t frame_slot);
+
+    // `name` must stay valid until the frame's results are read, a string literal is fine.
+    void begin_scope(VkCommandBuffer command_buffer, const char* name);
+    void end_scope(VkCommandBuffer command_buffer);
+
+    [[nodiscard]] const std::vector<Scope>& get_results() const { return results_; }
+    // milliseconds of the first scope called `name`, if the last frame had one
+    [[nodiscard]] std::optional<double> get_milliseconds(const std::string& name) const;
+
+private:
+    struct RecordedScope
+    {
+        const char* name;
+        uint32_t depth;
+        uint32_t timestamp_query;
+        // UINT32_MAX without a statistics query
+        uint32_t statistics_query;
+    };
+
+    struct FrameSlot
+    {
+        std::vector<RecordedScope> scopes;
+    };
+
+    VkDevice device_ = VK_NULL_HANDLE;
+    VkQueryPool timestamp_pool_ = VK_NULL_HANDLE;
+    VkQueryPool statistics_pool_ = VK_NULL_HANDLE;
+
+    // nanoseconds per timestamp tick
+    double timestamp_period_ = 1.0;
+    uint64_t timestamp_mask_ = 0;
+    uint32_t max_scopes_per_frame_ = 0;
+    bool statistics_enabled_ = false;
+
+    std::vector<FrameSlot> slots_;
+    uint32_t current_slot_ = 0;
+    // indices into the current slot's scopes
+    std::vector<uint32_t> open_scopes_;
+    bool statistics_active_ = false;
+
+    std::vector<Scope> results_;
+    std::vector<uint64_t> timestamps_;
+
+    void read_results(uint32_t frame_slot);
+};
@@ -0,0 +1,104 @@
+﻿#include "ComputeQueue.h"
+
+#include <stdexcept>
+
+void ComputeQueue::create(const CreateComputeQueueInfo& info)
+{
+    device_ = info.device;
+    queue_family_ = info.queue_family;
+    async_ = !info.shares_graphics_queue;
+
+    VkCommandPoolCreateInfo pool_info{};
+    pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    pool_info.queueFamilyIndex = queue_family_;
+
+    if (vkCreateCommandPool(device_, &pool_info, nullptr, &command_pool_) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Error: unable to create compute command pool.");
+    }
+
+    CreateQueueTimelineInfo timeline_info{};
+    timeline_info.device = device_;
+    timeline_info.queue = info.queue;
+    timeline_.create(timeline_info);
+}
+
+void ComputeQueue::clean()
+{
+    if (command_pool_ == VK_NULL_HANDLE)
+    {
+        return;
+    }
+
+    timeline_.wait_idle();
+    timeline_.clean();
+
+    // frees the command buffers with it
+    vkDestroyCommandPool(device_, command_pool_, nullptr);
+    command_pool_ = VK_NULL_HANDLE;
+
+    pending_.clear();
+    free_.clear();
+}
+
+uint64_t ComputeQueue::submit(const std::function<void(VkCommandBuffer)>& record, const std::vector<QueueTimeline::Wait>& waits)
+{
+    const VkCommandBuffer command_buffer = get_command_buffer();
+
+    VkCommandBufferBeginInfo begin_info{};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    if (vkBeginCommandBuffer(command_buffer, &begin_info) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Error: unable to begin compute command buffer.");
+    }
+
+    record(command_buffer);
+
+    if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Error: unable to record compute command buffer.");
+    }
+
+    const uint64_t value = timeline_.submit({command_buffer}, waits);
+    pending_.push_back({value, command_buffer});
+
+    return value;
+}
+
+VkCommandBuffer ComputeQueue::get_command_buffer()
+{
+    if (!pending_.empty())
+    {
+        const uint64_t completed_value = timeline_.poll();
+        while (!pending_.empty() && pending_.front().value <= completed_value)
+        {
+            free_.push_back(pending_.front().command_buffer);
+            pending_.pop_front();
+        }
+    }
+
+    if (!free_.empty())
+    {
+        const VkCommandBuffer command_buffer = free_.back();
+        free_.pop_back();
+        vkResetCommandBuffer(command_buffer, 0);
+        return command_buffer;
+    }
+
+    VkCommandBufferAllocateInfo allocate_info{};
+    allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocate_info.commandPool = command_pool_;
+    allocate_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocate_info.commandBufferCount = 1;
+
+    VkCommandBuffer command_buffer;
+    if (vkAllocateCommandBuffers(device_, &allocate_info, &command_buffer) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Error: unable to allocate compute command buffer.");
+    }
+
+    return command_buffer;
+}
@@ -0,0 +1,59 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <vector>
+#include <vulkan/vulkan_core.h>
+
+#include "QueueTimeline.h"
+
+struct CreateComputeQueueInfo
+{
+    VkDevice device;
+    VkQueue queue;
+    uint32_t queue_family;
+    // the queue is the graphics queue, on devices without a separate compute family
+    bool shares_graphics_queue;
+};
+
+// Submits compute work to its own queue so it overlaps the graphics queue's
+// frames. Every submit gets a value on the queue's own timeline, other queues
+// wait for the work by waiting for that value, and the work waits for theirs
+// through the waits it is submitted with. On the graphics queue the same calls
+// still work, the submits just run in turn with the frames.
+class ComputeQueue
+{
+public:
+    void create(const CreateComputeQueueInfo& info);
+    void clean();
+
+    // false when the work runs on the graphics queue
+    [[nodiscard]] bool is_async() const { return async_; }
+    [[nodiscard]] uint32_t get_queue_family() const { return queue_family_; }
+
+    // Records a command buffer with `record` and submits it after the waits,
+    // returns the value it finishes at. Command buffers are reused once their
+    // submit completed.
+    uint64_t submit(const std::function<void(VkCommandBuffer)>& record, const std::vector<QueueTimeline::Wait>& waits = {});
+
+    [[nodiscard]] QueueTimeline& get_timeline() { return timeline_; }
+
+private:
+    struct PendingCommandBuffer
+    {
+        uint64_t value;
+        VkCommandBuffer command_buffer;
+    };
+
+    VkDevice device_ = VK_NULL_HANDLE;
+    uint32_t queue_family_ = 0;
+    bool async_ = false;
+    VkCommandPool command_pool_ = VK_NULL_HANDLE;
+    QueueTimeline timeline_;
+
+    std::deque<PendingCommandBuffer> pending_;
+    std::vector<VkCommandBuffer> free_;
+
+    VkCommandBuffer get_command_buffer();
+};
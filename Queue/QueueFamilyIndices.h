@@ -7,6 +7,8 @@ struct QueueFamilyIndices
 {
     std::optional<uint32_t> graphics_family;
     std::optional<uint32_t> present_family;
+    // a compute family without graphics, unset when every compute family also does graphics
+    std::optional<uint32_t> compute_family;
 
     [[nodiscard]] bool is_complete() const;
 };
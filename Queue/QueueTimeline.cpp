@@ -0,0 +1,145 @@
+﻿#include "QueueTimeline.h"
+
+#include <stdexcept>
+
+void QueueTimeline::create(const CreateQueueTimelineInfo& info)
+{
+    device_ = info.device;
+    queue_ = info.queue;
+
+    VkSemaphoreTypeCreateInfo type_info{};
+    type_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    type_info.initialValue = 0;
+
+    VkSemaphoreCreateInfo semaphore_info{};
+    semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphore_info.pNext = &type_info;
+
+    if (vkCreateSemaphore(device_, &semaphore_info, nullptr, &semaphore_) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Error: unable to create timeline semaphore.");
+    }
+
+    submitted_value_ = 0;
+    completed_value_ = 0;
+}
+
+void QueueTimeline::clean()
+{
+    if (semaphore_ != VK_NULL_HANDLE)
+    {
+        vkDestroySemaphore(device_, semaphore_, nullptr);
+    }
+
+    semaphore_ = VK_NULL_HANDLE;
+    submitted_value_ = 0;
+    completed_value_ = 0;
+}
+
+uint64_t QueueTimeline::submit(const std::vector<VkCommandBuffer>& command_buffers, const std::vector<Wait>& waits,
+                               const std::vector<VkSemaphore>& binary_signals)
+{
+    std::vector<VkCommandBufferSubmitInfo> command_buffer_infos;
+    command_buffer_infos.reserve(command_buffers.size());
+    for (const auto command_buffer : command_buffers)
+    {
+        VkCommandBufferSubmitInfo command_buffer_info{};
+        command_buffer_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
+        command_buffer_info.commandBuffer = command_buffer;
+        command_buffer_infos.push_back(command_buffer_info);
+    }
+
+    std::vector<VkSemaphoreSubmitInfo> wait_infos;
+    wait_infos.reserve(waits.size());
+    for (const auto& wait : waits)
+    {
+        VkSemaphoreSubmitInfo wait_info{};
+        wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+        wait_info.semaphore = wait.semaphore;
+        wait_info.value = wait.value;
+        wait_info.stageMask = wait.stages;
+        wait_infos.push_back(wait_info);
+    }
+
+    const uint64_t value = submitted_value_ + 1;
+
+    std::vector<VkSemaphoreSubmitInfo> signal_infos;
+    signal_infos.reserve(binary_signals.size() + 1);
+
+    VkSemaphoreSubmitInfo timeline_signal{};
+    timeline_signal.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+    timeline_signal.semaphore = semaphore_;
+    timeline_signal.value = value;
+    timeline_signal.stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+    signal_infos.push_back(timeline_signal);
+
+    for (const auto semaphore : binary_signals)
+    {
+        VkSemaphoreSubmitInfo signal_info{};
+        signal_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+        signal_info.semaphore = semaphore;
+        signal_info.stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+        signal_infos.push_back(signal_info);
+    }
+
+    VkSubmitInfo2 submit_info{};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
+    submit_info.waitSemaphoreInfoCount = static_cast<uint32_t>(wait_infos.size());
+    submit_info.pWaitSemaphoreInfos = wait_infos.data();
+    submit_info.commandBufferInfoCount = static_cast<uint32_t>(command_buffer_infos.size());
+    submit_info.pCommandBufferInfos = command_buffer_infos.data();
+    submit_info.signalSemaphoreInfoCount = static_cast<uint32_t>(signal_infos.size());
+    submit_info.pSignalSemaphoreInfos = signal_infos.data();
+
+    if (vkQueueSubmit2(queue_, 1, &submit_info, VK_NULL_HANDLE) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Error: failed to submit command buffers.");
+    }
+
+    submitted_value_ = value;
+    return value;
+}
+
+uint64_t QueueTimeline::poll()
+{
+    uint64_t value = 0;
+    if (vkGetSemaphoreCounterValue(device_, semaphore_, &value) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Error: unable to read timeline semaphore.");
+    }
+
+    completed_value_ = value;
+    return completed_value_;
+}
+
+bool QueueTimeline::is_complete(const uint64_t value)
+{
+    return value <= completed_value_ || value <= poll();
+}
+
+void QueueTimeline::wait(const uint64_t value)
+{
+    if (value <= completed_value_)
+    {
+        return;
+    }
+
+    VkSemaphoreWaitInfo wait_info{};
+    wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    wait_info.semaphoreCount = 1;
+    wait_info.pSemaphores = &semaphore_;
+    wait_info.pValues = &value;
+
+    if (vkWaitSemaphores(device_, &wait_info, UINT64_MAX) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Error: failed to wait for timeline semaphore.");
+    }
+
+    completed_value_ = value;
+}
+
+void QueueTimeline::wait_idle()
+{
+    wait(submitted_value_);
+}
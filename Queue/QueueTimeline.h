@@ -0,0 +1,57 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <vulkan/vulkan_core.h>
+
+struct CreateQueueTimelineInfo
+{
+    VkDevice device;
+    VkQueue queue;
+};
+
+// Numbers the submits to a queue with a timeline semaphore. Every submit
+// signals the next value, so "everything up to submit N finished" is a single
+// comparison against the semaphore's counter, which the CPU can poll or wait on
+// and other submits can wait on at a stage.
+class QueueTimeline
+{
+public:
+    struct Wait
+    {
+        VkSemaphore semaphore;
+        // ignored for binary semaphores
+        uint64_t value;
+        VkPipelineStageFlags2 stages;
+    };
+
+    void create(const CreateQueueTimelineInfo& info);
+    void clean();
+
+    // Returns the value the submit signals once its command buffers completed.
+    // The binary semaphores are signalled alongside, for the presentation engine.
+    uint64_t submit(const std::vector<VkCommandBuffer>& command_buffers, const std::vector<Wait>& waits = {},
+                    const std::vector<VkSemaphore>& binary_signals = {});
+
+    // value of the most recent submit, 0 before the first
+    [[nodiscard]] uint64_t get_submitted_value() const { return submitted_value_; }
+    // Reads the semaphore's counter, every submit up to it has completed.
+    uint64_t poll();
+    // only queries the semaphore when `value` isn't known to be complete yet
+    bool is_complete(uint64_t value);
+    void wait(uint64_t value);
+    // waits for the most recent submit
+    void wait_idle();
+
+    [[nodiscard]] VkSemaphore get_semaphore() const { return semaphore_; }
+    [[nodiscard]] VkQueue get_queue() const { return queue_; }
+
+private:
+    VkDevice device_ = VK_NULL_HANDLE;
+    VkQueue queue_ = VK_NULL_HANDLE;
+    VkSemaphore semaphore_ = VK_NULL_HANDLE;
+
+    uint64_t submitted_value_ = 0;
+    // last counter value read back, never ahead of the semaphore
+    uint64_t completed_value_ = 0;
+};
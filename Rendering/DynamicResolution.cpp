@@ -0,0 +1,54 @@
+﻿#include "DynamicResolution.h"
+
+#include <algorithm>
+#include <cmath>
+
+void DynamicResolution::set_settings(const Settings& settings)
+{
+    settings_ = settings;
+    scale_ = std::clamp(scale_, settings_.min_scale, settings_.max_scale);
+    has_measurement_ = false;
+}
+
+float DynamicResolution::update(const double gpu_milliseconds)
+{
+    if (settling_frames_ > 0)
+    {
+        --settling_frames_;
+        return scale_;
+    }
+
+    // the mean of the last few frames, one slow frame alone doesn't change anything
+    constexpr double smoothing = 0.2;
+    smoothed_milliseconds_ = has_measurement_
+        ? smoothed_milliseconds_ + (gpu_milliseconds - smoothed_milliseconds_) * smoothing
+        : gpu_milliseconds;
+    has_measurement_ = true;
+
+    const double target = settings_.target_milliseconds;
+    const double lower_bound = target * (1.0 - settings_.headroom);
+
+    if (smoothed_milliseconds_ <= 0.0 || (smoothed_milliseconds_ <= target && smoothed_milliseconds_ >= lower_bound))
+    {
+        return scale_;
+    }
+
+    // aim for the middle of the band, rounded down to a step so it ends up inside
+    const double goal = (target + lower_bound) * 0.5;
+    const double ideal = scale_ * std::sqrt(goal / smoothed_milliseconds_);
+    const float rounded = std::floor(static_cast<float>(ideal) / settings_.step + 1e-3f) * settings_.step;
+    const float scale = std::clamp(rounded, settings_.min_scale, settings_.max_scale);
+
+    // rounding down may undo a small increase, and the limits may stop it entirely
+    const bool too_slow = smoothed_milliseconds_ > target;
+    if (too_slow ? scale >= scale_ : scale <= scale_)
+    {
+        return scale_;
+    }
+
+    scale_ = scale;
+    has_measurement_ = false;
+    settling_frames_ = settings_.settle_frames;
+
+    return scale_;
+}
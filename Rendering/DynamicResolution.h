@@ -0,0 +1,39 @@
+﻿#pragma once
+
+#include <cstdint>
+
+// Picks the fraction of the output resolution the scene is rendered at from
+// measured gpu frame times. Shading cost follows the pixel count, so the scale
+// moves by the square root of how far the smoothed time is off. It only moves
+// once the time leaves a band below the target, and then ignores a few frames
+// of measurements that were taken before the change could show up in them.
+class DynamicResolution
+{
+public:
+    struct Settings
+    {
+        double target_milliseconds = 16.0;
+        float min_scale = 0.5f;
+        float max_scale = 1.0f;
+        // the scale drops above the target, and rises below target * (1 - headroom)
+        double headroom = 0.15;
+        // frames ignored after a change, at least the frames in flight
+        uint32_t settle_frames = 8;
+        // scales are multiples of this, so small fluctuations don't move it
+        float step = 0.05f;
+    };
+
+    void set_settings(const Settings& settings);
+    [[nodiscard]] const Settings& get_settings() const { return settings_; }
+
+    // Takes one frame's gpu time and returns the scale to render at from now on.
+    float update(double gpu_milliseconds);
+    [[nodiscard]] float get_scale() const { return scale_; }
+
+private:
+    Settings settings_;
+    float scale_ = 1.0f;
+    double smoothed_milliseconds_ = 0.0;
+    bool has_measurement_ = false;
+    uint32_t settling_frames_ = 0;
+};
@@ -0,0 +1,40 @@
+﻿#include "QualityTier.h"
+
+#include <algorithm>
+
+namespace quality
+{
+
+const std::vector<QualityTier>& get_tiers()
+{
+    static const std::vector<QualityTier> tiers =
+    {
+        {"low", VK_SAMPLE_COUNT_1_BIT, false, 0.0f, 1.0f, 0.75f},
+        {"medium", VK_SAMPLE_COUNT_2_BIT, false, 0.0f, 4.0f, 1.0f},
+        {"high", VK_SAMPLE_COUNT_4_BIT, false, 0.0f, 8.0f, 1.0f},
+        // sample shading smooths out aliasing inside textures too, at several times the fragment cost
+        {"ultra", VK_SAMPLE_COUNT_8_BIT, true, 0.2f, 16.0f, 1.0f},
+    };
+
+    return tiers;
+}
+
+std::optional<QualityTier> find_tier(const std::string& name)
+{
+    const auto& tiers = get_tiers();
+
+    const auto tier = std::ranges::find(tiers, name, &QualityTier::name);
+    if (tier == tiers.end())
+    {
+        return std::nullopt;
+    }
+
+    return *tier;
+}
+
+const QualityTier& get_default_tier()
+{
+    return get_tiers()[2];
+}
+
+}
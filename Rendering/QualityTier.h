@@ -0,0 +1,38 @@
+﻿#pragma once
+
+#include <optional>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan_core.h>
+
+// The settings that trade image quality for gpu time. Sample counts and
+// anisotropy are clamped to what the device supports when a tier is applied.
+struct QualityTier
+{
+    std::string name;
+    // msaa samples of the color and depth attachments
+    VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_4_BIT;
+    // shades min_sample_shading of the samples individually, only with more than one sample
+    bool sample_shading = false;
+    float min_sample_shading = 0.2f;
+    // 1 turns anisotropic filtering off
+    float max_anisotropy = 8.0f;
+    // fraction of the output width and height the scene is rendered at, with
+    // dynamic resolution the most it may scale up to
+    float resolution_scale = 1.0f;
+
+    bool operator==(const QualityTier& rhs) const = default;
+};
+
+namespace quality
+{
+
+// "low", "medium", "high" and "ultra", cheapest first
+const std::vector<QualityTier>& get_tiers();
+
+std::optional<QualityTier> find_tier(const std::string& name);
+
+// the tier renderers start with
+const QualityTier& get_default_tier();
+
+}
@@ -0,0 +1,1077 @@
+﻿#include "RenderGraph.h"
+
+#include <algorithm>
+#include <format>
+#include <ranges>
+#include <stdexcept>
+
+#include "../Logging/Logging.h"
+#include "../Profiling/CpuProfiler.h"
+
+namespace
+{
+
+struct UsageInfo
+{
+    VkPipelineStageFlags stages;
+    VkAccessFlags access;
+    VkImageLayout layout;
+    VkImageUsageFlags image_usage;
+    bool writes;
+    bool attachment;
+};
+
+constexpr VkAccessFlags write_access_mask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+                                            VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+
+constexpr VkImageUsageFlags attachment_usage_mask = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+
+// transient images are created in steps of this many pixels, so a window being
+// dragged larger doesn't need new ones every frame
+constexpr uint32_t extent_granularity = 128;
+
+uint32_t round_up_dimension(const uint32_t size)
+{
+    return (size + extent_granularity - 1) / extent_granularity * extent_granularity;
+}
+
+// big enough, without holding on to much more memory than the size needs
+bool dimension_fits(const uint32_t capacity, const uint32_t size)
+{
+    return capacity >= size && capacity - size < std::max(size, extent_granularity);
+}
+
+bool is_depth_format(const VkFormat format)
+{
+    switch (format)
+    {
+    case VK_FORMAT_D16_UNORM:
+    case VK_FORMAT_X8_D24_UNORM_PACK32:
+    case VK_FORMAT_D32_SFLOAT:
+    case VK_FORMAT_D16_UNORM_S8_UINT:
+    case VK_FORMAT_D24_UNORM_S8_UINT:
+    case VK_FORMAT_D32_SFLOAT_S8_UINT:
+        return true;
+    default:
+        return false;
+    }
+}
+
+UsageInfo get_usage_info(const RenderGraph::Usage usage, const bool depth)
+{
+    // sampled depth stays in the read only depth layout, which render passes can pick up again
+    const VkImageLayout sampled_layout = depth ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+    switch (usage)
+    {
+    case RenderGraph::Usage::color_attachment:
+        return {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, true, true};
+    case RenderGraph::Usage::depth_attachment:
+        return {VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, true, true};
+    case RenderGraph::Usage::resolve_attachment:
+        return {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, true, true};
+    case RenderGraph::Usage::fragment_sampled:
+        return {VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+                sampled_layout, VK_IMAGE_USAGE_SAMPLED_BIT, false, false};
+    case RenderGraph::Usage::compute_sampled:
+        return {VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+                sampled_layout, VK_IMAGE_USAGE_SAMPLED_BIT, false, false};
+    case RenderGraph::Usage::compute_written:
+        return {VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                VK_IMAGE_LAYOUT_UNDEFINED, 0, true, false};
+    case RenderGraph::Usage::indirect_read:
+        return {VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT,
+                VK_IMAGE_LAYOUT_UNDEFINED, 0, false, false};
+    }
+
+    throw std::invalid_argument("Error: unknown render graph usage.");
+}
+
+// color and depth attachments load what an earlier pass left, resolves overwrite it
+bool reads_contents(const RenderGraph::Usage usage)
+{
+    return usage != RenderGraph::Usage::resolve_attachment && usage != RenderGraph::Usage::compute_written;
+}
+
+template <typename T>
+void append_bytes(std::string& key, const T& value)
+{
+    key.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+}
+
+bool RenderGraph::TransientKey::operator==(const TransientKey& other) const
+{
+    return format == other.format && extent.width == other.extent.width && extent.height == other.extent.height &&
+           samples == other.samples && usage == other.usage && lazy == other.lazy && block == other.block;
+}
+
+bool RenderGraph::TransientKey::fits(const TransientKey& requested) const
+{
+    return format == requested.format && dimension_fits(extent.width, requested.extent.width) &&
+           dimension_fits(extent.height, requested.extent.height) && samples == requested.samples &&
+           usage == requested.usage && lazy == requested.lazy && block == requested.block;
+}
+
+void RenderGraph::Barriers::record(VkCommandBuffer command_buffer) const
+{
+    const uint32_t memory_barrier_count = memory.dstStageMask != 0 ? 1 : 0;
+
+    if (memory_barrier_count == 0 && images.empty())
+    {
+        return;
+    }
+
+    VkDependencyInfo dependency_info{};
+    dependency_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    dependency_info.memoryBarrierCount = memory_barrier_count;
+    dependency_info.pMemoryBarriers = &memory;
+    dependency_info.imageMemoryBarrierCount = static_cast<uint32_t>(images.size());
+    dependency_info.pImageMemoryBarriers = images.data();
+
+    vkCmdPipelineBarrier2(command_buffer, &dependency_info);
+}
+
+void RenderGraph::create(const CreateRenderGraphInfo& info)
+{
+    device_ = info.device;
+    allocator_ = info.allocator;
+    retire_ = info.retire;
+
+    VmaAllocationCreateInfo lazy_allocation_info{};
+    lazy_allocation_info.usage = VMA_MEMORY_USAGE_GPU_LAZILY_ALLOCATED;
+
+    uint32_t memory_type;
+    lazy_memory_supported_ = vmaFindMemoryTypeIndex(allocator_, UINT32_MAX, &lazy_allocation_info, &memory_type) == VK_SUCCESS;
+
+    if (!lazy_memory_supported_)
+    {
+        logging::info("The device has no lazily allocated memory, attachment-only images use regular memory");
+    }
+}
+
+void RenderGraph::clean()
+{
+    clean_images();
+    reset();
+}
+
+void RenderGraph::clean_images()
+{
+    for (const auto framebuffer : framebuffers_ | std::views::values)
+    {
+        vkDestroyFramebuffer(device_, framebuffer, nullptr);
+    }
+    framebuffers_.clear();
+
+    for (const auto render_pass : render_passes_ | std::views::values)
+    {
+        vkDestroyRenderPass(device_, render_pass, nullptr);
+    }
+    render_passes_.clear();
+
+    for (const auto& physical : physical_images_)
+    {
+        vkDestroyImageView(device_, physical.view, nullptr);
+        vkDestroyImage(device_, physical.image, nullptr);
+
+        if (physical.allocation != VK_NULL_HANDLE)
+        {
+            vmaFreeMemory(allocator_, physical.allocation);
+        }
+    }
+    physical_images_.clear();
+
+    for (const auto allocation : block_allocations_)
+    {
+        vmaFreeMemory(allocator_, allocation);
+    }
+    block_allocations_.clear();
+
+    transient_keys_.clear();
+    declared_keys_.clear();
+}
+
+void RenderGraph::retire_framebuffers()
+{
+    if (framebuffers_.empty())
+    {
+        return;
+    }
+
+    retire_([device = device_, framebuffers = std::move(framebuffers_)]
+    {
+        for (const auto framebuffer : framebuffers | std::views::values)
+        {
+            vkDestroyFramebuffer(device, framebuffer, nullptr);
+        }
+    });
+
+    framebuffers_.clear();
+}
+
+void RenderGraph::reset()
+{
+    resources_.clear();
+    passes_.clear();
+    culled_pass_count_ = 0;
+}
+
+RenderGraph::Resource RenderGraph::import_image(const char* name, VkImage image, VkImageView view,
+                                                const ImageDescription& description, const VkImageLayout final_layout)
+{
+    ResourceEntry entry{};
+    entry.name = name;
+    entry.imported = true;
+    entry.description = description;
+    entry.image = image;
+    entry.view = view;
+    entry.final_layout = final_layout;
+    // the submit's wait on the image, the first use has to come after it
+    entry.state.read_stages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+
+    resources_.push_back(entry);
+    return static_cast<Resource>(resources_.size() - 1);
+}
+
+RenderGraph::Resource RenderGraph::import_buffer(const char* name, VkBuffer buffer)
+{
+    ResourceEntry entry{};
+    entry.name = name;
+    entry.buffer = true;
+    entry.imported = true;
+    entry.vk_buffer = buffer;
+
+    resources_.push_back(entry);
+    return static_cast<Resource>(resources_.size() - 1);
+}
+
+RenderGraph::Resource RenderGraph::create_image(const char* name, const ImageDescription& description)
+{
+    ResourceEntry entry{};
+    entry.name = name;
+    entry.description = description;
+
+    resources_.push_back(entry);
+    return static_cast<Resource>(resources_.size() - 1);
+}
+
+void RenderGraph::add_pass(const char* name, std::vector<Use> uses, std::function<void(VkCommandBuffer)> record)
+{
+    passes_.push_back({name, std::move(uses), std::move(record)});
+}
+
+void RenderGraph::compile()
+{
+    PROFILE_ZONE("compile render graph");
+
+    cull_passes();
+    derive_usage();
+
+    const auto keys = get_transient_keys();
+    const bool fits = keys.size() == transient_keys_.size() &&
+        std::ranges::equal(transient_keys_, keys, [](const TransientKey& created, const TransientKey& requested)
+        {
+            return created.fits(requested);
+        });
+
+    if (!fits)
+    {
+        if (!physical_images_.empty())
+        {
+            retire_transient_images();
+        }
+
+        auto created_keys = keys;
+        for (auto& key : created_keys)
+        {
+            key.extent = {round_up_dimension(key.extent.width), round_up_dimension(key.extent.height)};
+        }
+
+        create_transient_images(created_keys);
+        transient_keys_ = std::move(created_keys);
+        ++generation_;
+    }
+    else if (keys != declared_keys_)
+    {
+        // the same images at another size, the old size's framebuffers won't be asked for again
+        retire_framebuffers();
+    }
+
+    declared_keys_ = keys;
+
+    uint32_t physical_index = 0;
+    for (auto& resource : resources_)
+    {
+        if (resource.imported || resource.first_pass == UINT32_MAX)
+        {
+            continue;
+        }
+
+        resource.physical = physical_index++;
+        resource.image = physical_images_[resource.physical].image;
+        resource.view = physical_images_[resource.physical].view;
+    }
+}
+
+void RenderGraph::execute(VkCommandBuffer command_buffer, GpuProfiler& profiler)
+{
+    written_.assign(resources_.size(), false);
+    touched_.assign(resources_.size(), false);
+
+    for (uint32_t i = 0; i < passes_.size(); ++i)
+    {
+        const auto& pass = passes_[i];
+
+        if (pass.culled)
+        {
+            continue;
+        }
+
+        profiler.begin_scope(command_buffer, pass.name);
+
+        // sampled images and buffers are synchronized in front of the pass, attachments by its render pass
+        Barriers barriers;
+        bool graphics = false;
+
+        for (const auto& use : pass.uses)
+        {
+            const bool depth = !resources_[use.resource].buffer && is_depth_format(resources_[use.resource].description.format);
+            if (get_usage_info(use.usage, depth).attachment)
+            {
+                graphics = true;
+                continue;
+            }
+
+            synchronize(use.resource, use.usage, barriers);
+        }
+
+        barriers.record(command_buffer);
+
+        if (graphics)
+        {
+            record_graphics_pass(command_buffer, pass, i);
+        }
+        else
+        {
+            pass.record(command_buffer);
+        }
+
+        for (const auto& use : pass.uses)
+        {
+            const bool depth = !resources_[use.resource].buffer && is_depth_format(resources_[use.resource].description.format);
+            if (get_usage_info(use.usage, depth).writes)
+            {
+                written_[use.resource] = true;
+            }
+        }
+
+        profiler.end_scope(command_buffer);
+    }
+
+    // imported images whose last use wasn't an attachment, or that no pass touched
+    Barriers barriers;
+
+    for (Resource i = 0; i < resources_.size(); ++i)
+    {
+        auto& resource = resources_[i];
+
+        if (!resource.imported || resource.buffer || resource.state.layout == resource.final_layout)
+        {
+            continue;
+        }
+
+        // nothing in the frame comes after it, the submit's signal waits for it
+        VkImageMemoryBarrier2 barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+        barrier.srcStageMask = resource.state.write_stages | resource.state.read_stages;
+        barrier.srcAccessMask = resource.state.write_access;
+        barrier.dstStageMask = VK_PIPELINE_STAGE_2_NONE;
+        barrier.dstAccessMask = VK_ACCESS_2_NONE;
+        barrier.oldLayout = resource.state.layout;
+        barrier.newLayout = resource.final_layout;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = resource.image;
+        barrier.subresourceRange.aspectMask = is_depth_format(resource.description.format) ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.levelCount = 1;
+        barrier.subresourceRange.layerCount = 1;
+        barriers.images.push_back(barrier);
+
+        resource.state.layout = resource.final_layout;
+    }
+
+    barriers.record(command_buffer);
+}
+
+VkImageView RenderGraph::get_image_view(const Resource resource) const
+{
+    return resources_[resource].view;
+}
+
+void RenderGraph::cull_passes()
+{
+    // walking back from the imported images, a pass is needed if it writes
+    // something that is needed, and then everything it reads is needed too
+    std::vector<bool> needed(resources_.size(), false);
+    for (size_t i = 0; i < resources_.size(); ++i)
+    {
+        needed[i] = resources_[i].imported && !resources_[i].buffer;
+    }
+
+    culled_pass_count_ = 0;
+
+    for (auto pass = passes_.rbegin(); pass != passes_.rend(); ++pass)
+    {
+        pass->culled = std::ranges::none_of(pass->uses, [&](const Use& use)
+        {
+            const auto& resource = resources_[use.resource];
+            const bool depth = !resource.buffer && is_depth_format(resource.description.format);
+            return get_usage_info(use.usage, depth).writes && needed[use.resource];
+        });
+
+        if (pass->culled)
+        {
+            ++culled_pass_count_;
+            continue;
+        }
+
+        for (const auto& use : pass->uses)
+        {
+            if (reads_contents(use.usage))
+            {
+                needed[use.resource] = true;
+            }
+        }
+    }
+}
+
+void RenderGraph::derive_usage()
+{
+    for (auto& resource : resources_)
+    {
+        resource.usage = resource.description.extra_usage;
+        resource.first_pass = UINT32_MAX;
+        resource.last_pass = 0;
+        resource.physical = UINT32_MAX;
+    }
+
+    for (uint32_t i = 0; i < passes_.size(); ++i)
+    {
+        if (passes_[i].culled)
+        {
+            continue;
+        }
+
+        for (const auto& use : passes_[i].uses)
+        {
+            auto& resource = resources_[use.resource];
+            const bool depth = !resource.buffer && is_depth_format(resource.description.format);
+
+            resource.usage |= get_usage_info(use.usage, depth).image_usage;
+            resource.first_pass = std::min(resource.first_pass, i);
+            resource.last_pass = std::max(resource.last_pass, i);
+        }
+    }
+
+    for (auto& resource : resources_)
+    {
+        if (resource.imported || resource.first_pass == UINT32_MAX)
+        {
+            continue;
+        }
+
+        // nothing but render passes ever touch it, so it may never need memory at all
+        if ((resource.usage & ~attachment_usage_mask) == 0)
+        {
+            resource.usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+            resource.lazy = lazy_memory_supported_;
+        }
+    }
+}
+
+std::vector<RenderGraph::TransientKey> RenderGraph::get_transient_keys()
+{
+    std::vector<Resource> transients;
+    for (Resource i = 0; i < resources_.size(); ++i)
+    {
+        if (!resources_[i].imported && resources_[i].first_pass != UINT32_MAX)
+        {
+            transients.push_back(i);
+        }
+    }
+
+    // in the order they start, each image takes the first block whose images are all done by then
+    std::vector<Resource> by_first_pass = transients;
+    std::ranges::stable_sort(by_first_pass, {}, [&](const Resource resource) { return resources_[resource].first_pass; });
+
+    std::vector<uint32_t> blocks(resources_.size(), UINT32_MAX);
+    std::vector<uint32_t> block_last_passes;
+
+    for (const Resource resource : by_first_pass)
+    {
+        const auto& entry = resources_[resource];
+
+        if (entry.lazy)
+        {
+            continue;
+        }
+
+        const auto free_block = std::ranges::find_if(block_last_passes, [&](const uint32_t last_pass)
+        {
+            return last_pass < entry.first_pass;
+        });
+
+        if (free_block == block_last_passes.end())
+        {
+            blocks[resource] = static_cast<uint32_t>(block_last_passes.size());
+            block_last_passes.push_back(entry.last_pass);
+        }
+        else
+        {
+            blocks[resource] = static_cast<uint32_t>(free_block - block_last_passes.begin());
+            *free_block = entry.last_pass;
+        }
+    }
+
+    std::vector<TransientKey> keys;
+    for (const Resource resource : transients)
+    {
+        const auto& entry = resources_[resource];
+        keys.push_back({entry.description.format, entry.description.extent, entry.description.samples,
+                        entry.usage, entry.lazy, blocks[resource]});
+    }
+
+    return keys;
+}
+
+void RenderGraph::create_transient_images(const std::vector<TransientKey>& keys)
+{
+    physical_images_.resize(keys.size());
+
+    uint32_t block_count = 0;
+    for (const auto& key : keys)
+    {
+        if (!key.lazy)
+        {
+            block_count = std::max(block_count, key.block + 1);
+        }
+    }
+
+    // a block has to fit, and be aligned for, every image placed in it
+    std::vector<VkMemoryRequirements> block_requirements(block_count, {0, 1, UINT32_MAX});
+    VkDeviceSize unaliased_size = 0;
+    uint32_t lazy_count = 0;
+
+    for (size_t i = 0; i < keys.size(); ++i)
+    {
+        const auto& key = keys[i];
+        auto& physical = physical_images_[i];
+
+        VkImageCreateInfo image_info{};
+        image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        image_info.imageType = VK_IMAGE_TYPE_2D;
+        image_info.format = key.format;
+        image_info.extent = {key.extent.width, key.extent.height, 1};
+        image_info.mipLevels = 1;
+        image_info.arrayLayers = 1;
+        image_info.samples = key.samples;
+        image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+        image_info.usage = key.usage;
+        image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+        if (vkCreateImage(device_, &image_info, nullptr, &physical.image) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Error: unable to create render graph image.");
+        }
+
+        VkMemoryRequirements requirements;
+        vkGetImageMemoryRequirements(device_, physical.image, &requirements);
+
+        physical.block = key.lazy ? UINT32_MAX : key.block;
+
+        if (physical.block != UINT32_MAX)
+        {
+            unaliased_size += requirements.size;
+
+            auto& block = block_requirements[physical.block];
+            if ((block.memoryTypeBits & requirements.memoryTypeBits) != 0)
+            {
+                block.size = std::max(block.size, requirements.size);
+                block.alignment = std::max(block.alignment, requirements.alignment);
+                block.memoryTypeBits &= requirements.memoryTypeBits;
+                continue;
+            }
+
+            // no memory type suits both, it gets memory of its own
+            physical.block = UINT32_MAX;
+        }
+
+        VmaAllocationCreateInfo allocation_info{};
+        allocation_info.usage = key.lazy ? VMA_MEMORY_USAGE_GPU_LAZILY_ALLOCATED : VMA_MEMORY_USAGE_GPU_ONLY;
+
+        if (vmaAllocateMemoryForImage(allocator_, physical.image, &allocation_info, &physical.allocation, nullptr) != VK_SUCCESS ||
+            vmaBindImageMemory(allocator_, physical.allocation, physical.image) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Error: unable to allocate render graph image memory.");
+        }
+
+        lazy_count += key.lazy ? 1 : 0;
+    }
+
+    VkDeviceSize aliased_size = 0;
+    block_allocations_.resize(block_count, VK_NULL_HANDLE);
+
+    for (uint32_t i = 0; i < block_count; ++i)
+    {
+        // every image of the block may have ended up with memory of its own
+        if (block_requirements[i].size == 0)
+        {
+            continue;
+        }
+
+        VmaAllocationCreateInfo allocation_info{};
+        allocation_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+
+        if (vmaAllocateMemory(allocator_, &block_requirements[i], &allocation_info, &block_allocations_[i], nullptr) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Error: unable to allocate render graph memory.");
+        }
+
+        aliased_size += block_requirements[i].size;
+    }
+
+    for (size_t i = 0; i < keys.size(); ++i)
+    {
+        auto& physical = physical_images_[i];
+
+        if (physical.block != UINT32_MAX &&
+            vmaBindImageMemory(allocator_, block_allocations_[physical.block], physical.image) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Error: unable to bind render graph image memory.");
+        }
+
+        VkImageViewCreateInfo view_info{};
+        view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        view_info.image = physical.image;
+        view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        view_info.format = keys[i].format;
+        view_info.subresourceRange.aspectMask = is_depth_format(keys[i].format) ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+        view_info.subresourceRange.levelCount = 1;
+        view_info.subresourceRange.layerCount = 1;
+
+        if (vkCreateImageView(device_, &view_info, nullptr, &physical.view) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Error: unable to create render graph image view.");
+        }
+    }
+
+    logging::info(std::format("Render graph created {} transient images, {} lazily allocated, in {} bytes ({} without aliasing)",
+                              keys.size(), lazy_count, aliased_size, unaliased_size));
+}
+
+void RenderGraph::retire_transient_images()
+{
+    // frames that are still in flight use the images and every framebuffer made from them
+    retire_([device = device_, allocator = allocator_, physical_images = std::move(physical_images_),
+             block_allocations = std::move(block_allocations_), framebuffers = std::move(framebuffers_)]
+    {
+        for (const auto framebuffer : framebuffers | std::views::values)
+        {
+            vkDestroyFramebuffer(device, framebuffer, nullptr);
+        }
+
+        for (const auto& physical : physical_images)
+        {
+            vkDestroyImageView(device, physical.view, nullptr);
+            vkDestroyImage(device, physical.image, nullptr);
+
+            if (physical.allocation != VK_NULL_HANDLE)
+            {
+                vmaFreeMemory(allocator, physical.allocation);
+            }
+        }
+
+        for (const auto allocation : block_allocations)
+        {
+            if (allocation != VK_NULL_HANDLE)
+            {
+                vmaFreeMemory(allocator, allocation);
+            }
+        }
+    });
+
+    physical_images_.clear();
+    block_allocations_.clear();
+    framebuffers_.clear();
+    transient_keys_.clear();
+}
+
+RenderGraph::AccessState& RenderGraph::get_state(const Resource resource)
+{
+    auto& entry = resources_[resource];
+    return entry.imported ? entry.state : physical_images_[entry.physical].state;
+}
+
+RenderGraph::AccessState RenderGraph::get_previous_state(const Resource resource)
+{
+    const auto& entry = resources_[resource];
+
+    if (entry.imported || touched_[resource])
+    {
+        return get_state(resource);
+    }
+
+    // the contents are gone anyway, but whoever used the memory last has to be done with it
+    const auto& physical = physical_images_[entry.physical];
+    AccessState state = physical.state;
+
+    if (physical.block != UINT32_MAX)
+    {
+        for (const auto& other : physical_images_)
+        {
+            if (other.block == physical.block)
+            {
+                state.write_stages |= other.state.write_stages;
+                state.write_access |= other.state.write_access;
+                state.read_stages |= other.state.read_stages;
+            }
+        }
+    }
+
+    state.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    state.visible_stages = 0;
+    state.visible_access = 0;
+    return state;
+}
+
+std::optional<RenderGraph::Usage> RenderGraph::find_next_use(const Resource resource, const uint32_t pass) const
+{
+    for (uint32_t i = pass + 1; i < passes_.size(); ++i)
+    {
+        if (passes_[i].culled)
+        {
+            continue;
+        }
+
+        for (const auto& use : passes_[i].uses)
+        {
+            if (use.resource == resource)
+            {
+                return use.usage;
+            }
+        }
+    }
+
+    return std::nullopt;
+}
+
+void RenderGraph::synchronize(const Resource resource, const Usage usage, Barriers& barriers)
+{
+    const auto& entry = resources_[resource];
+    const auto info = get_usage_info(usage, !entry.buffer && is_depth_format(entry.description.format));
+
+    const AccessState previous = get_previous_state(resource);
+    touched_[resource] = true;
+
+    const bool layout_changes = !entry.buffer && info.layout != previous.layout;
+    // writes wait for everything before them, reads only for a write that isn't visible to them yet
+    const bool write_hazard = info.writes && (previous.write_stages | previous.read_stages) != 0;
+    const bool read_hazard = !info.writes && previous.write_stages != 0 &&
+        ((info.stages & ~previous.visible_stages) != 0 || (info.access & ~previous.visible_access) != 0);
+
+    auto& state = get_state(resource);
+
+    if (layout_changes || write_hazard || read_hazard)
+    {
+        const VkPipelineStageFlags2 src_stages =
+            previous.write_stages | (layout_changes || info.writes ? previous.read_stages : 0);
+
+        if (entry.buffer)
+        {
+            barriers.memory.srcStageMask |= src_stages;
+            barriers.memory.srcAccessMask |= previous.write_access;
+            barriers.memory.dstStageMask |= info.stages;
+            barriers.memory.dstAccessMask |= info.access;
+        }
+        else
+        {
+            VkImageMemoryBarrier2 barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+            barrier.srcStageMask = src_stages;
+            barrier.srcAccessMask = previous.write_access;
+            barrier.dstStageMask = info.stages;
+            barrier.dstAccessMask = info.access;
+            barrier.oldLayout = previous.layout;
+            barrier.newLayout = info.layout;
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.image = entry.image;
+            barrier.subresourceRange.aspectMask = is_depth_format(entry.description.format) ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+            barrier.subresourceRange.levelCount = 1;
+            barrier.subresourceRange.layerCount = 1;
+            barriers.images.push_back(barrier);
+        }
+
+        state.visible_stages |= info.stages;
+        state.visible_access |= info.access;
+    }
+
+    if (info.writes)
+    {
+        state.write_stages = info.stages;
+        state.write_access = info.access & write_access_mask;
+        state.read_stages = 0;
+        state.visible_stages = 0;
+        state.visible_access = 0;
+    }
+    else
+    {
+        state.read_stages |= info.stages;
+
+        // later uses in other stages have to come after the transition
+        if (layout_changes)
+        {
+            state.write_stages |= info.stages;
+        }
+    }
+
+    if (!entry.buffer)
+    {
+        state.layout = info.layout;
+    }
+}
+
+void RenderGraph::record_graphics_pass(VkCommandBuffer command_buffer, const Pass& pass, const uint32_t pass_index)
+{
+    // colors, depth, then resolves, the order the pipelines' render pass has to use too
+    std::vector<const Use*> attachments_uses;
+    for (const auto usage : {Usage::color_attachment, Usage::depth_attachment, Usage::resolve_attachment})
+    {
+        for (const auto& use : pass.uses)
+        {
+            if (use.usage == usage)
+            {
+                attachments_uses.push_back(&use);
+            }
+        }
+    }
+
+    const auto color_count = static_cast<uint32_t>(std::ranges::count(pass.uses, Usage::color_attachment, &Use::usage));
+    const auto depth_count = static_cast<uint32_t>(std::ranges::count(pass.uses, Usage::depth_attachment, &Use::usage));
+    const auto resolve_count = static_cast<uint32_t>(attachments_uses.size()) - color_count - depth_count;
+
+    if (depth_count > 1 || (resolve_count != 0 && resolve_count != color_count))
+    {
+        throw std::invalid_argument(std::format("Error: render graph pass {} has unsupported attachments.", pass.name));
+    }
+
+    std::vector<VkAttachmentDescription> attachments;
+    std::vector<VkImageView> views;
+    std::vector<VkClearValue> clear_values;
+
+    // waits for the attachments' previous uses
+    VkSubpassDependency incoming{};
+    incoming.srcSubpass = VK_SUBPASS_EXTERNAL;
+    incoming.dstSubpass = 0;
+
+    // hands attachments over to their next uses in the layouts those want
+    VkSubpassDependency outgoing{};
+    outgoing.srcSubpass = 0;
+    outgoing.dstSubpass = VK_SUBPASS_EXTERNAL;
+
+    for (const auto* use : attachments_uses)
+    {
+        const auto& entry = resources_[use->resource];
+        const bool depth = is_depth_format(entry.description.format);
+        const auto info = get_usage_info(use->usage, depth);
+
+        const AccessState previous = get_previous_state(use->resource);
+        touched_[use->resource] = true;
+
+        const bool load = written_[use->resource] && reads_contents(use->usage);
+        const auto next_use = find_next_use(use->resource, pass_index);
+
+        VkAttachmentDescription attachment{};
+        attachment.format = entry.description.format;
+        attachment.samples = entry.description.samples;
+        attachment.loadOp = load ? VK_ATTACHMENT_LOAD_OP_LOAD
+            : use->clear ? VK_ATTACHMENT_LOAD_OP_CLEAR : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        // only kept for a use that reads it, imported images are always kept
+        attachment.storeOp = next_use ? (reads_contents(*next_use) ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE)
+            : entry.imported ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        attachment.initialLayout = load ? previous.layout : VK_IMAGE_LAYOUT_UNDEFINED;
+        attachment.finalLayout = info.layout;
+
+        incoming.srcStageMask |= previous.write_stages | previous.read_stages;
+        incoming.srcAccessMask |= previous.write_access;
+        incoming.dstStageMask |= info.stages;
+        incoming.dstAccessMask |= info.access;
+
+        auto& state = get_state(use->resource);
+        state.write_stages = info.stages;
+        state.write_access = info.access & write_access_mask;
+        state.read_stages = 0;
+        state.visible_stages = 0;
+        state.visible_access = 0;
+
+        if (next_use && !get_usage_info(*next_use, depth).attachment)
+        {
+            const auto next_info = get_usage_info(*next_use, depth);
+            attachment.finalLayout = next_info.layout;
+
+            outgoing.srcStageMask |= info.stages;
+            outgoing.srcAccessMask |= info.access & write_access_mask;
+            outgoing.dstStageMask |= next_info.stages;
+            outgoing.dstAccessMask |= next_info.access;
+
+            state.visible_stages = next_info.stages;
+            state.visible_access = next_info.access;
+        }
+        else if (!next_use && entry.imported)
+        {
+            attachment.finalLayout = entry.final_layout;
+
+            outgoing.srcStageMask |= info.stages;
+            outgoing.srcAccessMask |= info.access & write_access_mask;
+            outgoing.dstStageMask |= VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+        }
+
+        state.layout = attachment.finalLayout;
+
+        attachments.push_back(attachment);
+        views.push_back(entry.view);
+        clear_values.push_back(use->clear.value_or(VkClearValue{}));
+    }
+
+    if (incoming.srcStageMask == 0)
+    {
+        incoming.srcStageMask = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+    }
+
+    std::vector dependencies = {incoming};
+    if (outgoing.srcStageMask != 0)
+    {
+        dependencies.push_back(outgoing);
+    }
+
+    const auto extent = resources_[attachments_uses.front()->resource].description.extent;
+    const VkRenderPass render_pass = get_render_pass(attachments, color_count, depth_count != 0, dependencies);
+
+    VkRenderPassBeginInfo render_pass_begin_info{};
+    render_pass_begin_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    render_pass_begin_info.renderPass = render_pass;
+    render_pass_begin_info.framebuffer = get_framebuffer(render_pass, views, extent);
+    render_pass_begin_info.renderArea.offset = {0, 0};
+    render_pass_begin_info.renderArea.extent = extent;
+    render_pass_begin_info.clearValueCount = static_cast<uint32_t>(clear_values.size());
+    render_pass_begin_info.pClearValues = clear_values.data();
+
+    vkCmdBeginRenderPass(command_buffer, &render_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
+    pass.record(command_buffer);
+    vkCmdEndRenderPass(command_buffer);
+}
+
+VkRenderPass RenderGraph::get_render_pass(const std::vector<VkAttachmentDescription>& attachments, const uint32_t color_count,
+                                          const bool has_depth, const std::vector<VkSubpassDependency>& dependencies)
+{
+    // the descriptions are all 32 bit fields, so their bytes make a key
+    std::string key;
+    append_bytes(key, color_count);
+    append_bytes(key, has_depth);
+    for (const auto& attachment : attachments)
+    {
+        append_bytes(key, attachment);
+    }
+    for (const auto& dependency : dependencies)
+    {
+        append_bytes(key, dependency);
+    }
+
+    if (const auto render_pass = render_passes_.find(key); render_pass != render_passes_.end())
+    {
+        return render_pass->second;
+    }
+
+    std::vector<VkAttachmentReference> color_references;
+    std::vector<VkAttachmentReference> resolve_references;
+    VkAttachmentReference depth_reference{};
+
+    for (uint32_t i = 0; i < attachments.size(); ++i)
+    {
+        if (i < color_count)
+        {
+            color_references.push_back({i, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL});
+        }
+        else if (has_depth && i == color_count)
+        {
+            depth_reference = {i, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL};
+        }
+        else
+        {
+            resolve_references.push_back({i, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL});
+        }
+    }
+
+    VkSubpassDescription subpass{};
+    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass.colorAttachmentCount = color_count;
+    subpass.pColorAttachments = color_references.data();
+    subpass.pDepthStencilAttachment = has_depth ? &depth_reference : nullptr;
+    subpass.pResolveAttachments = resolve_references.empty() ? nullptr : resolve_references.data();
+
+    VkRenderPassCreateInfo render_pass_info{};
+    render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    render_pass_info.attachmentCount = static_cast<uint32_t>(attachments.size());
+    render_pass_info.pAttachments = attachments.data();
+    render_pass_info.subpassCount = 1;
+    render_pass_info.pSubpasses = &subpass;
+    render_pass_info.dependencyCount = static_cast<uint32_t>(dependencies.size());
+    render_pass_info.pDependencies = dependencies.data();
+
+    VkRenderPass render_pass;
+    if (vkCreateRenderPass(device_, &render_pass_info, nullptr, &render_pass) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Error: unable to create render graph render pass.");
+    }
+
+    render_passes_.emplace(std::move(key), render_pass);
+    return render_pass;
+}
+
+VkFramebuffer RenderGraph::get_framebuffer(VkRenderPass render_pass, const std::vector<VkImageView>& views, const VkExtent2D extent)
+{
+    FramebufferKey key{render_pass, views, extent.width, extent.height};
+
+    if (const auto framebuffer = framebuffers_.find(key); framebuffer != framebuffers_.end())
+    {
+        return framebuffer->second;
+    }
+
+    VkFramebufferCreateInfo framebuffer_info{};
+    framebuffer_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    framebuffer_info.renderPass = render_pass;
+    framebuffer_info.attachmentCount = static_cast<uint32_t>(views.size());
+    framebuffer_info.pAttachments = views.data();
+    framebuffer_info.width = extent.width;
+    framebuffer_info.height = extent.height;
+    framebuffer_info.layers = 1;
+
+    VkFramebuffer framebuffer;
+    if (vkCreateFramebuffer(device_, &framebuffer_info, nullptr, &framebuffer) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Error: unable to create render graph framebuffer.");
+    }
+
+    framebuffers_.emplace(std::move(key), framebuffer);
+    return framebuffer;
+}
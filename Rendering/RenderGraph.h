@@ -0,0 +1,258 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+#include <vk_mem_alloc.h>
+#include <vulkan/vulkan_core.h>
+
+#include "../Profiling/GpuProfiler.h"
+
+struct CreateRenderGraphInfo
+{
+    VkDevice device;
+    VmaAllocator allocator;
+    // destroys objects once every frame that may still use them has finished
+    std::function<void(std::function<void()>)> retire;
+};
+
+// A frame made of passes that declare which images and buffers they read and
+// write. The frame is declared anew every time it is recorded, compile() then
+// drops the passes nothing needs and creates the transient images, and
+// execute() records the rest with the barriers between them. Graphics passes
+// get a render pass over their attachments, with load and store ops, layouts
+// and subpass dependencies derived from the passes around them, so most
+// transitions happen in the render passes instead of separate barriers.
+//
+// Transient images whose passes don't overlap share memory, and images that
+// are only ever attachments are created TRANSIENT_ATTACHMENT and backed by
+// lazily allocated memory where the device has it. Images, framebuffers and
+// render passes are kept as long as the declarations keep asking for the same
+// ones, and images are also kept for smaller sizes that still fit in them, so
+// resizing a window only creates new ones now and then.
+class RenderGraph
+{
+public:
+    // an image or buffer of the current declaration
+    using Resource = uint32_t;
+
+    enum class Usage
+    {
+        // written, and read back first if an earlier pass wrote it
+        color_attachment,
+        depth_attachment,
+        // the pass's color attachment at the same position resolves into it
+        resolve_attachment,
+        fragment_sampled,
+        compute_sampled,
+        // buffers only
+        compute_written,
+        indirect_read,
+    };
+
+    struct Use
+    {
+        Resource resource;
+        Usage usage;
+        // attachments are cleared to this when no earlier pass wrote them, otherwise their contents are undefined
+        std::optional<VkClearValue> clear = std::nullopt;
+    };
+
+    struct ImageDescription
+    {
+        VkFormat format;
+        VkExtent2D extent;
+        VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+        // added to the usage the passes need, for uses the declaration doesn't show
+        VkImageUsageFlags extra_usage = 0;
+    };
+
+    void create(const CreateRenderGraphInfo& info);
+    void clean();
+
+    // Destroys the transient images, framebuffers and render passes. The gpu has
+    // to be done with them, the next compile creates what it needs again.
+    void clean_images();
+
+    // Retires the framebuffers, for when imported images go away. Frames in
+    // flight keep using them until they are done.
+    void retire_framebuffers();
+
+    // Starts a new declaration, the previous one's resources are invalid from now on.
+    void reset();
+
+    // An image owned by someone else, like a swap chain image. Its contents are
+    // discarded, the submit has to wait for it at COLOR_ATTACHMENT_OUTPUT, and
+    // the graph leaves it in `final_layout`. Passes writing it are never dropped.
+    Resource import_image(const char* name, VkImage image, VkImageView view, const ImageDescription& description,
+                          VkImageLayout final_layout);
+    // A buffer owned by someone else, only synchronized between the passes using it.
+    Resource import_buffer(const char* name, VkBuffer buffer);
+    // An image created by the graph, its contents only live through one frame.
+    Resource create_image(const char* name, const ImageDescription& description);
+
+    // Passes are recorded in the order they are added. Graphics passes, the
+    // ones with attachments, record into a render pass that covers the whole
+    // attachments. `name` also names the pass's gpu scope, so it has to stay
+    // valid like a scope name.
+    void add_pass(const char* name, std::vector<Use> uses, std::function<void(VkCommandBuffer)> record);
+
+    // Drops the passes whose results nothing reads and creates the transient
+    // images, or reuses the previous ones when the declared ones fit in them.
+    // Reused images can be larger than declared, passes only ever cover the
+    // declared extent.
+    void compile();
+    void execute(VkCommandBuffer command_buffer, GpuProfiler& profiler);
+
+    // only valid after compile
+    [[nodiscard]] VkImageView get_image_view(Resource resource) const;
+    // changes every time compile creates new transient images
+    [[nodiscard]] uint64_t get_generation() const { return generation_; }
+
+    // passes of the most recent compile, and how many of them were dropped
+    [[nodiscard]] uint32_t get_pass_count() const { return static_cast<uint32_t>(passes_.size()); }
+    [[nodiscard]] uint32_t get_culled_pass_count() const { return culled_pass_count_; }
+
+private:
+    // what the last accesses were and what they have been made visible to, the
+    // original flags are the same bits in synchronization2 barriers and also fit
+    // the render passes' subpass dependencies
+    struct AccessState
+    {
+        VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkPipelineStageFlags write_stages = 0;
+        VkAccessFlags write_access = 0;
+        // stages reading since the last write
+        VkPipelineStageFlags read_stages = 0;
+        VkPipelineStageFlags visible_stages = 0;
+        VkAccessFlags visible_access = 0;
+    };
+
+    struct ResourceEntry
+    {
+        const char* name;
+        bool buffer = false;
+        bool imported = false;
+        ImageDescription description = {};
+        VkImage image = VK_NULL_HANDLE;
+        VkImageView view = VK_NULL_HANDLE;
+        VkBuffer vk_buffer = VK_NULL_HANDLE;
+        VkImageLayout final_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        // derived by compile
+        VkImageUsageFlags usage = 0;
+        uint32_t first_pass = UINT32_MAX;
+        uint32_t last_pass = 0;
+        bool lazy = false;
+        // index into physical_images_ for transient images
+        uint32_t physical = UINT32_MAX;
+        // imported resources only live through the frame
+        AccessState state;
+    };
+
+    struct Pass
+    {
+        const char* name;
+        std::vector<Use> uses;
+        std::function<void(VkCommandBuffer)> record;
+        bool culled = false;
+    };
+
+    // what compile needs to know about a transient image to tell whether it can reuse it
+    struct TransientKey
+    {
+        VkFormat format;
+        VkExtent2D extent;
+        VkSampleCountFlagBits samples;
+        VkImageUsageFlags usage;
+        bool lazy;
+        uint32_t block;
+
+        bool operator==(const TransientKey& other) const;
+        // an image created for this key can stand in for one of `requested`
+        [[nodiscard]] bool fits(const TransientKey& requested) const;
+    };
+
+    struct PhysicalImage
+    {
+        VkImage image = VK_NULL_HANDLE;
+        VkImageView view = VK_NULL_HANDLE;
+        // its own allocation when lazy or when it can't share its block's memory
+        VmaAllocation allocation = VK_NULL_HANDLE;
+        uint32_t block;
+        // kept across frames, the next frame's first use waits for the last one's
+        AccessState state;
+    };
+
+    // merged into one vkCmdPipelineBarrier2 in front of a pass, every barrier
+    // only waits for the stages that touched its own resource
+    struct Barriers
+    {
+        // buffers go through a global memory barrier
+        VkMemoryBarrier2 memory{VK_STRUCTURE_TYPE_MEMORY_BARRIER_2};
+        std::vector<VkImageMemoryBarrier2> images;
+
+        void record(VkCommandBuffer command_buffer) const;
+    };
+
+    struct FramebufferKey
+    {
+        VkRenderPass render_pass;
+        std::vector<VkImageView> views;
+        uint32_t width;
+        uint32_t height;
+
+        bool operator<(const FramebufferKey& other) const
+        {
+            return std::tie(render_pass, views, width, height) < std::tie(other.render_pass, other.views, other.width, other.height);
+        }
+    };
+
+    VkDevice device_ = VK_NULL_HANDLE;
+    VmaAllocator allocator_ = VK_NULL_HANDLE;
+    std::function<void(std::function<void()>)> retire_;
+    bool lazy_memory_supported_ = false;
+
+    std::vector<ResourceEntry> resources_;
+    std::vector<Pass> passes_;
+    uint32_t culled_pass_count_ = 0;
+
+    // per resource while executing: written by an earlier pass, used by an earlier pass
+    std::vector<bool> written_;
+    std::vector<bool> touched_;
+
+    // what the images were created for, and what the last compile asked for
+    std::vector<TransientKey> transient_keys_;
+    std::vector<TransientKey> declared_keys_;
+    std::vector<PhysicalImage> physical_images_;
+    std::vector<VmaAllocation> block_allocations_;
+    uint64_t generation_ = 0;
+
+    // render passes by their attachment descriptions and dependencies
+    std::map<std::string, VkRenderPass> render_passes_;
+    std::map<FramebufferKey, VkFramebuffer> framebuffers_;
+
+    void cull_passes();
+    void derive_usage();
+    std::vector<TransientKey> get_transient_keys();
+    void create_transient_images(const std::vector<TransientKey>& keys);
+    void retire_transient_images();
+
+    AccessState& get_state(Resource resource);
+    // what the resource's next use has to wait for, the first use of a transient
+    // image in a frame also waits for the images it shares memory with
+    AccessState get_previous_state(Resource resource);
+    // next pass after `pass` that uses `resource`, and how
+    [[nodiscard]] std::optional<Usage> find_next_use(Resource resource, uint32_t pass) const;
+
+    // a use outside of a render pass, or a non-attachment use of a graphics pass
+    void synchronize(Resource resource, Usage usage, Barriers& barriers);
+    void record_graphics_pass(VkCommandBuffer command_buffer, const Pass& pass, uint32_t pass_index);
+    VkRenderPass get_render_pass(const std::vector<VkAttachmentDescription>& attachments, uint32_t color_count,
+                                 bool has_depth, const std::vector<VkSubpassDependency>& dependencies);
+    VkFramebuffer get_framebuffer(VkRenderPass render_pass, const std::vector<VkImageView>& views, VkExtent2D extent);
+};
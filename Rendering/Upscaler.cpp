@@ -0,0 +1,331 @@
+﻿#include "Upscaler.h"
+
+#include <array>
+#include <filesystem>
+#include <format>
+#include <stdexcept>
+
+#include "../Image/MappedFile.h"
+#include "../Logging/Logging.h"
+
+namespace
+{
+
+const char* const fullscreen_shader = "Shaders/Vertex/fullscreen.spv";
+const char* const upscale_shader = "Shaders/Fragment/upscale.spv";
+
+struct UpscalePushConstants
+{
+    float render_width;
+    float render_height;
+};
+
+}
+
+void Upscaler::create(const CreateUpscalerInfo& info)
+{
+    device_ = info.device;
+
+    for (const auto path : {fullscreen_shader, upscale_shader})
+    {
+        if (!std::filesystem::exists(path))
+        {
+            logging::warning(std::format("{} is missing, resolution scaling is unavailable", path));
+            return;
+        }
+    }
+
+    create_render_pass(info.format);
+
+    VkDescriptorSetLayoutBinding scene_color_binding{};
+    scene_color_binding.binding = 0;
+    scene_color_binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    scene_color_binding.descriptorCount = 1;
+    scene_color_binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+    VkDescriptorSetLayoutCreateInfo set_layout_info{};
+    set_layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    set_layout_info.bindingCount = 1;
+    set_layout_info.pBindings = &scene_color_binding;
+
+    if (vkCreateDescriptorSetLayout(device_, &set_layout_info, nullptr, &set_layout_) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Error: unable to create upscale descriptor set layout.");
+    }
+
+    VkPushConstantRange push_constant_range{};
+    push_constant_range.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    push_constant_range.size = sizeof(UpscalePushConstants);
+
+    VkPipelineLayoutCreateInfo pipeline_layout_info{};
+    pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipeline_layout_info.setLayoutCount = 1;
+    pipeline_layout_info.pSetLayouts = &set_layout_;
+    pipeline_layout_info.pushConstantRangeCount = 1;
+    pipeline_layout_info.pPushConstantRanges = &push_constant_range;
+
+    if (vkCreatePipelineLayout(device_, &pipeline_layout_info, nullptr, &pipeline_layout_) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Error: unable to create upscale pipeline layout.");
+    }
+
+    create_pipeline(info.pipeline_cache);
+
+    // the filter is built from bilinear fetches
+    VkSamplerCreateInfo sampler_info{};
+    sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    sampler_info.magFilter = VK_FILTER_LINEAR;
+    sampler_info.minFilter = VK_FILTER_LINEAR;
+    sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+
+    if (vkCreateSampler(device_, &sampler_info, nullptr, &sampler_) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Error: unable to create upscale sampler.");
+    }
+
+    VkDescriptorPoolSize pool_size{};
+    pool_size.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    pool_size.descriptorCount = info.frame_count;
+
+    VkDescriptorPoolCreateInfo pool_info{};
+    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.poolSizeCount = 1;
+    pool_info.pPoolSizes = &pool_size;
+    pool_info.maxSets = info.frame_count;
+
+    if (vkCreateDescriptorPool(device_, &pool_info, nullptr, &descriptor_pool_) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Error: unable to create upscale descriptor pool.");
+    }
+
+    const std::vector layouts(info.frame_count, set_layout_);
+    descriptor_sets_.resize(info.frame_count);
+    outdated_.assign(info.frame_count, true);
+
+    VkDescriptorSetAllocateInfo allocate_info{};
+    allocate_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocate_info.descriptorPool = descriptor_pool_;
+    allocate_info.descriptorSetCount = info.frame_count;
+    allocate_info.pSetLayouts = layouts.data();
+
+    if (vkAllocateDescriptorSets(device_, &allocate_info, descriptor_sets_.data()) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Error: unable to allocate upscale descriptor sets.");
+    }
+
+    available_ = true;
+}
+
+void Upscaler::clean()
+{
+    if (!available_)
+    {
+        return;
+    }
+
+    vkDestroyDescriptorPool(device_, descriptor_pool_, nullptr);
+    descriptor_sets_.clear();
+    outdated_.clear();
+    scene_color_ = VK_NULL_HANDLE;
+    vkDestroySampler(device_, sampler_, nullptr);
+    vkDestroyPipeline(device_, pipeline_, nullptr);
+    vkDestroyPipelineLayout(device_, pipeline_layout_, nullptr);
+    vkDestroyDescriptorSetLayout(device_, set_layout_, nullptr);
+    vkDestroyRenderPass(device_, render_pass_, nullptr);
+
+    available_ = false;
+}
+
+void Upscaler::set_scene_color(VkImageView view)
+{
+    scene_color_ = view;
+
+    // frames in flight may still use the sets
+    outdated_.assign(outdated_.size(), true);
+}
+
+void Upscaler::record(VkCommandBuffer command_buffer, const uint32_t frame_slot, const VkExtent2D target_extent,
+                      const VkExtent2D render_extent)
+{
+    const VkDescriptorSet descriptor_set = descriptor_sets_[frame_slot];
+
+    if (outdated_[frame_slot])
+    {
+        VkDescriptorImageInfo image_info{};
+        image_info.sampler = sampler_;
+        image_info.imageView = scene_color_;
+        image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+        VkWriteDescriptorSet write{};
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet = descriptor_set;
+        write.dstBinding = 0;
+        write.descriptorCount = 1;
+        write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        write.pImageInfo = &image_info;
+
+        vkUpdateDescriptorSets(device_, 1, &write, 0, nullptr);
+        outdated_[frame_slot] = false;
+    }
+
+    VkViewport viewport{};
+    viewport.width = static_cast<float>(target_extent.width);
+    viewport.height = static_cast<float>(target_extent.height);
+    viewport.maxDepth = 1.0f;
+    vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+
+    VkRect2D scissor{};
+    scissor.extent = target_extent;
+    vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_);
+    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout_,
+                            0, 1, &descriptor_set, 0, nullptr);
+
+    const UpscalePushConstants push_constants =
+    {
+        static_cast<float>(render_extent.width), static_cast<float>(render_extent.height),
+    };
+    vkCmdPushConstants(command_buffer, pipeline_layout_, VK_SHADER_STAGE_FRAGMENT_BIT,
+                       0, sizeof(push_constants), &push_constants);
+
+    vkCmdDraw(command_buffer, 3, 1, 0, 0);
+}
+
+void Upscaler::create_render_pass(const VkFormat format)
+{
+    // load and store ops, layouts and dependencies don't matter for compatibility
+    VkAttachmentDescription target_attachment{};
+    target_attachment.format = format;
+    target_attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    target_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    target_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    target_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    target_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    target_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    target_attachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+    VkAttachmentReference target_reference{};
+    target_reference.attachment = 0;
+    target_reference.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+    VkSubpassDescription subpass{};
+    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass.colorAttachmentCount = 1;
+    subpass.pColorAttachments = &target_reference;
+
+    VkRenderPassCreateInfo render_pass_info{};
+    render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    render_pass_info.attachmentCount = 1;
+    render_pass_info.pAttachments = &target_attachment;
+    render_pass_info.subpassCount = 1;
+    render_pass_info.pSubpasses = &subpass;
+
+    if (vkCreateRenderPass(device_, &render_pass_info, nullptr, &render_pass_) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Error: unable to create upscale render pass.");
+    }
+}
+
+void Upscaler::create_pipeline(VkPipelineCache pipeline_cache)
+{
+    const VkShaderModule vertex_module = create_shader_module(fullscreen_shader);
+    const VkShaderModule fragment_module = create_shader_module(upscale_shader);
+
+    std::array<VkPipelineShaderStageCreateInfo, 2> stages{};
+    stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+    stages[0].module = vertex_module;
+    stages[0].pName = "main";
+    stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+    stages[1].module = fragment_module;
+    stages[1].pName = "main";
+
+    // the triangle comes from the vertex index
+    VkPipelineVertexInputStateCreateInfo vertex_input{};
+    vertex_input.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+
+    VkPipelineInputAssemblyStateCreateInfo input_assembly{};
+    input_assembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    input_assembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+    VkPipelineViewportStateCreateInfo viewport_state{};
+    viewport_state.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewport_state.viewportCount = 1;
+    viewport_state.scissorCount = 1;
+
+    VkPipelineRasterizationStateCreateInfo rasterization{};
+    rasterization.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterization.polygonMode = VK_POLYGON_MODE_FILL;
+    rasterization.cullMode = VK_CULL_MODE_NONE;
+    rasterization.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+    rasterization.lineWidth = 1.0f;
+
+    VkPipelineMultisampleStateCreateInfo multisample{};
+    multisample.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisample.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+    VkPipelineColorBlendAttachmentState blend_attachment{};
+    blend_attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
+                                      VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+
+    VkPipelineColorBlendStateCreateInfo color_blend{};
+    color_blend.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    color_blend.attachmentCount = 1;
+    color_blend.pAttachments = &blend_attachment;
+
+    // the targets change with the swap chain, the pipeline doesn't
+    std::array dynamic_states = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+
+    VkPipelineDynamicStateCreateInfo dynamic_state{};
+    dynamic_state.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamic_state.dynamicStateCount = static_cast<uint32_t>(dynamic_states.size());
+    dynamic_state.pDynamicStates = dynamic_states.data();
+
+    VkGraphicsPipelineCreateInfo pipeline_info{};
+    pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipeline_info.stageCount = static_cast<uint32_t>(stages.size());
+    pipeline_info.pStages = stages.data();
+    pipeline_info.pVertexInputState = &vertex_input;
+    pipeline_info.pInputAssemblyState = &input_assembly;
+    pipeline_info.pViewportState = &viewport_state;
+    pipeline_info.pRasterizationState = &rasterization;
+    pipeline_info.pMultisampleState = &multisample;
+    pipeline_info.pColorBlendState = &color_blend;
+    pipeline_info.pDynamicState = &dynamic_state;
+    pipeline_info.layout = pipeline_layout_;
+    pipeline_info.renderPass = render_pass_;
+    pipeline_info.subpass = 0;
+
+    const auto result = vkCreateGraphicsPipelines(device_, pipeline_cache, 1, &pipeline_info, nullptr, &pipeline_);
+
+    vkDestroyShaderModule(device_, vertex_module, nullptr);
+    vkDestroyShaderModule(device_, fragment_module, nullptr);
+
+    if (result != VK_SUCCESS)
+    {
+        throw std::runtime_error("Error: unable to create upscale pipeline.");
+    }
+}
+
+VkShaderModule Upscaler::create_shader_module(const char* path)
+{
+    const MappedFile code(path);
+
+    VkShaderModuleCreateInfo module_info{};
+    module_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    module_info.codeSize = code.size();
+    module_info.pCode = reinterpret_cast<const uint32_t*>(code.data());
+
+    VkShaderModule shader_module;
+    if (vkCreateShaderModule(device_, &module_info, nullptr, &shader_module) != VK_SUCCESS)
+    {
+        throw std::runtime_error(std::string("Error: unable to create shader module for ") + path);
+    }
+
+    return shader_module;
+}
@@ -0,0 +1,58 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <vulkan/vulkan_core.h>
+
+struct CreateUpscalerInfo
+{
+    VkDevice device;
+    VkPipelineCache pipeline_cache;
+    // of the targets, the scene color has the same
+    VkFormat format;
+    // one descriptor set per frame that can be in flight
+    uint32_t frame_count;
+};
+
+// Draws the part of the scene color a frame was rendered into over a whole
+// target, filtered with Catmull-Rom. It records into a render pass someone else
+// began over the target alone, the scene color has to be in
+// SHADER_READ_ONLY_OPTIMAL by then with its writes visible to fragment shaders.
+class Upscaler
+{
+public:
+    void create(const CreateUpscalerInfo& info);
+    void clean();
+
+    // false when the shaders are missing, nothing else may be called then
+    [[nodiscard]] bool is_available() const { return available_; }
+
+    // Samples `view` in the frames recorded from now on. Frames in flight keep
+    // sampling the previous one, which has to stay valid until they are done.
+    void set_scene_color(VkImageView view);
+
+    // Scales the top left `render_extent` of the scene color to a target of
+    // `target_extent`, the scene color is at least the target's size. Must be
+    // called after the slot's previous frame was waited for.
+    void record(VkCommandBuffer command_buffer, uint32_t frame_slot, VkExtent2D target_extent, VkExtent2D render_extent);
+
+private:
+    VkDevice device_ = VK_NULL_HANDLE;
+    bool available_ = false;
+
+    // only for creating the pipeline, compatible with any pass over a single target
+    VkRenderPass render_pass_ = VK_NULL_HANDLE;
+    VkDescriptorSetLayout set_layout_ = VK_NULL_HANDLE;
+    VkPipelineLayout pipeline_layout_ = VK_NULL_HANDLE;
+    VkPipeline pipeline_ = VK_NULL_HANDLE;
+    VkSampler sampler_ = VK_NULL_HANDLE;
+    VkDescriptorPool descriptor_pool_ = VK_NULL_HANDLE;
+    std::vector<VkDescriptorSet> descriptor_sets_;
+    VkImageView scene_color_ = VK_NULL_HANDLE;
+    // the slot's set still samples a previous scene color, it is rewritten when the slot is recorded next
+    std::vector<bool> outdated_;
+
+    void create_render_pass(VkFormat format);
+    void create_pipeline(VkPipelineCache pipeline_cache);
+    VkShaderModule create_shader_module(const char* path);
+};
@@ -1,6 +1,7 @@
 ﻿#pragma once
 
 #include <array>
+#include <functional>
 #include <glm/glm.hpp>
 #include <vulkan/vulkan_core.h>
 
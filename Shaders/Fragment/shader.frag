@@ -7,8 +7,14 @@ layout(location = 0) out vec4 outColor;
 
 layout(set = 1, binding = 0) uniform sampler2D texSampler;
 
+// the vertex shader's transform index takes the first 4 bytes
+layout(push_constant) uniform PushConstants
+{
+    layout(offset = 4) float lodBias;
+} pushConstants;
+
 void main() 
 {
-    vec4 texColor = texture(texSampler, fragTexCoord);
+    vec4 texColor = texture(texSampler, fragTexCoord, pushConstants.lodBias);
     outColor = texColor * vec4(fragColor, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,48 @@
+#version 450
+
+// Scales the top left renderSize pixels of the scene color up to the whole
+// target with a Catmull-Rom filter. The 4x4 taps are folded into 3x3 bilinear
+// fetches by sampling between the two middle texels of each row and column.
+// Taps are clamped to the rendered pixels, so the cleared rest doesn't bleed in.
+
+layout(location = 0) in vec2 fragTexCoord;
+
+layout(location = 0) out vec4 outColor;
+
+layout(set = 0, binding = 0) uniform sampler2D sceneColor;
+
+layout(push_constant) uniform PushConstants
+{
+    vec2 renderSize;
+} pushConstants;
+
+vec3 fetch(vec2 pixel)
+{
+    pixel = clamp(pixel, vec2(0.5), pushConstants.renderSize - 0.5);
+    return textureLod(sceneColor, pixel / vec2(textureSize(sceneColor, 0)), 0.0).rgb;
+}
+
+void main()
+{
+    vec2 position = fragTexCoord * pushConstants.renderSize;
+    vec2 center = floor(position - 0.5) + 0.5;
+    vec2 f = position - center;
+
+    vec2 w0 = f * (-0.5 + f * (1.0 - 0.5 * f));
+    vec2 w1 = 1.0 + f * f * (-2.5 + 1.5 * f);
+    vec2 w2 = f * (0.5 + f * (2.0 - 1.5 * f));
+    vec2 w3 = f * f * (-0.5 + 0.5 * f);
+
+    vec2 w12 = w1 + w2;
+    vec2 p0 = center - 1.0;
+    vec2 p12 = center + w2 / w12;
+    vec2 p3 = center + 2.0;
+
+    vec3 color =
+        (fetch(vec2(p0.x, p0.y)) * w0.x + fetch(vec2(p12.x, p0.y)) * w12.x + fetch(vec2(p3.x, p0.y)) * w3.x) * w0.y +
+        (fetch(vec2(p0.x, p12.y)) * w0.x + fetch(vec2(p12.x, p12.y)) * w12.x + fetch(vec2(p3.x, p12.y)) * w3.x) * w12.y +
+        (fetch(vec2(p0.x, p3.y)) * w0.x + fetch(vec2(p12.x, p3.y)) * w12.x + fetch(vec2(p3.x, p3.y)) * w3.x) * w3.y;
+
+    // the negative lobes overshoot at hard edges
+    outColor = vec4(max(color, vec3(0.0)), 1.0);
+}
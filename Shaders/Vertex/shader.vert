@@ -6,8 +6,14 @@ layout(set = 0, binding = 0) uniform GlobalUBO
     mat4 proj;
 } globalUBO;
 
+// every object's model matrix, the frame's own copy
+layout(std430, set = 0, binding = 1) readonly buffer Transforms
+{
+    mat4 models[];
+} transforms;
+
 layout(push_constant) uniform PushConstants {
-    mat4 model;
+    uint transformIndex;
 } pushConstants;
 
 layout(location = 0) in vec3 inPosition;
@@ -19,7 +25,7 @@ layout(location = 1) out vec2 fragTexCoord;
 
 void main()
 {
-    mat4 mvp = globalUBO.proj * globalUBO.view * pushConstants.model;
+    mat4 mvp = globalUBO.proj * globalUBO.view * transforms.models[pushConstants.transformIndex];
     gl_Position = mvp * vec4(inPosition, 1.0);
     
     // simple pass-through to the fragment shader
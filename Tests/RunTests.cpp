@@ -0,0 +1,17 @@
+﻿// Runs the automated tests, the ones that need neither a gpu nor a display.
+// Exits with 1 when any of them failed.
+
+#include <cstdlib>
+
+#include "TestDynamicBvh.h"
+#include "TestTransformSystem.h"
+#include "TestWorkStealingDeque.h"
+
+int main()
+{
+    bool passed = TestDynamicBvh::run();
+    passed = TestTransformSystem::run() && passed;
+    passed = TestWorkStealingDeque::run() && passed;
+
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,252 @@
+﻿#include "TestDynamicBvh.h"
+
+#include "../Culling/DynamicBvh.h"
+#include "../Culling/Frustum.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+namespace
+{
+
+struct Entry
+{
+    uint32_t id;
+    uint32_t proxy;
+    BoundingBox box;
+};
+
+BoundingBox random_box(std::mt19937& random, const uint32_t id)
+{
+    std::uniform_real_distribution<float> coordinate(-100.f, 100.f);
+    std::uniform_real_distribution<float> extent(0.f, 3.f);
+
+    const glm::vec3 center(coordinate(random), coordinate(random), coordinate(random));
+    // some points and flat boxes among them
+    const glm::vec3 half_extent = id % 10 == 0 ? glm::vec3(0.f) : glm::vec3(extent(random), extent(random), id % 10 == 1 ? 0.f : extent(random));
+
+    return {center - half_extent, center + half_extent};
+}
+
+bool touches(const Frustum& frustum, const BoundingBox& box)
+{
+    const glm::vec3 center = (box.min + box.max) * 0.5f;
+    const glm::vec3 extent = (box.max - box.min) * 0.5f;
+
+    for (const auto& plane : frustum.planes)
+    {
+        const glm::vec3 normal(plane);
+        if (glm::dot(normal, center) + plane.w < -glm::dot(extent, glm::abs(normal)))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool touches(const BoundingSphere& sphere, const BoundingBox& box)
+{
+    const glm::vec3 offset = glm::clamp(sphere.center, box.min, box.max) - sphere.center;
+    return glm::dot(offset, offset) <= sphere.radius * sphere.radius;
+}
+
+bool touches(const glm::vec3& origin, const glm::vec3& direction, const float max_distance, const BoundingBox& box)
+{
+    float enter = 0.f;
+    float exit = max_distance;
+
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        const float t0 = (box.min[axis] - origin[axis]) / direction[axis];
+        const float t1 = (box.max[axis] - origin[axis]) / direction[axis];
+        enter = std::max(enter, std::min(t0, t1));
+        exit = std::min(exit, std::max(t0, t1));
+    }
+
+    return enter <= exit;
+}
+
+bool same_ids(std::vector<uint32_t> found, std::vector<uint32_t> expected, const char* query, const int round)
+{
+    std::ranges::sort(found);
+    std::ranges::sort(expected);
+
+    if (found != expected)
+    {
+        std::cerr << "DynamicBvh " << query << " query found " << found.size() << " boxes instead of " << expected.size()
+                  << " in round " << round << '\n';
+        return false;
+    }
+
+    return true;
+}
+
+}
+
+bool TestDynamicBvh::run()
+{
+    bool passed = queries_match_brute_force();
+    passed = small_moves_keep_their_place() && passed;
+
+    std::cout << "TestDynamicBvh " << (passed ? "passed" : "FAILED") << '\n';
+    return passed;
+}
+
+bool TestDynamicBvh::queries_match_brute_force()
+{
+    DynamicBvh bvh;
+    std::mt19937 random(3);
+    std::uniform_real_distribution<float> coordinate(-100.f, 100.f);
+    std::uniform_real_distribution<float> unit(-1.f, 1.f);
+    std::uniform_real_distribution<float> radius(1.f, 50.f);
+
+    uint32_t next_id = 0;
+    std::vector<Entry> entries;
+    const auto add = [&]
+    {
+        const uint32_t id = next_id++;
+        const auto box = random_box(random, id);
+        entries.push_back({id, bvh.insert(id, box), box});
+    };
+
+    for (int i = 0; i < 500; ++i)
+    {
+        add();
+    }
+
+    bool passed = true;
+    std::vector<uint32_t> found;
+    std::vector<uint32_t> expected;
+    std::vector<DynamicBvh::RayHit> hits;
+
+    for (int round = 0; round < 30; ++round)
+    {
+        // mostly small moves that stay inside the fat boxes, some far jumps
+        for (int i = 0; i < 100; ++i)
+        {
+            auto& entry = entries[random() % entries.size()];
+            const glm::vec3 offset = i % 4 == 0
+                ? glm::vec3(coordinate(random), coordinate(random), coordinate(random))
+                : glm::vec3(unit(random), unit(random), unit(random)) * 0.1f;
+            entry.box = {entry.box.min + offset, entry.box.max + offset};
+            bvh.update(entry.proxy, entry.box);
+        }
+
+        for (int i = 0; i < 20; ++i)
+        {
+            const size_t index = random() % entries.size();
+            bvh.remove(entries[index].proxy);
+            entries[index] = entries.back();
+            entries.pop_back();
+        }
+
+        for (int i = 0; i < 20; ++i)
+        {
+            add();
+        }
+
+        if (bvh.get_leaf_count() != entries.size())
+        {
+            std::cerr << "DynamicBvh holds " << bvh.get_leaf_count() << " boxes instead of " << entries.size()
+                      << " in round " << round << '\n';
+            passed = false;
+        }
+
+        const glm::vec3 eye(coordinate(random), coordinate(random), coordinate(random));
+        const glm::vec3 target(coordinate(random), coordinate(random), coordinate(random));
+        const auto frustum = Frustum::from_matrix(glm::perspective(glm::radians(60.f), 16.f / 9.f, 0.1f, 150.f)
+                                                * glm::lookAt(eye, target, glm::vec3(0.f, 0.f, 1.f)));
+        bvh.query(frustum, found);
+        expected.clear();
+        for (const auto& entry : entries)
+        {
+            if (touches(frustum, entry.box))
+            {
+                expected.push_back(entry.id);
+            }
+        }
+        passed = same_ids(found, expected, "frustum", round) && passed;
+
+        const BoundingSphere sphere{{coordinate(random), coordinate(random), coordinate(random)}, radius(random)};
+        bvh.query(sphere, found);
+        expected.clear();
+        for (const auto& entry : entries)
+        {
+            if (touches(sphere, entry.box))
+            {
+                expected.push_back(entry.id);
+            }
+        }
+        passed = same_ids(found, expected, "sphere", round) && passed;
+
+        // aimed at one of the boxes, a random ray through this much space mostly hits nothing
+        const glm::vec3 origin(coordinate(random), coordinate(random), coordinate(random));
+        const auto& aim = entries[random() % entries.size()].box;
+        const glm::vec3 direction = glm::normalize((aim.min + aim.max) * 0.5f + glm::vec3(0.01f, 0.02f, 0.03f) - origin);
+        bvh.raycast(origin, direction, 300.f, hits);
+        found.clear();
+        for (size_t i = 0; i < hits.size(); ++i)
+        {
+            found.push_back(hits[i].id);
+            if (i > 0 && hits[i].distance < hits[i - 1].distance)
+            {
+                std::cerr << "DynamicBvh ray hits aren't sorted nearest first in round " << round << '\n';
+                passed = false;
+            }
+        }
+        expected.clear();
+        for (const auto& entry : entries)
+        {
+            if (touches(origin, direction, 300.f, entry.box))
+            {
+                expected.push_back(entry.id);
+            }
+        }
+        passed = same_ids(found, expected, "ray", round) && passed;
+    }
+
+    return passed;
+}
+
+bool TestDynamicBvh::small_moves_keep_their_place()
+{
+    DynamicBvh bvh;
+
+    // a point and a flat box, neither has a size to take a margin from
+    BoundingBox point{glm::vec3(1.f, 2.f, 3.f), glm::vec3(1.f, 2.f, 3.f)};
+    BoundingBox flat{glm::vec3(-1.f, -1.f, 0.f), glm::vec3(1.f, 1.f, 0.f)};
+    const uint32_t point_proxy = bvh.insert(0, point);
+    const uint32_t flat_proxy = bvh.insert(1, flat);
+    bvh.insert(2, {glm::vec3(10.f), glm::vec3(12.f)});
+
+    bool passed = true;
+    const glm::vec3 step(0.001f, -0.001f, 0.001f);
+
+    for (int i = 0; i < 10; ++i)
+    {
+        point = {point.min + step, point.max + step};
+        flat = {flat.min + step, flat.max + step};
+
+        if (bvh.update(point_proxy, point) || bvh.update(flat_proxy, flat))
+        {
+            std::cerr << "DynamicBvh reinserted a box without extent after a move of " << glm::length(step) << '\n';
+            passed = false;
+            break;
+        }
+    }
+
+    point = {point.min + glm::vec3(5.f), point.max + glm::vec3(5.f)};
+    if (!bvh.update(point_proxy, point))
+    {
+        std::cerr << "DynamicBvh kept a box in place after it left its fat box" << '\n';
+        passed = false;
+    }
+
+    return passed;
+}
@@ -0,0 +1,13 @@
+﻿#pragma once
+
+// Checks the BVH's frustum, sphere and ray queries against testing every box,
+// while boxes are inserted, moved and removed.
+class TestDynamicBvh
+{
+public:
+    // false if any check failed, the failures are printed
+    static bool run();
+private:
+    static bool queries_match_brute_force();
+    static bool small_moves_keep_their_place();
+};
@@ -0,0 +1,208 @@
+﻿#include "TestTransformSystem.h"
+
+#include "../Actors/TransformSystem.h"
+#include "../Jobs/JobSystem.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <set>
+#include <vector>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+namespace
+{
+
+glm::quat random_orientation(std::mt19937& random)
+{
+    std::uniform_real_distribution<float> component(-1.f, 1.f);
+    return glm::normalize(glm::quat(component(random), component(random), component(random), component(random)));
+}
+
+float max_difference(const glm::mat4& a, const glm::mat4& b)
+{
+    float difference = 0.f;
+    for (int column = 0; column < 4; ++column)
+    {
+        for (int row = 0; row < 4; ++row)
+        {
+            difference = std::max(difference, std::fabs(a[column][row] - b[column][row]));
+        }
+    }
+
+    return difference;
+}
+
+}
+
+bool TestTransformSystem::run()
+{
+    bool passed = matrices_match_glm();
+    passed = changed_are_the_set_transforms() && passed;
+
+    std::cout << "TestTransformSystem " << (passed ? "passed" : "FAILED") << '\n';
+    return passed;
+}
+
+bool TestTransformSystem::matrices_match_glm()
+{
+    TransformSystem transforms;
+    transforms.create();
+
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> coordinate(-100.f, 100.f);
+    std::uniform_real_distribution<float> scale(0.1f, 4.f);
+
+    // not a multiple of the simd width, so the tail of the last block is covered too
+    std::vector<TransformSystem::Handle> handles;
+    for (int i = 0; i < 1003; ++i)
+    {
+        handles.push_back(transforms.add({}, glm::quat(1.f, 0.f, 0.f, 0.f), glm::vec3(1.f)));
+    }
+
+    // holes, the last transforms move into them
+    for (size_t i = 0; i < 100; i += 3)
+    {
+        transforms.remove(handles[i]);
+    }
+    std::erase_if(handles, [](const TransformSystem::Handle handle) { return handle < 100 && handle % 3 == 0; });
+
+    for (const auto handle : handles)
+    {
+        transforms.set_position(handle, {coordinate(random), coordinate(random), coordinate(random)});
+        transforms.set_orientation(handle, random_orientation(random));
+        transforms.set_scale(handle, {scale(random), scale(random), scale(random)});
+    }
+
+    // built by the sse or avx path
+    transforms.update();
+
+    bool passed = true;
+    for (const auto handle : handles)
+    {
+        const auto expected = glm::translate(glm::mat4(1.f), transforms.get_position(handle))
+                            * glm::mat4_cast(transforms.get_orientation(handle))
+                            * glm::scale(glm::mat4(1.f), transforms.get_scale(handle));
+
+        if (const auto difference = max_difference(transforms.get_world_matrix(handle), expected); difference > 1e-4f)
+        {
+            std::cerr << "TransformSystem " << transforms.get_instruction_set() << " matrix of " << handle
+                      << " is off from glm by " << difference << '\n';
+            passed = false;
+        }
+    }
+
+    // the same transforms built one by one by the scalar path when added
+    TransformSystem scalar;
+    scalar.create();
+    for (const auto handle : handles)
+    {
+        const auto added = scalar.add(transforms.get_position(handle), transforms.get_orientation(handle), transforms.get_scale(handle));
+
+        if (const auto difference = max_difference(transforms.get_world_matrix(handle), scalar.get_world_matrix(added)); difference > 1e-5f)
+        {
+            std::cerr << "TransformSystem " << transforms.get_instruction_set() << " matrix of " << handle
+                      << " is off from the scalar path by " << difference << '\n';
+            passed = false;
+        }
+    }
+
+    transforms.clean();
+    scalar.clean();
+
+    return passed;
+}
+
+bool TestTransformSystem::changed_are_the_set_transforms()
+{
+    // enough transforms that the rebuild is split across the jobs
+    JobSystem jobs;
+    jobs.create(4);
+
+    TransformSystem transforms;
+    transforms.create(&jobs);
+
+    std::mt19937 random(2);
+    std::uniform_real_distribution<float> coordinate(-1.f, 1.f);
+
+    std::vector<TransformSystem::Handle> handles;
+    for (int i = 0; i < 50000; ++i)
+    {
+        handles.push_back(transforms.add({coordinate(random), coordinate(random), coordinate(random)}, random_orientation(random), glm::vec3(1.f)));
+    }
+    transforms.update();
+
+    bool passed = true;
+
+    // added transforms count as changed
+    if (transforms.get_changed().size() != handles.size())
+    {
+        std::cerr << "TransformSystem reported " << transforms.get_changed().size() << " of " << handles.size()
+                  << " added transforms as changed" << '\n';
+        passed = false;
+    }
+
+    for (int round = 0; round < 20 && passed; ++round)
+    {
+        // most of them now and then, a few otherwise
+        const int moves = round % 3 == 0 ? 40000 : 37;
+
+        std::set<TransformSystem::Handle> moved;
+        for (int i = 0; i < moves; ++i)
+        {
+            const auto handle = handles[random() % handles.size()];
+            transforms.set_position(handle, {coordinate(random), coordinate(random), coordinate(random)});
+            moved.insert(handle);
+        }
+
+        // a removed transform is not reported, a moved one carries its pending rebuild along
+        for (int i = 0; i < 5; ++i)
+        {
+            const size_t index = random() % handles.size();
+            moved.erase(handles[index]);
+            transforms.remove(handles[index]);
+            handles.erase(handles.begin() + static_cast<std::ptrdiff_t>(index));
+        }
+
+        transforms.update();
+
+        const auto& changed = transforms.get_changed();
+        const std::set<TransformSystem::Handle> unique(changed.begin(), changed.end());
+        if (unique.size() != changed.size())
+        {
+            std::cerr << "TransformSystem reported a changed transform twice in round " << round << '\n';
+            passed = false;
+        }
+        if (unique != moved)
+        {
+            std::cerr << "TransformSystem reported " << unique.size() << " changed transforms instead of " << moved.size()
+                      << " in round " << round << '\n';
+            passed = false;
+        }
+
+        for (const auto handle : handles)
+        {
+            const auto position = transforms.get_position(handle);
+            if (glm::vec3(transforms.get_world_matrix(handle)[3]) != position)
+            {
+                std::cerr << "TransformSystem matrix of " << handle << " is stale in round " << round << '\n';
+                passed = false;
+                break;
+            }
+        }
+
+        transforms.update();
+        if (!transforms.get_changed().empty())
+        {
+            std::cerr << "TransformSystem reported changes without any set in round " << round << '\n';
+            passed = false;
+        }
+    }
+
+    transforms.clean();
+    jobs.clean();
+
+    return passed;
+}
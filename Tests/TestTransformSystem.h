@@ -0,0 +1,13 @@
+﻿#pragma once
+
+// Checks the batched world matrices against glm and the change tracking
+// against the transforms that were actually set.
+class TestTransformSystem
+{
+public:
+    // false if any check failed, the failures are printed
+    static bool run();
+private:
+    static bool matrices_match_glm();
+    static bool changed_are_the_set_transforms();
+};
@@ -0,0 +1,134 @@
+﻿#include "TestWorkStealingDeque.h"
+
+#include "../Jobs/WorkStealingDeque.h"
+
+#include <atomic>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+bool TestWorkStealingDeque::run()
+{
+    bool passed = single_thread_order();
+    passed = thieves_take_each_item_once() && passed;
+
+    std::cout << "TestWorkStealingDeque " << (passed ? "passed" : "FAILED") << '\n';
+    return passed;
+}
+
+bool TestWorkStealingDeque::single_thread_order()
+{
+    WorkStealingDeque<int> deque(4);
+    int items[5] = {0, 1, 2, 3, 4};
+
+    bool passed = true;
+    const auto check = [&passed](const bool condition, const char* what)
+    {
+        if (!condition)
+        {
+            std::cerr << "WorkStealingDeque " << what << '\n';
+            passed = false;
+        }
+    };
+
+    for (int i = 0; i < 4; ++i)
+    {
+        check(deque.push(&items[i]), "refused a push below its capacity");
+    }
+    check(!deque.push(&items[4]), "accepted a push past its capacity");
+
+    // thieves take the oldest, the owner the newest
+    check(deque.steal() == &items[0], "steal didn't return the oldest item");
+    check(deque.pop() == &items[3], "pop didn't return the newest item");
+    check(deque.pop() == &items[2], "pop didn't return the newest item");
+    check(deque.steal() == &items[1], "steal didn't return the oldest item");
+    check(deque.pop() == nullptr, "pop returned an item when empty");
+    check(deque.steal() == nullptr, "steal returned an item when empty");
+
+    // wraps around the buffer
+    for (int round = 0; round < 3; ++round)
+    {
+        for (int i = 0; i < 3; ++i)
+        {
+            check(deque.push(&items[i]), "refused a push after wrapping");
+        }
+        check(deque.steal() == &items[0], "steal after wrapping didn't return the oldest item");
+        check(deque.pop() == &items[2], "pop after wrapping didn't return the newest item");
+        check(deque.pop() == &items[1], "pop after wrapping didn't return the newest item");
+    }
+
+    return passed;
+}
+
+bool TestWorkStealingDeque::thieves_take_each_item_once()
+{
+    constexpr int item_count = 200000;
+    constexpr int thief_count = 3;
+
+    WorkStealingDeque<int> deque(1024);
+    std::vector<int> items(item_count);
+    std::vector<std::atomic<int>> taken(item_count);
+    std::atomic<bool> done{false};
+
+    const auto take = [&items, &taken](const int* item)
+    {
+        taken[item - items.data()].fetch_add(1, std::memory_order_relaxed);
+    };
+
+    std::vector<std::thread> thieves;
+    for (int i = 0; i < thief_count; ++i)
+    {
+        thieves.emplace_back([&deque, &done, &take]
+        {
+            while (!done.load(std::memory_order_acquire))
+            {
+                if (const auto item = deque.steal())
+                {
+                    take(item);
+                }
+            }
+        });
+    }
+
+    // the owner pushes everything, popping some back as it goes like a worker would
+    for (int i = 0; i < item_count; ++i)
+    {
+        while (!deque.push(&items[i]))
+        {
+            if (const auto item = deque.pop())
+            {
+                take(item);
+            }
+        }
+
+        if (i % 7 == 0)
+        {
+            if (const auto item = deque.pop())
+            {
+                take(item);
+            }
+        }
+    }
+
+    while (const auto item = deque.pop())
+    {
+        take(item);
+    }
+
+    done.store(true, std::memory_order_release);
+    for (auto& thief : thieves)
+    {
+        thief.join();
+    }
+
+    for (int i = 0; i < item_count; ++i)
+    {
+        if (taken[i].load() != 1)
+        {
+            std::cerr << "WorkStealingDeque item " << i << " was taken " << taken[i].load() << " times" << '\n';
+            return false;
+        }
+    }
+
+    return true;
+}
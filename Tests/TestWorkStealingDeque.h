@@ -0,0 +1,13 @@
+﻿#pragma once
+
+// Checks the deque's order for its owner and thieves, and that concurrent
+// thieves take every item exactly once.
+class TestWorkStealingDeque
+{
+public:
+    // false if any check failed, the failures are printed
+    static bool run();
+private:
+    static bool single_thread_order();
+    static bool thieves_take_each_item_once();
+};
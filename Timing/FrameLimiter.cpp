@@ -0,0 +1,121 @@
+﻿#include "FrameLimiter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+#endif
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+FrameLimiter::FrameLimiter()
+{
+#ifdef _WIN32
+    // Sleep() only wakes on the 15.6 ms scheduler tick, a high resolution timer
+    // (Windows 10 1803 and later) wakes within a fraction of a millisecond
+    timer_ = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+#endif
+}
+
+FrameLimiter::~FrameLimiter()
+{
+#ifdef _WIN32
+    if (timer_ != nullptr)
+    {
+        CloseHandle(timer_);
+    }
+#endif
+}
+
+void FrameLimiter::set_target_frame_rate(const double frames_per_second)
+{
+    frames_per_second_ = std::max(frames_per_second, 0.0);
+    frame_time_ = frames_per_second_ > 0.0
+        ? std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(1.0 / frames_per_second_))
+        : clock::duration::zero();
+
+    // start counting from the next frame
+    deadline_ = clock::time_point{};
+}
+
+void FrameLimiter::wait()
+{
+    if (frame_time_ == clock::duration::zero())
+    {
+        return;
+    }
+
+    const auto now = clock::now();
+
+    // first frame, or a frame so late that catching up would mean a burst of short ones
+    if (deadline_ == clock::time_point{} || now - deadline_ > frame_time_)
+    {
+        deadline_ = now;
+        return;
+    }
+
+    deadline_ += frame_time_;
+    sleep_until(deadline_);
+}
+
+void FrameLimiter::sleep_until(const clock::time_point deadline)
+{
+    // sleep while even a pessimistic sleep would still wake up in time
+    while (true)
+    {
+        const double remaining = std::chrono::duration<double>(deadline - clock::now()).count();
+        const double estimate = sleep_mean_ + std::sqrt(sleep_variance_);
+
+        if (remaining <= estimate)
+        {
+            break;
+        }
+
+        const auto start = clock::now();
+        sleep_one_millisecond();
+        const double observed = std::chrono::duration<double>(clock::now() - start).count();
+
+        // both decay, so old samples stop counting instead of piling up in the variance
+        sleep_count_ = std::min(sleep_count_ + 1.0, sleep_window_);
+        const double weight = 1.0 / sleep_count_;
+        const double delta = observed - sleep_mean_;
+        sleep_mean_ += weight * delta;
+        sleep_variance_ = (1.0 - weight) * (sleep_variance_ + weight * delta * delta);
+    }
+
+    while (clock::now() < deadline)
+    {
+#if defined(_M_X64) || defined(__x86_64__) || defined(__i386__)
+        _mm_pause();
+#else
+        std::this_thread::yield();
+#endif
+    }
+}
+
+void FrameLimiter::sleep_one_millisecond()
+{
+#ifdef _WIN32
+    if (timer_ != nullptr)
+    {
+        // negative due times are relative, in 100 ns units
+        LARGE_INTEGER due_time;
+        due_time.QuadPart = -10000;
+        SetWaitableTimerEx(timer_, &due_time, 0, nullptr, nullptr, nullptr, 0);
+        WaitForSingleObject(timer_, INFINITE);
+        return;
+    }
+#endif
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
@@ -0,0 +1,45 @@
+﻿#pragma once
+
+#include <chrono>
+
+// Holds a target frame time. Most of the wait is slept away, the last stretch
+// is spun so frames land within a fraction of a millisecond of their deadline.
+// How long to spin is learned from how much the sleeps overshoot.
+class FrameLimiter
+{
+public:
+    FrameLimiter();
+    ~FrameLimiter();
+
+    FrameLimiter(const FrameLimiter&) = delete;
+    FrameLimiter& operator=(const FrameLimiter&) = delete;
+
+    // 0 disables the limit
+    void set_target_frame_rate(double frames_per_second);
+    [[nodiscard]] double get_target_frame_rate() const { return frames_per_second_; }
+
+    // Blocks until the current frame's time is up. Call once per frame.
+    void wait();
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    double frames_per_second_ = 0.0;
+    clock::duration frame_time_{};
+    clock::time_point deadline_{};
+
+    // exponentially weighted mean and variance of how long a 1 ms sleep really
+    // takes, in seconds. The weight of a new sample starts at 1 / samples and
+    // bottoms out at 1 / sleep_window_, so both follow changes in system load.
+    static constexpr double sleep_window_ = 100.0;
+    double sleep_mean_ = 0.002;
+    double sleep_variance_ = 0.0;
+    double sleep_count_ = 1.0;
+
+#ifdef _WIN32
+    void* timer_ = nullptr;
+#endif
+
+    void sleep_until(clock::time_point deadline);
+    void sleep_one_millisecond();
+};
@@ -0,0 +1,198 @@
+﻿#include "TextureCompressor.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <format>
+#include <limits>
+#include <stdexcept>
+
+// STB_IMAGE_IMPLEMENTATION is defined for the whole project, the implementation
+// itself is compiled into GraphicsRunner.cpp
+#undef STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+#include "../Image/Ktx2.h"
+#include "../Image/MipChain.h"
+#include "../Logging/Logging.h"
+
+namespace
+{
+
+uint16_t to_565(const std::array<int, 3>& color)
+{
+    const int r = (color[0] * 31 + 127) / 255;
+    const int g = (color[1] * 63 + 127) / 255;
+    const int b = (color[2] * 31 + 127) / 255;
+    return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+}
+
+std::array<int, 3> from_565(const uint16_t color)
+{
+    const int r = (color >> 11) & 31;
+    const int g = (color >> 5) & 63;
+    const int b = color & 31;
+    return {(r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2)};
+}
+
+}
+
+void TextureCompressor::run(const std::vector<std::string>& texture_paths)
+{
+    for (const auto& texture_path : texture_paths)
+    {
+        compress(texture_path);
+    }
+}
+
+void TextureCompressor::compress(const std::string& texture_path)
+{
+    int texture_width, texture_height, texture_channels;
+    stbi_uc* pixels = stbi_load(texture_path.c_str(), &texture_width, &texture_height, &texture_channels, STBI_rgb_alpha);
+
+    if (!pixels)
+    {
+        throw std::runtime_error("Error: unable to load texture image " + texture_path);
+    }
+
+    const auto chain = mip_chain::generate(pixels, static_cast<uint32_t>(texture_width), static_cast<uint32_t>(texture_height));
+    stbi_image_free(pixels);
+
+    ktx2::Texture texture;
+    texture.format = VK_FORMAT_BC1_RGBA_SRGB_BLOCK;
+    texture.width = chain.width;
+    texture.height = chain.height;
+
+    for (const auto& level : chain.levels)
+    {
+        const uint32_t blocks_x = (level.width + 3) / 4;
+        const uint32_t blocks_y = (level.height + 3) / 4;
+        const uint64_t level_size = static_cast<uint64_t>(blocks_x) * blocks_y * 8;
+
+        texture.levels.push_back({texture.data.size(), level_size});
+        texture.data.resize(texture.data.size() + level_size);
+
+        uint8_t* output = texture.data.data() + texture.levels.back().offset;
+        for (uint32_t block_y = 0; block_y < blocks_y; ++block_y)
+        for (uint32_t block_x = 0; block_x < blocks_x; ++block_x)
+        {
+            encode_bc1_block(chain.data.data() + level.offset, level.width, level.height, block_x, block_y, output);
+            output += 8;
+        }
+    }
+
+    const auto output_path = ktx2::variant_path(texture_path, "bc1");
+    ktx2::save(output_path, texture);
+
+    logging::info(std::format("Compressed {} ({} bytes) to {} ({} bytes)", texture_path,
+        static_cast<uint64_t>(texture.width) * texture.height * 4, output_path, texture.data.size()));
+}
+
+void TextureCompressor::encode_bc1_block(const uint8_t* pixels, const uint32_t width, const uint32_t height,
+                                         const uint32_t block_x, const uint32_t block_y, uint8_t* output)
+{
+    std::array<std::array<int, 3>, 16> block{};
+
+    for (uint32_t y = 0; y < 4; ++y)
+    for (uint32_t x = 0; x < 4; ++x)
+    {
+        // partial blocks at the edge repeat the last row/column
+        const uint32_t pixel_x = std::min(block_x * 4 + x, width - 1);
+        const uint32_t pixel_y = std::min(block_y * 4 + y, height - 1);
+        const uint8_t* pixel = pixels + (static_cast<size_t>(pixel_y) * width + pixel_x) * 4;
+        block[y * 4 + x] = {pixel[0], pixel[1], pixel[2]};
+    }
+
+    // bounding box of the block's colors, inset slightly to reduce the error at the extremes
+    std::array min_color = {255, 255, 255};
+    std::array max_color = {0, 0, 0};
+    std::array mean = {0, 0, 0};
+    for (const auto& color : block)
+    for (int c = 0; c < 3; ++c)
+    {
+        min_color[c] = std::min(min_color[c], color[c]);
+        max_color[c] = std::max(max_color[c], color[c]);
+        mean[c] += color[c];
+    }
+
+    for (int c = 0; c < 3; ++c)
+    {
+        mean[c] /= 16;
+        const int inset = (max_color[c] - min_color[c]) / 16;
+        min_color[c] = std::min(min_color[c] + inset, 255);
+        max_color[c] = std::max(max_color[c] - inset, 0);
+    }
+
+    // pick the bounding box diagonal that follows the colors' red/blue vs green correlation
+    int covariance_rg = 0;
+    int covariance_bg = 0;
+    for (const auto& color : block)
+    {
+        covariance_rg += (color[0] - mean[0]) * (color[1] - mean[1]);
+        covariance_bg += (color[2] - mean[2]) * (color[1] - mean[1]);
+    }
+
+    if (covariance_rg < 0)
+    {
+        std::swap(min_color[0], max_color[0]);
+    }
+
+    if (covariance_bg < 0)
+    {
+        std::swap(min_color[2], max_color[2]);
+    }
+
+    uint16_t color0 = to_565(max_color);
+    uint16_t color1 = to_565(min_color);
+
+    // color0 > color1 selects the opaque four color mode
+    if (color0 < color1)
+    {
+        std::swap(color0, color1);
+    }
+
+    uint32_t indices = 0;
+
+    if (color0 != color1)
+    {
+        const auto end0 = from_565(color0);
+        const auto end1 = from_565(color1);
+
+        std::array<std::array<int, 3>, 4> palette{};
+        for (int c = 0; c < 3; ++c)
+        {
+            palette[0][c] = end0[c];
+            palette[1][c] = end1[c];
+            palette[2][c] = (2 * end0[c] + end1[c]) / 3;
+            palette[3][c] = (end0[c] + 2 * end1[c]) / 3;
+        }
+
+        for (uint32_t i = 0; i < 16; ++i)
+        {
+            uint32_t best_index = 0;
+            int best_distance = std::numeric_limits<int>::max();
+
+            for (uint32_t p = 0; p < 4; ++p)
+            {
+                int distance = 0;
+                for (int c = 0; c < 3; ++c)
+                {
+                    const int difference = block[i][c] - palette[p][c];
+                    distance += difference * difference;
+                }
+
+                if (distance < best_distance)
+                {
+                    best_distance = distance;
+                    best_index = p;
+                }
+            }
+
+            indices |= best_index << (i * 2);
+        }
+    }
+
+    memcpy(output, &color0, sizeof(color0));
+    memcpy(output + 2, &color1, sizeof(color1));
+    memcpy(output + 4, &indices, sizeof(indices));
+}
@@ -0,0 +1,20 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Offline tool that turns our png/jpg textures into BC1 KTX2 files with a
+// full mip chain, stored beside the source as <name>.bc1.ktx2. GraphicsRunner
+// picks those up instead of the source image when the device supports BC.
+class TextureCompressor
+{
+public:
+    static void run(const std::vector<std::string>& texture_paths);
+private:
+    static void compress(const std::string& texture_path);
+
+    // Encodes the 4x4 block at (block_x, block_y) of an rgba8 image into 8 bytes of BC1.
+    static void encode_bc1_block(const uint8_t* pixels, uint32_t width, uint32_t height,
+                                 uint32_t block_x, uint32_t block_y, uint8_t* output);
+};
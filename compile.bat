@@ -1,3 +1,9 @@
-﻿C:\VulkanSDK\1.3.296.0\Bin\glslc.exe Shaders\Vertex\shader.vert -o Shaders\Vertex\vert.spv
-C:\VulkanSDK\1.3.296.0\Bin\glslc.exe Shaders\Fragment\shader.frag -o Shaders\Fragment\frag.spv
-pause
\ No newline at end of file
+@echo off
+rem Compiles the shaders in place, run from the directory containing Shaders/.
+C:\VulkanSDK\1.3.296.0\Bin\glslc.exe Shaders\Vertex\shader.vert -o Shaders\Vertex\vert.spv || exit /b 1
+C:\VulkanSDK\1.3.296.0\Bin\glslc.exe Shaders\Fragment\shader.frag -o Shaders\Fragment\frag.spv || exit /b 1
+C:\VulkanSDK\1.3.296.0\Bin\glslc.exe Shaders\Compute\depth_reduce.comp -o Shaders\Compute\depth_reduce.spv || exit /b 1
+C:\VulkanSDK\1.3.296.0\Bin\glslc.exe -DMULTISAMPLED Shaders\Compute\depth_reduce.comp -o Shaders\Compute\depth_reduce_ms.spv || exit /b 1
+C:\VulkanSDK\1.3.296.0\Bin\glslc.exe Shaders\Compute\occlusion_cull.comp -o Shaders\Compute\occlusion_cull.spv || exit /b 1
+C:\VulkanSDK\1.3.296.0\Bin\glslc.exe Shaders\Vertex\fullscreen.vert -o Shaders\Vertex\fullscreen.spv || exit /b 1
+C:\VulkanSDK\1.3.296.0\Bin\glslc.exe Shaders\Fragment\upscale.frag -o Shaders\Fragment\upscale.spv || exit /b 1